@@ -15,6 +15,12 @@ extern void error(char *);
 
 #define ARCH_HAS_DECOMP_WDOG
 
+/*
+ * The decompressor may run with the MMU off, where every access is
+ * strongly ordered and unaligned loads and stores fault even on ARMv6+.
+ */
+#undef CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS
+
 /* Diagnostic functions */
 #ifdef DEBUG
 #  define Assert(cond,msg) {if(!(cond)) error(msg);}
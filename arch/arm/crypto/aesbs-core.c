@@ -0,0 +1,429 @@
+/*
+ * arch/arm/crypto/aesbs-core.c
+ *
+ * Bit-sliced AES for NEON.  Eight blocks are processed at once, spread
+ * over eight 128-bit registers so that register i holds bit i of every
+ * state byte of all eight blocks: byte j of register i carries bit i of
+ * state byte j, one bit per block.
+ *
+ * In that form SubBytes is a fixed boolean circuit evaluated on whole
+ * registers, ShiftRows and the row rotations of MixColumns are byte
+ * permutations, and multiplying by x in GF(2^8) is a renaming of
+ * registers plus three XORs.  There are no table lookups indexed by
+ * secret data, so unlike the table based implementations this one runs
+ * in constant time.
+ *
+ * Built with -mfpu=neon, and only called between kernel_neon_begin() and
+ * kernel_neon_end().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <arm_neon.h>
+
+#include "aesbs.h"
+
+/*
+ * State byte j is row j % 4 of column j / 4.  Each table gives, for
+ * every output byte, the input byte it is taken from.
+ */
+static const unsigned char shift_rows[16] __attribute__((aligned(16))) = {
+	0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12, 1, 6, 11,
+};
+
+static const unsigned char inv_shift_rows[16] __attribute__((aligned(16))) = {
+	0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3,
+};
+
+/* ShiftRows followed by moving every column up by one row */
+static const unsigned char shift_rows_rot1[16] __attribute__((aligned(16))) = {
+	5, 10, 15, 0, 9, 14, 3, 4, 13, 2, 7, 8, 1, 6, 11, 12,
+};
+
+static const unsigned char rot1[16] __attribute__((aligned(16))) = {
+	1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12,
+};
+
+static const unsigned char rot2[16] __attribute__((aligned(16))) = {
+	2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+};
+
+static const unsigned char identity[16] __attribute__((aligned(16))) = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+};
+
+/*
+ * ARMv7 NEON has no 128-bit table lookup, do the 16-entry lookup of each
+ * half of the index vector with a two-register vtbl.
+ */
+static inline uint8x16_t tbl16(uint8x16_t tbl, uint8x16_t idx)
+{
+	union {
+		uint8x16_t	val;
+		uint8x8x2_t	pair;
+	} __tbl = { tbl };
+
+	return vcombine_u8(vtbl2_u8(__tbl.pair, vget_low_u8(idx)),
+			   vtbl2_u8(__tbl.pair, vget_high_u8(idx)));
+}
+
+#define SWAPMOVE(a, b, n, m) do {					\
+	uint8x16_t __t = vandq_u8(veorq_u8(vshrq_n_u8(b, n), a), m);	\
+	a = veorq_u8(a, __t);						\
+	b = veorq_u8(b, vshlq_n_u8(__t, n));				\
+} while (0)
+
+/*
+ * Transpose the 8x8 bit matrix formed by byte j of the eight registers,
+ * for all j at once.  This converts eight blocks to bit-sliced form and,
+ * being its own inverse, back again.
+ */
+static inline void bitslice(uint8x16_t x[8])
+{
+	const uint8x16_t m1 = vdupq_n_u8(0x55);
+	const uint8x16_t m2 = vdupq_n_u8(0x33);
+	const uint8x16_t m4 = vdupq_n_u8(0x0f);
+
+	SWAPMOVE(x[1], x[0], 1, m1);
+	SWAPMOVE(x[3], x[2], 1, m1);
+	SWAPMOVE(x[5], x[4], 1, m1);
+	SWAPMOVE(x[7], x[6], 1, m1);
+
+	SWAPMOVE(x[2], x[0], 2, m2);
+	SWAPMOVE(x[3], x[1], 2, m2);
+	SWAPMOVE(x[6], x[4], 2, m2);
+	SWAPMOVE(x[7], x[5], 2, m2);
+
+	SWAPMOVE(x[4], x[0], 4, m4);
+	SWAPMOVE(x[5], x[1], 4, m4);
+	SWAPMOVE(x[6], x[2], 4, m4);
+	SWAPMOVE(x[7], x[3], 4, m4);
+}
+
+static inline void add_round_key(uint8x16_t x[8], const unsigned char rk[8][16])
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		x[i] = veorq_u8(x[i], vld1q_u8(rk[i]));
+}
+
+#define XOR(a, b)	veorq_u8(a, b)
+#define AND(a, b)	vandq_u8(a, b)
+#define XNOR(a, b)	vmvnq_u8(veorq_u8(a, b))
+
+/*
+ * The AES S-box as the 113 gate circuit of Boyar and Peralta, "A depth-16
+ * circuit for the AES S-box".  U0 and S0 are the most significant bits.
+ */
+static inline void sub_bytes(uint8x16_t x[8])
+{
+	uint8x16_t U0 = x[7], U1 = x[6], U2 = x[5], U3 = x[4];
+	uint8x16_t U4 = x[3], U5 = x[2], U6 = x[1], U7 = x[0];
+	uint8x16_t T1, T2, T3, T4, T5, T6, T7, T8, T9, T10, T11, T12, T13;
+	uint8x16_t T14, T15, T16, T17, T18, T19, T20, T21, T22, T23, T24;
+	uint8x16_t T25, T26, T27;
+	uint8x16_t M1, M2, M3, M4, M5, M6, M7, M8, M9, M10, M11, M12, M13;
+	uint8x16_t M14, M15, M16, M17, M18, M19, M20, M21, M22, M23, M24;
+	uint8x16_t M25, M26, M27, M28, M29, M30, M31, M32, M33, M34, M35;
+	uint8x16_t M36, M37, M38, M39, M40, M41, M42, M43, M44, M45, M46;
+	uint8x16_t M47, M48, M49, M50, M51, M52, M53, M54, M55, M56, M57;
+	uint8x16_t M58, M59, M60, M61, M62, M63;
+	uint8x16_t L0, L1, L2, L3, L4, L5, L6, L7, L8, L9, L10, L11, L12;
+	uint8x16_t L13, L14, L15, L16, L17, L18, L19, L20, L21, L22, L23;
+	uint8x16_t L24, L25, L26, L27, L28, L29;
+
+	/* top linear transformation */
+	T1 = XOR(U0, U3);
+	T2 = XOR(U0, U5);
+	T3 = XOR(U0, U6);
+	T4 = XOR(U3, U5);
+	T5 = XOR(U4, U6);
+	T6 = XOR(T1, T5);
+	T7 = XOR(U1, U2);
+	T8 = XOR(U7, T6);
+	T9 = XOR(U7, T7);
+	T10 = XOR(T6, T7);
+	T11 = XOR(U1, U5);
+	T12 = XOR(U2, U5);
+	T13 = XOR(T3, T4);
+	T14 = XOR(T6, T11);
+	T15 = XOR(T5, T11);
+	T16 = XOR(T5, T12);
+	T17 = XOR(T9, T16);
+	T18 = XOR(U3, U7);
+	T19 = XOR(T7, T18);
+	T20 = XOR(T1, T19);
+	T21 = XOR(U6, U7);
+	T22 = XOR(T7, T21);
+	T23 = XOR(T2, T22);
+	T24 = XOR(T2, T10);
+	T25 = XOR(T20, T17);
+	T26 = XOR(T3, T16);
+	T27 = XOR(T1, T12);
+
+	/* shared non-linear part: inversion in GF(2^8) */
+	M1 = AND(T13, T6);
+	M2 = AND(T23, T8);
+	M3 = XOR(T14, M1);
+	M4 = AND(T19, U7);
+	M5 = XOR(M4, M1);
+	M6 = AND(T3, T16);
+	M7 = AND(T22, T9);
+	M8 = XOR(T26, M6);
+	M9 = AND(T20, T17);
+	M10 = XOR(M9, M6);
+	M11 = AND(T1, T15);
+	M12 = AND(T4, T27);
+	M13 = XOR(M12, M11);
+	M14 = AND(T2, T10);
+	M15 = XOR(M14, M11);
+	M16 = XOR(M3, M2);
+	M17 = XOR(M5, T24);
+	M18 = XOR(M8, M7);
+	M19 = XOR(M10, M15);
+	M20 = XOR(M16, M13);
+	M21 = XOR(M17, M15);
+	M22 = XOR(M18, M13);
+	M23 = XOR(M19, T25);
+	M24 = XOR(M22, M23);
+	M25 = AND(M22, M20);
+	M26 = XOR(M21, M25);
+	M27 = XOR(M20, M21);
+	M28 = XOR(M23, M25);
+	M29 = AND(M28, M27);
+	M30 = AND(M26, M24);
+	M31 = AND(M20, M23);
+	M32 = AND(M27, M31);
+	M33 = XOR(M27, M25);
+	M34 = AND(M21, M22);
+	M35 = AND(M24, M34);
+	M36 = XOR(M24, M25);
+	M37 = XOR(M21, M29);
+	M38 = XOR(M32, M33);
+	M39 = XOR(M23, M30);
+	M40 = XOR(M35, M36);
+	M41 = XOR(M38, M40);
+	M42 = XOR(M37, M39);
+	M43 = XOR(M37, M38);
+	M44 = XOR(M39, M40);
+	M45 = XOR(M42, M41);
+	M46 = AND(M44, T6);
+	M47 = AND(M40, T8);
+	M48 = AND(M39, U7);
+	M49 = AND(M43, T16);
+	M50 = AND(M38, T9);
+	M51 = AND(M37, T17);
+	M52 = AND(M42, T15);
+	M53 = AND(M45, T27);
+	M54 = AND(M41, T10);
+	M55 = AND(M44, T13);
+	M56 = AND(M40, T23);
+	M57 = AND(M39, T19);
+	M58 = AND(M43, T3);
+	M59 = AND(M38, T22);
+	M60 = AND(M37, T20);
+	M61 = AND(M42, T1);
+	M62 = AND(M45, T4);
+	M63 = AND(M41, T2);
+
+	/* bottom linear transformation, including the affine map */
+	L0 = XOR(M61, M62);
+	L1 = XOR(M50, M56);
+	L2 = XOR(M46, M48);
+	L3 = XOR(M47, M55);
+	L4 = XOR(M54, M58);
+	L5 = XOR(M49, M61);
+	L6 = XOR(M62, L5);
+	L7 = XOR(M46, L3);
+	L8 = XOR(M51, M59);
+	L9 = XOR(M52, M53);
+	L10 = XOR(M53, L4);
+	L11 = XOR(M60, L2);
+	L12 = XOR(M48, M51);
+	L13 = XOR(M50, L0);
+	L14 = XOR(M52, M61);
+	L15 = XOR(M55, L1);
+	L16 = XOR(M56, L0);
+	L17 = XOR(M57, L1);
+	L18 = XOR(M58, L8);
+	L19 = XOR(M63, L4);
+	L20 = XOR(L0, L1);
+	L21 = XOR(L1, L7);
+	L22 = XOR(L3, L12);
+	L23 = XOR(L18, L2);
+	L24 = XOR(L15, L9);
+	L25 = XOR(L6, L10);
+	L26 = XOR(L7, L9);
+	L27 = XOR(L8, L10);
+	L28 = XOR(L11, L14);
+	L29 = XOR(L11, L17);
+
+	x[7] = XOR(L6, L24);
+	x[6] = XNOR(L16, L26);
+	x[5] = XNOR(L19, L28);
+	x[4] = XOR(L6, L21);
+	x[3] = XOR(L20, L22);
+	x[2] = XOR(L25, L29);
+	x[1] = XNOR(L13, L27);
+	x[0] = XNOR(L6, L23);
+}
+
+/*
+ * The inverse affine map of the S-box, x' = (x <<< 1) ^ (x <<< 3) ^
+ * (x <<< 6) ^ 0x05.  With it InvSubBytes(x) = A(S(A(x))): the inner
+ * A undoes the affine map, S followed by the outer A is the inversion.
+ */
+static inline void inv_affine(uint8x16_t x[8])
+{
+	uint8x16_t y[8];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		y[i] = XOR(XOR(x[(i + 7) & 7], x[(i + 5) & 7]), x[(i + 2) & 7]);
+	for (i = 0; i < 8; i++)
+		x[i] = y[i];
+	x[0] = vmvnq_u8(x[0]);
+	x[2] = vmvnq_u8(x[2]);
+}
+
+static inline void inv_sub_bytes(uint8x16_t x[8])
+{
+	inv_affine(x);
+	sub_bytes(x);
+	inv_affine(x);
+}
+
+/* multiplication by x in GF(2^8) */
+static inline void xtime(uint8x16_t y[8], const uint8x16_t x[8])
+{
+	y[0] = x[7];
+	y[1] = XOR(x[0], x[7]);
+	y[2] = x[1];
+	y[3] = XOR(x[2], x[7]);
+	y[4] = XOR(x[3], x[7]);
+	y[5] = x[4];
+	y[6] = x[5];
+	y[7] = x[6];
+}
+
+static inline void permute(uint8x16_t x[8], uint8x16_t perm)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		x[i] = tbl16(x[i], perm);
+}
+
+/*
+ * MixColumns of the state permuted by p, with p1 being p followed by a
+ * rotation by one row, so ShiftRows comes for free when encrypting:
+ *
+ *	a'[r] = 2 (a[r] ^ a[r + 1]) ^ (a[0] ^ a[1] ^ a[2] ^ a[3]) ^ a[r]
+ */
+static inline void mix_columns(uint8x16_t x[8], uint8x16_t p,
+			       uint8x16_t p1, uint8x16_t r2)
+{
+	uint8x16_t t[8], t2[8];
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		uint8x16_t a = tbl16(x[i], p);
+
+		t[i] = XOR(a, tbl16(x[i], p1));
+		x[i] = XOR(XOR(a, t[i]), tbl16(t[i], r2));
+	}
+	xtime(t2, t);
+	for (i = 0; i < 8; i++)
+		x[i] = XOR(x[i], t2[i]);
+}
+
+/*
+ * InvMixColumns as a pre-processing step followed by MixColumns:
+ * a[r] ^= 4 (a[r] ^ a[r + 2]), from "The Design of Rijndael", 4.1.3.
+ */
+static inline void inv_mix_columns(uint8x16_t x[8], uint8x16_t r1,
+				   uint8x16_t r2)
+{
+	uint8x16_t w[8], w2[8], w4[8];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		w[i] = XOR(x[i], tbl16(x[i], r2));
+	xtime(w2, w);
+	xtime(w4, w2);
+	for (i = 0; i < 8; i++)
+		x[i] = XOR(x[i], w4[i]);
+	mix_columns(x, vld1q_u8(identity), r1, r2);
+}
+
+static inline void load_blocks(uint8x16_t x[8], const unsigned char *in)
+{
+	int i;
+
+	for (i = 0; i < AESBS_BLOCKS; i++)
+		x[i] = vld1q_u8(in + 16 * i);
+}
+
+static inline void store_blocks(unsigned char *out, uint8x16_t x[8])
+{
+	int i;
+
+	for (i = 0; i < AESBS_BLOCKS; i++)
+		vst1q_u8(out + 16 * i, x[i]);
+}
+
+void aesbs_encrypt8(const struct aesbs_key *key, unsigned char *out,
+		    const unsigned char *in)
+{
+	const uint8x16_t sr = vld1q_u8(shift_rows);
+	const uint8x16_t sr1 = vld1q_u8(shift_rows_rot1);
+	const uint8x16_t r2 = vld1q_u8(rot2);
+	uint8x16_t x[8];
+	int n;
+
+	load_blocks(x, in);
+	bitslice(x);
+
+	add_round_key(x, key->rk[0]);
+	for (n = 1; n < key->rounds; n++) {
+		sub_bytes(x);
+		mix_columns(x, sr, sr1, r2);
+		add_round_key(x, key->rk[n]);
+	}
+	sub_bytes(x);
+	permute(x, sr);
+	add_round_key(x, key->rk[n]);
+
+	bitslice(x);
+	store_blocks(out, x);
+}
+
+void aesbs_decrypt8(const struct aesbs_key *key, unsigned char *out,
+		    const unsigned char *in)
+{
+	const uint8x16_t isr = vld1q_u8(inv_shift_rows);
+	const uint8x16_t r1 = vld1q_u8(rot1);
+	const uint8x16_t r2 = vld1q_u8(rot2);
+	uint8x16_t x[8];
+	int n;
+
+	load_blocks(x, in);
+	bitslice(x);
+
+	add_round_key(x, key->rk[key->rounds]);
+	for (n = key->rounds - 1; n > 0; n--) {
+		permute(x, isr);
+		inv_sub_bytes(x);
+		add_round_key(x, key->rk[n]);
+		inv_mix_columns(x, r1, r2);
+	}
+	permute(x, isr);
+	inv_sub_bytes(x);
+	add_round_key(x, key->rk[0]);
+
+	bitslice(x);
+	store_blocks(out, x);
+}
@@ -0,0 +1,406 @@
+/*
+ * Glue code for the NEON bit-sliced AES implementation
+ *
+ * The bit-sliced core only pays off when it gets eight independent blocks
+ * at a time, so only the modes that can feed it that way are provided:
+ * CBC decryption, CTR and XTS.  CBC encryption is inherently serial and
+ * goes through the scalar ARM asm cipher, as do the leftover blocks at
+ * the end of each walk step and all requests made from interrupt
+ * context, where kernel mode NEON may not be used.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/hardirq.h>
+#include <linux/crypto.h>
+#include <crypto/aes.h>
+#include <crypto/algapi.h>
+#include <crypto/b128ops.h>
+#include <crypto/gf128mul.h>
+#include <asm/aes.h>
+#include <asm/hwcap.h>
+#include <asm/neon.h>
+
+#include "aesbs.h"
+
+#define AESBS_CHUNK		(AESBS_BLOCKS * AES_BLOCK_SIZE)
+
+struct aesbs_ctx {
+	struct crypto_aes_ctx	rk;
+	struct aesbs_key	bs;
+};
+
+struct aesbs_xts_ctx {
+	struct aesbs_ctx	data;
+	struct crypto_aes_ctx	twkey;
+};
+
+static void aesbs_convert_key(struct aesbs_key *bs,
+			      const struct crypto_aes_ctx *rk)
+{
+	int rounds = rk->key_length / 4 + 6;
+	int n, i, j;
+
+	for (n = 0; n <= rounds; n++)
+		for (j = 0; j < AES_BLOCK_SIZE; j++) {
+			u8 b = rk->key_enc[4 * n + j / 4] >> (8 * (j % 4));
+
+			for (i = 0; i < 8; i++)
+				bs->rk[n][i][j] = (b >> i) & 1 ? 0xff : 0;
+		}
+	bs->rounds = rounds;
+}
+
+static int aesbs_setkey(struct crypto_tfm *tfm, const u8 *in_key,
+			unsigned int key_len)
+{
+	struct aesbs_ctx *ctx = crypto_tfm_ctx(tfm);
+	int err;
+
+	err = crypto_aes_expand_key(&ctx->rk, in_key, key_len);
+	if (err) {
+		tfm->crt_flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return err;
+	}
+	aesbs_convert_key(&ctx->bs, &ctx->rk);
+	return 0;
+}
+
+static int aesbs_xts_setkey(struct crypto_tfm *tfm, const u8 *in_key,
+			    unsigned int key_len)
+{
+	struct aesbs_xts_ctx *ctx = crypto_tfm_ctx(tfm);
+	int err;
+
+	if (key_len % 2) {
+		tfm->crt_flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return -EINVAL;
+	}
+	key_len /= 2;
+
+	err = crypto_aes_expand_key(&ctx->twkey, in_key + key_len, key_len);
+	if (err) {
+		tfm->crt_flags |= CRYPTO_TFM_RES_BAD_KEY_LEN;
+		return err;
+	}
+	return aesbs_setkey(tfm, in_key, key_len);
+}
+
+static int cbc_encrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	struct blkcipher_walk walk;
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+
+	while ((nbytes = walk.nbytes)) {
+		u8 *s = walk.src.virt.addr;
+		u8 *d = walk.dst.virt.addr;
+
+		do {
+			crypto_xor(walk.iv, s, AES_BLOCK_SIZE);
+			crypto_aes_encrypt_arm(&ctx->rk, walk.iv, walk.iv);
+			memcpy(d, walk.iv, AES_BLOCK_SIZE);
+			s += AES_BLOCK_SIZE;
+			d += AES_BLOCK_SIZE;
+		} while ((nbytes -= AES_BLOCK_SIZE) >= AES_BLOCK_SIZE);
+
+		err = blkcipher_walk_done(desc, &walk, nbytes);
+	}
+	return err;
+}
+
+static int cbc_decrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	u8 prev[AESBS_CHUNK];
+	struct blkcipher_walk walk;
+	int use_neon = !in_interrupt();
+	int err;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+	desc->flags &= ~CRYPTO_TFM_REQ_MAY_SLEEP;
+
+	while ((nbytes = walk.nbytes)) {
+		u8 *s = walk.src.virt.addr;
+		u8 *d = walk.dst.virt.addr;
+
+		if (use_neon && nbytes >= AESBS_CHUNK) {
+			kernel_neon_begin();
+			do {
+				/* keep the ciphertext, d may be s */
+				memcpy(prev + AES_BLOCK_SIZE, s,
+				       AESBS_CHUNK - AES_BLOCK_SIZE);
+				memcpy(prev, walk.iv, AES_BLOCK_SIZE);
+				memcpy(walk.iv, s + AESBS_CHUNK - AES_BLOCK_SIZE,
+				       AES_BLOCK_SIZE);
+				aesbs_decrypt8(&ctx->bs, d, s);
+				crypto_xor(d, prev, AESBS_CHUNK);
+				s += AESBS_CHUNK;
+				d += AESBS_CHUNK;
+			} while ((nbytes -= AESBS_CHUNK) >= AESBS_CHUNK);
+			kernel_neon_end();
+		}
+
+		while (nbytes >= AES_BLOCK_SIZE) {
+			memcpy(prev, s, AES_BLOCK_SIZE);
+			crypto_aes_decrypt_arm(&ctx->rk, d, s);
+			crypto_xor(d, walk.iv, AES_BLOCK_SIZE);
+			memcpy(walk.iv, prev, AES_BLOCK_SIZE);
+			s += AES_BLOCK_SIZE;
+			d += AES_BLOCK_SIZE;
+			nbytes -= AES_BLOCK_SIZE;
+		}
+
+		err = blkcipher_walk_done(desc, &walk, nbytes);
+	}
+	memset(prev, 0, sizeof(prev));
+	return err;
+}
+
+static int ctr_encrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	struct aesbs_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	u8 ks[AESBS_CHUNK];
+	struct blkcipher_walk walk;
+	int use_neon = !in_interrupt();
+	int err, i;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt_block(desc, &walk, AES_BLOCK_SIZE);
+	desc->flags &= ~CRYPTO_TFM_REQ_MAY_SLEEP;
+
+	while ((nbytes = walk.nbytes) >= AES_BLOCK_SIZE) {
+		u8 *s = walk.src.virt.addr;
+		u8 *d = walk.dst.virt.addr;
+
+		if (use_neon && nbytes >= AESBS_CHUNK) {
+			kernel_neon_begin();
+			do {
+				for (i = 0; i < AESBS_BLOCKS; i++) {
+					memcpy(ks + i * AES_BLOCK_SIZE, walk.iv,
+					       AES_BLOCK_SIZE);
+					crypto_inc(walk.iv, AES_BLOCK_SIZE);
+				}
+				aesbs_encrypt8(&ctx->bs, ks, ks);
+				crypto_xor(ks, s, AESBS_CHUNK);
+				memcpy(d, ks, AESBS_CHUNK);
+				s += AESBS_CHUNK;
+				d += AESBS_CHUNK;
+			} while ((nbytes -= AESBS_CHUNK) >= AESBS_CHUNK);
+			kernel_neon_end();
+		}
+
+		while (nbytes >= AES_BLOCK_SIZE) {
+			crypto_aes_encrypt_arm(&ctx->rk, ks, walk.iv);
+			crypto_inc(walk.iv, AES_BLOCK_SIZE);
+			crypto_xor(ks, s, AES_BLOCK_SIZE);
+			memcpy(d, ks, AES_BLOCK_SIZE);
+			s += AES_BLOCK_SIZE;
+			d += AES_BLOCK_SIZE;
+			nbytes -= AES_BLOCK_SIZE;
+		}
+
+		err = blkcipher_walk_done(desc, &walk, nbytes);
+	}
+	if (walk.nbytes) {
+		nbytes = walk.nbytes;
+		crypto_aes_encrypt_arm(&ctx->rk, ks, walk.iv);
+		crypto_xor(ks, walk.src.virt.addr, nbytes);
+		memcpy(walk.dst.virt.addr, ks, nbytes);
+		crypto_inc(walk.iv, AES_BLOCK_SIZE);
+		err = blkcipher_walk_done(desc, &walk, 0);
+	}
+	memset(ks, 0, sizeof(ks));
+	return err;
+}
+
+/*
+ * XTS: the tweak is encrypted once with the second key, then multiplied
+ * by x for every block.  The eight tweaks of a chunk are kept in tw[]
+ * so they can be applied again after the block cipher.
+ */
+static int xts_crypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		     struct scatterlist *src, unsigned int nbytes, int enc)
+{
+	struct aesbs_xts_ctx *ctx = crypto_blkcipher_ctx(desc->tfm);
+	be128 tw[AESBS_BLOCKS];
+	struct blkcipher_walk walk;
+	int use_neon = !in_interrupt();
+	int err, i;
+
+	blkcipher_walk_init(&walk, dst, src, nbytes);
+	err = blkcipher_walk_virt(desc, &walk);
+	desc->flags &= ~CRYPTO_TFM_REQ_MAY_SLEEP;
+
+	crypto_aes_encrypt_arm(&ctx->twkey, walk.iv, walk.iv);
+
+	while ((nbytes = walk.nbytes)) {
+		u8 *s = walk.src.virt.addr;
+		u8 *d = walk.dst.virt.addr;
+
+		if (use_neon && nbytes >= AESBS_CHUNK) {
+			kernel_neon_begin();
+			do {
+				for (i = 0; i < AESBS_BLOCKS; i++) {
+					memcpy(&tw[i], walk.iv, AES_BLOCK_SIZE);
+					gf128mul_x_ble((be128 *)walk.iv, &tw[i]);
+				}
+				if (d != s)
+					memcpy(d, s, AESBS_CHUNK);
+				crypto_xor(d, (u8 *)tw, AESBS_CHUNK);
+				if (enc)
+					aesbs_encrypt8(&ctx->data.bs, d, d);
+				else
+					aesbs_decrypt8(&ctx->data.bs, d, d);
+				crypto_xor(d, (u8 *)tw, AESBS_CHUNK);
+				s += AESBS_CHUNK;
+				d += AESBS_CHUNK;
+			} while ((nbytes -= AESBS_CHUNK) >= AESBS_CHUNK);
+			kernel_neon_end();
+		}
+
+		while (nbytes >= AES_BLOCK_SIZE) {
+			memcpy(&tw[0], walk.iv, AES_BLOCK_SIZE);
+			gf128mul_x_ble((be128 *)walk.iv, &tw[0]);
+			if (d != s)
+				memcpy(d, s, AES_BLOCK_SIZE);
+			crypto_xor(d, (u8 *)tw, AES_BLOCK_SIZE);
+			if (enc)
+				crypto_aes_encrypt_arm(&ctx->data.rk, d, d);
+			else
+				crypto_aes_decrypt_arm(&ctx->data.rk, d, d);
+			crypto_xor(d, (u8 *)tw, AES_BLOCK_SIZE);
+			s += AES_BLOCK_SIZE;
+			d += AES_BLOCK_SIZE;
+			nbytes -= AES_BLOCK_SIZE;
+		}
+
+		err = blkcipher_walk_done(desc, &walk, nbytes);
+	}
+	memset(tw, 0, sizeof(tw));
+	return err;
+}
+
+static int xts_encrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	return xts_crypt(desc, dst, src, nbytes, 1);
+}
+
+static int xts_decrypt(struct blkcipher_desc *desc, struct scatterlist *dst,
+		       struct scatterlist *src, unsigned int nbytes)
+{
+	return xts_crypt(desc, dst, src, nbytes, 0);
+}
+
+static struct crypto_alg aesbs_algs[] = { {
+	.cra_name		= "cbc(aes)",
+	.cra_driver_name	= "cbc-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_alignmask		= 7,
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_list		= LIST_HEAD_INIT(aesbs_algs[0].cra_list),
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= AES_MIN_KEY_SIZE,
+			.max_keysize	= AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aesbs_setkey,
+			.encrypt	= cbc_encrypt,
+			.decrypt	= cbc_decrypt,
+		},
+	},
+}, {
+	.cra_name		= "ctr(aes)",
+	.cra_driver_name	= "ctr-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= 1,
+	.cra_ctxsize		= sizeof(struct aesbs_ctx),
+	.cra_alignmask		= 7,
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_list		= LIST_HEAD_INIT(aesbs_algs[1].cra_list),
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= AES_MIN_KEY_SIZE,
+			.max_keysize	= AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aesbs_setkey,
+			.encrypt	= ctr_encrypt,
+			.decrypt	= ctr_encrypt,
+		},
+	},
+}, {
+	.cra_name		= "xts(aes)",
+	.cra_driver_name	= "xts-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_BLKCIPHER,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct aesbs_xts_ctx),
+	.cra_alignmask		= 7,
+	.cra_type		= &crypto_blkcipher_type,
+	.cra_module		= THIS_MODULE,
+	.cra_list		= LIST_HEAD_INIT(aesbs_algs[2].cra_list),
+	.cra_u = {
+		.blkcipher = {
+			.min_keysize	= 2 * AES_MIN_KEY_SIZE,
+			.max_keysize	= 2 * AES_MAX_KEY_SIZE,
+			.ivsize		= AES_BLOCK_SIZE,
+			.setkey		= aesbs_xts_setkey,
+			.encrypt	= xts_encrypt,
+			.decrypt	= xts_decrypt,
+		},
+	},
+} };
+
+static int __init aesbs_mod_init(void)
+{
+	int err, i;
+
+	if (!(elf_hwcap & HWCAP_NEON))
+		return -ENODEV;
+
+	for (i = 0; i < ARRAY_SIZE(aesbs_algs); i++) {
+		err = crypto_register_alg(&aesbs_algs[i]);
+		if (err)
+			goto unregister;
+	}
+	return 0;
+
+unregister:
+	while (--i >= 0)
+		crypto_unregister_alg(&aesbs_algs[i]);
+	return err;
+}
+
+static void __exit aesbs_mod_exit(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(aesbs_algs); i++)
+		crypto_unregister_alg(&aesbs_algs[i]);
+}
+
+module_init(aesbs_mod_init);
+module_exit(aesbs_mod_exit);
+
+MODULE_DESCRIPTION("Bit sliced AES in CBC/CTR/XTS modes using NEON");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS("cbc(aes)");
+MODULE_ALIAS("ctr(aes)");
+MODULE_ALIAS("xts(aes)");
@@ -0,0 +1,27 @@
+/*
+ * Interface between the NEON bit-sliced AES core and its glue code.
+ *
+ * Kept free of kernel headers, aesbs-core.c is built with the compiler's
+ * own arm_neon.h.
+ */
+#ifndef _ARM_CRYPTO_AESBS_H
+#define _ARM_CRYPTO_AESBS_H
+
+#define AESBS_BLOCKS		8
+
+/*
+ * Round keys in bit-sliced form: byte j of rk[n][i] is 0xff if bit i of
+ * byte j of round key n is set, 0 otherwise.
+ */
+struct aesbs_key {
+	unsigned char	rk[15][8][16] __attribute__((aligned(16)));
+	int		rounds;
+};
+
+/* AESBS_BLOCKS independent blocks, in and out may overlap exactly */
+void aesbs_encrypt8(const struct aesbs_key *key, unsigned char *out,
+		    const unsigned char *in);
+void aesbs_decrypt8(const struct aesbs_key *key, unsigned char *out,
+		    const unsigned char *in);
+
+#endif /* _ARM_CRYPTO_AESBS_H */
@@ -0,0 +1,30 @@
+/*
+ * linux/arch/arm/include/asm/neon.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_NEON_H
+#define __ASM_NEON_H
+
+#include <asm/hwcap.h>
+
+#define cpu_has_neon()		(!!(elf_hwcap & HWCAP_NEON))
+
+/*
+ * NEON code in the kernel must be bracketed by kernel_neon_begin() and
+ * kernel_neon_end().  In between, preemption is disabled and the NEON
+ * registers may be used freely; the userland VFP/NEON state is saved
+ * first and restored lazily afterwards.  Not allowed in interrupt
+ * context.
+ *
+ * kernel_neon_begin() must not be called from a compilation unit built
+ * with -mfpu=neon: the compiler is free to emit NEON instructions
+ * anywhere in such a unit, including before the call.  Keep the NEON
+ * code in a separate file and call it from a plain C wrapper.
+ */
+void kernel_neon_begin(void);
+void kernel_neon_end(void);
+
+#endif /* __ASM_NEON_H */
@@ -1,7 +1,16 @@
 #ifndef _ASM_ARM_UNALIGNED_H
 #define _ASM_ARM_UNALIGNED_H
 
+/*
+ * ARMv6 and later handle unaligned ldr/str in hardware once the
+ * alignment trap has been turned off (see alignment_init()), so let the
+ * compiler use plain word accesses for little endian kernels there.
+ */
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) && !defined(__ARMEB__)
+#include <linux/unaligned/le_struct.h>
+#else
 #include <linux/unaligned/le_byteshift.h>
+#endif
 #include <linux/unaligned/be_byteshift.h>
 #include <linux/unaligned/generic.h>
 
@@ -216,7 +216,7 @@ void do_bad_area(unsigned long addr, unsigned int fsr, struct pt_regs *regs)
  * If we encountered a write fault, we must have write permission, otherwise
  * we allow any permission.
  */
-static inline bool access_error(unsigned int fsr, struct vm_area_struct *vma)
+static inline unsigned int access_mask(unsigned int fsr)
 {
 	unsigned int mask = VM_READ | VM_WRITE | VM_EXEC;
 
@@ -225,7 +225,12 @@ static inline bool access_error(unsigned int fsr, struct vm_area_struct *vma)
 	if (fsr & FSR_LNX_PF)
 		mask = VM_EXEC;
 
-	return vma->vm_flags & mask ? false : true;
+	return mask;
+}
+
+static inline bool access_error(unsigned int fsr, struct vm_area_struct *vma)
+{
+	return vma->vm_flags & access_mask(fsr) ? false : true;
 }
 
 static int __kprobes
@@ -272,6 +277,39 @@ out:
 	return fault;
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Try to handle the fault without mmap_sem, so that the threads of a
+ * process do not wait for each other's mmap and munmap.  Anything out of
+ * the ordinary, including a bad access, returns VM_FAULT_RETRY and is
+ * handled by __do_page_fault().
+ */
+static int __kprobes
+__do_speculative_page_fault(struct mm_struct *mm, unsigned long addr,
+			    unsigned int fsr, struct task_struct *tsk)
+{
+	int fault;
+
+	fault = handle_speculative_fault(mm, addr & PAGE_MASK,
+					 (fsr & FSR_WRITE) ? FAULT_FLAG_WRITE : 0,
+					 access_mask(fsr));
+	if (fault & VM_FAULT_RETRY)
+		return fault;
+	if (fault & VM_FAULT_MAJOR)
+		tsk->maj_flt++;
+	else
+		tsk->min_flt++;
+	return fault;
+}
+#else
+static inline int
+__do_speculative_page_fault(struct mm_struct *mm, unsigned long addr,
+			    unsigned int fsr, struct task_struct *tsk)
+{
+	return VM_FAULT_RETRY;
+}
+#endif
+
 static int __kprobes
 do_page_fault(unsigned long addr, unsigned int fsr, struct pt_regs *regs)
 {
@@ -292,31 +330,38 @@ do_page_fault(unsigned long addr, unsigned int fsr, struct pt_regs *regs)
 	if (in_atomic() || !mm)
 		goto no_context;
 
-	/*
-	 * As per x86, we may deadlock here.  However, since the kernel only
-	 * validly references user space from well defined areas of the code,
-	 * we can bug out early if this is from code which shouldn't.
-	 */
-	if (!down_read_trylock(&mm->mmap_sem)) {
-		if (!user_mode(regs) && !search_exception_tables(regs->ARM_pc))
-			goto no_context;
-		down_read(&mm->mmap_sem);
-	} else {
+	fault = VM_FAULT_RETRY;
+	if (user_mode(regs))
+		fault = __do_speculative_page_fault(mm, addr, fsr, tsk);
+	if (fault & VM_FAULT_RETRY) {
 		/*
-		 * The above down_read_trylock() might have succeeded in
-		 * which case, we'll have missed the might_sleep() from
-		 * down_read()
+		 * As per x86, we may deadlock here.  However, since the kernel
+		 * only validly references user space from well defined areas
+		 * of the code, we can bug out early if this is from code which
+		 * shouldn't.
 		 */
-		might_sleep();
+		if (!down_read_trylock(&mm->mmap_sem)) {
+			if (!user_mode(regs) &&
+			    !search_exception_tables(regs->ARM_pc))
+				goto no_context;
+			down_read(&mm->mmap_sem);
+		} else {
+			/*
+			 * The above down_read_trylock() might have succeeded
+			 * in which case, we'll have missed the might_sleep()
+			 * from down_read()
+			 */
+			might_sleep();
 #ifdef CONFIG_DEBUG_VM
-		if (!user_mode(regs) &&
-		    !search_exception_tables(regs->ARM_pc))
-			goto no_context;
+			if (!user_mode(regs) &&
+			    !search_exception_tables(regs->ARM_pc))
+				goto no_context;
 #endif
-	}
+		}
 
-	fault = __do_page_fault(mm, addr, fsr, tsk);
-	up_read(&mm->mmap_sem);
+		fault = __do_page_fault(mm, addr, fsr, tsk);
+		up_read(&mm->mmap_sem);
+	}
 
 	perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS, 1, 0, regs, addr);
 	if (fault & VM_FAULT_MAJOR)
@@ -0,0 +1,504 @@
+/*
+ *  Flash i/o scheduler, a deadline variant for devices without seek cost.
+ *
+ *  Based on the deadline i/o scheduler,
+ *  Copyright (C) 2002 Jens Axboe <axboe@kernel.dk>
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+#include <linux/ktime.h>
+
+/*
+ * See Documentation/block/flash-iosched.txt
+ */
+static const int write_expire = HZ;     /* max time before a write is submitted. */
+static const int writes_starved = 16;   /* max reads dispatched while a write waits */
+static const int write_batch = 16;      /* max writes dispatched back to back */
+static const int erase_block_kb = 512;  /* write batches stay within this unit */
+
+struct flash_lat_stats {
+	unsigned long nr;		/* completed requests */
+	u64 total_us;			/* sum of queue-to-completion latencies */
+	unsigned long max_us;		/* worst queue-to-completion latency */
+};
+
+struct flash_data {
+	struct request_queue *queue;
+
+	/*
+	 * requests are present on both sort_list and fifo_list.  Reads are
+	 * served in fifo order, the sort_list is used for merging and, for
+	 * writes, to build batches in sector order.
+	 */
+	struct rb_root sort_list[2];
+	struct list_head fifo_list[2];
+
+	struct request *next_write;	/* next write of the current batch */
+	unsigned int batching;		/* number of writes in the current batch */
+	sector_t last_sector;		/* end of the last write dispatched */
+	unsigned int starved;		/* reads dispatched while writes wait */
+
+	struct flash_lat_stats stats[2];
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int write_expire;
+	int writes_starved;
+	int write_batch;
+	int erase_block_kb;
+	int front_merges;
+};
+
+static void flash_move_request(struct flash_data *, struct request *);
+
+/*
+ * The time a request entered the scheduler is kept in microseconds in the
+ * first elevator private pointer.  It wraps on 32-bit, but the difference
+ * is still right for any latency below an hour.
+ */
+static inline unsigned long flash_now_us(void)
+{
+	return (unsigned long)ktime_to_us(ktime_get());
+}
+
+#define rq_flash_time(rq)		((unsigned long) (rq)->elevator_private[0])
+#define rq_set_flash_time(rq, t)	((rq)->elevator_private[0] = (void *) (t))
+
+static inline struct rb_root *
+flash_rb_root(struct flash_data *fd, struct request *rq)
+{
+	return &fd->sort_list[rq_data_dir(rq)];
+}
+
+/*
+ * get the request after `rq' in sector-sorted order
+ */
+static inline struct request *
+flash_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+static void
+flash_add_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	struct rb_root *root = flash_rb_root(fd, rq);
+	struct request *__alias;
+
+	while (unlikely(__alias = elv_rb_add(root, rq)))
+		flash_move_request(fd, __alias);
+}
+
+static inline void
+flash_del_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	if (fd->next_write == rq)
+		fd->next_write = flash_latter_request(rq);
+
+	elv_rb_del(flash_rb_root(fd, rq), rq);
+}
+
+/*
+ * add rq to rbtree and fifo
+ */
+static void
+flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int data_dir = rq_data_dir(rq);
+
+	flash_add_rq_rb(fd, rq);
+
+	/*
+	 * only writes expire, reads are always served first
+	 */
+	rq_set_fifo_time(rq, jiffies + fd->write_expire);
+	rq_set_flash_time(rq, flash_now_us());
+	list_add_tail(&rq->queuelist, &fd->fifo_list[data_dir]);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void flash_remove_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	rq_fifo_clear(rq);
+	flash_del_rq_rb(fd, rq);
+}
+
+static int
+flash_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *__rq;
+
+	/*
+	 * check for front merge
+	 */
+	if (fd->front_merges) {
+		sector_t sector = bio->bi_sector + bio_sectors(bio);
+
+		__rq = elv_rb_find(&fd->sort_list[bio_data_dir(bio)], sector);
+		if (__rq) {
+			BUG_ON(sector != blk_rq_pos(__rq));
+
+			if (elv_rq_merge_ok(__rq, bio)) {
+				*req = __rq;
+				return ELEVATOR_FRONT_MERGE;
+			}
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void flash_merged_request(struct request_queue *q,
+				 struct request *req, int type)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(flash_rb_root(fd, req), req);
+		flash_add_rq_rb(fd, req);
+	}
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *req,
+		      struct request *next)
+{
+	/*
+	 * if next expires before rq, assign its expire time to rq
+	 * and move into next position (next will be deleted) in fifo
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+			rq_set_flash_time(req, rq_flash_time(next));
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	flash_remove_request(q, next);
+}
+
+/*
+ * move an entry to dispatch queue
+ */
+static void
+flash_move_request(struct flash_data *fd, struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	if (rq_data_dir(rq) == WRITE) {
+		fd->next_write = flash_latter_request(rq);
+		fd->last_sector = rq_end_sector(rq);
+	}
+
+	/*
+	 * take it off the sort and fifo list, move
+	 * to dispatch queue
+	 */
+	flash_remove_request(q, rq);
+	elv_dispatch_add_tail(q, rq);
+}
+
+/*
+ * flash_check_fifo returns 1 if the oldest write has expired, 0 otherwise.
+ * Requires !list_empty(&fd->fifo_list[WRITE])
+ */
+static inline int flash_check_fifo(struct flash_data *fd)
+{
+	struct request *rq = rq_entry_fifo(fd->fifo_list[WRITE].next);
+
+	return time_after(jiffies, rq_fifo_time(rq));
+}
+
+/*
+ * Can @rq continue the current write batch?  It has to start where the
+ * last write ended or inside the same erase block, so that a batch of
+ * small writes lands on the device as one sequential stream.
+ */
+static int flash_batch_continues(struct flash_data *fd, struct request *rq)
+{
+	unsigned int eb_sectors = fd->erase_block_kb << 1;
+	sector_t pos = blk_rq_pos(rq);
+	sector_t last = fd->last_sector;
+
+	if (fd->batching >= fd->write_batch)
+		return 0;
+	if (pos == last)
+		return 1;
+	if (!eb_sectors || pos < last)
+		return 0;
+
+	last--;
+	sector_div(pos, eb_sectors);
+	sector_div(last, eb_sectors);
+	return pos == last;
+}
+
+/*
+ * flash_dispatch_requests selects the next request: reads in fifo order
+ * ahead of writes, unless writes have waited for writes_starved reads or
+ * write_expire, then a batch of up to write_batch writes in sector order.
+ */
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int reads = !list_empty(&fd->fifo_list[READ]);
+	const int writes = !list_empty(&fd->fifo_list[WRITE]);
+	struct request *rq;
+
+	/*
+	 * finish the current write batch first, it is short and bounded
+	 */
+	rq = fd->next_write;
+	if (rq && fd->batching && flash_batch_continues(fd, rq))
+		goto dispatch_write;
+
+	fd->batching = 0;
+
+	if (reads) {
+		if (writes && (fd->starved >= fd->writes_starved ||
+			       flash_check_fifo(fd)))
+			goto dispatch_writes;
+
+		if (writes)
+			fd->starved++;
+
+		rq = rq_entry_fifo(fd->fifo_list[READ].next);
+		flash_move_request(fd, rq);
+		return 1;
+	}
+
+	if (writes) {
+dispatch_writes:
+		fd->starved = 0;
+
+		/*
+		 * start the batch from the oldest write
+		 */
+		rq = rq_entry_fifo(fd->fifo_list[WRITE].next);
+		goto dispatch_write;
+	}
+
+	return 0;
+
+dispatch_write:
+	fd->batching++;
+	flash_move_request(fd, rq);
+
+	return 1;
+}
+
+static void flash_completed_request(struct request_queue *q,
+				    struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct flash_lat_stats *st = &fd->stats[rq_data_dir(rq)];
+	unsigned long lat = flash_now_us() - rq_flash_time(rq);
+
+	st->nr++;
+	st->total_us += lat;
+	if (lat > st->max_us)
+		st->max_us = lat;
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	BUG_ON(!list_empty(&fd->fifo_list[READ]));
+	BUG_ON(!list_empty(&fd->fifo_list[WRITE]));
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static void *flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return NULL;
+
+	fd->queue = q;
+	INIT_LIST_HEAD(&fd->fifo_list[READ]);
+	INIT_LIST_HEAD(&fd->fifo_list[WRITE]);
+	fd->sort_list[READ] = RB_ROOT;
+	fd->sort_list[WRITE] = RB_ROOT;
+	fd->write_expire = write_expire;
+	fd->writes_starved = writes_starved;
+	fd->write_batch = write_batch;
+	fd->erase_block_kb = erase_block_kb;
+	fd->front_merges = 1;
+	return fd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_write_expire_show, fd->write_expire, 1);
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved, 0);
+SHOW_FUNCTION(flash_write_batch_show, fd->write_batch, 0);
+SHOW_FUNCTION(flash_erase_block_kb_show, fd->erase_block_kb, 0);
+SHOW_FUNCTION(flash_front_merges_show, fd->front_merges, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_write_expire_store, &fd->write_expire, 0, INT_MAX, 1);
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(flash_write_batch_store, &fd->write_batch, 1, INT_MAX, 0);
+STORE_FUNCTION(flash_erase_block_kb_store, &fd->erase_block_kb, 0, INT_MAX / 2, 0);
+STORE_FUNCTION(flash_front_merges_store, &fd->front_merges, 0, 1, 0);
+#undef STORE_FUNCTION
+
+static ssize_t flash_latency_stats_show(struct elevator_queue *e, char *page)
+{
+	struct flash_data *fd = e->elevator_data;
+	struct flash_lat_stats st[2];
+	int len = 0, dir;
+
+	spin_lock_irq(fd->queue->queue_lock);
+	memcpy(st, fd->stats, sizeof(st));
+	spin_unlock_irq(fd->queue->queue_lock);
+
+	for (dir = READ; dir <= WRITE; dir++) {
+		u64 avg = st[dir].total_us;
+
+		if (st[dir].nr)
+			do_div(avg, st[dir].nr);
+		len += sprintf(page + len, "%s %lu %llu %lu\n",
+			       dir == READ ? "read" : "write", st[dir].nr,
+			       (unsigned long long)avg, st[dir].max_us);
+	}
+	return len;
+}
+
+static ssize_t flash_latency_stats_store(struct elevator_queue *e,
+					 const char *page, size_t count)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	spin_lock_irq(fd->queue->queue_lock);
+	memset(fd->stats, 0, sizeof(fd->stats));
+	spin_unlock_irq(fd->queue->queue_lock);
+	return count;
+}
+
+#define FD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FD_ATTR(write_expire),
+	FD_ATTR(writes_starved),
+	FD_ATTR(write_batch),
+	FD_ATTR(erase_block_kb),
+	FD_ATTR(front_merges),
+	FD_ATTR(latency_stats),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_fn = 		flash_merge,
+		.elevator_merged_fn =		flash_merged_request,
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_completed_req_fn =	flash_completed_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	elv_register(&iosched_flash);
+
+	return 0;
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("flash IO scheduler");
@@ -33,6 +33,8 @@
 #include <linux/jiffies.h>
 #include <linux/timex.h>
 #include <linux/interrupt.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
 #include "tcrypt.h"
 #include "internal.h"
 
@@ -64,7 +66,7 @@ static char *check[] = {
 	"cast6", "arc4", "michael_mic", "deflate", "crc32c", "tea", "xtea",
 	"khazad", "wp512", "wp384", "wp256", "tnepres", "xeta",  "fcrypt",
 	"camellia", "seed", "salsa20", "rmd128", "rmd160", "rmd256", "rmd320",
-	"lzo", "cts", "zlib", NULL
+	"lzo", "cts", "zlib", "lz4", "lz4hc", NULL
 };
 
 static int test_cipher_jiffies(struct blkcipher_desc *desc, int enc,
@@ -719,6 +721,167 @@ out:
 	crypto_free_ahash(tfm);
 }
 
+static int test_comp_jiffies(struct crypto_comp *tfm, int dec, const u8 *in,
+			     unsigned int ilen, u8 *out, unsigned int olen,
+			     unsigned int blen, int sec)
+{
+	unsigned long start, end;
+	unsigned int dlen;
+	int bcount;
+	int ret;
+
+	for (start = jiffies, end = start + sec * HZ, bcount = 0;
+	     time_before(jiffies, end); bcount++) {
+		dlen = olen;
+		if (dec)
+			ret = crypto_comp_decompress(tfm, in, ilen, out, &dlen);
+		else
+			ret = crypto_comp_compress(tfm, in, ilen, out, &dlen);
+		if (ret)
+			return ret;
+	}
+
+	printk("%d operations in %d seconds (%ld bytes)\n",
+	       bcount, sec, (long)bcount * blen);
+	return 0;
+}
+
+static int test_comp_cycles(struct crypto_comp *tfm, int dec, const u8 *in,
+			    unsigned int ilen, u8 *out, unsigned int olen,
+			    unsigned int blen)
+{
+	unsigned long cycles = 0;
+	unsigned int dlen;
+	int ret = 0;
+	int i;
+
+	local_bh_disable();
+	local_irq_disable();
+
+	/* Warm-up run. */
+	for (i = 0; i < 4; i++) {
+		dlen = olen;
+		if (dec)
+			ret = crypto_comp_decompress(tfm, in, ilen, out, &dlen);
+		else
+			ret = crypto_comp_compress(tfm, in, ilen, out, &dlen);
+		if (ret)
+			goto out;
+	}
+
+	/* The real thing. */
+	for (i = 0; i < 8; i++) {
+		cycles_t start, end;
+
+		dlen = olen;
+		start = get_cycles();
+		if (dec)
+			ret = crypto_comp_decompress(tfm, in, ilen, out, &dlen);
+		else
+			ret = crypto_comp_compress(tfm, in, ilen, out, &dlen);
+		end = get_cycles();
+
+		if (ret)
+			goto out;
+
+		cycles += end - start;
+	}
+
+out:
+	local_irq_enable();
+	local_bh_enable();
+
+	if (ret == 0)
+		printk("1 operation in %lu cycles (%d bytes)\n",
+		       (cycles + 4) / 8, blen);
+
+	return ret;
+}
+
+static void test_comp_speed(const char *algo, unsigned int sec,
+			    unsigned int *b_size)
+{
+	struct crypto_comp *tfm;
+	struct rnd_state rnd;
+	unsigned int max_len = 0, clen, i, j;
+	u8 *src, *comp, *dst;
+	int ret = 0;
+
+	printk(KERN_INFO "\ntesting speed of %s\n", algo);
+
+	tfm = crypto_alloc_comp(algo, 0, 0);
+	if (IS_ERR(tfm)) {
+		printk(KERN_ERR "failed to load transform for %s: %ld\n", algo,
+		       PTR_ERR(tfm));
+		return;
+	}
+
+	for (i = 0; b_size[i]; i++)
+		max_len = max(max_len, b_size[i]);
+	src = vmalloc(max_len);
+	comp = vmalloc(2 * max_len);
+	dst = vmalloc(max_len);
+	if (!src || !comp || !dst) {
+		printk(KERN_ERR "could not allocate %u byte buffers\n",
+		       max_len);
+		goto out;
+	}
+
+	/* the same pseudo text every time, so runs can be compared */
+	prandom32_seed(&rnd, 42);
+	for (i = 0; i < max_len; ) {
+		const char *w = comp_speed_words[prandom32(&rnd) %
+						 ARRAY_SIZE(comp_speed_words)];
+
+		for (j = 0; w[j] && i < max_len; j++)
+			src[i++] = w[j];
+	}
+
+	for (i = 0; b_size[i]; i++) {
+		clen = 2 * max_len;
+		ret = crypto_comp_compress(tfm, src, b_size[i], comp, &clen);
+		if (ret) {
+			printk(KERN_ERR "compression failed ret=%d\n", ret);
+			break;
+		}
+
+		printk(KERN_INFO "test %u (%5u byte blocks -> %5u bytes) "
+		       "compress: ", i, b_size[i], clen);
+		if (sec)
+			ret = test_comp_jiffies(tfm, 0, src, b_size[i], comp,
+						2 * max_len, b_size[i], sec);
+		else
+			ret = test_comp_cycles(tfm, 0, src, b_size[i], comp,
+					       2 * max_len, b_size[i]);
+		if (ret)
+			break;
+
+		printk(KERN_INFO "test %u (%5u byte blocks -> %5u bytes) "
+		       "decompress: ", i, b_size[i], clen);
+		if (sec)
+			ret = test_comp_jiffies(tfm, 1, comp, clen, dst,
+						max_len, b_size[i], sec);
+		else
+			ret = test_comp_cycles(tfm, 1, comp, clen, dst,
+					       max_len, b_size[i]);
+		if (ret)
+			break;
+
+		if (memcmp(src, dst, b_size[i])) {
+			printk(KERN_ERR "decompressed data differs\n");
+			break;
+		}
+	}
+
+	if (ret)
+		printk(KERN_ERR "%s failed ret=%d\n", algo, ret);
+out:
+	vfree(dst);
+	vfree(comp);
+	vfree(src);
+	crypto_free_comp(tfm);
+}
+
 static void test_available(void)
 {
 	char **name = check;
@@ -944,6 +1107,14 @@ static int do_test(int m)
 		ret += tcrypt_test("rfc4309(ccm(aes))");
 		break;
 
+	case 46:
+		ret += tcrypt_test("lz4");
+		break;
+
+	case 47:
+		ret += tcrypt_test("lz4hc");
+		break;
+
 	case 100:
 		ret += tcrypt_test("hmac(md5)");
 		break;
@@ -1154,6 +1325,10 @@ static int do_test(int m)
 		test_hash_speed("ghash-generic", sec, hash_speed_template_16);
 		if (mode > 300 && mode < 400) break;
 
+	case 319:
+		test_hash_speed("crc32c", sec, generic_hash_speed_template);
+		if (mode > 300 && mode < 400) break;
+
 	case 399:
 		break;
 
@@ -1231,6 +1406,28 @@ static int do_test(int m)
 	case 499:
 		break;
 
+	case 500:
+		/* fall through */
+
+	case 501:
+		test_comp_speed("deflate", sec, comp_speed_template);
+		if (mode > 500 && mode < 600) break;
+
+	case 502:
+		test_comp_speed("lzo", sec, comp_speed_template);
+		if (mode > 500 && mode < 600) break;
+
+	case 503:
+		test_comp_speed("lz4", sec, comp_speed_template);
+		if (mode > 500 && mode < 600) break;
+
+	case 504:
+		test_comp_speed("lz4hc", sec, comp_speed_template);
+		if (mode > 500 && mode < 600) break;
+
+	case 599:
+		break;
+
 	case 1000:
 		test_available();
 		break;
@@ -112,4 +112,22 @@ static struct hash_speed hash_speed_template_16[] = {
 	{  .blen = 0,	.plen = 0,	.klen = 0, }
 };
 
+/*
+ * Compression speed tests
+ */
+static unsigned int comp_speed_template[] = {
+	512, 1024, 4096, 16384, 65536, 0
+};
+
+/*
+ * The input is made of these words in pseudo random order, so that it
+ * compresses roughly like English text does.
+ */
+static const char * const comp_speed_words[] = {
+	"the ", "of ", "and ", "to ", "in ", "is ", "that ", "for ",
+	"it ", "with ", "as ", "was ", "on ", "be ", "by ", "this ",
+	"data ", "block ", "page ", "file ", "system ", "kernel ", "memory ",
+	"compression ", "algorithm ", "buffer ", "device ", "\n", ", ", ". ",
+};
+
 #endif	/* _CRYPTO_TCRYPT_H */
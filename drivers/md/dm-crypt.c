@@ -19,6 +19,8 @@
 #include <linux/workqueue.h>
 #include <linux/backing-dev.h>
 #include <linux/percpu.h>
+#include <linux/cpumask.h>
+#include <linux/moduleparam.h>
 #include <asm/atomic.h>
 #include <linux/scatterlist.h>
 #include <asm/page.h>
@@ -43,6 +45,7 @@ struct convert_context {
 	unsigned int offset_out;
 	unsigned int idx_in;
 	unsigned int idx_out;
+	unsigned int nr_sectors;
 	sector_t sector;
 	atomic_t pending;
 };
@@ -61,6 +64,18 @@ struct dm_crypt_io {
 	int error;
 	sector_t sector;
 	struct dm_crypt_io *base_io;
+
+	/*
+	 * Fragments of a parallel write are passed to the device in
+	 * the order given by seq, base_io keeps the ones that finished
+	 * early on order_list.
+	 */
+	int ordered;
+	unsigned int seq;
+	struct list_head list;
+	spinlock_t order_lock;
+	unsigned int next_seq;
+	struct list_head order_list;
 };
 
 struct dm_crypt_request {
@@ -134,6 +149,7 @@ struct crypt_config {
 
 	struct workqueue_struct *io_queue;
 	struct workqueue_struct *crypt_queue;
+	struct workqueue_struct *frag_queue;
 
 	char *cipher;
 	char *cipher_string;
@@ -181,6 +197,15 @@ struct crypt_config {
 
 static struct kmem_cache *_crypt_io_pool;
 
+/*
+ * Bios of at least two batches are split into batches of this many
+ * sectors which are converted on all online CPUs in parallel.
+ */
+static unsigned int parallel_sectors = 64;
+module_param(parallel_sectors, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(parallel_sectors,
+		 "Sectors per batch when spreading a bio over CPUs (0 = off)");
+
 static void clone_init(struct dm_crypt_io *, struct bio *);
 static void kcryptd_queue_crypt(struct dm_crypt_io *io);
 static u8 *iv_of_dmreq(struct crypt_config *cc, struct dm_crypt_request *dmreq);
@@ -666,10 +691,38 @@ static void crypt_convert_init(struct crypt_config *cc,
 	ctx->offset_out = 0;
 	ctx->idx_in = bio_in ? bio_in->bi_idx : 0;
 	ctx->idx_out = bio_out ? bio_out->bi_idx : 0;
+	ctx->nr_sectors = bio_in ? bio_sectors(bio_in) : 0;
 	ctx->sector = sector + cc->iv_offset;
 	init_completion(&ctx->restart);
 }
 
+/*
+ * Move the input position of a context forward without converting
+ * anything, used to hand out the following sectors to another CPU.
+ */
+static void crypt_convert_skip(struct convert_context *ctx,
+			       unsigned int sectors)
+{
+	unsigned int bytes = sectors << SECTOR_SHIFT;
+	struct bio_vec *bv;
+	unsigned int len;
+
+	while (bytes) {
+		bv = bio_iovec_idx(ctx->bio_in, ctx->idx_in);
+		len = min(bytes, bv->bv_len - ctx->offset_in);
+
+		ctx->offset_in += len;
+		if (ctx->offset_in >= bv->bv_len) {
+			ctx->offset_in = 0;
+			ctx->idx_in++;
+		}
+		bytes -= len;
+	}
+
+	ctx->sector += sectors;
+	ctx->nr_sectors -= sectors;
+}
+
 static struct dm_crypt_request *dmreq_of_req(struct crypt_config *cc,
 					     struct ablkcipher_request *req)
 {
@@ -724,6 +777,8 @@ static int crypt_convert_block(struct crypt_config *cc,
 		ctx->idx_out++;
 	}
 
+	ctx->nr_sectors--;
+
 	if (cc->iv_gen_ops) {
 		r = cc->iv_gen_ops->generator(cc, iv, dmreq);
 		if (r < 0)
@@ -773,7 +828,8 @@ static int crypt_convert(struct crypt_config *cc,
 
 	atomic_set(&ctx->pending, 1);
 
-	while(ctx->idx_in < ctx->bio_in->bi_vcnt &&
+	while(ctx->nr_sectors &&
+	      ctx->idx_in < ctx->bio_in->bi_vcnt &&
 	      ctx->idx_out < ctx->bio_out->bi_vcnt) {
 
 		crypt_alloc_req(cc, ctx);
@@ -899,6 +955,7 @@ static struct dm_crypt_io *crypt_io_alloc(struct dm_target *ti,
 	io->sector = sector;
 	io->error = 0;
 	io->base_io = NULL;
+	io->ordered = 0;
 	atomic_set(&io->pending, 0);
 
 	return io;
@@ -1047,12 +1104,21 @@ static void kcryptd_queue_io(struct dm_crypt_io *io)
 	queue_work(cc->io_queue, &io->work);
 }
 
+static void kcryptd_crypt_write_ordered(struct dm_crypt_io *io, int async);
+
 static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io,
 					  int error, int async)
 {
 	struct bio *clone = io->ctx.bio_out;
 	struct crypt_config *cc = io->target->private;
 
+	if (io->ordered) {
+		if (unlikely(error < 0))
+			io->error = -EIO;
+		kcryptd_crypt_write_ordered(io, async);
+		return;
+	}
+
 	if (unlikely(error < 0)) {
 		crypt_free_buffer_pages(cc, clone);
 		bio_put(clone);
@@ -1072,6 +1138,164 @@ static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io,
 		generic_make_request(clone);
 }
 
+static void kcryptd_crypt_read_done(struct dm_crypt_io *io, int error)
+{
+	if (unlikely(error < 0))
+		io->error = -EIO;
+
+	crypt_dec_pending(io);
+}
+
+/*
+ * Fragments of a parallel write finish on different CPUs in any order.
+ * Like the serial callbacks of padata, restore the original order before
+ * passing them on, so that the device still sees one ascending stream.
+ * Failed fragments go through here as well, later ones would wait for
+ * them forever otherwise.
+ */
+static void kcryptd_crypt_write_ordered(struct dm_crypt_io *io, int async)
+{
+	struct dm_crypt_io *base_io = io->base_io;
+	struct dm_crypt_io *next;
+	struct list_head *pos;
+	unsigned long flags;
+	LIST_HEAD(ready);
+
+	spin_lock_irqsave(&base_io->order_lock, flags);
+
+	list_for_each_prev(pos, &base_io->order_list)
+		if (list_entry(pos, struct dm_crypt_io, list)->seq < io->seq)
+			break;
+	list_add(&io->list, pos);
+
+	while (!list_empty(&base_io->order_list)) {
+		next = list_first_entry(&base_io->order_list,
+					struct dm_crypt_io, list);
+		if (next->seq != base_io->next_seq)
+			break;
+		list_move_tail(&next->list, &ready);
+		base_io->next_seq++;
+	}
+
+	spin_unlock_irqrestore(&base_io->order_lock, flags);
+
+	/* base_io may go away with the last fragment, don't touch it */
+	while (!list_empty(&ready)) {
+		next = list_first_entry(&ready, struct dm_crypt_io, list);
+		list_del(&next->list);
+		next->ordered = 0;
+		kcryptd_crypt_write_io_submit(next, next->error, async);
+	}
+}
+
+static void kcryptd_crypt_fragment(struct work_struct *work)
+{
+	struct dm_crypt_io *io = container_of(work, struct dm_crypt_io, work);
+	struct crypt_config *cc = io->target->private;
+	int r;
+
+	crypt_inc_pending(io);
+
+	r = crypt_convert(cc, &io->ctx);
+
+	if (!atomic_dec_and_test(&io->ctx.pending))
+		return;
+
+	if (bio_data_dir(io->base_bio) == READ)
+		kcryptd_crypt_read_done(io, r);
+	else
+		kcryptd_crypt_write_io_submit(io, r, 0);
+}
+
+/*
+ * Returns the batch size if io is worth spreading over several CPUs.
+ */
+static unsigned int crypt_parallel_batch(struct dm_crypt_io *io)
+{
+	unsigned int batch = ACCESS_ONCE(parallel_sectors);
+
+	if (!batch || num_online_cpus() < 2 ||
+	    bio_sectors(io->base_bio) < 2 * batch)
+		return 0;
+
+	return batch;
+}
+
+/*
+ * Split io into fragments of up to batch sectors and queue them to
+ * kcryptd_frag round robin over the online CPUs, starting with the next
+ * one.  Reads are decrypted in place in the base bio, writes get a clone
+ * each.  The caller holds a reference to io.
+ *
+ * This may sleep in the mempools while fragments queued earlier wait for
+ * their turn on order_list.  They are not queued to crypt_queue, where
+ * they could wait behind this work or another one sleeping here, so
+ * they get converted, written and give their pages back in any case.
+ */
+static void kcryptd_crypt_parallel(struct dm_crypt_io *io, unsigned int batch)
+{
+	struct crypt_config *cc = io->target->private;
+	int write = bio_data_dir(io->base_bio) == WRITE;
+	unsigned int remaining = bio_sectors(io->base_bio);
+	sector_t sector = io->sector;
+	int cpu = raw_smp_processor_id();
+	unsigned out_of_pages = 0;
+	struct dm_crypt_io *frag;
+	struct bio *clone;
+	unsigned int seq = 0, n;
+
+	crypt_convert_init(cc, &io->ctx, NULL, io->base_bio, sector);
+	spin_lock_init(&io->order_lock);
+	INIT_LIST_HEAD(&io->order_list);
+	io->next_seq = 0;
+
+	while (remaining) {
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+
+		frag = crypt_io_alloc(io->target, io->base_bio, sector);
+		frag->base_io = io;
+
+		if (write) {
+			clone = crypt_alloc_buffer(frag,
+				min(remaining, batch) << SECTOR_SHIFT,
+				&out_of_pages);
+			if (unlikely(!clone)) {
+				mempool_free(frag, cc->io_pool);
+				io->error = -ENOMEM;
+				break;
+			}
+			crypt_convert_init(cc, &frag->ctx, clone,
+					   io->base_bio, sector);
+			frag->ordered = 1;
+			frag->seq = seq++;
+			n = bio_sectors(clone);
+		} else {
+			crypt_convert_init(cc, &frag->ctx, io->base_bio,
+					   io->base_bio, sector);
+			frag->ctx.idx_out = io->ctx.idx_in;
+			frag->ctx.offset_out = io->ctx.offset_in;
+			n = min(remaining, batch);
+		}
+		frag->ctx.idx_in = io->ctx.idx_in;
+		frag->ctx.offset_in = io->ctx.offset_in;
+		frag->ctx.nr_sectors = n;
+
+		crypt_convert_skip(&io->ctx, n);
+		remaining -= n;
+		sector += n;
+
+		crypt_inc_pending(io);
+		INIT_WORK(&frag->work, kcryptd_crypt_fragment);
+		queue_work_on(cpu, cc->frag_queue, &frag->work);
+
+		/* Out of memory -> run queues */
+		if (unlikely(out_of_pages))
+			congestion_wait(BLK_RW_ASYNC, HZ/100);
+	}
+}
+
 static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->target->private;
@@ -1081,12 +1305,21 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 	unsigned out_of_pages = 0;
 	unsigned remaining = io->base_bio->bi_size;
 	sector_t sector = io->sector;
+	unsigned int batch;
 	int r;
 
 	/*
 	 * Prevent io from disappearing until this function completes.
 	 */
 	crypt_inc_pending(io);
+
+	batch = crypt_parallel_batch(io);
+	if (batch) {
+		kcryptd_crypt_parallel(io, batch);
+		crypt_dec_pending(io);
+		return;
+	}
+
 	crypt_convert_init(cc, &io->ctx, NULL, io->base_bio, sector);
 
 	/*
@@ -1143,6 +1376,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 					   io->base_bio, sector);
 			new_io->ctx.idx_in = io->ctx.idx_in;
 			new_io->ctx.offset_in = io->ctx.offset_in;
+			new_io->ctx.nr_sectors = io->ctx.nr_sectors;
 
 			/*
 			 * Fragments after the first use the base_io
@@ -1163,21 +1397,22 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 	crypt_dec_pending(io);
 }
 
-static void kcryptd_crypt_read_done(struct dm_crypt_io *io, int error)
-{
-	if (unlikely(error < 0))
-		io->error = -EIO;
-
-	crypt_dec_pending(io);
-}
-
 static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->target->private;
+	unsigned int batch;
 	int r = 0;
 
 	crypt_inc_pending(io);
 
+	batch = crypt_parallel_batch(io);
+	if (batch) {
+		kcryptd_crypt_parallel(io, batch);
+		kcryptd_crypt_read_done(io, 0);
+		crypt_dec_pending(io);
+		return;
+	}
+
 	crypt_convert_init(cc, &io->ctx, io->base_bio, io->base_bio,
 			   io->sector);
 
@@ -1372,6 +1607,8 @@ static void crypt_dtr(struct dm_target *ti)
 		destroy_workqueue(cc->io_queue);
 	if (cc->crypt_queue)
 		destroy_workqueue(cc->crypt_queue);
+	if (cc->frag_queue)
+		destroy_workqueue(cc->frag_queue);
 
 	if (cc->cpu)
 		for_each_possible_cpu(cpu) {
@@ -1668,6 +1905,16 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		goto bad;
 	}
 
+	cc->frag_queue = alloc_workqueue("kcryptd_frag",
+					 WQ_NON_REENTRANT|
+					 WQ_CPU_INTENSIVE|
+					 WQ_MEM_RECLAIM,
+					 1);
+	if (!cc->frag_queue) {
+		ti->error = "Couldn't create kcryptd fragment queue";
+		goto bad;
+	}
+
 	ti->num_flush_requests = 1;
 	return 0;
 
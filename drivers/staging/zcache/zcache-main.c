@@ -1,5 +1,5 @@
 /*
- * zcache.c
+ * zcache-main.c
  *
  * Copyright (c) 2010,2011, Dan Magenheimer, Oracle Corp.
  * Copyright (c) 2010,2011, Nitin Gupta
@@ -7,13 +7,12 @@
  * Zcache provides an in-kernel "host implementation" for transcendent memory
  * and, thus indirectly, for cleancache and frontswap.  Zcache includes two
  * page-accessible memory [1] interfaces, both utilizing lzo1x compression:
- * 1) "compression buddies" ("zbud") is used for ephemeral pages
+ * 1) "zeph" slab size classes are used for ephemeral pages
  * 2) xvmalloc is used for persistent pages.
  * Xvmalloc (based on the TLSF allocator) has very low fragmentation
- * so maximizes space efficiency, while zbud allows pairs (and potentially,
- * in the future, more than a pair of) compressed pages to be closely linked
- * so that reclaiming can be done via the kernel's physical-page-oriented
- * "shrinker" interface.
+ * so maximizes space efficiency, while the zeph objects are kept on an
+ * LRU list so that the least recently used ones can be reclaimed via the
+ * kernel's "shrinker" interface.
  *
  * [1] For a definition of page-accessible memory (aka PAM), see:
  *   http://marc.info/?l=linux-mm&m=127811271605009
@@ -29,7 +28,9 @@
 #include <linux/atomic.h>
 #include "tmem.h"
 
+#ifdef CONFIG_FRONTSWAP
 #include "../zram/xvmalloc.h" /* if built in drivers/staging */
+#endif
 
 #if (!defined(CONFIG_CLEANCACHE) && !defined(CONFIG_FRONTSWAP))
 #error "zcache is useless without CONFIG_CLEANCACHE or CONFIG_FRONTSWAP"
@@ -50,540 +51,226 @@
 #endif
 
 /**********
- * Compression buddies ("zbud") provides for packing two (or, possibly
- * in the future, more) compressed ephemeral pages into a single "raw"
- * (physical) page and tracking them with data structures so that
- * the raw pages can be easily reclaimed.
+ * Ephemeral pages are compressed into objects allocated from a set of slab
+ * caches, one for every ZEPH_CLASS_DELTA bytes of object size.  A
+ * compressed page so takes little more memory than its compressed size,
+ * and the slab allocator packs the objects of each size class densely
+ * into page frames, including frames of higher order for the big ones.
  *
- * A zbud page ("zbpg") is an aligned page containing a list_head,
- * a lock, and two "zbud headers".  The remainder of the physical
- * page is divided up into aligned 64-byte "chunks" which contain
- * the compressed data for zero, one, or two zbuds.  Each zbpg
- * resides on: (1) an "unused list" if it has no zbuds; (2) a
- * "buddied" list if it is fully populated  with two zbuds; or
- * (3) one of PAGE_SIZE/64 "unbuddied" lists indexed by how many chunks
- * the one unbuddied zbud uses.  The data inside a zbpg cannot be
- * read or written unless the zbpg's lock is held.
+ * Every ephemeral object is on a global LRU list, oldest first.  A
+ * successful get removes an ephemeral page from tmem, so this is also
+ * the order in which they were last used.  When the system is short of
+ * memory, the shrinker flushes objects from the head of the list, and the
+ * page frames they leave empty go back to the page allocator.  The total
+ * size of the objects is also kept below eph_max_pool_percent of RAM, by
+ * evicting the oldest objects before a new one is put.
  */
 
-#define ZBH_SENTINEL  0x43214321
-#define ZBPG_SENTINEL  0xdeadbeef
-
-#define ZBUD_MAX_BUDS 2
+#define ZEPH_SENTINEL  0x43214321
 
-struct zbud_hdr {
-	uint32_t pool_id;
+struct zeph_hdr {
+	struct list_head lru;
 	struct tmem_oid oid;
+	uint32_t pool_id;
 	uint32_t index;
-	uint16_t size; /* compressed size in bytes, zero means unused */
+	uint16_t size; /* compressed size in bytes */
+	uint16_t class;
 	DECL_SENTINEL
+	/* followed by the compressed data */
 };
 
-struct zbud_page {
-	struct list_head bud_list;
-	spinlock_t lock;
-	struct zbud_hdr buddy[ZBUD_MAX_BUDS];
-	DECL_SENTINEL
-	/* followed by NUM_CHUNK aligned CHUNK_SIZE-byte chunks */
-};
-
-#define CHUNK_SHIFT	6
-#define CHUNK_SIZE	(1 << CHUNK_SHIFT)
-#define CHUNK_MASK	(~(CHUNK_SIZE-1))
-#define NCHUNKS		(((PAGE_SIZE - sizeof(struct zbud_page)) & \
-				CHUNK_MASK) >> CHUNK_SHIFT)
-#define MAX_CHUNK	(NCHUNKS-1)
-
-static struct {
-	struct list_head list;
-	unsigned count;
-} zbud_unbuddied[NCHUNKS];
-/* list N contains pages with N chunks USED and NCHUNKS-N unused */
-/* element 0 is never used but optimizing that isn't worth it */
-static unsigned long zbud_cumul_chunk_counts[NCHUNKS];
-
-struct list_head zbud_buddied_list;
-static unsigned long zcache_zbud_buddied_count;
-
-/* protects the buddied list and all unbuddied lists */
-static DEFINE_SPINLOCK(zbud_budlists_spinlock);
-
-static LIST_HEAD(zbpg_unused_list);
-static unsigned long zcache_zbpg_unused_list_count;
-
-/* protects the unused page list */
-static DEFINE_SPINLOCK(zbpg_unused_list_spinlock);
-
-static atomic_t zcache_zbud_curr_raw_pages;
-static atomic_t zcache_zbud_curr_zpages;
-static unsigned long zcache_zbud_curr_zbytes;
-static unsigned long zcache_zbud_cumul_zpages;
-static unsigned long zcache_zbud_cumul_zbytes;
+#define ZEPH_CLASS_SHIFT	7
+#define ZEPH_CLASS_DELTA	(1 << ZEPH_CLASS_SHIFT)
+#define ZEPH_MAX_SIZE		((PAGE_SIZE / 8) * 7)
+#define ZEPH_NR_CLASSES \
+	DIV_ROUND_UP(sizeof(struct zeph_hdr) + ZEPH_MAX_SIZE, ZEPH_CLASS_DELTA)
+
+static struct kmem_cache *zeph_cache[ZEPH_NR_CLASSES];
+static char zeph_cache_name[ZEPH_NR_CLASSES][20];
+static unsigned long zeph_class_count[ZEPH_NR_CLASSES];
+
+/* protects the LRU list, the class counts and the byte counts */
+static LIST_HEAD(zeph_lru);
+static DEFINE_SPINLOCK(zeph_lru_lock);
+
+static atomic_t zcache_eph_zpages;
+static unsigned long zcache_eph_zbytes;
+static unsigned long zcache_eph_pool_bytes;
+static unsigned long zcache_eph_cumul_zpages;
+static unsigned long zcache_eph_cumul_zbytes;
+static atomic_t zcache_evicted_eph_zpages;
+static atomic_t zcache_eph_pool_limit_hit;
 static unsigned long zcache_compress_poor;
+static unsigned long zcache_failed_alloc;
 
-/* forward references */
-static void *zcache_get_free_page(void);
-static void zcache_free_page(void *p);
-
-/*
- * zbud helper functions
- */
-
-static inline unsigned zbud_max_buddy_size(void)
-{
-	return MAX_CHUNK << CHUNK_SHIFT;
-}
-
-static inline unsigned zbud_size_to_chunks(unsigned size)
-{
-	BUG_ON(size == 0 || size > zbud_max_buddy_size());
-	return (size + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
-}
-
-static inline int zbud_budnum(struct zbud_hdr *zh)
-{
-	unsigned offset = (unsigned long)zh & (PAGE_SIZE - 1);
-	struct zbud_page *zbpg = NULL;
-	unsigned budnum = -1U;
-	int i;
-
-	for (i = 0; i < ZBUD_MAX_BUDS; i++)
-		if (offset == offsetof(typeof(*zbpg), buddy[i])) {
-			budnum = i;
-			break;
-		}
-	BUG_ON(budnum == -1U);
-	return budnum;
-}
+static unsigned int zcache_eph_max_pool_percent = 20;
 
-static char *zbud_data(struct zbud_hdr *zh, unsigned size)
-{
-	struct zbud_page *zbpg;
-	char *p;
-	unsigned budnum;
-
-	ASSERT_SENTINEL(zh, ZBH);
-	budnum = zbud_budnum(zh);
-	BUG_ON(size == 0 || size > zbud_max_buddy_size());
-	zbpg = container_of(zh, struct zbud_page, buddy[budnum]);
-	ASSERT_SPINLOCK(&zbpg->lock);
-	p = (char *)zbpg;
-	if (budnum == 0)
-		p += ((sizeof(struct zbud_page) + CHUNK_SIZE - 1) &
-							CHUNK_MASK);
-	else if (budnum == 1)
-		p += PAGE_SIZE - ((size + CHUNK_SIZE - 1) & CHUNK_MASK);
-	return p;
-}
+/* objects evicted per put while the pool is over its limit */
+#define ZEPH_EVICT_BATCH	4
 
-/*
- * zbud raw page management
- */
+/* forward references */
+static struct tmem_pool *zcache_get_pool_by_id(uint32_t poolid);
+static void zcache_put_pool(struct tmem_pool *pool);
 
-static struct zbud_page *zbud_alloc_raw_page(void)
+static inline unsigned zeph_size_to_class(unsigned size)
 {
-	struct zbud_page *zbpg = NULL;
-	struct zbud_hdr *zh0, *zh1;
-	bool recycled = 0;
-
-	/* if any pages on the zbpg list, use one */
-	spin_lock(&zbpg_unused_list_spinlock);
-	if (!list_empty(&zbpg_unused_list)) {
-		zbpg = list_first_entry(&zbpg_unused_list,
-				struct zbud_page, bud_list);
-		list_del_init(&zbpg->bud_list);
-		zcache_zbpg_unused_list_count--;
-		recycled = 1;
-	}
-	spin_unlock(&zbpg_unused_list_spinlock);
-	if (zbpg == NULL)
-		/* none on zbpg list, try to get a kernel page */
-		zbpg = zcache_get_free_page();
-	if (likely(zbpg != NULL)) {
-		INIT_LIST_HEAD(&zbpg->bud_list);
-		zh0 = &zbpg->buddy[0]; zh1 = &zbpg->buddy[1];
-		spin_lock_init(&zbpg->lock);
-		if (recycled) {
-			ASSERT_INVERTED_SENTINEL(zbpg, ZBPG);
-			SET_SENTINEL(zbpg, ZBPG);
-			BUG_ON(zh0->size != 0 || tmem_oid_valid(&zh0->oid));
-			BUG_ON(zh1->size != 0 || tmem_oid_valid(&zh1->oid));
-		} else {
-			atomic_inc(&zcache_zbud_curr_raw_pages);
-			INIT_LIST_HEAD(&zbpg->bud_list);
-			SET_SENTINEL(zbpg, ZBPG);
-			zh0->size = 0; zh1->size = 0;
-			tmem_oid_set_invalid(&zh0->oid);
-			tmem_oid_set_invalid(&zh1->oid);
-		}
-	}
-	return zbpg;
+	BUG_ON(size == 0 || size > ZEPH_MAX_SIZE);
+	return (sizeof(struct zeph_hdr) + size - 1) >> ZEPH_CLASS_SHIFT;
 }
 
-static void zbud_free_raw_page(struct zbud_page *zbpg)
+static inline unsigned zeph_class_size(unsigned class)
 {
-	struct zbud_hdr *zh0 = &zbpg->buddy[0], *zh1 = &zbpg->buddy[1];
-
-	ASSERT_SENTINEL(zbpg, ZBPG);
-	BUG_ON(!list_empty(&zbpg->bud_list));
-	ASSERT_SPINLOCK(&zbpg->lock);
-	BUG_ON(zh0->size != 0 || tmem_oid_valid(&zh0->oid));
-	BUG_ON(zh1->size != 0 || tmem_oid_valid(&zh1->oid));
-	INVERT_SENTINEL(zbpg, ZBPG);
-	spin_unlock(&zbpg->lock);
-	spin_lock(&zbpg_unused_list_spinlock);
-	list_add(&zbpg->bud_list, &zbpg_unused_list);
-	zcache_zbpg_unused_list_count++;
-	spin_unlock(&zbpg_unused_list_spinlock);
+	return (class + 1) << ZEPH_CLASS_SHIFT;
 }
 
-/*
- * core zbud handling routines
- */
-
-static unsigned zbud_free(struct zbud_hdr *zh)
+static struct zeph_hdr *zeph_create(uint32_t pool_id, struct tmem_oid *oid,
+					uint32_t index, void *cdata,
+					unsigned size)
 {
-	unsigned size;
-
-	ASSERT_SENTINEL(zh, ZBH);
-	BUG_ON(!tmem_oid_valid(&zh->oid));
-	size = zh->size;
-	BUG_ON(zh->size == 0 || zh->size > zbud_max_buddy_size());
-	zh->size = 0;
-	tmem_oid_set_invalid(&zh->oid);
-	INVERT_SENTINEL(zh, ZBH);
-	zcache_zbud_curr_zbytes -= size;
-	atomic_dec(&zcache_zbud_curr_zpages);
-	return size;
-}
-
-static void zbud_free_and_delist(struct zbud_hdr *zh)
-{
-	unsigned chunks;
-	struct zbud_hdr *zh_other;
-	unsigned budnum = zbud_budnum(zh), size;
-	struct zbud_page *zbpg =
-		container_of(zh, struct zbud_page, buddy[budnum]);
-
-	spin_lock(&zbpg->lock);
-	if (list_empty(&zbpg->bud_list)) {
-		/* ignore zombie page... see zbud_evict_pages() */
-		spin_unlock(&zbpg->lock);
-		return;
-	}
-	size = zbud_free(zh);
-	ASSERT_SPINLOCK(&zbpg->lock);
-	zh_other = &zbpg->buddy[(budnum == 0) ? 1 : 0];
-	if (zh_other->size == 0) { /* was unbuddied: unlist and free */
-		chunks = zbud_size_to_chunks(size) ;
-		spin_lock(&zbud_budlists_spinlock);
-		BUG_ON(list_empty(&zbud_unbuddied[chunks].list));
-		list_del_init(&zbpg->bud_list);
-		zbud_unbuddied[chunks].count--;
-		spin_unlock(&zbud_budlists_spinlock);
-		zbud_free_raw_page(zbpg);
-	} else { /* was buddied: move remaining buddy to unbuddied list */
-		chunks = zbud_size_to_chunks(zh_other->size) ;
-		spin_lock(&zbud_budlists_spinlock);
-		list_del_init(&zbpg->bud_list);
-		zcache_zbud_buddied_count--;
-		list_add_tail(&zbpg->bud_list, &zbud_unbuddied[chunks].list);
-		zbud_unbuddied[chunks].count++;
-		spin_unlock(&zbud_budlists_spinlock);
-		spin_unlock(&zbpg->lock);
-	}
-}
+	unsigned class = zeph_size_to_class(size);
+	struct zeph_hdr *zh;
+	unsigned long flags;
 
-static struct zbud_hdr *zbud_create(uint32_t pool_id, struct tmem_oid *oid,
-					uint32_t index, struct page *page,
-					void *cdata, unsigned size)
-{
-	struct zbud_hdr *zh0, *zh1, *zh = NULL;
-	struct zbud_page *zbpg = NULL, *ztmp;
-	unsigned nchunks;
-	char *to;
-	int i, found_good_buddy = 0;
-
-	nchunks = zbud_size_to_chunks(size) ;
-	for (i = MAX_CHUNK - nchunks + 1; i > 0; i--) {
-		spin_lock(&zbud_budlists_spinlock);
-		if (!list_empty(&zbud_unbuddied[i].list)) {
-			list_for_each_entry_safe(zbpg, ztmp,
-				    &zbud_unbuddied[i].list, bud_list) {
-				if (spin_trylock(&zbpg->lock)) {
-					found_good_buddy = i;
-					goto found_unbuddied;
-				}
-			}
-		}
-		spin_unlock(&zbud_budlists_spinlock);
-	}
-	/* didn't find a good buddy, try allocating a new page */
-	zbpg = zbud_alloc_raw_page();
-	if (unlikely(zbpg == NULL))
+	zh = kmem_cache_alloc(zeph_cache[class], ZCACHE_GFP_MASK);
+	if (unlikely(zh == NULL)) {
+		zcache_failed_alloc++;
 		goto out;
-	/* ok, have a page, now compress the data before taking locks */
-	spin_lock(&zbpg->lock);
-	spin_lock(&zbud_budlists_spinlock);
-	list_add_tail(&zbpg->bud_list, &zbud_unbuddied[nchunks].list);
-	zbud_unbuddied[nchunks].count++;
-	zh = &zbpg->buddy[0];
-	goto init_zh;
-
-found_unbuddied:
-	ASSERT_SPINLOCK(&zbpg->lock);
-	zh0 = &zbpg->buddy[0]; zh1 = &zbpg->buddy[1];
-	BUG_ON(!((zh0->size == 0) ^ (zh1->size == 0)));
-	if (zh0->size != 0) { /* buddy0 in use, buddy1 is vacant */
-		ASSERT_SENTINEL(zh0, ZBH);
-		zh = zh1;
-	} else if (zh1->size != 0) { /* buddy1 in use, buddy0 is vacant */
-		ASSERT_SENTINEL(zh1, ZBH);
-		zh = zh0;
-	} else
-		BUG();
-	list_del_init(&zbpg->bud_list);
-	zbud_unbuddied[found_good_buddy].count--;
-	list_add_tail(&zbpg->bud_list, &zbud_buddied_list);
-	zcache_zbud_buddied_count++;
-
-init_zh:
-	SET_SENTINEL(zh, ZBH);
-	zh->size = size;
-	zh->index = index;
+	}
 	zh->oid = *oid;
 	zh->pool_id = pool_id;
-	/* can wait to copy the data until the list locks are dropped */
-	spin_unlock(&zbud_budlists_spinlock);
-
-	to = zbud_data(zh, size);
-	memcpy(to, cdata, size);
-	spin_unlock(&zbpg->lock);
-	zbud_cumul_chunk_counts[nchunks]++;
-	atomic_inc(&zcache_zbud_curr_zpages);
-	zcache_zbud_cumul_zpages++;
-	zcache_zbud_curr_zbytes += size;
-	zcache_zbud_cumul_zbytes += size;
+	zh->index = index;
+	zh->size = size;
+	zh->class = class;
+	SET_SENTINEL(zh, ZEPH);
+	memcpy(zh + 1, cdata, size);
+
+	spin_lock_irqsave(&zeph_lru_lock, flags);
+	list_add_tail(&zh->lru, &zeph_lru);
+	zeph_class_count[class]++;
+	zcache_eph_zbytes += size;
+	zcache_eph_pool_bytes += zeph_class_size(class);
+	zcache_eph_cumul_zpages++;
+	zcache_eph_cumul_zbytes += size;
+	spin_unlock_irqrestore(&zeph_lru_lock, flags);
+	atomic_inc(&zcache_eph_zpages);
 out:
 	return zh;
 }
 
-static int zbud_decompress(struct page *page, struct zbud_hdr *zh)
+static void zeph_free(struct zeph_hdr *zh)
+{
+	unsigned class = zh->class;
+	unsigned long flags;
+
+	ASSERT_SENTINEL(zh, ZEPH);
+	/* zeph_evict() may already have taken it off the LRU */
+	spin_lock_irqsave(&zeph_lru_lock, flags);
+	list_del_init(&zh->lru);
+	zeph_class_count[class]--;
+	zcache_eph_zbytes -= zh->size;
+	zcache_eph_pool_bytes -= zeph_class_size(class);
+	spin_unlock_irqrestore(&zeph_lru_lock, flags);
+	atomic_dec(&zcache_eph_zpages);
+	INVERT_SENTINEL(zh, ZEPH);
+	kmem_cache_free(zeph_cache[class], zh);
+}
+
+static void zeph_decompress(struct page *page, struct zeph_hdr *zh)
 {
-	struct zbud_page *zbpg;
-	unsigned budnum = zbud_budnum(zh);
 	size_t out_len = PAGE_SIZE;
-	char *to_va, *from_va;
-	unsigned size;
-	int ret = 0;
+	char *to_va;
+	int ret;
 
-	zbpg = container_of(zh, struct zbud_page, buddy[budnum]);
-	spin_lock(&zbpg->lock);
-	if (list_empty(&zbpg->bud_list)) {
-		/* ignore zombie page... see zbud_evict_pages() */
-		ret = -EINVAL;
-		goto out;
-	}
-	ASSERT_SENTINEL(zh, ZBH);
-	BUG_ON(zh->size == 0 || zh->size > zbud_max_buddy_size());
+	ASSERT_SENTINEL(zh, ZEPH);
 	to_va = kmap_atomic(page, KM_USER0);
-	size = zh->size;
-	from_va = zbud_data(zh, size);
-	ret = lzo1x_decompress_safe(from_va, size, to_va, &out_len);
+	ret = lzo1x_decompress_safe((char *)(zh + 1), zh->size,
+					to_va, &out_len);
+	kunmap_atomic(to_va, KM_USER0);
 	BUG_ON(ret != LZO_E_OK);
 	BUG_ON(out_len != PAGE_SIZE);
-	kunmap_atomic(to_va, KM_USER0);
-out:
-	spin_unlock(&zbpg->lock);
-	return ret;
 }
 
 /*
- * The following routines handle shrinking of ephemeral pages by evicting
- * pages "least valuable" first.
+ * Flush the nr least recently used ephemeral pages.  The handle of each
+ * object is copied while it is taken off the LRU, and the page is then
+ * flushed through tmem like any other, which frees the object unless a
+ * racing get or flush has already done that.  No zeph_hdr is touched
+ * outside zeph_lru_lock, so nothing here can race with its freeing.
  */
-
-static unsigned long zcache_evicted_raw_pages;
-static unsigned long zcache_evicted_buddied_pages;
-static unsigned long zcache_evicted_unbuddied_pages;
-
-static struct tmem_pool *zcache_get_pool_by_id(uint32_t poolid);
-static void zcache_put_pool(struct tmem_pool *pool);
-
-/*
- * Flush and free all zbuds in a zbpg, then free the pageframe
- */
-static void zbud_evict_zbpg(struct zbud_page *zbpg)
+static void zeph_evict(int nr)
 {
-	struct zbud_hdr *zh;
-	int i, j;
-	uint32_t pool_id[ZBUD_MAX_BUDS], index[ZBUD_MAX_BUDS];
-	struct tmem_oid oid[ZBUD_MAX_BUDS];
+	struct zeph_hdr *zh;
 	struct tmem_pool *pool;
+	struct tmem_oid oid;
+	uint32_t pool_id, index;
+	unsigned long flags;
 
-	ASSERT_SPINLOCK(&zbpg->lock);
-	BUG_ON(!list_empty(&zbpg->bud_list));
-	for (i = 0, j = 0; i < ZBUD_MAX_BUDS; i++) {
-		zh = &zbpg->buddy[i];
-		if (zh->size) {
-			pool_id[j] = zh->pool_id;
-			oid[j] = zh->oid;
-			index[j] = zh->index;
-			j++;
-			zbud_free(zh);
+	while (nr-- > 0) {
+		spin_lock_irqsave(&zeph_lru_lock, flags);
+		if (list_empty(&zeph_lru)) {
+			spin_unlock_irqrestore(&zeph_lru_lock, flags);
+			break;
 		}
-	}
-	spin_unlock(&zbpg->lock);
-	for (i = 0; i < j; i++) {
-		pool = zcache_get_pool_by_id(pool_id[i]);
+		zh = list_first_entry(&zeph_lru, struct zeph_hdr, lru);
+		list_del_init(&zh->lru);
+		oid = zh->oid;
+		pool_id = zh->pool_id;
+		index = zh->index;
+		/* tmem is called with irqs disabled, as by the shims below */
+		spin_unlock(&zeph_lru_lock);
+		pool = zcache_get_pool_by_id(pool_id);
 		if (pool != NULL) {
-			tmem_flush_page(pool, &oid[i], index[i]);
+			if (tmem_flush_page(pool, &oid, index) >= 0)
+				atomic_inc(&zcache_evicted_eph_zpages);
 			zcache_put_pool(pool);
 		}
+		local_irq_restore(flags);
 	}
-	ASSERT_SENTINEL(zbpg, ZBPG);
-	spin_lock(&zbpg->lock);
-	zbud_free_raw_page(zbpg);
 }
 
-/*
- * Free nr pages.  This code is funky because we want to hold the locks
- * protecting various lists for as short a time as possible, and in some
- * circumstances the list may change asynchronously when the list lock is
- * not held.  In some cases we also trylock not only to avoid waiting on a
- * page in use by another cpu, but also to avoid potential deadlock due to
- * lock inversion.
- */
-static void zbud_evict_pages(int nr)
+static bool zeph_over_limit(void)
 {
-	struct zbud_page *zbpg;
-	int i;
-
-	/* first try freeing any pages on unused list */
-retry_unused_list:
-	spin_lock_bh(&zbpg_unused_list_spinlock);
-	if (!list_empty(&zbpg_unused_list)) {
-		/* can't walk list here, since it may change when unlocked */
-		zbpg = list_first_entry(&zbpg_unused_list,
-				struct zbud_page, bud_list);
-		list_del_init(&zbpg->bud_list);
-		zcache_zbpg_unused_list_count--;
-		atomic_dec(&zcache_zbud_curr_raw_pages);
-		spin_unlock_bh(&zbpg_unused_list_spinlock);
-		zcache_free_page(zbpg);
-		zcache_evicted_raw_pages++;
-		if (--nr <= 0)
-			goto out;
-		goto retry_unused_list;
-	}
-	spin_unlock_bh(&zbpg_unused_list_spinlock);
-
-	/* now try freeing unbuddied pages, starting with least space avail */
-	for (i = 0; i < MAX_CHUNK; i++) {
-retry_unbud_list_i:
-		spin_lock_bh(&zbud_budlists_spinlock);
-		if (list_empty(&zbud_unbuddied[i].list)) {
-			spin_unlock_bh(&zbud_budlists_spinlock);
-			continue;
-		}
-		list_for_each_entry(zbpg, &zbud_unbuddied[i].list, bud_list) {
-			if (unlikely(!spin_trylock(&zbpg->lock)))
-				continue;
-			list_del_init(&zbpg->bud_list);
-			zbud_unbuddied[i].count--;
-			spin_unlock(&zbud_budlists_spinlock);
-			zcache_evicted_unbuddied_pages++;
-			/* want budlists unlocked when doing zbpg eviction */
-			zbud_evict_zbpg(zbpg);
-			local_bh_enable();
-			if (--nr <= 0)
-				goto out;
-			goto retry_unbud_list_i;
-		}
-		spin_unlock_bh(&zbud_budlists_spinlock);
-	}
-
-	/* as a last resort, free buddied pages */
-retry_bud_list:
-	spin_lock_bh(&zbud_budlists_spinlock);
-	if (list_empty(&zbud_buddied_list)) {
-		spin_unlock_bh(&zbud_budlists_spinlock);
-		goto out;
-	}
-	list_for_each_entry(zbpg, &zbud_buddied_list, bud_list) {
-		if (unlikely(!spin_trylock(&zbpg->lock)))
-			continue;
-		list_del_init(&zbpg->bud_list);
-		zcache_zbud_buddied_count--;
-		spin_unlock(&zbud_budlists_spinlock);
-		zcache_evicted_buddied_pages++;
-		/* want budlists unlocked when doing zbpg eviction */
-		zbud_evict_zbpg(zbpg);
-		local_bh_enable();
-		if (--nr <= 0)
-			goto out;
-		goto retry_bud_list;
-	}
-	spin_unlock_bh(&zbud_budlists_spinlock);
-out:
-	return;
+	return (zcache_eph_pool_bytes >> PAGE_SHIFT) >
+		totalram_pages * zcache_eph_max_pool_percent / 100;
 }
 
-static void zbud_init(void)
+static int __init zeph_init(void)
 {
-	int i;
-
-	INIT_LIST_HEAD(&zbud_buddied_list);
-	zcache_zbud_buddied_count = 0;
-	for (i = 0; i < NCHUNKS; i++) {
-		INIT_LIST_HEAD(&zbud_unbuddied[i].list);
-		zbud_unbuddied[i].count = 0;
+	unsigned class;
+
+	for (class = 0; class < ZEPH_NR_CLASSES; class++) {
+		snprintf(zeph_cache_name[class], sizeof(zeph_cache_name[0]),
+			 "zcache_eph-%u", zeph_class_size(class));
+		zeph_cache[class] = kmem_cache_create(zeph_cache_name[class],
+					zeph_class_size(class), 0, 0, NULL);
+		if (zeph_cache[class] == NULL)
+			goto fail;
 	}
-}
-
-#ifdef CONFIG_SYSFS
-/*
- * These sysfs routines show a nice distribution of how many zbpg's are
- * currently (and have ever been placed) in each unbuddied list.  It's fun
- * to watch but can probably go away before final merge.
- */
-static int zbud_show_unbuddied_list_counts(char *buf)
-{
-	int i;
-	char *p = buf;
+	return 0;
 
-	for (i = 0; i < NCHUNKS - 1; i++)
-		p += sprintf(p, "%u ", zbud_unbuddied[i].count);
-	p += sprintf(p, "%d\n", zbud_unbuddied[i].count);
-	return p - buf;
+fail:
+	while (class--)
+		kmem_cache_destroy(zeph_cache[class]);
+	return -ENOMEM;
 }
 
-static int zbud_show_cumul_chunk_counts(char *buf)
+#ifdef CONFIG_SYSFS
+static int zeph_show_class_counts(char *buf)
 {
-	unsigned long i, chunks = 0, total_chunks = 0, sum_total_chunks = 0;
-	unsigned long total_chunks_lte_21 = 0, total_chunks_lte_32 = 0;
-	unsigned long total_chunks_lte_42 = 0;
+	unsigned long flags;
 	char *p = buf;
+	int i;
 
-	for (i = 0; i < NCHUNKS; i++) {
-		p += sprintf(p, "%lu ", zbud_cumul_chunk_counts[i]);
-		chunks += zbud_cumul_chunk_counts[i];
-		total_chunks += zbud_cumul_chunk_counts[i];
-		sum_total_chunks += i * zbud_cumul_chunk_counts[i];
-		if (i == 21)
-			total_chunks_lte_21 = total_chunks;
-		if (i == 32)
-			total_chunks_lte_32 = total_chunks;
-		if (i == 42)
-			total_chunks_lte_42 = total_chunks;
-	}
-	p += sprintf(p, "<=21:%lu <=32:%lu <=42:%lu, mean:%lu\n",
-		total_chunks_lte_21, total_chunks_lte_32, total_chunks_lte_42,
-		chunks == 0 ? 0 : sum_total_chunks / chunks);
+	spin_lock_irqsave(&zeph_lru_lock, flags);
+	for (i = 0; i < ZEPH_NR_CLASSES - 1; i++)
+		p += sprintf(p, "%lu ", zeph_class_count[i]);
+	p += sprintf(p, "%lu\n", zeph_class_count[i]);
+	spin_unlock_irqrestore(&zeph_lru_lock, flags);
 	return p - buf;
 }
 #endif
 
+#ifdef CONFIG_FRONTSWAP
 /**********
  * This "zv" PAM implementation combines the TLSF-based xvMalloc
  * with lzo1x compression to maximize the amount of data that can
@@ -664,6 +351,7 @@ static void zv_decompress(struct page *page, struct zv_hdr *zv)
 	BUG_ON(ret != LZO_E_OK);
 	BUG_ON(clen != PAGE_SIZE);
 }
+#endif /* CONFIG_FRONTSWAP */
 
 /*
  * zcache core code starts here
@@ -681,7 +369,9 @@ static unsigned long zcache_failed_pers_puts;
 
 static struct {
 	struct tmem_pool *tmem_pools[MAX_POOLS_PER_CLIENT];
+#ifdef CONFIG_FRONTSWAP
 	struct xv_pool *xvpool;
+#endif
 } zcache_client;
 
 /*
@@ -710,18 +400,7 @@ static void zcache_put_pool(struct tmem_pool *pool)
 }
 
 /* counters for debugging */
-static unsigned long zcache_failed_get_free_pages;
-static unsigned long zcache_failed_alloc;
 static unsigned long zcache_put_to_flush;
-static unsigned long zcache_aborted_preload;
-static unsigned long zcache_aborted_shrink;
-
-/*
- * Ensure that memory allocation requests in zcache don't result
- * in direct reclaim requests via the shrinker, which would cause
- * an infinite loop.  Maybe a GFP flag would be better?
- */
-static DEFINE_SPINLOCK(zcache_direct_reclaim_lock);
 
 /*
  * for now, used named slabs so can easily track usage; later can
@@ -736,12 +415,13 @@ static atomic_t zcache_curr_objnode_count = ATOMIC_INIT(0);
 static unsigned long zcache_curr_objnode_count_max;
 
 /*
- * to avoid memory allocation recursion (e.g. due to direct reclaim), we
- * preload all necessary data structures so the hostops callbacks never
- * actually do a malloc
+ * The hostops callbacks run under a tmem hashbucket lock, so the tmem
+ * data structures they need are preloaded and the callbacks never
+ * actually do a malloc.  None of the allocations in zcache can enter
+ * direct reclaim, as ZCACHE_GFP_MASK lacks __GFP_WAIT, so the shrinker
+ * cannot be called recursively from here.
  */
 struct zcache_preload {
-	void *page;
 	struct tmem_obj *obj;
 	int nr;
 	struct tmem_objnode *objnodes[OBJNODE_TREE_MAX_PATH];
@@ -753,17 +433,12 @@ static int zcache_do_preload(struct tmem_pool *pool)
 	struct zcache_preload *kp;
 	struct tmem_objnode *objnode;
 	struct tmem_obj *obj;
-	void *page;
 	int ret = -ENOMEM;
 
 	if (unlikely(zcache_objnode_cache == NULL))
 		goto out;
 	if (unlikely(zcache_obj_cache == NULL))
 		goto out;
-	if (!spin_trylock(&zcache_direct_reclaim_lock)) {
-		zcache_aborted_preload++;
-		goto out;
-	}
 	preempt_disable();
 	kp = &__get_cpu_var(zcache_preloads);
 	while (kp->nr < ARRAY_SIZE(kp->objnodes)) {
@@ -772,7 +447,7 @@ static int zcache_do_preload(struct tmem_pool *pool)
 				ZCACHE_GFP_MASK);
 		if (unlikely(objnode == NULL)) {
 			zcache_failed_alloc++;
-			goto unlock_out;
+			goto out;
 		}
 		preempt_disable();
 		kp = &__get_cpu_var(zcache_preloads);
@@ -785,13 +460,7 @@ static int zcache_do_preload(struct tmem_pool *pool)
 	obj = kmem_cache_alloc(zcache_obj_cache, ZCACHE_GFP_MASK);
 	if (unlikely(obj == NULL)) {
 		zcache_failed_alloc++;
-		goto unlock_out;
-	}
-	page = (void *)__get_free_page(ZCACHE_GFP_MASK);
-	if (unlikely(page == NULL)) {
-		zcache_failed_get_free_pages++;
-		kmem_cache_free(zcache_obj_cache, obj);
-		goto unlock_out;
+		goto out;
 	}
 	preempt_disable();
 	kp = &__get_cpu_var(zcache_preloads);
@@ -799,34 +468,11 @@ static int zcache_do_preload(struct tmem_pool *pool)
 		kp->obj = obj;
 	else
 		kmem_cache_free(zcache_obj_cache, obj);
-	if (kp->page == NULL)
-		kp->page = page;
-	else
-		free_page((unsigned long)page);
 	ret = 0;
-unlock_out:
-	spin_unlock(&zcache_direct_reclaim_lock);
 out:
 	return ret;
 }
 
-static void *zcache_get_free_page(void)
-{
-	struct zcache_preload *kp;
-	void *page;
-
-	kp = &__get_cpu_var(zcache_preloads);
-	page = kp->page;
-	BUG_ON(page == NULL);
-	kp->page = NULL;
-	return page;
-}
-
-static void zcache_free_page(void *p)
-{
-	free_page((unsigned long)p);
-}
-
 /*
  * zcache implementation for tmem host ops
  */
@@ -895,8 +541,10 @@ static struct tmem_hostops zcache_hostops = {
 
 static atomic_t zcache_curr_eph_pampd_count = ATOMIC_INIT(0);
 static unsigned long zcache_curr_eph_pampd_count_max;
+#ifdef CONFIG_FRONTSWAP
 static atomic_t zcache_curr_pers_pampd_count = ATOMIC_INIT(0);
 static unsigned long zcache_curr_pers_pampd_count_max;
+#endif
 
 /* forward reference */
 static int zcache_compress(struct page *from, void **out_va, size_t *out_len);
@@ -913,20 +561,21 @@ static void *zcache_pampd_create(struct tmem_pool *pool, struct tmem_oid *oid,
 	if (ephemeral) {
 		ret = zcache_compress(page, &cdata, &clen);
 		if (ret == 0)
-
 			goto out;
-		if (clen == 0 || clen > zbud_max_buddy_size()) {
+		if (clen == 0 || clen > ZEPH_MAX_SIZE) {
 			zcache_compress_poor++;
 			goto out;
 		}
-		pampd = (void *)zbud_create(pool->pool_id, oid, index,
-						page, cdata, clen);
+		pampd = (void *)zeph_create(pool->pool_id, oid, index,
+						cdata, clen);
 		if (pampd != NULL) {
 			count = atomic_inc_return(&zcache_curr_eph_pampd_count);
 			if (count > zcache_curr_eph_pampd_count_max)
 				zcache_curr_eph_pampd_count_max = count;
 		}
-	} else {
+	}
+#ifdef CONFIG_FRONTSWAP
+	else {
 		/*
 		 * FIXME: This is all the "policy" there is for now.
 		 * 3/4 totpages should allow ~37% of RAM to be filled with
@@ -950,6 +599,7 @@ static void *zcache_pampd_create(struct tmem_pool *pool, struct tmem_oid *oid,
 		if (count > zcache_curr_pers_pampd_count_max)
 			zcache_curr_pers_pampd_count_max = count;
 	}
+#endif
 out:
 	return pampd;
 }
@@ -961,13 +611,13 @@ out:
 static int zcache_pampd_get_data(struct page *page, void *pampd,
 						struct tmem_pool *pool)
 {
-	int ret = 0;
-
 	if (is_ephemeral(pool))
-		ret = zbud_decompress(page, pampd);
+		zeph_decompress(page, pampd);
+#ifdef CONFIG_FRONTSWAP
 	else
 		zv_decompress(page, pampd);
-	return ret;
+#endif
+	return 0;
 }
 
 /*
@@ -977,14 +627,17 @@ static int zcache_pampd_get_data(struct page *page, void *pampd,
 static void zcache_pampd_free(void *pampd, struct tmem_pool *pool)
 {
 	if (is_ephemeral(pool)) {
-		zbud_free_and_delist((struct zbud_hdr *)pampd);
+		zeph_free((struct zeph_hdr *)pampd);
 		atomic_dec(&zcache_curr_eph_pampd_count);
 		BUG_ON(atomic_read(&zcache_curr_eph_pampd_count) < 0);
-	} else {
+	}
+#ifdef CONFIG_FRONTSWAP
+	else {
 		zv_free(zcache_client.xvpool, (struct zv_hdr *)pampd);
 		atomic_dec(&zcache_curr_pers_pampd_count);
 		BUG_ON(atomic_read(&zcache_curr_pers_pampd_count) < 0);
 	}
+#endif
 }
 
 static struct tmem_pamops zcache_pamops = {
@@ -1054,7 +707,7 @@ static int zcache_cpu_notifier(struct notifier_block *nb,
 			kp->nr--;
 		}
 		kmem_cache_free(zcache_obj_cache, kp->obj);
-		free_page((unsigned long)kp->page);
+		kp->obj = NULL;
 		break;
 	default:
 		break;
@@ -1108,28 +761,45 @@ ZCACHE_SYSFS_RO(flobj_total);
 ZCACHE_SYSFS_RO(flobj_found);
 ZCACHE_SYSFS_RO(failed_eph_puts);
 ZCACHE_SYSFS_RO(failed_pers_puts);
-ZCACHE_SYSFS_RO(zbud_curr_zbytes);
-ZCACHE_SYSFS_RO(zbud_cumul_zpages);
-ZCACHE_SYSFS_RO(zbud_cumul_zbytes);
-ZCACHE_SYSFS_RO(zbud_buddied_count);
-ZCACHE_SYSFS_RO(zbpg_unused_list_count);
-ZCACHE_SYSFS_RO(evicted_raw_pages);
-ZCACHE_SYSFS_RO(evicted_unbuddied_pages);
-ZCACHE_SYSFS_RO(evicted_buddied_pages);
-ZCACHE_SYSFS_RO(failed_get_free_pages);
+ZCACHE_SYSFS_RO(eph_zbytes);
+ZCACHE_SYSFS_RO(eph_pool_bytes);
+ZCACHE_SYSFS_RO(eph_cumul_zpages);
+ZCACHE_SYSFS_RO(eph_cumul_zbytes);
 ZCACHE_SYSFS_RO(failed_alloc);
 ZCACHE_SYSFS_RO(put_to_flush);
-ZCACHE_SYSFS_RO(aborted_preload);
-ZCACHE_SYSFS_RO(aborted_shrink);
 ZCACHE_SYSFS_RO(compress_poor);
-ZCACHE_SYSFS_RO_ATOMIC(zbud_curr_raw_pages);
-ZCACHE_SYSFS_RO_ATOMIC(zbud_curr_zpages);
+ZCACHE_SYSFS_RO_ATOMIC(eph_zpages);
+ZCACHE_SYSFS_RO_ATOMIC(evicted_eph_zpages);
+ZCACHE_SYSFS_RO_ATOMIC(eph_pool_limit_hit);
 ZCACHE_SYSFS_RO_ATOMIC(curr_obj_count);
 ZCACHE_SYSFS_RO_ATOMIC(curr_objnode_count);
-ZCACHE_SYSFS_RO_CUSTOM(zbud_unbuddied_list_counts,
-			zbud_show_unbuddied_list_counts);
-ZCACHE_SYSFS_RO_CUSTOM(zbud_cumul_chunk_counts,
-			zbud_show_cumul_chunk_counts);
+ZCACHE_SYSFS_RO_CUSTOM(eph_class_counts, zeph_show_class_counts);
+
+static ssize_t zcache_eph_max_pool_percent_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", zcache_eph_max_pool_percent);
+}
+
+static ssize_t zcache_eph_max_pool_percent_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	unsigned long val;
+	int err;
+
+	err = kstrtoul(buf, 10, &val);
+	if (err || val > 100)
+		return -EINVAL;
+	zcache_eph_max_pool_percent = val;
+	return count;
+}
+
+static struct kobj_attribute zcache_eph_max_pool_percent_attr = {
+	.attr = { .name = "eph_max_pool_percent", .mode = 0644 },
+	.show = zcache_eph_max_pool_percent_show,
+	.store = zcache_eph_max_pool_percent_store,
+};
 
 static struct attribute *zcache_attrs[] = {
 	&zcache_curr_obj_count_attr.attr,
@@ -1143,23 +813,17 @@ static struct attribute *zcache_attrs[] = {
 	&zcache_failed_eph_puts_attr.attr,
 	&zcache_failed_pers_puts_attr.attr,
 	&zcache_compress_poor_attr.attr,
-	&zcache_zbud_curr_raw_pages_attr.attr,
-	&zcache_zbud_curr_zpages_attr.attr,
-	&zcache_zbud_curr_zbytes_attr.attr,
-	&zcache_zbud_cumul_zpages_attr.attr,
-	&zcache_zbud_cumul_zbytes_attr.attr,
-	&zcache_zbud_buddied_count_attr.attr,
-	&zcache_zbpg_unused_list_count_attr.attr,
-	&zcache_evicted_raw_pages_attr.attr,
-	&zcache_evicted_unbuddied_pages_attr.attr,
-	&zcache_evicted_buddied_pages_attr.attr,
-	&zcache_failed_get_free_pages_attr.attr,
+	&zcache_eph_zpages_attr.attr,
+	&zcache_eph_zbytes_attr.attr,
+	&zcache_eph_pool_bytes_attr.attr,
+	&zcache_eph_cumul_zpages_attr.attr,
+	&zcache_eph_cumul_zbytes_attr.attr,
+	&zcache_evicted_eph_zpages_attr.attr,
+	&zcache_eph_pool_limit_hit_attr.attr,
+	&zcache_eph_max_pool_percent_attr.attr,
 	&zcache_failed_alloc_attr.attr,
 	&zcache_put_to_flush_attr.attr,
-	&zcache_aborted_preload_attr.attr,
-	&zcache_aborted_shrink_attr.attr,
-	&zcache_zbud_unbuddied_list_counts_attr.attr,
-	&zcache_zbud_cumul_chunk_counts_attr.attr,
+	&zcache_eph_class_counts_attr.attr,
 	NULL,
 };
 
@@ -1179,7 +843,7 @@ static struct attribute_group zcache_attr_group = {
 static bool zcache_freeze;
 
 /*
- * zcache shrinker interface (only useful for ephemeral pages, so zbud only)
+ * zcache shrinker interface (only useful for ephemeral pages, so zeph only)
  */
 static int shrink_zcache_memory(struct shrinker *shrink,
 				struct shrink_control *sc)
@@ -1188,17 +852,13 @@ static int shrink_zcache_memory(struct shrinker *shrink,
 	int nr = sc->nr_to_scan;
 	gfp_t gfp_mask = sc->gfp_mask;
 
-	if (nr >= 0) {
+	if (nr > 0) {
 		if (!(gfp_mask & __GFP_FS))
 			/* does this case really need to be skipped? */
 			goto out;
-		if (spin_trylock(&zcache_direct_reclaim_lock)) {
-			zbud_evict_pages(nr);
-			spin_unlock(&zcache_direct_reclaim_lock);
-		} else
-			zcache_aborted_shrink++;
+		zeph_evict(nr);
 	}
-	ret = (int)atomic_read(&zcache_zbud_curr_raw_pages);
+	ret = atomic_read(&zcache_eph_zpages);
 out:
 	return ret;
 }
@@ -1222,6 +882,11 @@ static int zcache_put_page(int pool_id, struct tmem_oid *oidp,
 	pool = zcache_get_pool_by_id(pool_id);
 	if (unlikely(pool == NULL))
 		goto out;
+	if (is_ephemeral(pool) && zeph_over_limit()) {
+		/* make room by dropping the oldest compressed pages */
+		atomic_inc(&zcache_eph_pool_limit_hit);
+		zeph_evict(ZEPH_EVICT_BATCH);
+	}
 	if (!zcache_freeze && zcache_do_preload(pool) == 0) {
 		/* preload does preempt_disable on success */
 		ret = tmem_put(pool, oidp, index, page);
@@ -1561,7 +1226,11 @@ struct frontswap_ops zcache_frontswap_register_ops(void)
  * NOTHING HAPPENS!
  */
 
+#ifdef CONFIG_ZCACHE_ENABLED_BY_DEFAULT
+static int zcache_enabled = 1;
+#else
 static int zcache_enabled;
+#endif
 
 static int __init enable_zcache(char *s)
 {
@@ -1629,11 +1298,15 @@ static int __init zcache_init(void)
 	if (zcache_enabled && use_cleancache) {
 		struct cleancache_ops old_ops;
 
-		zbud_init();
+		ret = zeph_init();
+		if (ret) {
+			pr_err("zcache: can't create zeph slab caches\n");
+			goto out;
+		}
 		register_shrinker(&zcache_shrinker);
 		old_ops = zcache_cleancache_register_ops();
 		pr_info("zcache: cleancache enabled using kernel "
-			"transcendent memory and compression buddies\n");
+			"transcendent memory and slab size classes\n");
 		if (old_ops.init_fs != NULL)
 			pr_warning("zcache: cleancache_ops overridden");
 	}
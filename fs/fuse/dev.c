@@ -20,21 +20,189 @@
 #include <linux/swap.h>
 #include <linux/splice.h>
 #include <linux/freezer.h>
+#include <linux/uaccess.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_dev *fuse_get_dev(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
-	 * once during mount and is valid until the file is released.
+	 * once during mount (or clone) and is valid until the file is
+	 * released.
 	 */
 	return file->private_data;
 }
 
+void fuse_chan_init(struct fuse_chan *chan)
+{
+	spin_lock_init(&chan->lock);
+	init_waitqueue_head(&chan->waitq);
+	INIT_LIST_HEAD(&chan->pending);
+	INIT_LIST_HEAD(&chan->processing);
+	INIT_LIST_HEAD(&chan->io);
+	chan->num_devs = 0;
+}
+
+static struct fuse_chan *fuse_cpu_chans_alloc(void)
+{
+	struct fuse_chan *chans;
+	unsigned cpu;
+
+	chans = kcalloc(nr_cpu_ids, sizeof(struct fuse_chan), GFP_KERNEL);
+	if (!chans)
+		return NULL;
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+		fuse_chan_init(&chans[cpu]);
+
+	return chans;
+}
+
+/*
+ * Does the channel have to serve requests of the default channel?
+ * True for the default channel itself, and for per-CPU channels once
+ * every device has left the default channel.
+ */
+static bool fuse_chan_serves_default(struct fuse_conn *fc,
+				     struct fuse_chan *chan)
+{
+	return chan == &fc->chan || !ACCESS_ONCE(fc->chan.num_devs);
+}
+
+/*
+ * Wake up a reader for work queued on the default channel
+ *
+ * Called with fc->lock or the default channel's lock held
+ */
+static void fuse_chan_wake_default(struct fuse_conn *fc)
+{
+	unsigned cpu;
+
+	if (fc->chan.num_devs || !fc->cpu_chans) {
+		wake_up(&fc->chan.waitq);
+		return;
+	}
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		if (fc->cpu_chans[cpu].num_devs)
+			wake_up(&fc->cpu_chans[cpu].waitq);
+	}
+}
+
+void fuse_chan_wake_all(struct fuse_conn *fc)
+{
+	unsigned cpu;
+
+	wake_up_all(&fc->chan.waitq);
+	if (fc->cpu_chans) {
+		for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+			wake_up_all(&fc->cpu_chans[cpu].waitq);
+	}
+}
+EXPORT_SYMBOL_GPL(fuse_chan_wake_all);
+
+/*
+ * Route a request to the channel bound to the submitting CPU, or to
+ * the default channel if no device is bound there
+ *
+ * Called with fc->lock held
+ */
+static struct fuse_chan *fuse_select_chan(struct fuse_conn *fc)
+{
+	if (fc->cpu_chans) {
+		struct fuse_chan *chan = &fc->cpu_chans[smp_processor_id()];
+
+		if (chan->num_devs)
+			return chan;
+	}
+	return &fc->chan;
+}
+
+/*
+ * Move a device to another channel, or detach it if @chan is NULL.
+ * Requests still pending on a per-CPU channel left without devices
+ * are handed over to the default channel, unless the connection is
+ * going away and they are about to be ended where they are.
+ *
+ * Called with fc->lock held
+ */
+static void fuse_dev_set_chan(struct fuse_conn *fc, struct fuse_dev *fud,
+			      struct fuse_chan *chan)
+{
+	struct fuse_chan *old = fud->chan;
+	bool own_lock = old && old != &fc->chan;
+
+	if (old == chan)
+		return;
+
+	if (own_lock)
+		spin_lock(&old->lock);
+	spin_lock(&fc->chan.lock);
+	if (old) {
+		old->num_devs--;
+		/* Readers sleeping on the old channel must notice the move */
+		wake_up_all(&old->waitq);
+		if (old == &fc->chan && !old->num_devs)
+			fuse_chan_wake_default(fc);
+		if (old != &fc->chan && !old->num_devs && fc->connected &&
+		    !list_empty(&old->pending)) {
+			struct fuse_req *req;
+
+			list_for_each_entry(req, &old->pending, list)
+				req->chan = &fc->chan;
+			list_splice_tail_init(&old->pending, &fc->chan.pending);
+			fuse_chan_wake_default(fc);
+		}
+	}
+	if (chan)
+		chan->num_devs++;
+	fud->chan = chan;
+	spin_unlock(&fc->chan.lock);
+	if (own_lock)
+		spin_unlock(&old->lock);
+}
+
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc)
+{
+	struct fuse_dev *fud;
+
+	fud = kzalloc(sizeof(struct fuse_dev), GFP_KERNEL);
+	if (!fud)
+		return NULL;
+
+	fud->fc = fuse_conn_get(fc);
+	spin_lock(&fc->lock);
+	fc->num_devs++;
+	fuse_dev_set_chan(fc, fud, &fc->chan);
+	spin_unlock(&fc->lock);
+
+	return fud;
+}
+EXPORT_SYMBOL_GPL(fuse_dev_alloc);
+
+/* Called with fc->lock held, returns true if this was the last device */
+static bool fuse_dev_detach(struct fuse_conn *fc, struct fuse_dev *fud)
+{
+	fuse_dev_set_chan(fc, fud, NULL);
+	return !--fc->num_devs;
+}
+
+void fuse_dev_free(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+
+	spin_lock(&fc->lock);
+	fuse_dev_detach(fc, fud);
+	spin_unlock(&fc->lock);
+	fuse_conn_put(fc);
+	kfree(fud);
+}
+EXPORT_SYMBOL_GPL(fuse_dev_free);
+
 static void fuse_request_init(struct fuse_req *req)
 {
 	memset(req, 0, sizeof(*req));
@@ -63,6 +231,8 @@ struct fuse_req *fuse_request_alloc_nofs(void)
 
 void fuse_request_free(struct fuse_req *req)
 {
+	if (req->passthrough_filp)
+		fput(req->passthrough_filp);
 	kmem_cache_free(fuse_req_cachep, req);
 }
 
@@ -230,44 +400,73 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 
 static u64 fuse_get_unique(struct fuse_conn *fc)
 {
-	fc->reqctr++;
+	u64 unique;
+
 	/* zero is special */
-	if (fc->reqctr == 0)
-		fc->reqctr = 1;
+	do {
+		unique = atomic64_inc_return(&fc->reqctr);
+	} while (unlikely(!unique));
 
-	return fc->reqctr;
+	return unique;
 }
 
+/* Called with fc->lock held */
 static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_chan *chan = fuse_select_chan(fc);
+
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
-	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
+	spin_lock(&chan->lock);
+	req->chan = chan;
+	list_add_tail(&req->list, &chan->pending);
+	req->state = FUSE_REQ_PENDING;
+	if (chan == &fc->chan)
+		fuse_chan_wake_default(fc);
+	else
+		wake_up(&chan->waitq);
+	spin_unlock(&chan->lock);
 	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 }
 
+/*
+ * Lock the channel a queued request is on.  The request may be handed
+ * over from a per-CPU channel to the default one until it is read.
+ */
+static struct fuse_chan *lock_req_chan(struct fuse_req *req)
+__acquires(req->chan->lock)
+{
+	struct fuse_chan *chan;
+
+	for (;;) {
+		chan = ACCESS_ONCE(req->chan);
+		spin_lock(&chan->lock);
+		if (likely(req->chan == chan))
+			return chan;
+		spin_unlock(&chan->lock);
+	}
+}
+
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
 	forget->forget_one.nodeid = nodeid;
 	forget->forget_one.nlookup = nlookup;
 
-	spin_lock(&fc->lock);
+	spin_lock(&fc->chan.lock);
 	if (fc->connected) {
 		fc->forget_list_tail->next = forget;
 		fc->forget_list_tail = forget;
-		wake_up(&fc->waitq);
+		fuse_chan_wake_default(fc);
 		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 	} else {
 		kfree(forget);
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&fc->chan.lock);
 }
 
 static void flush_bg_queue(struct fuse_conn *fc)
@@ -292,17 +491,29 @@ static void flush_bg_queue(struct fuse_conn *fc)
  * the 'end' callback is called if given, else the reference to the
  * request is released
  *
- * Called with fc->lock, unlocks it
+ * Called with req->chan->lock held if the request was queued, unlocks
+ * it.  fc->lock must not be held.
  */
 static void request_end(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
+__releases(req->chan->lock)
 {
+	struct fuse_chan *chan = req->chan;
 	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 	req->end = NULL;
 	list_del(&req->list);
-	list_del(&req->intr_entry);
+	/* Only queue_interrupt() adds it, and that needs chan->lock */
+	if (!list_empty(&req->intr_entry)) {
+		if (chan != &fc->chan)
+			spin_lock(&fc->chan.lock);
+		list_del_init(&req->intr_entry);
+		if (chan != &fc->chan)
+			spin_unlock(&fc->chan.lock);
+	}
 	req->state = FUSE_REQ_FINISHED;
+	if (chan)
+		spin_unlock(&chan->lock);
 	if (req->background) {
+		spin_lock(&fc->lock);
 		if (fc->num_background == fc->max_background) {
 			fc->blocked = 0;
 			wake_up_all(&fc->blocked_waitq);
@@ -315,50 +526,54 @@ __releases(fc->lock)
 		fc->num_background--;
 		fc->active_background--;
 		flush_bg_queue(fc);
+		spin_unlock(&fc->lock);
 	}
-	spin_unlock(&fc->lock);
 	wake_up(&req->waitq);
 	if (end)
 		end(fc, req);
 	fuse_put_request(fc, req);
 }
 
-static void wait_answer_interruptible(struct fuse_conn *fc,
-				      struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void wait_answer_interruptible(struct fuse_req *req)
 {
 	if (signal_pending(current))
 		return;
 
-	spin_unlock(&fc->lock);
 	wait_event_interruptible(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
 }
 
+/* Called with req->chan->lock held */
 static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
 {
+	if (req->chan != &fc->chan)
+		spin_lock(&fc->chan.lock);
 	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
+	fuse_chan_wake_default(fc);
+	if (req->chan != &fc->chan)
+		spin_unlock(&fc->chan.lock);
 	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
 {
+	struct fuse_chan *chan;
+
 	if (!fc->no_interrupt) {
 		/* Any signal may interrupt this */
-		wait_answer_interruptible(fc, req);
+		wait_answer_interruptible(req);
 
+		chan = lock_req_chan(req);
 		if (req->aborted)
 			goto aborted;
-		if (req->state == FUSE_REQ_FINISHED)
+		if (req->state == FUSE_REQ_FINISHED) {
+			spin_unlock(&chan->lock);
 			return;
+		}
 
 		req->interrupted = 1;
 		if (req->state == FUSE_REQ_SENT)
 			queue_interrupt(fc, req);
+		spin_unlock(&chan->lock);
 	}
 
 	if (!req->force) {
@@ -366,49 +581,51 @@ __acquires(fc->lock)
 
 		/* Only fatal signals may interrupt this */
 		block_sigs(&oldset);
-		wait_answer_interruptible(fc, req);
+		wait_answer_interruptible(req);
 		restore_sigs(&oldset);
 
+		chan = lock_req_chan(req);
 		if (req->aborted)
 			goto aborted;
-		if (req->state == FUSE_REQ_FINISHED)
+		if (req->state == FUSE_REQ_FINISHED) {
+			spin_unlock(&chan->lock);
 			return;
+		}
 
 		/* Request is not yet in userspace, bail out */
 		if (req->state == FUSE_REQ_PENDING) {
 			list_del(&req->list);
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
+			spin_unlock(&chan->lock);
 			return;
 		}
+		spin_unlock(&chan->lock);
 	}
 
 	/*
 	 * Either request is already in userspace, or it was forced.
 	 * Wait it out.
 	 */
-	spin_unlock(&fc->lock);
-
 	while (req->state != FUSE_REQ_FINISHED)
 		wait_event_freezable(req->waitq,
 				     req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
 
-	if (!req->aborted)
+	chan = lock_req_chan(req);
+	if (!req->aborted) {
+		spin_unlock(&chan->lock);
 		return;
+	}
 
  aborted:
 	BUG_ON(req->state != FUSE_REQ_FINISHED);
-	if (req->locked) {
-		/* This is uninterruptible sleep, because data is
-		   being copied to/from the buffers of req.  During
-		   locked state, there mustn't be any filesystem
-		   operation (e.g. page fault), since that could lead
-		   to deadlock */
-		spin_unlock(&fc->lock);
-		wait_event(req->waitq, !req->locked);
-		spin_lock(&fc->lock);
-	}
+	spin_unlock(&chan->lock);
+	/* This is uninterruptible sleep, because data is
+	   being copied to/from the buffers of req.  During
+	   locked state, there mustn't be any filesystem
+	   operation (e.g. page fault), since that could lead
+	   to deadlock */
+	wait_event(req->waitq, !req->locked);
 }
 
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
@@ -421,12 +638,14 @@ void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 		req->out.h.error = -ECONNREFUSED;
 	else {
 		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
 		__fuse_get_request(req);
+		queue_request(fc, req);
+		spin_unlock(&fc->lock);
 
 		request_wait_answer(fc, req);
+		return;
 	}
 	spin_unlock(&fc->lock);
 }
@@ -455,6 +674,7 @@ static void fuse_request_send_nowait(struct fuse_conn *fc, struct fuse_req *req)
 		fuse_request_send_nowait_locked(fc, req);
 		spin_unlock(&fc->lock);
 	} else {
+		spin_unlock(&fc->lock);
 		req->out.h.error = -ENOTCONN;
 		request_end(fc, req);
 	}
@@ -505,12 +725,12 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	int err = 0;
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->chan->lock);
 		if (req->aborted)
 			err = -ENOENT;
 		else
 			req->locked = 1;
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->chan->lock);
 	}
 	return err;
 }
@@ -523,11 +743,11 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
 static void unlock_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->chan->lock);
 		req->locked = 0;
 		if (req->aborted)
 			wake_up(&req->waitq);
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->chan->lock);
 	}
 }
 
@@ -757,12 +977,12 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 		lru_cache_add_file(newpage);
 
 	err = 0;
-	spin_lock(&cs->fc->lock);
+	spin_lock(&cs->req->chan->lock);
 	if (cs->req->aborted)
 		err = -ENOENT;
 	else
 		*pagep = newpage;
-	spin_unlock(&cs->fc->lock);
+	spin_unlock(&cs->req->chan->lock);
 
 	if (err) {
 		unlock_page(newpage);
@@ -915,31 +1135,63 @@ static int forget_pending(struct fuse_conn *fc)
 	return fc->forget_list_head.next != NULL;
 }
 
-static int request_pending(struct fuse_conn *fc)
+/* Called with chan->lock held */
+static int request_pending(struct fuse_conn *fc, struct fuse_chan *chan)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
-		forget_pending(fc);
+	int ret;
+
+	if (!list_empty(&chan->pending))
+		return 1;
+
+	if (!fuse_chan_serves_default(fc, chan))
+		return 0;
+
+	if (chan != &fc->chan)
+		spin_lock(&fc->chan.lock);
+	ret = !list_empty(&fc->chan.pending) ||
+		!list_empty(&fc->interrupts) || forget_pending(fc);
+	if (chan != &fc->chan)
+		spin_unlock(&fc->chan.lock);
+
+	return ret;
 }
 
-/* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+/*
+ * Wait until a request is available on the pending list of the
+ * device's channel, or the device is moved to another channel
+ *
+ * Called with chan->lock held
+ */
+static void request_wait(struct fuse_conn *fc, struct fuse_dev *fud,
+			 struct fuse_chan *chan)
+__releases(chan->lock)
+__acquires(chan->lock)
 {
 	DECLARE_WAITQUEUE(wait, current);
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
+	add_wait_queue_exclusive(&chan->waitq, &wait);
+	for (;;) {
 		set_current_state(TASK_INTERRUPTIBLE);
-		if (signal_pending(current))
+		if (!fc->connected || fud->chan != chan ||
+		    request_pending(fc, chan) || signal_pending(current))
 			break;
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&chan->lock);
 		schedule();
-		spin_lock(&fc->lock);
+		spin_lock(&chan->lock);
 	}
 	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	remove_wait_queue(&chan->waitq, &wait);
+}
+
+/* Drop the locks fuse_dev_do_read() took to read from the default channel */
+static void fuse_read_unlock(struct fuse_conn *fc, struct fuse_chan *chan)
+__releases(fc->chan.lock)
+__releases(chan->lock)
+{
+	if (chan != &fc->chan)
+		spin_unlock(&fc->chan.lock);
+	spin_unlock(&chan->lock);
 }
 
 /*
@@ -948,11 +1200,14 @@ __acquires(fc->lock)
  * Unlike other requests this is assembled on demand, without a need
  * to allocate a separate fuse_req structure.
  *
- * Called with fc->lock held, releases it
+ * Called with chan->lock and the default channel's lock held, releases
+ * them
  */
-static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_copy_state *cs,
-			       size_t nbytes, struct fuse_req *req)
-__releases(fc->lock)
+static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_chan *chan,
+			       struct fuse_copy_state *cs, size_t nbytes,
+			       struct fuse_req *req)
+__releases(fc->chan.lock)
+__releases(chan->lock)
 {
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
@@ -968,7 +1223,7 @@ __releases(fc->lock)
 	ih.unique = req->intr_unique;
 	arg.unique = req->in.h.unique;
 
-	spin_unlock(&fc->lock);
+	fuse_read_unlock(fc, chan);
 	if (nbytes < reqsize)
 		return -EINVAL;
 
@@ -1003,9 +1258,11 @@ static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
 }
 
 static int fuse_read_single_forget(struct fuse_conn *fc,
+				   struct fuse_chan *chan,
 				   struct fuse_copy_state *cs,
 				   size_t nbytes)
-__releases(fc->lock)
+__releases(fc->chan.lock)
+__releases(chan->lock)
 {
 	int err;
 	struct fuse_forget_link *forget = dequeue_forget(fc, 1, NULL);
@@ -1019,7 +1276,7 @@ __releases(fc->lock)
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
-	spin_unlock(&fc->lock);
+	fuse_read_unlock(fc, chan);
 	kfree(forget);
 	if (nbytes < ih.len)
 		return -EINVAL;
@@ -1036,8 +1293,10 @@ __releases(fc->lock)
 }
 
 static int fuse_read_batch_forget(struct fuse_conn *fc,
-				   struct fuse_copy_state *cs, size_t nbytes)
-__releases(fc->lock)
+				  struct fuse_chan *chan,
+				  struct fuse_copy_state *cs, size_t nbytes)
+__releases(fc->chan.lock)
+__releases(chan->lock)
 {
 	int err;
 	unsigned max_forgets;
@@ -1051,13 +1310,13 @@ __releases(fc->lock)
 	};
 
 	if (nbytes < ih.len) {
-		spin_unlock(&fc->lock);
+		fuse_read_unlock(fc, chan);
 		return -EINVAL;
 	}
 
 	max_forgets = (nbytes - ih.len) / sizeof(struct fuse_forget_one);
 	head = dequeue_forget(fc, max_forgets, &count);
-	spin_unlock(&fc->lock);
+	fuse_read_unlock(fc, chan);
 
 	arg.count = count;
 	ih.len += count * sizeof(struct fuse_forget_one);
@@ -1084,14 +1343,15 @@ __releases(fc->lock)
 	return ih.len;
 }
 
-static int fuse_read_forget(struct fuse_conn *fc, struct fuse_copy_state *cs,
-			    size_t nbytes)
-__releases(fc->lock)
+static int fuse_read_forget(struct fuse_conn *fc, struct fuse_chan *chan,
+			    struct fuse_copy_state *cs, size_t nbytes)
+__releases(fc->chan.lock)
+__releases(chan->lock)
 {
 	if (fc->minor < 16 || fc->forget_list_head.next->next == NULL)
-		return fuse_read_single_forget(fc, cs, nbytes);
+		return fuse_read_single_forget(fc, chan, cs, nbytes);
 	else
-		return fuse_read_batch_forget(fc, cs, nbytes);
+		return fuse_read_batch_forget(fc, chan, cs, nbytes);
 }
 
 /*
@@ -1103,51 +1363,89 @@ __releases(fc->lock)
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_chan *chan, *rchan;
+	struct list_head *pending;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
+	bool dflt;
 
  restart:
-	spin_lock(&fc->lock);
+	chan = ACCESS_ONCE(fud->chan);
+	spin_lock(&chan->lock);
+	if (fud->chan != chan) {
+		spin_unlock(&chan->lock);
+		goto restart;
+	}
 	err = -EAGAIN;
 	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
-	    !request_pending(fc))
+	    !request_pending(fc, chan))
 		goto err_unlock;
 
-	request_wait(fc);
+	request_wait(fc, fud, chan);
 	err = -ENODEV;
 	if (!fc->connected)
 		goto err_unlock;
+	if (fud->chan != chan) {
+		spin_unlock(&chan->lock);
+		goto restart;
+	}
 	err = -ERESTARTSYS;
-	if (!request_pending(fc))
+	if (!request_pending(fc, chan))
 		goto err_unlock;
 
-	if (!list_empty(&fc->interrupts)) {
-		req = list_entry(fc->interrupts.next, struct fuse_req,
-				 intr_entry);
-		return fuse_read_interrupt(fc, cs, nbytes, req);
-	}
+	/* Requests of the own channel first, then the default channel's */
+	pending = &chan->pending;
+	dflt = fuse_chan_serves_default(fc, chan);
+	if (dflt) {
+		if (chan != &fc->chan)
+			spin_lock(&fc->chan.lock);
+		if (list_empty(pending))
+			pending = &fc->chan.pending;
+
+		if (!list_empty(&fc->interrupts)) {
+			req = list_entry(fc->interrupts.next, struct fuse_req,
+					 intr_entry);
+			return fuse_read_interrupt(fc, chan, cs, nbytes, req);
+		}
 
-	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
-			return fuse_read_forget(fc, cs, nbytes);
+		if (forget_pending(fc)) {
+			if (list_empty(pending) || fc->forget_batch-- > 0)
+				return fuse_read_forget(fc, chan, cs, nbytes);
 
-		if (fc->forget_batch <= -8)
-			fc->forget_batch = 16;
+			if (fc->forget_batch <= -8)
+				fc->forget_batch = 16;
+		}
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	if (list_empty(pending)) {
+		/* The default channel's work went to another reader */
+		if (dflt)
+			fuse_read_unlock(fc, chan);
+		else
+			spin_unlock(&chan->lock);
+		goto restart;
+	}
+
+	req = list_entry(pending->next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	rchan = req->chan;
+	list_move(&req->list, &rchan->io);
+	if (dflt)
+		fuse_read_unlock(fc, chan);
+	else
+		spin_unlock(&chan->lock);
 
 	in = &req->in;
 	reqsize = in->h.len;
 	/* If request is too large, reply with an error and restart the read */
 	if (nbytes < reqsize) {
+		spin_lock(&rchan->lock);
 		req->out.h.error = -EIO;
 		/* SETXATTR is special, since it may contain too large data */
 		if (in->h.opcode == FUSE_SETXATTR)
@@ -1155,14 +1453,13 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 		goto restart;
 	}
-	spin_unlock(&fc->lock);
 	cs->req = req;
 	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
 		err = fuse_copy_args(cs, in->numargs, in->argpages,
 				     (struct fuse_arg *) in->args, 0);
 	fuse_copy_finish(cs);
-	spin_lock(&fc->lock);
+	spin_lock(&rchan->lock);
 	req->locked = 0;
 	if (req->aborted) {
 		request_end(fc, req);
@@ -1177,15 +1474,15 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		list_move_tail(&req->list, &rchan->processing);
 		if (req->interrupted)
 			queue_interrupt(fc, req);
-		spin_unlock(&fc->lock);
+		spin_unlock(&rchan->lock);
 	}
 	return reqsize;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&chan->lock);
 	return err;
 }
 
@@ -1194,13 +1491,13 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 {
 	struct fuse_copy_state cs;
 	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 1, iov, nr_segs);
+	fuse_copy_init(&cs, fud->fc, 1, iov, nr_segs);
 
-	return fuse_dev_do_read(fc, file, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_read(fud, file, &cs, iov_length(iov, nr_segs));
 }
 
 static int fuse_dev_pipe_buf_steal(struct pipe_inode_info *pipe,
@@ -1228,18 +1525,18 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	int do_wakeup = 0;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(in);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(in);
+	if (!fud)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
 	if (!bufs)
 		return -ENOMEM;
 
-	fuse_copy_init(&cs, fc, 1, NULL, 0);
+	fuse_copy_init(&cs, fud->fc, 1, NULL, 0);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fc, in, &cs, len);
+	ret = fuse_dev_do_read(fud, in, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -1606,17 +1903,60 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 	}
 }
 
-/* Look up request on processing list by unique ID */
-static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
+/*
+ * Look up request on the processing list of a channel by unique ID.
+ * If found, it is returned with chan->lock held.
+ */
+static struct fuse_req *chan_request_find(struct fuse_chan *chan, u64 unique)
 {
 	struct list_head *entry;
 
-	list_for_each(entry, &fc->processing) {
+	spin_lock(&chan->lock);
+	list_for_each(entry, &chan->processing) {
 		struct fuse_req *req;
 		req = list_entry(entry, struct fuse_req, list);
 		if (req->in.h.unique == unique || req->intr_unique == unique)
 			return req;
 	}
+	spin_unlock(&chan->lock);
+	return NULL;
+}
+
+/*
+ * Replies normally arrive on the channel the request was read from.
+ * Interrupt replies, and requests a per-CPU reader took over from the
+ * default channel, may be found elsewhere.
+ *
+ * The request is returned with req->chan->lock held.
+ */
+static struct fuse_req *request_find(struct fuse_conn *fc,
+				     struct fuse_chan *chan, u64 unique)
+{
+	struct fuse_req *req;
+	unsigned cpu;
+
+	if (chan) {
+		req = chan_request_find(chan, unique);
+		if (req)
+			return req;
+	}
+
+	if (chan != &fc->chan) {
+		req = chan_request_find(&fc->chan, unique);
+		if (req)
+			return req;
+	}
+
+	if (!fc->cpu_chans)
+		return NULL;
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++) {
+		if (&fc->cpu_chans[cpu] == chan)
+			continue;
+		req = chan_request_find(&fc->cpu_chans[cpu], unique);
+		if (req)
+			return req;
+	}
 	return NULL;
 }
 
@@ -1650,10 +1990,12 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
  * it from the list and copy the rest of the buffer to the request.
  * The request is finished by calling request_end()
  */
-static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
+static ssize_t fuse_dev_do_write(struct fuse_dev *fud,
 				 struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_chan *chan;
 	struct fuse_req *req;
 	struct fuse_out_header oh;
 
@@ -1681,19 +2023,19 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	if (oh.error <= -1000 || oh.error > 0)
 		goto err_finish;
 
-	spin_lock(&fc->lock);
 	err = -ENOENT;
-	if (!fc->connected)
-		goto err_unlock;
-
-	req = request_find(fc, oh.unique);
+	req = request_find(fc, ACCESS_ONCE(fud->chan), oh.unique);
 	if (!req)
+		goto err_finish;
+
+	chan = req->chan;
+	if (!fc->connected)
 		goto err_unlock;
 
 	if (req->aborted) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&chan->lock);
 		fuse_copy_finish(cs);
-		spin_lock(&fc->lock);
+		spin_lock(&chan->lock);
 		request_end(fc, req);
 		return -ENOENT;
 	}
@@ -1703,29 +2045,34 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 		if (nbytes != sizeof(struct fuse_out_header))
 			goto err_unlock;
 
-		if (oh.error == -ENOSYS)
-			fc->no_interrupt = 1;
-		else if (oh.error == -EAGAIN)
+		if (oh.error == -EAGAIN)
 			queue_interrupt(fc, req);
+		spin_unlock(&chan->lock);
 
-		spin_unlock(&fc->lock);
+		if (oh.error == -ENOSYS) {
+			spin_lock(&fc->lock);
+			fc->no_interrupt = 1;
+			spin_unlock(&fc->lock);
+		}
 		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
 	req->state = FUSE_REQ_WRITING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &chan->io);
 	req->out.h = oh;
 	req->locked = 1;
 	cs->req = req;
 	if (!req->out.page_replace)
 		cs->move_pages = 0;
-	spin_unlock(&fc->lock);
+	spin_unlock(&chan->lock);
 
 	err = copy_out_args(cs, &req->out, nbytes);
+	if (!err)
+		fuse_passthrough_setup(fc, req);
 	fuse_copy_finish(cs);
 
-	spin_lock(&fc->lock);
+	spin_lock(&chan->lock);
 	req->locked = 0;
 	if (!err) {
 		if (req->aborted)
@@ -1737,7 +2084,7 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	return err ? err : nbytes;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&chan->lock);
  err_finish:
 	fuse_copy_finish(cs);
 	return err;
@@ -1747,13 +2094,13 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 			      unsigned long nr_segs, loff_t pos)
 {
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(iocb->ki_filp);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(iocb->ki_filp);
+	if (!fud)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 0, iov, nr_segs);
+	fuse_copy_init(&cs, fud->fc, 0, iov, nr_segs);
 
-	return fuse_dev_do_write(fc, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_write(fud, &cs, iov_length(iov, nr_segs));
 }
 
 static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
@@ -1764,12 +2111,12 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	unsigned idx;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc;
+	struct fuse_dev *fud;
 	size_t rem;
 	ssize_t ret;
 
-	fc = fuse_get_conn(out);
-	if (!fc)
+	fud = fuse_get_dev(out);
+	if (!fud)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
@@ -1816,14 +2163,14 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	}
 	pipe_unlock(pipe);
 
-	fuse_copy_init(&cs, fc, 0, NULL, nbuf);
+	fuse_copy_init(&cs, fud->fc, 0, NULL, nbuf);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
 
 	if (flags & SPLICE_F_MOVE)
 		cs.move_pages = 1;
 
-	ret = fuse_dev_do_write(fc, &cs, len);
+	ret = fuse_dev_do_write(fud, &cs, len);
 
 	for (idx = 0; idx < nbuf; idx++) {
 		struct pipe_buffer *buf = &bufs[idx];
@@ -1837,18 +2184,22 @@ out:
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_conn *fc;
+	struct fuse_chan *chan;
+	if (!fud)
 		return POLLERR;
 
-	poll_wait(file, &fc->waitq, wait);
+	fc = fud->fc;
+	chan = ACCESS_ONCE(fud->chan);
+	poll_wait(file, &chan->waitq, wait);
 
-	spin_lock(&fc->lock);
+	spin_lock(&chan->lock);
 	if (!fc->connected)
 		mask = POLLERR;
-	else if (request_pending(fc))
+	else if (request_pending(fc, chan))
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fc->lock);
+	spin_unlock(&chan->lock);
 
 	return mask;
 }
@@ -1856,18 +2207,19 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 /*
  * Abort all requests on the given list (pending or processing)
  *
- * This function releases and reacquires fc->lock
+ * This function releases and reacquires chan->lock
  */
-static void end_requests(struct fuse_conn *fc, struct list_head *head)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_requests(struct fuse_conn *fc, struct fuse_chan *chan,
+			 struct list_head *head)
+__releases(chan->lock)
+__acquires(chan->lock)
 {
 	while (!list_empty(head)) {
 		struct fuse_req *req;
 		req = list_entry(head->next, struct fuse_req, list);
 		req->out.h.error = -ECONNABORTED;
 		request_end(fc, req);
-		spin_lock(&fc->lock);
+		spin_lock(&chan->lock);
 	}
 }
 
@@ -1882,13 +2234,13 @@ __acquires(fc->lock)
  * called after waiting for the request to be unlocked (if it was
  * locked).
  */
-static void end_io_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_io_requests(struct fuse_conn *fc, struct fuse_chan *chan)
+__releases(chan->lock)
+__acquires(chan->lock)
 {
-	while (!list_empty(&fc->io)) {
+	while (!list_empty(&chan->io)) {
 		struct fuse_req *req =
-			list_entry(fc->io.next, struct fuse_req, list);
+			list_entry(chan->io.next, struct fuse_req, list);
 		void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 
 		req->aborted = 1;
@@ -1899,25 +2251,50 @@ __acquires(fc->lock)
 		if (end) {
 			req->end = NULL;
 			__fuse_get_request(req);
-			spin_unlock(&fc->lock);
+			spin_unlock(&chan->lock);
 			wait_event(req->waitq, !req->locked);
 			end(fc, req);
 			fuse_put_request(fc, req);
-			spin_lock(&fc->lock);
+			spin_lock(&chan->lock);
 		}
 	}
 }
 
-static void end_queued_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+/*
+ * End the requests of a channel.  Requests under I/O must be aborted
+ * first, see fuse_abort_conn().
+ */
+static void end_chan_requests(struct fuse_conn *fc, struct fuse_chan *chan,
+			      bool io)
+{
+	spin_lock(&chan->lock);
+	if (io)
+		end_io_requests(fc, chan);
+	end_requests(fc, chan, &chan->pending);
+	end_requests(fc, chan, &chan->processing);
+	spin_unlock(&chan->lock);
+}
+
+/* Called after fc->connected has been cleared */
+static void end_queued_requests(struct fuse_conn *fc, bool io)
 {
+	unsigned cpu;
+
+	spin_lock(&fc->lock);
 	fc->max_background = UINT_MAX;
 	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
-	end_requests(fc, &fc->processing);
+	spin_unlock(&fc->lock);
+
+	end_chan_requests(fc, &fc->chan, io);
+	if (fc->cpu_chans) {
+		for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+			end_chan_requests(fc, &fc->cpu_chans[cpu], io);
+	}
+
+	spin_lock(&fc->chan.lock);
 	while (forget_pending(fc))
 		kfree(dequeue_forget(fc, 1, NULL));
+	spin_unlock(&fc->chan.lock);
 }
 
 static void end_polls(struct fuse_conn *fc)
@@ -1949,6 +2326,8 @@ static void end_polls(struct fuse_conn *fc)
  * During the aborting, progression of requests from the pending and
  * processing lists onto the io list, and progression of new requests
  * onto the pending list is prevented by req->connected being false.
+ * Readers and writers check it under the channel's lock, which the
+ * abort takes after clearing it.
  *
  * Progression of requests under I/O to the processing list is
  * prevented by the req->aborted flag being true for these requests.
@@ -1960,10 +2339,11 @@ void fuse_abort_conn(struct fuse_conn *fc)
 	if (fc->connected) {
 		fc->connected = 0;
 		fc->blocked = 0;
-		end_io_requests(fc);
-		end_queued_requests(fc);
+		spin_unlock(&fc->lock);
+		end_queued_requests(fc, true);
+		spin_lock(&fc->lock);
 		end_polls(fc);
-		wake_up_all(&fc->waitq);
+		fuse_chan_wake_all(fc);
 		wake_up_all(&fc->blocked_waitq);
 		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 	}
@@ -1973,16 +2353,28 @@ EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (fud) {
+		struct fuse_conn *fc = fud->fc;
+		bool last;
+
 		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->blocked_waitq);
+		/* The connection goes away with its last device */
+		last = fuse_dev_detach(fc, fud);
+		if (last) {
+			fc->connected = 0;
+			fc->blocked = 0;
+		}
 		spin_unlock(&fc->lock);
+		if (last) {
+			end_queued_requests(fc, false);
+			spin_lock(&fc->lock);
+			end_polls(fc);
+			wake_up_all(&fc->blocked_waitq);
+			spin_unlock(&fc->lock);
+		}
 		fuse_conn_put(fc);
+		kfree(fud);
 	}
 
 	return 0;
@@ -1991,12 +2383,112 @@ EXPORT_SYMBOL_GPL(fuse_dev_release);
 
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
 		return -EPERM;
 
 	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fc->fasync);
+	return fasync_helper(fd, file, on, &fud->fc->fasync);
+}
+
+/*
+ * Attach a freshly opened fuse device to the connection of @oldfd
+ */
+static int fuse_dev_clone(struct file *file, unsigned oldfd)
+{
+	struct fuse_dev *fud;
+	struct file *old;
+	int err = -EINVAL;
+
+	old = fget(oldfd);
+	if (!old)
+		return -EINVAL;
+
+	mutex_lock(&fuse_mutex);
+	/* CUSE channels can't be cloned, they have their own f_op */
+	if (old->f_op == &fuse_dev_operations && fuse_get_dev(old) &&
+	    !file->private_data) {
+		err = -ENOMEM;
+		fud = fuse_dev_alloc(fuse_get_dev(old)->fc);
+		if (fud) {
+			fud->clone = 1;
+			file->private_data = fud;
+			err = 0;
+		}
+	}
+	mutex_unlock(&fuse_mutex);
+	fput(old);
+
+	return err;
+}
+
+/*
+ * Bind a cloned device to the channel of @cpu, or back to the default
+ * channel if @cpu is FUSE_DEV_CPU_NONE.  The device opened for mounting
+ * always stays on the default channel, which also carries INTERRUPT and
+ * FORGET requests.
+ */
+static int fuse_dev_bind_cpu(struct fuse_dev *fud, unsigned cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_chan *chans = NULL;
+
+	if (!fud->clone)
+		return -EINVAL;
+
+	if (cpu != FUSE_DEV_CPU_NONE) {
+		if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+			return -EINVAL;
+
+		if (!fc->cpu_chans) {
+			chans = fuse_cpu_chans_alloc();
+			if (!chans)
+				return -ENOMEM;
+		}
+	}
+
+	spin_lock(&fc->lock);
+	if (cpu == FUSE_DEV_CPU_NONE) {
+		fuse_dev_set_chan(fc, fud, &fc->chan);
+	} else {
+		if (!fc->cpu_chans) {
+			fc->cpu_chans = chans;
+			chans = NULL;
+		}
+		fuse_dev_set_chan(fc, fud, &fc->cpu_chans[cpu]);
+	}
+	spin_unlock(&fc->lock);
+	kfree(chans);
+
+	return 0;
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct fuse_dev *fud;
+	__u32 val;
+
+	switch (cmd) {
+	case FUSE_DEV_IOC_CLONE:
+		if (get_user(val, (__u32 __user *) arg))
+			return -EFAULT;
+
+		return fuse_dev_clone(file, val);
+
+	case FUSE_DEV_IOC_BIND_CPU:
+		fud = fuse_get_dev(file);
+		if (!fud)
+			return -EPERM;
+
+		if (get_user(val, (__u32 __user *) arg))
+			return -EFAULT;
+
+		return fuse_dev_bind_cpu(fud, val);
+
+	default:
+		return -ENOTTY;
+	}
 }
 
 const struct file_operations fuse_dev_operations = {
@@ -2011,6 +2503,8 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+	.compat_ioctl	= fuse_dev_ioctl,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
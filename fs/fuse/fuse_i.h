@@ -32,6 +32,9 @@
 /** It could be as large as PATH_MAX, but would that have any uses? */
 #define FUSE_NAME_MAX 1024
 
+/** Magic number of the fuse superblock */
+#define FUSE_SUPER_MAGIC 0x65735546
+
 /** Number of dentries for each connection in the control filesystem */
 #define FUSE_CTL_NUM_DENTRIES 5
 
@@ -135,6 +138,9 @@ struct fuse_file {
 
 	/** Wait queue head for poll */
 	wait_queue_head_t poll_wait;
+
+	/** Lower file serving read/write/mmap in passthrough mode */
+	struct file *passthrough_filp;
 };
 
 /** One input argument of a request */
@@ -209,10 +215,11 @@ enum fuse_req_state {
  */
 struct fuse_req {
 	/** This can be on either pending processing or io lists in
-	    fuse_conn */
+	    fuse_chan */
 	struct list_head list;
 
-	/** Entry on the interrupts list  */
+	/** Entry on the interrupts list, protected by the default
+	    channel's lock  */
 	struct list_head intr_entry;
 
 	/** refcount */
@@ -307,6 +314,66 @@ struct fuse_req {
 
 	/** Request is stolen from fuse_file->reserved_req */
 	struct file *stolen_file;
+
+	/** Channel the request was queued on.  Its lock protects the
+	    list entry, state, interrupted, aborted and locked */
+	struct fuse_chan *chan;
+
+	/** Lower file taken from an OPEN or CREATE reply (or NULL) */
+	struct file *passthrough_filp;
+};
+
+/**
+ * A queue of requests for the userspace filesystem.
+ *
+ * Each connection has a default channel, and optionally one channel
+ * per CPU, which requests submitted on that CPU are routed to while a
+ * device is bound to it.
+ *
+ * The lists are protected by the channel's own lock, so readers and
+ * writers of different channels don't contend.  The lock of the default
+ * channel also protects the interrupt and forget queues of fuse_conn.
+ * Locks nest fuse_conn->lock, then a per-CPU channel's, then the
+ * default channel's.  num_devs and fuse_dev->chan change with
+ * fuse_conn->lock, the default channel's lock and the lock of the
+ * channel the device leaves held.
+ */
+struct fuse_chan {
+	/** Lock protecting the lists */
+	spinlock_t lock;
+
+	/** Readers of the channel are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** The list of requests being processed */
+	struct list_head processing;
+
+	/** The list of requests under I/O */
+	struct list_head io;
+
+	/** Number of devices reading from this channel */
+	unsigned num_devs;
+};
+
+/**
+ * An open instance of the fuse device, stored in file->private_data.
+ *
+ * The device opened for mounting is always on the default channel.
+ * Further instances may be attached to the same connection with the
+ * FUSE_DEV_IOC_CLONE ioctl and then bound to a per-CPU channel.
+ */
+struct fuse_dev {
+	/** Fuse connection for this device */
+	struct fuse_conn *fc;
+
+	/** Channel requests are read from */
+	struct fuse_chan *chan;
+
+	/** Attached with FUSE_DEV_IOC_CLONE */
+	unsigned clone:1;
 };
 
 /**
@@ -341,17 +408,14 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
-	wait_queue_head_t waitq;
-
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Default request channel */
+	struct fuse_chan chan;
 
-	/** The list of requests being processed */
-	struct list_head processing;
+	/** Per-CPU request channels, allocated on first CPU binding */
+	struct fuse_chan *cpu_chans;
 
-	/** The list of requests under I/O */
-	struct list_head io;
+	/** Number of open devices attached to the connection */
+	unsigned num_devs;
 
 	/** The next unique kernel file handle */
 	u64 khctr;
@@ -374,10 +438,10 @@ struct fuse_conn {
 	/** The list of background requests set aside for later queuing */
 	struct list_head bg_queue;
 
-	/** Pending interrupts */
+	/** Pending interrupts, protected by chan.lock */
 	struct list_head interrupts;
 
-	/** Queue of pending forgets */
+	/** Queue of pending forgets, protected by chan.lock */
 	struct fuse_forget_link forget_list_head;
 	struct fuse_forget_link *forget_list_tail;
 
@@ -396,7 +460,7 @@ struct fuse_conn {
 	wait_queue_head_t reserved_req_waitq;
 
 	/** The next unique request id */
-	u64 reqctr;
+	atomic64_t reqctr;
 
 	/** Connection established, cleared on umount, connection
 	    abort and device release */
@@ -472,6 +536,9 @@ struct fuse_conn {
 	/** Don't apply umask to creation modes */
 	unsigned dont_mask:1;
 
+	/** Filesystem may hand back lower files on open.  Only set in INIT */
+	unsigned passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -577,6 +644,7 @@ int fuse_open_common(struct inode *inode, struct file *file, bool isdir);
 struct fuse_file *fuse_file_alloc(struct fuse_conn *fc);
 struct fuse_file *fuse_file_get(struct fuse_file *ff);
 void fuse_file_free(struct fuse_file *ff);
+void fuse_passthrough_attach(struct fuse_file *ff, struct fuse_req *req);
 void fuse_finish_open(struct inode *inode, struct file *file);
 
 void fuse_sync_release(struct fuse_file *ff, int flags);
@@ -761,6 +829,67 @@ long fuse_do_ioctl(struct file *file, unsigned int cmd, unsigned long arg,
 unsigned fuse_file_poll(struct file *file, poll_table *wait);
 int fuse_dev_release(struct inode *inode, struct file *file);
 
+/**
+ * Allocate a device instance attached to the default channel
+ */
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
+
+/**
+ * Detach and free a device instance that was never opened
+ */
+void fuse_dev_free(struct fuse_dev *fud);
+
+/**
+ * Initialize a request channel
+ */
+void fuse_chan_init(struct fuse_chan *chan);
+
+/**
+ * Wake up readers on all channels of the connection
+ */
+void fuse_chan_wake_all(struct fuse_conn *fc);
+
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
+#ifdef CONFIG_FUSE_PASSTHROUGH
+/**
+ * Take the lower file named in an OPEN or CREATE reply.  Called in
+ * the context of the filesystem daemon writing the reply.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req);
+
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos);
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+#else
+static inline void fuse_passthrough_setup(struct fuse_conn *fc,
+					  struct fuse_req *req)
+{
+}
+
+static inline ssize_t fuse_passthrough_aio_read(struct kiocb *iocb,
+						const struct iovec *iov,
+						unsigned long nr_segs,
+						loff_t pos)
+{
+	return -EIO;
+}
+
+static inline ssize_t fuse_passthrough_aio_write(struct kiocb *iocb,
+						 const struct iovec *iov,
+						 unsigned long nr_segs,
+						 loff_t pos)
+{
+	return -EIO;
+}
+
+static inline int fuse_passthrough_mmap(struct file *file,
+					struct vm_area_struct *vma)
+{
+	return -ENODEV;
+}
+#endif
+
 #endif /* _FS_FUSE_I_H */
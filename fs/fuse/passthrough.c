@@ -0,0 +1,184 @@
+/*
+  FUSE: Filesystem in Userspace
+  Copyright (C) 2001-2008  Miklos Szeredi <miklos@szeredi.hu>
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+/*
+ * Passthrough mode: a daemon that merely proxies a file to a lower
+ * filesystem can return the lower file descriptor in its OPEN or CREATE
+ * reply.  Reads, writes and mmaps of the resulting FUSE file are then
+ * served directly by the lower file, without a round trip through
+ * /dev/fuse.  Permission checks remain the daemon's business at open
+ * time; the lower I/O runs with the credentials the lower file was
+ * opened with.
+ */
+
+#include "fuse_i.h"
+
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/aio.h>
+#include <linux/uio.h>
+#include <linux/cred.h>
+#include <linux/fsnotify.h>
+
+static bool fuse_passthrough_lower_ok(struct file *lower)
+{
+	struct inode *inode = lower->f_path.dentry->d_inode;
+
+	if (!S_ISREG(inode->i_mode))
+		return false;
+
+	if (!lower->f_op)
+		return false;
+	if ((lower->f_mode & FMODE_READ) && !lower->f_op->aio_read)
+		return false;
+	if ((lower->f_mode & FMODE_WRITE) && !lower->f_op->aio_write)
+		return false;
+
+	/* Don't let passthrough files stack on top of each other */
+	if (inode->i_sb->s_magic == FUSE_SUPER_MAGIC)
+		return false;
+
+	return true;
+}
+
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_open_out *outarg;
+	struct fuse_arg *arg;
+	struct file *lower;
+
+	if (!fc->passthrough || req->out.h.error)
+		return;
+
+	if (req->in.h.opcode != FUSE_OPEN && req->in.h.opcode != FUSE_CREATE)
+		return;
+
+	/* fuse_open_out is the last output argument of OPEN and CREATE */
+	arg = &req->out.args[req->out.numargs - 1];
+	if (arg->size != sizeof(*outarg))
+		return;
+
+	outarg = arg->value;
+	if (!(outarg->open_flags & FOPEN_PASSTHROUGH))
+		return;
+
+	/*
+	 * On any failure fall back to regular FUSE I/O, the filesystem is
+	 * still able to serve READ and WRITE requests itself.
+	 */
+	outarg->open_flags &= ~FOPEN_PASSTHROUGH;
+
+	lower = fget(outarg->passthrough_fd);
+	if (!lower)
+		return;
+
+	if (!fuse_passthrough_lower_ok(lower)) {
+		fput(lower);
+		return;
+	}
+
+	outarg->open_flags |= FOPEN_PASSTHROUGH;
+	req->passthrough_filp = lower;
+}
+
+static ssize_t fuse_passthrough_rw(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos, int write)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct file *lower = ff->passthrough_filp;
+	const struct cred *old_cred;
+	struct kiocb lower_iocb;
+	ssize_t ret;
+
+	if (!(lower->f_mode & (write ? FMODE_WRITE : FMODE_READ)))
+		return -EBADF;
+
+	/*
+	 * The FUSE file may have been opened (or fcntl'd) O_APPEND while
+	 * the lower one was not.  Position the write at the lower end of
+	 * file in that case, the lower write path does the rest.
+	 */
+	if (write && (file->f_flags & O_APPEND) && !(lower->f_flags & O_APPEND))
+		pos = i_size_read(lower->f_mapping->host);
+
+	init_sync_kiocb(&lower_iocb, lower);
+	lower_iocb.ki_pos = pos;
+	lower_iocb.ki_left = iov_length(iov, nr_segs);
+	lower_iocb.ki_nbytes = lower_iocb.ki_left;
+
+	old_cred = override_creds(lower->f_cred);
+	if (write)
+		ret = lower->f_op->aio_write(&lower_iocb, iov, nr_segs, pos);
+	else
+		ret = lower->f_op->aio_read(&lower_iocb, iov, nr_segs, pos);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&lower_iocb);
+	revert_creds(old_cred);
+
+	if (ret > 0) {
+		iocb->ki_pos = lower_iocb.ki_pos;
+		if (write)
+			fsnotify_modify(lower);
+		else
+			fsnotify_access(lower);
+	}
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos)
+{
+	return fuse_passthrough_rw(iocb, iov, nr_segs, pos, 0);
+}
+
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos)
+{
+	return fuse_passthrough_rw(iocb, iov, nr_segs, pos, 1);
+}
+
+/*
+ * Map the lower file instead of the FUSE one, so that page faults are
+ * resolved against the lower page cache.  The vma takes over the
+ * reference on the lower file and drops the one mmap_region() took on
+ * the FUSE file.
+ */
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *lower = ff->passthrough_filp;
+	const struct cred *old_cred;
+	int err;
+
+	if (!lower->f_op->mmap)
+		return -ENODEV;
+
+	if ((vma->vm_flags & VM_SHARED) && (vma->vm_flags & VM_MAYWRITE) &&
+	    !(lower->f_mode & FMODE_WRITE))
+		return -EACCES;
+
+	vma->vm_file = lower;
+	get_file(lower);
+
+	old_cred = override_creds(lower->f_cred);
+	err = lower->f_op->mmap(lower, vma);
+	revert_creds(old_cred);
+
+	if (err) {
+		vma->vm_file = file;
+		fput(lower);
+		return err;
+	}
+
+	file_accessed(file);
+	fput(file);
+
+	return 0;
+}
@@ -12,6 +12,8 @@
 #include <linux/swap.h>
 #include <linux/swapops.h>
 
+#include <trace/events/vmscan.h>
+
 #include <asm/elf.h>
 #include <asm/uaccess.h>
 #include <asm/tlbflush.h>
@@ -593,6 +595,145 @@ const struct file_operations proc_clear_refs_operations = {
 	.llseek		= noop_llseek,
 };
 
+#ifdef CONFIG_PROCESS_RECLAIM
+#define RECLAIM_FILE 1
+#define RECLAIM_ANON 2
+#define RECLAIM_ALL 3
+
+struct reclaim_walk {
+	struct vm_area_struct *vma;
+	int type;
+	unsigned long nr_scanned;
+	unsigned long nr_reclaimed;
+};
+
+static int reclaim_pte_range(pmd_t *pmd, unsigned long addr,
+				unsigned long end, struct mm_walk *walk)
+{
+	struct reclaim_walk *rw = walk->private;
+	struct vm_area_struct *vma = rw->vma;
+	LIST_HEAD(page_list);
+	pte_t *pte, ptent;
+	spinlock_t *ptl;
+	struct page *page;
+
+	split_huge_page_pmd(walk->mm, pmd);
+
+	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+		if (!pte_present(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page)
+			continue;
+
+		if (rw->type == RECLAIM_ANON && !PageAnon(page))
+			continue;
+		if (rw->type == RECLAIM_FILE && PageAnon(page))
+			continue;
+
+		/* Leave pages shared with other processes to global reclaim */
+		if (page_mapcount(page) != 1)
+			continue;
+
+		if (isolate_lru_page(page))
+			continue;
+
+		if (PageUnevictable(page)) {
+			putback_lru_page(page);
+			continue;
+		}
+
+		list_add(&page->lru, &page_list);
+		rw->nr_scanned++;
+	}
+	pte_unmap_unlock(pte - 1, ptl);
+
+	/* Reclaim in batches of one page table, with no locks held */
+	if (!list_empty(&page_list))
+		rw->nr_reclaimed += reclaim_pages_from_list(&page_list);
+	cond_resched();
+	return 0;
+}
+
+static ssize_t reclaim_write(struct file *file, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct task_struct *task;
+	char buffer[PROC_NUMBUF];
+	char *type_buf;
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	int type;
+
+	memset(buffer, 0, sizeof(buffer));
+	if (count > sizeof(buffer) - 1)
+		count = sizeof(buffer) - 1;
+	if (copy_from_user(buffer, buf, count))
+		return -EFAULT;
+
+	type_buf = strstrip(buffer);
+	if (!strcmp(type_buf, "file"))
+		type = RECLAIM_FILE;
+	else if (!strcmp(type_buf, "anon"))
+		type = RECLAIM_ANON;
+	else if (!strcmp(type_buf, "all"))
+		type = RECLAIM_ALL;
+	else
+		return -EINVAL;
+
+	task = get_proc_task(file->f_path.dentry->d_inode);
+	if (!task)
+		return -ESRCH;
+	mm = get_task_mm(task);
+	if (mm) {
+		struct reclaim_walk rw = {
+			.type = type,
+		};
+		struct mm_walk reclaim_walk = {
+			.pmd_entry = reclaim_pte_range,
+			.mm = mm,
+			.private = &rw,
+		};
+
+		trace_mm_vmscan_process_reclaim_begin(task_pid_nr(task), type);
+		down_read(&mm->mmap_sem);
+		for (vma = mm->mmap; vma; vma = vma->vm_next) {
+			if (is_vm_hugetlb_page(vma))
+				continue;
+			/* Mlocked pages are unevictable anyway */
+			if (vma->vm_flags & VM_LOCKED)
+				continue;
+			/* No anon_vma, no anonymous pages */
+			if (type == RECLAIM_ANON && !vma->anon_vma)
+				continue;
+			if (type == RECLAIM_FILE && !vma->vm_file)
+				continue;
+
+			rw.vma = vma;
+			walk_page_range(vma->vm_start, vma->vm_end,
+					&reclaim_walk);
+			if (fatal_signal_pending(current))
+				break;
+		}
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+		trace_mm_vmscan_process_reclaim_end(task_pid_nr(task),
+						rw.nr_scanned, rw.nr_reclaimed);
+	}
+	put_task_struct(task);
+
+	return count;
+}
+
+const struct file_operations proc_reclaim_operations = {
+	.write		= reclaim_write,
+	.llseek		= noop_llseek,
+};
+#endif /* CONFIG_PROCESS_RECLAIM */
+
 struct pagemapread {
 	int pos, len;
 	u64 *buffer;
@@ -0,0 +1,169 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * Copyright (c) 2002, 2003, 2004, 2005, 2006, 2007, 2008
+ * Phillip Lougher <phillip@squashfs.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * file_direct.c
+ */
+
+#include <linux/fs.h>
+#include <linux/vfs.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/vmalloc.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs_fs_i.h"
+#include "squashfs.h"
+
+/*
+ * Decompress a datablock straight into the page cache pages it covers,
+ * rather than into the "data" cache followed by a copy into each page.
+ *
+ * The neighbouring pages are grabbed opportunistically.  Pages that can't
+ * be grabbed without blocking, are already up to date, or lie beyond the
+ * end of file are replaced by a single scratch "sink" page, which the
+ * decompressor overwrites and which is then thrown away.
+ *
+ * The decompressors take an array of PAGE_CACHE_SIZE buffers.  Lowmem
+ * pages are used through their kernel address, highmem pages are vmapped
+ * for the duration of the decompression.
+ */
+
+/* Read separately compressed datablock directly into page cache */
+int squashfs_readpage_block(struct page *target_page, u64 block, int bsize)
+{
+	struct inode *inode = target_page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int file_end = (i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT;
+	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	int start_index = target_page->index & ~mask;
+	int pages = mask + 1;
+	int i, n, bytes, highmem = 0, res = -ENOMEM;
+	struct page **page, *sink = NULL;
+	void **buffer = NULL, *vaddr = NULL;
+
+	page = kcalloc(pages, sizeof(*page), GFP_KERNEL);
+	if (page == NULL)
+		goto out;
+
+	buffer = kcalloc(pages, sizeof(*buffer), GFP_KERNEL);
+	if (buffer == NULL)
+		goto out;
+
+	/* Try to grab all the pages covered by the datablock */
+	for (i = 0, n = start_index; i < pages; i++, n++) {
+		if (n == target_page->index) {
+			page[i] = target_page;
+			continue;
+		}
+
+		if (n > file_end)
+			continue;
+
+		page[i] = grab_cache_page_nowait(target_page->mapping, n);
+		if (page[i] && PageUptodate(page[i])) {
+			unlock_page(page[i]);
+			page_cache_release(page[i]);
+			page[i] = NULL;
+		}
+	}
+
+	for (i = 0; i < pages; i++) {
+		if (page[i] == NULL) {
+			if (sink == NULL) {
+				sink = alloc_page(GFP_KERNEL);
+				if (sink == NULL)
+					goto release_pages;
+			}
+			page[i] = sink;
+		}
+		if (PageHighMem(page[i]))
+			highmem = 1;
+	}
+
+	if (highmem) {
+		vaddr = vmap(page, pages, VM_MAP, PAGE_KERNEL);
+		if (vaddr == NULL)
+			goto release_pages;
+		for (i = 0; i < pages; i++)
+			buffer[i] = vaddr + i * PAGE_CACHE_SIZE;
+	} else
+		for (i = 0; i < pages; i++)
+			buffer[i] = page_address(page[i]);
+
+	res = squashfs_read_data(inode->i_sb, buffer, block, bsize, NULL,
+		msblk->block_size, pages);
+
+	if (vaddr) {
+		flush_kernel_vmap_range(vaddr, pages * PAGE_CACHE_SIZE);
+		vunmap(vaddr);
+	}
+
+	if (res < 0) {
+		ERROR("Unable to read page, block %llx, size %x\n", block,
+			bsize);
+		goto release_pages;
+	}
+
+	/* Zero the tail of the last page, and mark the pages up to date */
+	for (bytes = res, i = 0; i < pages; i++, bytes -= PAGE_CACHE_SIZE) {
+		if (page[i] == sink)
+			continue;
+
+		if (bytes < (int) PAGE_CACHE_SIZE) {
+			int avail = max(bytes, 0);
+			void *pageaddr = kmap_atomic(page[i], KM_USER0);
+
+			memset(pageaddr + avail, 0, PAGE_CACHE_SIZE - avail);
+			kunmap_atomic(pageaddr, KM_USER0);
+		}
+		flush_dcache_page(page[i]);
+		SetPageUptodate(page[i]);
+		unlock_page(page[i]);
+		if (page[i] != target_page)
+			page_cache_release(page[i]);
+	}
+
+	res = 0;
+	goto out;
+
+release_pages:
+	/*
+	 * The neighbouring pages are left !PageUptodate for a later read to
+	 * retry, the target page is handled by the caller.
+	 */
+	for (i = 0; i < pages; i++) {
+		if (page[i] == NULL || page[i] == sink ||
+				page[i] == target_page)
+			continue;
+		unlock_page(page[i]);
+		page_cache_release(page[i]);
+	}
+
+out:
+	if (sink)
+		__free_page(sink);
+	kfree(buffer);
+	kfree(page);
+	return res;
+}
@@ -13,6 +13,7 @@
 
 #include "yaffs_checkptrw.h"
 #include "yaffs_getblockinfo.h"
+#include "yaffs_rdcache.h"
 
 static int yaffs2_checkpt_space_ok(struct yaffs_dev *dev)
 {
@@ -41,6 +42,7 @@ static int yaffs_checkpt_erase(struct yaffs_dev *dev)
 			"erasing checkpt block %d", i);
 
 			dev->n_erasures++;
+			yaffs_rd_cache_invalidate_block(dev, i);
 
 			if (dev->param.
 			    erase_fn(dev,
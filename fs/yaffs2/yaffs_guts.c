@@ -26,6 +26,7 @@
 #include "yaffs_yaffs2.h"
 #include "yaffs_bitmap.h"
 #include "yaffs_verify.h"
+#include "yaffs_rdcache.h"
 
 #include "yaffs_nand.h"
 #include "yaffs_packedtags2.h"
@@ -1096,6 +1097,8 @@ int yaffs_put_chunk_in_file(struct yaffs_obj *in, int inode_chunk,
 		return YAFFS_OK;
 	}
 
+	in->data_version++;
+
 	tn = yaffs_add_find_tnode_0(dev,
 				    &in->variant.file_variant,
 				    inode_chunk, NULL);
@@ -2991,24 +2994,206 @@ int yaffs_bg_gc(struct yaffs_dev *dev, unsigned urgency)
 
 /*-------------------- Data file manipulation -----------------*/
 
-static int yaffs_rd_data_obj(struct yaffs_obj *in, int inode_chunk, u8 * buffer)
+/* How many of the chunks following inode_chunk can be read in one batch.
+ * They must be in the pages following nand_chunk in the same block, and
+ * not be cached already.
+ */
+static int yaffs_rd_ahead_run(struct yaffs_obj *in, int inode_chunk,
+			      int nand_chunk, int max_chunks)
+{
+	struct yaffs_dev *dev = in->my_dev;
+	int n;
+	int next;
+
+	for (n = 1; n < max_chunks; n++) {
+		next = nand_chunk + n;
+		if (next % dev->param.chunks_per_block == 0)
+			break;
+		if (yaffs_find_chunk_in_file(in, inode_chunk + n, NULL) != next)
+			break;
+		if (yaffs_rd_cache_find(dev, next))
+			break;
+	}
+	return n;
+}
+
+/* Read chunk data of an object with the OS lock dropped, if the OS lets us.
+ * A NAND page does not change until its block is erased, but meanwhile the
+ * file may be written or truncated, or gc may move its chunks. So what was
+ * read is only good if, with the lock taken again, the object data did not
+ * change and the chunks are still where they were looked up. If not, fail
+ * and let the caller look the chunks up again with the lock held throughout.
+ * Anything the read goes into must be private to the caller.
+ */
+static int yaffs_rd_chunks_unlocked(struct yaffs_obj *in, int inode_chunk,
+				    int nand_chunk, int n_chunks, u8 * buffer)
+{
+	struct yaffs_dev *dev = in->my_dev;
+	u32 erasures = dev->n_erasures;
+	u32 version = in->data_version;
+	int result;
+	int i;
+
+	if (!dev->param.unlock_fn || !dev->param.read_chunks_fn ||
+	    dev->param.inband_tags ||
+	    dev->data_bytes_per_chunk != dev->param.total_bytes_per_chunk)
+		return YAFFS_FAIL;
+
+	dev->param.unlock_fn(dev);
+	result = dev->param.read_chunks_fn(dev, nand_chunk - dev->chunk_offset,
+					   n_chunks, buffer);
+	dev->param.lock_fn(dev);
+
+	if (result != YAFFS_OK || dev->n_erasures != erasures ||
+	    in->data_version != version)
+		return YAFFS_FAIL;
+
+	for (i = 0; i < n_chunks; i++)
+		if (yaffs_find_chunk_in_file(in, inode_chunk + i, NULL) !=
+		    nand_chunk + i)
+			return YAFFS_FAIL;
+
+	dev->n_page_reads += n_chunks;
+	dev->n_unlocked_reads += n_chunks;
+	return YAFFS_OK;
+}
+
+static int yaffs_rd_data_obj_worker(struct yaffs_obj *in, int inode_chunk,
+				    u8 * buffer, int may_unlock);
+
+/* Read a data chunk through the read cache.
+ * Misses that continue a sequential read of the object grow a read-ahead
+ * window, like the VFS does for pages: the chunks that follow are read
+ * from NAND in the same batch and put in the cache for the next reads.
+ */
+static int yaffs_rd_data_cached(struct yaffs_obj *in, int inode_chunk,
+				int nand_chunk, u8 * buffer, int may_unlock)
 {
+	struct yaffs_dev *dev = in->my_dev;
+	struct yaffs_rd_cache *rc = dev->rd_cache;
+	u8 *batch = rc->batch_buffer;
+	int sequential;
+	int n_chunks;
+	int result;
+	int i;
+	u8 *data;
+
+	sequential = (dev->rd_ahead_obj == in &&
+		      dev->rd_ahead_chunk + 1 == inode_chunk);
+	dev->rd_ahead_obj = in;
+	dev->rd_ahead_chunk = inode_chunk;
+
+	data = yaffs_rd_cache_find(dev, nand_chunk);
+	if (data) {
+		dev->rd_cache_hits++;
+		memcpy(buffer, data, dev->data_bytes_per_chunk);
+		return YAFFS_OK;
+	}
+	dev->rd_cache_misses++;
+
+	if (!sequential || dev->rd_ahead_win < 1)
+		dev->rd_ahead_win = 1;
+	else if (dev->rd_ahead_win < dev->param.max_read_ahead)
+		dev->rd_ahead_win *= 2;
+	if (dev->rd_ahead_win > dev->param.max_read_ahead)
+		dev->rd_ahead_win = dev->param.max_read_ahead;
+
+	/* Only one batch at a time can use the batch buffer */
+	n_chunks = 1;
+	if (batch && !rc->batch_busy && dev->rd_ahead_win > 1)
+		n_chunks = yaffs_rd_ahead_run(in, inode_chunk, nand_chunk,
+					      dev->rd_ahead_win);
+
+	if (n_chunks > 1) {
+		rc->batch_busy = 1;
+		result = YAFFS_FAIL;
+		if (may_unlock)
+			result = yaffs_rd_chunks_unlocked(in, inode_chunk,
+							  nand_chunk, n_chunks,
+							  batch);
+		if (result != YAFFS_OK && may_unlock) {
+			/* The chunks may have moved while we were unlocked */
+			rc->batch_busy = 0;
+			return yaffs_rd_data_obj_worker(in, inode_chunk,
+							buffer, 0);
+		}
+		if (result != YAFFS_OK)
+			result = yaffs_rd_chunks_nand(dev, nand_chunk,
+						      n_chunks, batch);
+		rc->batch_busy = 0;
+
+		if (result == YAFFS_OK) {
+			yaffs_trace(YAFFS_TRACE_NANDACCESS,
+				"read-ahead obj %d chunk %d nand %d n %d",
+				in->obj_id, inode_chunk, nand_chunk, n_chunks);
+			dev->n_rd_ahead_batches++;
+			dev->n_rd_ahead_chunks += n_chunks - 1;
+
+			memcpy(buffer, batch, dev->data_bytes_per_chunk);
+			for (i = 0; i < n_chunks; i++) {
+				/* Another reader may have got there first */
+				if (yaffs_rd_cache_find(dev, nand_chunk + i))
+					continue;
+				memcpy(yaffs_rd_cache_add(dev, nand_chunk + i),
+				       batch + i * dev->data_bytes_per_chunk,
+				       dev->data_bytes_per_chunk);
+			}
+			return YAFFS_OK;
+		}
+	}
+
+	if (may_unlock) {
+		if (yaffs_rd_chunks_unlocked(in, inode_chunk, nand_chunk, 1,
+					     buffer) != YAFFS_OK)
+			return yaffs_rd_data_obj_worker(in, inode_chunk,
+							buffer, 0);
+		result = YAFFS_OK;
+	} else {
+		result = yaffs_rd_chunk_tags_nand(dev, nand_chunk, buffer,
+						  NULL);
+	}
+	if (result == YAFFS_OK && !yaffs_rd_cache_find(dev, nand_chunk))
+		memcpy(yaffs_rd_cache_add(dev, nand_chunk), buffer,
+		       dev->data_bytes_per_chunk);
+	return result;
+}
+
+/* Read a data chunk of an object. If may_unlock is set, buffer is private
+ * to the caller and the NAND reads may be done without the OS lock.
+ */
+static int yaffs_rd_data_obj_worker(struct yaffs_obj *in, int inode_chunk,
+				    u8 * buffer, int may_unlock)
+{
+	struct yaffs_dev *dev = in->my_dev;
 	int nand_chunk = yaffs_find_chunk_in_file(in, inode_chunk, NULL);
 
-	if (nand_chunk >= 0)
-		return yaffs_rd_chunk_tags_nand(in->my_dev, nand_chunk,
-						buffer, NULL);
+	if (nand_chunk >= 0 && dev->rd_cache)
+		return yaffs_rd_data_cached(in, inode_chunk, nand_chunk,
+					    buffer, may_unlock);
+	else if (nand_chunk >= 0 && may_unlock &&
+		 yaffs_rd_chunks_unlocked(in, inode_chunk, nand_chunk, 1,
+					  buffer) == YAFFS_OK)
+		return YAFFS_OK;
+	else if (nand_chunk >= 0 && may_unlock)
+		return yaffs_rd_data_obj_worker(in, inode_chunk, buffer, 0);
+	else if (nand_chunk >= 0)
+		return yaffs_rd_chunk_tags_nand(dev, nand_chunk, buffer, NULL);
 	else {
 		yaffs_trace(YAFFS_TRACE_NANDACCESS,
 			"Chunk %d not found zero instead",
 			nand_chunk);
 		/* get sane (zero) data if you read a hole */
-		memset(buffer, 0, in->my_dev->data_bytes_per_chunk);
+		memset(buffer, 0, dev->data_bytes_per_chunk);
 		return 0;
 	}
 
 }
 
+static int yaffs_rd_data_obj(struct yaffs_obj *in, int inode_chunk, u8 * buffer)
+{
+	return yaffs_rd_data_obj_worker(in, inode_chunk, buffer, 0);
+}
+
 void yaffs_chunk_del(struct yaffs_dev *dev, int chunk_id, int mark_flash,
 		     int lyn)
 {
@@ -3612,8 +3797,11 @@ int yaffs_file_rd(struct yaffs_obj *in, u8 * buffer, loff_t offset, int n_bytes)
 
 		} else {
 
-			/* A full chunk. Read directly into the supplied buffer. */
-			yaffs_rd_data_obj(in, chunk, buffer);
+			/* A full chunk. Read directly into the supplied buffer,
+			 * which is the caller's own, so the lock can be dropped
+			 * for the NAND access.
+			 */
+			yaffs_rd_data_obj_worker(in, chunk, buffer, 1);
 
 		}
 
@@ -3645,6 +3833,7 @@ int yaffs_do_file_wr(struct yaffs_obj *in, const u8 * buffer, loff_t offset,
 	struct yaffs_dev *dev;
 
 	dev = in->my_dev;
+	in->data_version++;
 
 	while (n > 0 && chunk_written >= 0) {
 		yaffs_addr_to_chunk(dev, offset, &chunk, &start);
@@ -3884,6 +4073,7 @@ int yaffs_resize_file(struct yaffs_obj *in, loff_t new_size)
 	struct yaffs_dev *dev = in->my_dev;
 	int old_size = in->variant.file_variant.file_size;
 
+	in->data_version++;
 	yaffs_flush_file_cache(in);
 	yaffs_invalidate_whole_cache(in);
 
@@ -4916,6 +5106,7 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	dev->passive_gc_count = 0;
 	dev->oldest_dirty_gc_count = 0;
 	dev->bg_gcs = 0;
+	dev->n_bg_checkpoints = 0;
 	dev->gc_block_finder = 0;
 	dev->buffered_block = -1;
 	dev->doing_buffered_block_rewrite = 0;
@@ -4972,6 +5163,17 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 
 	dev->cache_hits = 0;
 
+	dev->rd_ahead_obj = NULL;
+	dev->rd_ahead_win = 0;
+	dev->rd_cache_hits = 0;
+	dev->rd_cache_misses = 0;
+	dev->n_rd_ahead_batches = 0;
+	dev->n_rd_ahead_chunks = 0;
+	dev->n_unlocked_reads = 0;
+
+	if (!init_failed && !yaffs_rd_cache_init(dev))
+		init_failed = 1;
+
 	if (!init_failed) {
 		dev->gc_cleanup_list =
 		    kmalloc(dev->param.chunks_per_block * sizeof(u32),
@@ -5088,6 +5290,8 @@ void yaffs_deinitialise(struct yaffs_dev *dev)
 			dev->cache = NULL;
 		}
 
+		yaffs_rd_cache_deinit(dev);
+
 		kfree(dev->gc_cleanup_list);
 
 		for (i = 0; i < YAFFS_N_TEMP_BUFFERS; i++)
@@ -85,6 +85,10 @@
 
 #define YAFFS_MAX_SHORT_OP_CACHES	20
 
+/* Limits on the read cache and on the size of a read-ahead batch */
+#define YAFFS_MAX_RD_CACHES		1024
+#define YAFFS_MAX_READ_AHEAD		32
+
 #define YAFFS_N_TEMP_BUFFERS		6
 
 /* We limit the number attempts at sucessfully saving a chunk of data.
@@ -418,6 +422,8 @@ struct yaffs_obj {
 
 	int n_data_chunks;	/* Number of data chunks attached to the file. */
 
+	u32 data_version;	/* Bumped when the file data or its chunks change */
+
 	u32 obj_id;		/* the object id value */
 
 	u32 yst_mode;
@@ -509,6 +515,12 @@ struct yaffs_param {
 				 * the number of short op caches (don't use too many).
 				 * 10 to 20 is a good bet.
 				 */
+	int n_rd_caches;	/* Number of chunks in the read cache. If <= 0
+				 * the read cache (and read-ahead) is disabled.
+				 */
+	int max_read_ahead;	/* Max chunks fetched by one read-ahead batch.
+				 * If <= 1 read-ahead is disabled.
+				 */
 	int use_nand_ecc;	/* Flag to decide whether or not to use NANDECC on data (yaffs1) */
 	int no_tags_ecc;	/* Flag to decide whether or not to do ECC on packed tags (yaffs2) */
 
@@ -549,6 +561,20 @@ struct yaffs_param {
 			       u32 * seq_number);
 #endif
 
+	/* Optional: read the data of n_chunks consecutive chunks into one
+	 * buffer with a single NAND access. No tags are read, an ECC problem
+	 * in any of the chunks should make this fail so that the chunks are
+	 * read again one by one.
+	 */
+	int (*read_chunks_fn) (struct yaffs_dev * dev, int nand_chunk,
+			       int n_chunks, u8 * data);
+
+	/* Optional: read only the tags of n_chunks consecutive chunks with a
+	 * single NAND access. Used by the yaffs2 mount scan.
+	 */
+	int (*read_tags_fn) (struct yaffs_dev * dev, int nand_chunk,
+			     int n_chunks, struct yaffs_ext_tags * tags);
+
 	/* The remove_obj_fn function must be supplied by OS flavours that
 	 * need it.
 	 * yaffs direct uses it to implement the faster readdir.
@@ -562,6 +588,12 @@ struct yaffs_param {
 	/*  Callback to control garbage collection. */
 	unsigned (*gc_control) (struct yaffs_dev * dev);
 
+	/* Optional callbacks to release and retake the OS lock around yaffs
+	 * calls. If set, file data reads run the NAND access unlocked.
+	 */
+	void (*unlock_fn) (struct yaffs_dev * dev);
+	void (*lock_fn) (struct yaffs_dev * dev);
+
 	/* Debug control flags. Don't use unless you know what you're doing */
 	int use_header_file_size;	/* Flag to determine if we should use file sizes from the header */
 	int disable_lazy_load;	/* Disable lazy loading on this device */
@@ -687,6 +719,12 @@ struct yaffs_dev {
 	struct yaffs_cache *cache;
 	int cache_last_use;
 
+	/* Read cache and read-ahead state */
+	struct yaffs_rd_cache *rd_cache;
+	struct yaffs_obj *rd_ahead_obj;	/* Object and chunk of the last read */
+	int rd_ahead_chunk;
+	int rd_ahead_win;	/* Current read-ahead window, in chunks */
+
 	/* Stuff for background deletion and unlinked files. */
 	struct yaffs_obj *unlinked_dir;	/* Directory where unlinked and deleted files live. */
 	struct yaffs_obj *del_dir;	/* Directory where deleted objects are sent to disappear. */
@@ -724,6 +762,7 @@ struct yaffs_dev {
 	u32 oldest_dirty_gc_count;
 	u32 n_gc_blocks;
 	u32 bg_gcs;
+	u32 n_bg_checkpoints;
 	u32 n_retired_writes;
 	u32 n_retired_blocks;
 	u32 n_ecc_fixed;
@@ -734,6 +773,11 @@ struct yaffs_dev {
 	u32 n_unmarked_deletions;
 	u32 refresh_count;
 	u32 cache_hits;
+	u32 rd_cache_hits;
+	u32 rd_cache_misses;
+	u32 n_rd_ahead_batches;
+	u32 n_rd_ahead_chunks;
+	u32 n_unlocked_reads;
 
 };
 
@@ -24,6 +24,10 @@ struct yaffs_linux_context {
 	struct super_block *super;
 	struct task_struct *bg_thread;	/* Background thread for this device */
 	int bg_running;
+	unsigned long last_dirty;	/* jiffies when last made dirty */
+	unsigned long bg_checkpt_time;	/* jiffies of last bg checkpoint */
+	int bg_checkpointed;	/* ... and it is still valid */
+	unsigned bg_checkpt_shift;	/* Idle time backoff */
 	struct mutex gross_lock;	/* Gross locking mutex*/
 	u8 *spare_buffer;	/* For mtdif2 use. Don't know the size of the buffer
 				 * at compile time so we have to allocate it.
@@ -165,6 +165,85 @@ int nandmtd2_read_chunk_tags(struct yaffs_dev *dev, int nand_chunk,
 		return YAFFS_FAIL;
 }
 
+/* Batched read of the data areas of consecutive pages, for read-ahead */
+int nandmtd2_read_chunks(struct yaffs_dev *dev, int nand_chunk, int n_chunks,
+			 u8 * data)
+{
+	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
+	size_t len = n_chunks * dev->param.total_bytes_per_chunk;
+	loff_t addr = ((loff_t) nand_chunk) * dev->param.total_bytes_per_chunk;
+	size_t retlen = 0;
+	int retval;
+
+	yaffs_trace(YAFFS_TRACE_MTD,
+		"nandmtd2_read_chunks chunk %d n %d", nand_chunk, n_chunks);
+
+	retval = mtd->read(mtd, addr, len, &retlen, data);
+
+	/* Even a corrected error (-EUCLEAN) fails the batch, so that the
+	 * single chunk read path gets to see it and handle the block.
+	 */
+	if (retval == 0 && retlen == len)
+		return YAFFS_OK;
+	else
+		return YAFFS_FAIL;
+}
+
+/* Batched read of the tags of consecutive pages, for the mount scan.
+ * MTD_OOB_AUTO packs the free OOB bytes of each page one after the other,
+ * so the tags of page i start at i * oobavail in the buffer.
+ */
+int nandmtd2_read_tags(struct yaffs_dev *dev, int nand_chunk, int n_chunks,
+		       struct yaffs_ext_tags *tags)
+{
+	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
+	struct mtd_oob_ops ops;
+	struct yaffs_packed_tags2 pt;
+	loff_t addr = ((loff_t) nand_chunk) * dev->param.total_bytes_per_chunk;
+	int oobavail = mtd->ecclayout ? mtd->ecclayout->oobavail : 0;
+	int packed_tags_size =
+	    dev->param.no_tags_ecc ? sizeof(pt.t) : sizeof(pt);
+	void *packed_tags_ptr =
+	    dev->param.no_tags_ecc ? (void *)&pt.t : (void *)&pt;
+	u8 *oob;
+	int retval;
+	int i;
+
+	if (oobavail < packed_tags_size)
+		return YAFFS_FAIL;
+
+	oob = kmalloc(n_chunks * oobavail, GFP_NOFS);
+	if (!oob)
+		return YAFFS_FAIL;
+
+	yaffs_trace(YAFFS_TRACE_MTD,
+		"nandmtd2_read_tags chunk %d n %d", nand_chunk, n_chunks);
+
+	ops.mode = MTD_OOB_AUTO;
+	ops.ooblen = n_chunks * oobavail;
+	ops.len = 0;
+	ops.ooboffs = 0;
+	ops.datbuf = NULL;
+	ops.oobbuf = oob;
+	retval = mtd->read_oob(mtd, addr, &ops);
+
+	if (retval == 0 && ops.oobretlen == ops.ooblen) {
+		for (i = 0; i < n_chunks; i++) {
+			memcpy(packed_tags_ptr, oob + i * oobavail,
+			       packed_tags_size);
+			yaffs_unpack_tags2(&tags[i], &pt,
+					   !dev->param.no_tags_ecc);
+		}
+	}
+
+	kfree(oob);
+
+	if (retval == 0 && ops.oobretlen == ops.ooblen)
+		return YAFFS_OK;
+	else
+		return YAFFS_FAIL;
+}
+
 int nandmtd2_mark_block_bad(struct yaffs_dev *dev, int block_no)
 {
 	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
@@ -16,6 +16,7 @@
 #include "yaffs_tagsvalidity.h"
 
 #include "yaffs_getblockinfo.h"
+#include "yaffs_rdcache.h"
 
 int yaffs_rd_chunk_tags_nand(struct yaffs_dev *dev, int nand_chunk,
 			     u8 * buffer, struct yaffs_ext_tags *tags)
@@ -50,6 +51,60 @@ int yaffs_rd_chunk_tags_nand(struct yaffs_dev *dev, int nand_chunk,
 	return result;
 }
 
+/*
+ * Read the data of n_chunks consecutive chunks in a single NAND access.
+ * Fails if the driver can't do it or on any ECC event; the caller then
+ * reads the chunks one at a time so that errors get the usual handling.
+ */
+int yaffs_rd_chunks_nand(struct yaffs_dev *dev, int nand_chunk,
+			 int n_chunks, u8 * buffer)
+{
+	int result;
+
+	if (!dev->param.read_chunks_fn)
+		return YAFFS_FAIL;
+
+	result = dev->param.read_chunks_fn(dev, nand_chunk - dev->chunk_offset,
+					   n_chunks, buffer);
+	if (result == YAFFS_OK)
+		dev->n_page_reads += n_chunks;
+
+	return result;
+}
+
+/*
+ * Read the tags of n_chunks consecutive chunks in one NAND access, if the
+ * driver can. ECC problems in the tags are handled as for single reads.
+ */
+int yaffs_rd_tags_nand(struct yaffs_dev *dev, int nand_chunk,
+		       int n_chunks, struct yaffs_ext_tags *tags)
+{
+	struct yaffs_block_info *bi;
+	int result;
+	int i;
+
+	if (!dev->param.read_tags_fn || dev->param.inband_tags)
+		return YAFFS_FAIL;
+
+	result = dev->param.read_tags_fn(dev, nand_chunk - dev->chunk_offset,
+					 n_chunks, tags);
+	if (result != YAFFS_OK)
+		return result;
+
+	dev->n_page_reads += n_chunks;
+
+	for (i = 0; i < n_chunks; i++) {
+		if (tags[i].ecc_result > YAFFS_ECC_RESULT_NO_ERROR) {
+			bi = yaffs_get_block_info(dev,
+						  (nand_chunk + i) /
+						  dev->param.chunks_per_block);
+			yaffs_handle_chunk_error(dev, bi);
+		}
+	}
+
+	return YAFFS_OK;
+}
+
 int yaffs_wr_chunk_tags_nand(struct yaffs_dev *dev,
 			     int nand_chunk,
 			     const u8 * buffer, struct yaffs_ext_tags *tags)
@@ -110,6 +165,8 @@ int yaffs_erase_block(struct yaffs_dev *dev, int flash_block)
 {
 	int result;
 
+	yaffs_rd_cache_invalidate_block(dev, flash_block);
+
 	flash_block -= dev->block_offset;
 
 	dev->n_erasures++;
@@ -0,0 +1,198 @@
+/*
+ * YAFFS: Yet Another Flash File System. A NAND-flash specific file system.
+ *
+ * Copyright (C) 2002-2010 Aleph One Ltd.
+ *   for Toby Churchill Ltd and Brightstar Engineering
+ *
+ * Created by Charles Manning <charles@aleph1.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * The read cache holds copies of data chunks as they were read from NAND.
+ * It is indexed by NAND chunk number rather than by object and chunk id:
+ * a NAND page is never rewritten in place, so an entry stays valid until
+ * the block holding it is erased, whatever happens to the file.  Writes,
+ * truncates and deletes therefore need no cache handling at all, only
+ * erasures do.
+ *
+ * Replacement is least recently used.  Read-ahead fills the cache with
+ * the chunks that follow a sequential read, see yaffs_rd_data_obj().
+ */
+
+#include "yaffs_rdcache.h"
+#include "yaffs_trace.h"
+#include "yportenv.h"
+
+static struct list_head *yaffs_rd_cache_bucket(struct yaffs_rd_cache *rc,
+					       int nand_chunk)
+{
+	return &rc->hash[nand_chunk & rc->hash_mask];
+}
+
+static void yaffs_rd_cache_drop(struct yaffs_rd_cache *rc,
+				struct yaffs_rd_cache_entry *e)
+{
+	list_del_init(&e->hash);
+	e->nand_chunk = -1;
+	list_move_tail(&e->lru, &rc->lru);
+}
+
+int yaffs_rd_cache_init(struct yaffs_dev *dev)
+{
+	struct yaffs_rd_cache *rc;
+	int n = dev->param.n_rd_caches;
+	u32 n_buckets;
+	int i;
+
+	dev->rd_cache = NULL;
+
+	if (n <= 0)
+		return YAFFS_OK;
+
+	if (n > YAFFS_MAX_RD_CACHES)
+		n = dev->param.n_rd_caches = YAFFS_MAX_RD_CACHES;
+
+	/* Batched reads only work where chunk data is all there is in a page */
+	if (!dev->param.read_chunks_fn || dev->param.inband_tags ||
+	    dev->data_bytes_per_chunk != dev->param.total_bytes_per_chunk ||
+	    dev->chunk_grp_size > 1)
+		dev->param.max_read_ahead = 1;
+
+	if (dev->param.max_read_ahead > YAFFS_MAX_READ_AHEAD)
+		dev->param.max_read_ahead = YAFFS_MAX_READ_AHEAD;
+
+	/* A batch must not push itself out of the cache */
+	if (dev->param.max_read_ahead > n / 2)
+		dev->param.max_read_ahead = n / 2;
+
+	rc = kmalloc(sizeof(struct yaffs_rd_cache), GFP_NOFS);
+	if (!rc)
+		return YAFFS_FAIL;
+	memset(rc, 0, sizeof(struct yaffs_rd_cache));
+
+	for (n_buckets = 1; n_buckets < n; n_buckets <<= 1)
+		;
+
+	rc->n_entries = n;
+	rc->hash_mask = n_buckets - 1;
+	INIT_LIST_HEAD(&rc->lru);
+	rc->hash = kmalloc(n_buckets * sizeof(struct list_head), GFP_NOFS);
+	rc->entries = kmalloc(n * sizeof(struct yaffs_rd_cache_entry),
+			      GFP_NOFS);
+	dev->rd_cache = rc;
+
+	if (!rc->hash || !rc->entries)
+		goto fail;
+
+	for (i = 0; i < n_buckets; i++)
+		INIT_LIST_HEAD(&rc->hash[i]);
+
+	memset(rc->entries, 0, n * sizeof(struct yaffs_rd_cache_entry));
+	for (i = 0; i < n; i++) {
+		struct yaffs_rd_cache_entry *e = &rc->entries[i];
+
+		INIT_LIST_HEAD(&e->hash);
+		e->nand_chunk = -1;
+		list_add_tail(&e->lru, &rc->lru);
+	}
+
+	for (i = 0; i < n; i++) {
+		rc->entries[i].data =
+		    kmalloc(dev->data_bytes_per_chunk, GFP_NOFS);
+		if (!rc->entries[i].data)
+			goto fail;
+	}
+
+	if (dev->param.max_read_ahead > 1) {
+		rc->batch_buffer = kmalloc(dev->param.max_read_ahead *
+					   dev->param.total_bytes_per_chunk,
+					   GFP_NOFS);
+		if (!rc->batch_buffer) {
+			yaffs_trace(YAFFS_TRACE_ALWAYS,
+				"yaffs: no memory for read-ahead, disabled");
+			dev->param.max_read_ahead = 1;
+		}
+	}
+
+	return YAFFS_OK;
+
+fail:
+	yaffs_rd_cache_deinit(dev);
+	return YAFFS_FAIL;
+}
+
+void yaffs_rd_cache_deinit(struct yaffs_dev *dev)
+{
+	struct yaffs_rd_cache *rc = dev->rd_cache;
+	int i;
+
+	if (!rc)
+		return;
+
+	if (rc->entries) {
+		for (i = 0; i < rc->n_entries; i++)
+			kfree(rc->entries[i].data);
+		kfree(rc->entries);
+	}
+	kfree(rc->hash);
+	kfree(rc->batch_buffer);
+	kfree(rc);
+
+	dev->rd_cache = NULL;
+}
+
+/* Look a chunk up, making it the most recently used one if it is there */
+u8 *yaffs_rd_cache_find(struct yaffs_dev *dev, int nand_chunk)
+{
+	struct yaffs_rd_cache *rc = dev->rd_cache;
+	struct yaffs_rd_cache_entry *e;
+
+	list_for_each_entry(e, yaffs_rd_cache_bucket(rc, nand_chunk), hash) {
+		if (e->nand_chunk == nand_chunk) {
+			list_move(&e->lru, &rc->lru);
+			return e->data;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Recycle the least recently used entry for nand_chunk and return its data
+ * buffer for the caller to fill. The chunk must not be in the cache.
+ */
+u8 *yaffs_rd_cache_add(struct yaffs_dev *dev, int nand_chunk)
+{
+	struct yaffs_rd_cache *rc = dev->rd_cache;
+	struct yaffs_rd_cache_entry *e;
+
+	e = list_entry(rc->lru.prev, struct yaffs_rd_cache_entry, lru);
+	list_del(&e->hash);
+	e->nand_chunk = nand_chunk;
+	list_add(&e->hash, yaffs_rd_cache_bucket(rc, nand_chunk));
+	list_move(&e->lru, &rc->lru);
+
+	return e->data;
+}
+
+/* Forget every chunk of a block that is about to be erased */
+void yaffs_rd_cache_invalidate_block(struct yaffs_dev *dev, int block)
+{
+	struct yaffs_rd_cache *rc = dev->rd_cache;
+	int first = block * dev->param.chunks_per_block;
+	int last = first + dev->param.chunks_per_block;
+	int i;
+
+	if (!rc)
+		return;
+
+	for (i = 0; i < rc->n_entries; i++) {
+		struct yaffs_rd_cache_entry *e = &rc->entries[i];
+
+		if (e->nand_chunk >= first && e->nand_chunk < last)
+			yaffs_rd_cache_drop(rc, e);
+	}
+}
@@ -0,0 +1,49 @@
+/*
+ * YAFFS: Yet another Flash File System . A NAND-flash specific file system.
+ *
+ * Copyright (C) 2002-2010 Aleph One Ltd.
+ *   for Toby Churchill Ltd and Brightstar Engineering
+ *
+ * Created by Charles Manning <charles@aleph1.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * Note: Only YAFFS headers are LGPL, YAFFS C code is covered by GPL.
+ */
+
+/*
+ * Read cache of NAND data chunks, indexed by NAND chunk number.
+ */
+
+#ifndef __YAFFS_RDCACHE_H__
+#define __YAFFS_RDCACHE_H__
+
+#include "yaffs_guts.h"
+
+struct yaffs_rd_cache_entry {
+	struct list_head lru;	/* Position in the LRU list */
+	struct list_head hash;	/* Hash chain, empty if the entry is unused */
+	int nand_chunk;		/* -1 if the entry is unused */
+	u8 *data;
+};
+
+struct yaffs_rd_cache {
+	int n_entries;
+	u32 hash_mask;
+	struct yaffs_rd_cache_entry *entries;
+	struct list_head lru;	/* Most recently used entry first */
+	struct list_head *hash;
+	u8 *batch_buffer;	/* max_read_ahead chunks, NULL if no read-ahead */
+	int batch_busy;		/* batch_buffer is in use by an unlocked read */
+};
+
+int yaffs_rd_cache_init(struct yaffs_dev *dev);
+void yaffs_rd_cache_deinit(struct yaffs_dev *dev);
+
+u8 *yaffs_rd_cache_find(struct yaffs_dev *dev, int nand_chunk);
+u8 *yaffs_rd_cache_add(struct yaffs_dev *dev, int nand_chunk);
+void yaffs_rd_cache_invalidate_block(struct yaffs_dev *dev, int block);
+
+#endif
@@ -92,11 +92,17 @@ static uint32_t YCALCBLOCKS(uint64_t partition_size, uint32_t block_size)
 #include "yaffs_mtdif1.h"
 #include "yaffs_mtdif2.h"
 
+/* Background checkpoints wait for at most 64 times yaffs_bg_checkpoint */
+#define YAFFS_BG_CHECKPT_MAX_SHIFT 6
+
 unsigned int yaffs_trace_mask = YAFFS_TRACE_BAD_BLOCKS | YAFFS_TRACE_ALWAYS;
 unsigned int yaffs_wr_attempts = YAFFS_WR_ATTEMPTS;
 unsigned int yaffs_auto_checkpoint = 1;
 unsigned int yaffs_gc_control = 1;
 unsigned int yaffs_bg_enable = 1;
+unsigned int yaffs_bg_checkpoint;
+unsigned int yaffs_rd_caches = 64;
+unsigned int yaffs_read_ahead = 16;
 
 /* Module Parameters */
 module_param(yaffs_trace_mask, uint, 0644);
@@ -104,6 +110,9 @@ module_param(yaffs_wr_attempts, uint, 0644);
 module_param(yaffs_auto_checkpoint, uint, 0644);
 module_param(yaffs_gc_control, uint, 0644);
 module_param(yaffs_bg_enable, uint, 0644);
+module_param(yaffs_bg_checkpoint, uint, 0644);
+module_param(yaffs_rd_caches, uint, 0644);
+module_param(yaffs_read_ahead, uint, 0644);
 
 
 #define yaffs_inode_to_obj_lv(iptr) ((iptr)->i_private)
@@ -1120,9 +1129,28 @@ static void yaffs_touch_super(struct yaffs_dev *dev)
 {
 	struct super_block *sb = yaffs_dev_to_lc(dev)->super;
 
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+
 	yaffs_trace(YAFFS_TRACE_OS, "yaffs_touch_super() sb = %p", sb);
 	if (sb)
 		sb->s_dirt = 1;
+	lc->last_dirty = jiffies;
+
+	/*
+	 * A background checkpoint that is invalidated within
+	 * yaffs_bg_checkpoint seconds only cost an erase.  Make the
+	 * background thread wait twice as long for the next one.
+	 */
+	if (lc->bg_checkpointed && !dev->is_checkpointed) {
+		lc->bg_checkpointed = 0;
+		if (time_before(jiffies, lc->bg_checkpt_time +
+				yaffs_bg_checkpoint * HZ)) {
+			if (lc->bg_checkpt_shift < YAFFS_BG_CHECKPT_MAX_SHIFT)
+				lc->bg_checkpt_shift++;
+		} else {
+			lc->bg_checkpt_shift = 0;
+		}
+	}
 }
 
 static int yaffs_readpage_nolock(struct file *f, struct page *pg)
@@ -1149,6 +1177,9 @@ static int yaffs_readpage_nolock(struct file *f, struct page *pg)
 	pg_buf = kmap(pg);
 	/* FIXME: Can kmap fail? */
 
+	/* yaffs_file_rd() lets go of the lock while it reads NAND pages,
+	 * so reads don't wait for writers and gc more than they have to.
+	 */
 	yaffs_gross_lock(dev);
 
 	ret = yaffs_file_rd(obj, pg_buf,
@@ -1650,6 +1681,32 @@ static int yaffs_bg_thread_fn(void *data)
 			next_dir_update = now + HZ;
 		}
 
+		/*
+		 * Once the fs has been left alone for yaffs_bg_checkpoint
+		 * seconds, write a checkpoint so that an unclean shutdown
+		 * does not leave the next mount with a full scan to do.
+		 * The wait doubles while checkpoints keep being invalidated
+		 * soon after they were written, see yaffs_touch_super().
+		 */
+		if (yaffs_bg_checkpoint && yaffs_bg_enable &&
+		    !dev->is_checkpointed &&
+		    time_after(now, context->last_dirty +
+			       ((yaffs_bg_checkpoint * HZ) <<
+				context->bg_checkpt_shift)) &&
+		    !yaffs_bg_gc_urgency(dev)) {
+			yaffs_trace(YAFFS_TRACE_BACKGROUND | YAFFS_TRACE_CHECKPOINT,
+				"yaffs_background checkpoint");
+			yaffs_flush_super(context->super, 1);
+			context->super->s_dirt = 0;
+			dev->n_bg_checkpoints++;
+			if (dev->is_checkpointed) {
+				context->bg_checkpt_time = now;
+				context->bg_checkpointed = 1;
+			}
+			/* Don't retry every second if there was no room */
+			context->last_dirty = now;
+		}
+
 		if (time_after(now, next_gc) && yaffs_bg_enable) {
 			if (!dev->is_checkpointed) {
 				urgency = yaffs_bg_gc_urgency(dev);
@@ -1758,6 +1815,7 @@ struct yaffs_options {
 	int skip_checkpoint_read;
 	int skip_checkpoint_write;
 	int no_cache;
+	int no_read_ahead;
 	int tags_ecc_on;
 	int tags_ecc_overridden;
 	int lazy_loading_enabled;
@@ -1813,6 +1871,8 @@ static int yaffs_parse_options(struct yaffs_options *options,
 			options->empty_lost_and_found_overridden = 1;
 		} else if (!strcmp(cur_opt, "no-cache")) {
 			options->no_cache = 1;
+		} else if (!strcmp(cur_opt, "no-read-ahead")) {
+			options->no_read_ahead = 1;
 		} else if (!strcmp(cur_opt, "no-checkpoint-read")) {
 			options->skip_checkpoint_read = 1;
 		} else if (!strcmp(cur_opt, "no-checkpoint-write")) {
@@ -2196,6 +2256,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	INIT_LIST_HEAD(&(context->context_list));
 	context->dev = dev;
 	context->super = sb;
+	context->last_dirty = jiffies;
 
 	dev->read_only = read_only;
 
@@ -2216,6 +2277,8 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	param->total_bytes_per_chunk = YAFFS_BYTES_PER_CHUNK;
 	param->n_reserved_blocks = 5;
 	param->n_caches = (options.no_cache) ? 0 : 10;
+	param->n_rd_caches = (options.no_cache) ? 0 : yaffs_rd_caches;
+	param->max_read_ahead = (options.no_read_ahead) ? 1 : yaffs_read_ahead;
 	param->inband_tags = options.inband_tags;
 
 #ifdef CONFIG_YAFFS_DISABLE_LAZY_LOAD
@@ -2260,6 +2323,8 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	if (yaffs_version == 2) {
 		param->write_chunk_tags_fn = nandmtd2_write_chunk_tags;
 		param->read_chunk_tags_fn = nandmtd2_read_chunk_tags;
+		param->read_chunks_fn = nandmtd2_read_chunks;
+		param->read_tags_fn = nandmtd2_read_tags;
 		param->bad_block_fn = nandmtd2_mark_block_bad;
 		param->query_block_fn = nandmtd2_query_block;
 		yaffs_dev_to_lc(dev)->spare_buffer = 
@@ -2287,6 +2352,8 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 
 	param->sb_dirty_fn = yaffs_touch_super;
 	param->gc_control = yaffs_gc_control_callback;
+	param->unlock_fn = yaffs_gross_unlock;
+	param->lock_fn = yaffs_gross_lock;
 
 	yaffs_dev_to_lc(dev)->super = sb;
 
@@ -2438,6 +2505,9 @@ static char *yaffs_dump_dev_part0(char *buf, struct yaffs_dev *dev)
 	buf += sprintf(buf, "refresh_period........ %d\n",
 			param->refresh_period);
 	buf += sprintf(buf, "n_caches.............. %d\n", param->n_caches);
+	buf += sprintf(buf, "n_rd_caches........... %d\n", param->n_rd_caches);
+	buf += sprintf(buf, "max_read_ahead........ %d\n",
+			param->max_read_ahead);
 	buf += sprintf(buf, "n_reserved_blocks..... %d\n",
 			param->n_reserved_blocks);
 	buf += sprintf(buf, "always_check_erased... %d\n",
@@ -2474,6 +2544,8 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 		    dev->oldest_dirty_gc_count);
 	buf += sprintf(buf, "n_gc_blocks........... %u\n", dev->n_gc_blocks);
 	buf += sprintf(buf, "bg_gcs................ %u\n", dev->bg_gcs);
+	buf +=
+	    sprintf(buf, "n_bg_checkpoints...... %u\n", dev->n_bg_checkpoints);
 	buf +=
 	    sprintf(buf, "n_retired_writes...... %u\n", dev->n_retired_writes);
 	buf +=
@@ -2486,6 +2558,21 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	    sprintf(buf, "n_tags_ecc_unfixed.... %u\n",
 		    dev->n_tags_ecc_unfixed);
 	buf += sprintf(buf, "cache_hits............ %u\n", dev->cache_hits);
+	buf += sprintf(buf, "rd_cache_hits......... %u\n", dev->rd_cache_hits);
+	buf +=
+	    sprintf(buf, "rd_cache_misses....... %u\n", dev->rd_cache_misses);
+	buf +=
+	    sprintf(buf, "rd_cache_hit_pct...... %u\n",
+		    (dev->rd_cache_hits + dev->rd_cache_misses) ?
+		    (u32) (100ULL * dev->rd_cache_hits /
+			   (dev->rd_cache_hits + dev->rd_cache_misses)) : 0);
+	buf +=
+	    sprintf(buf, "n_rd_ahead_batches.... %u\n",
+		    dev->n_rd_ahead_batches);
+	buf +=
+	    sprintf(buf, "n_rd_ahead_chunks..... %u\n", dev->n_rd_ahead_chunks);
+	buf +=
+	    sprintf(buf, "n_unlocked_reads...... %u\n", dev->n_unlocked_reads);
 	buf +=
 	    sprintf(buf, "n_deleted_files....... %u\n", dev->n_deleted_files);
 	buf +=
@@ -11,6 +11,12 @@
 extern u32  crc32_le(u32 crc, unsigned char const *p, size_t len);
 extern u32  crc32_be(u32 crc, unsigned char const *p, size_t len);
 
+/*
+ * Castagnoli CRC32c with the same table code.  Most users want the
+ * "crc32c" crypto API algorithm instead, which may be hardware backed.
+ */
+extern u32  __crc32c_le(u32 crc, unsigned char const *p, size_t len);
+
 #define crc32(seed, data, length)  crc32_le(seed, (unsigned char const *)(data), length)
 
 /*
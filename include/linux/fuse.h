@@ -53,6 +53,7 @@
 #define _LINUX_FUSE_H
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /*
  * Version negotiation:
@@ -145,16 +146,20 @@ struct fuse_file_lock {
  * FOPEN_DIRECT_IO: bypass page cache for this open file
  * FOPEN_KEEP_CACHE: don't invalidate the data cache on open
  * FOPEN_NONSEEKABLE: the file is not seekable
+ * FOPEN_PASSTHROUGH: serve I/O directly from the file in passthrough_fd
  */
 #define FOPEN_DIRECT_IO		(1 << 0)
 #define FOPEN_KEEP_CACHE	(1 << 1)
 #define FOPEN_NONSEEKABLE	(1 << 2)
+#define FOPEN_PASSTHROUGH	(1 << 31)
 
 /**
  * INIT request/reply flags
  *
  * FUSE_EXPORT_SUPPORT: filesystem handles lookups of "." and ".."
  * FUSE_DONT_MASK: don't apply umask to file mode on create operations
+ * FUSE_PASSTHROUGH: filesystem may pass lower files back in OPEN replies,
+ *		     honoured only for a daemon with CAP_SYS_ADMIN
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -163,6 +168,7 @@ struct fuse_file_lock {
 #define FUSE_EXPORT_SUPPORT	(1 << 4)
 #define FUSE_BIG_WRITES		(1 << 5)
 #define FUSE_DONT_MASK		(1 << 6)
+#define FUSE_PASSTHROUGH	(1 << 31)
 
 /**
  * CUSE INIT request/reply flags
@@ -380,7 +386,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	__u64	fh;
 	__u32	open_flags;
-	__u32	padding;
+	__u32	passthrough_fd;	/* only valid with FOPEN_PASSTHROUGH */
 };
 
 struct fuse_release_in {
@@ -624,4 +630,19 @@ struct fuse_notify_retrieve_in {
 	__u64	dummy4;
 };
 
+/* Device ioctls */
+#define FUSE_DEV_IOC_MAGIC		229
+
+/**
+ * FUSE_DEV_IOC_CLONE: attach a newly opened /dev/fuse to the connection
+ *	of the /dev/fuse file descriptor passed as argument
+ * FUSE_DEV_IOC_BIND_CPU: read requests submitted on the given CPU from
+ *	this (cloned) device, FUSE_DEV_CPU_NONE binds it back to the
+ *	default queue
+ */
+#define FUSE_DEV_IOC_CLONE		_IOR(FUSE_DEV_IOC_MAGIC, 0, __u32)
+#define FUSE_DEV_IOC_BIND_CPU		_IOW(FUSE_DEV_IOC_MAGIC, 1, __u32)
+
+#define FUSE_DEV_CPU_NONE		((__u32) -1)
+
 #endif /* _LINUX_FUSE_H */
@@ -0,0 +1,66 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+/*
+ * LZ4 Kernel Interface
+ *
+ * Compressors and decompressor for the LZ4 block format designed by
+ * Yann Collet.  The format and the reference implementation can be
+ * found at http://code.google.com/p/lz4/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define LZ4_MEM_COMPRESS	(4096 * sizeof(unsigned int))
+#define LZ4HC_MEM_COMPRESS	(32768 * sizeof(unsigned int) + \
+				 65536 * sizeof(unsigned short))
+
+/*
+ * lz4_compressbound()
+ * Provides the maximum size that LZ4 may output in a "worst case" scenario
+ * (input data not compressible)
+ */
+static inline size_t lz4_compressbound(size_t isize)
+{
+	return isize + (isize / 255) + 16;
+}
+
+/*
+ * lz4_compress()
+ *	src     : source address of the original data
+ *	src_len : size of the original data
+ *	dst	: output buffer address of the compressed data
+ *	dst_len : in: size of the output buffer, out: size of the
+ *		  compressed data.  Allocating lz4_compressbound(src_len)
+ *		  bytes guarantees that compression succeeds.
+ *	wrkmem  : address of the working memory.
+ *		  This requires 'wrkmem' of size LZ4_MEM_COMPRESS.
+ *	return  : 0 on success, -E2BIG if the output did not fit
+ */
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * lz4hc_compress()
+ *	Same as lz4_compress(), but spends more time searching for matches
+ *	and produces smaller output which decompresses just as fast.
+ *	This requires 'wrkmem' of size LZ4HC_MEM_COMPRESS.
+ */
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * lz4_decompress_safe()
+ *	src     : source address of the compressed data
+ *	src_len : size of the compressed data, one complete LZ4 block
+ *	dst	: output buffer address of the decompressed data
+ *	dst_len : in: size of the output buffer, out: size of the
+ *		  decompressed data
+ *	return  : 0 on success, -EINVAL for malformed input and -E2BIG if
+ *		  the output buffer is too small.  Never reads or writes
+ *		  outside of the two buffers, even for corrupted input.
+ */
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len);
+#endif
@@ -21,6 +21,150 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
+#ifdef CONFIG_LRU_GEN
+
+extern bool __lru_gen_enabled;
+
+/* Does the multi-gen LRU hold the evictable pages, see mm/vmscan.c? */
+static inline bool lru_gen_enabled(void)
+{
+	return __lru_gen_enabled;
+}
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+/* The generation of a page on the multi-gen LRU, or -1 */
+static inline int page_lru_gen(struct page *page)
+{
+	return (int)((page->flags & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1;
+}
+
+/*
+ * Set the generation of a page, or clear it with @gen == -1, and return
+ * the old one.  The aging updates the generations of pages found young
+ * in the page tables without zone->lru_lock, so this has to be atomic
+ * against it as well as against the other page flag updates.
+ */
+static inline int page_xchg_lru_gen(struct page *page, int gen)
+{
+	unsigned long old, new;
+
+	do {
+		old = ACCESS_ONCE(page->flags);
+		new = (old & ~LRU_GEN_MASK) |
+		      ((unsigned long)(gen + 1) << LRU_GEN_PGOFF);
+	} while (cmpxchg(&page->flags, old, new) != old);
+
+	return (int)((old & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1;
+}
+
+/*
+ * The two youngest generations stand in for the active list, so that the
+ * zone statistics, and the users of the active list sizes, stay meaningful.
+ */
+static inline bool lru_gen_is_active(struct zone *zone, int gen)
+{
+	unsigned long max_seq = zone->lru_gen.max_seq;
+
+	return gen == lru_gen_from_seq(max_seq) ||
+	       gen == lru_gen_from_seq(max_seq - 1);
+}
+
+static inline void lru_gen_update_size(struct zone *zone, int type, int gen,
+				       int delta)
+{
+	enum lru_list l = type * LRU_FILE;
+
+	if (lru_gen_is_active(zone, gen))
+		l += LRU_ACTIVE;
+	zone->lru_gen.nr_pages[gen][type] += delta;
+	__mod_zone_page_state(zone, NR_LRU_BASE + l, delta);
+}
+
+/*
+ * Put an evictable page on the multi-gen LRU.  Active pages, which include
+ * newly faulted anon pages, start out in the youngest generation.  Pages
+ * that reclaim wants to see again soon go to the tail of the oldest one,
+ * and the rest, mostly new page cache, into the second oldest one.  The
+ * generation takes the place of PG_active, so that is cleared.
+ */
+static inline bool lru_gen_add_page(struct zone *zone, struct page *page,
+				    bool reclaiming)
+{
+	struct lru_gen *lrugen = &zone->lru_gen;
+	int type = page_is_file_cache(page);
+	unsigned long seq;
+	int gen;
+
+	if (!lru_gen_enabled() || PageUnevictable(page))
+		return false;
+
+	if (PageActive(page))
+		seq = lrugen->max_seq;
+	else if (reclaiming ||
+		 lrugen->min_seq[type] + MIN_NR_GENS >= lrugen->max_seq)
+		seq = lrugen->min_seq[type];
+	else
+		seq = lrugen->min_seq[type] + 1;
+
+	gen = lru_gen_from_seq(seq);
+	ClearPageActive(page);
+	page_xchg_lru_gen(page, gen);
+	lru_gen_update_size(zone, type, gen, hpage_nr_pages(page));
+	if (reclaiming)
+		list_add_tail(&page->lru, &lrugen->lists[gen][type]);
+	else
+		list_add(&page->lru, &lrugen->lists[gen][type]);
+	return true;
+}
+
+/*
+ * Take a page off the multi-gen LRU.  Unless it is going away for reclaim
+ * or for good, a page from the two youngest generations gets PG_active
+ * so that it comes back young, and so that isolate_lru_page() callers
+ * see it as an active page.
+ */
+static inline bool lru_gen_del_page(struct zone *zone, struct page *page,
+				    bool reclaiming)
+{
+	int gen;
+
+	if (page_lru_gen(page) < 0)
+		return false;
+
+	gen = page_xchg_lru_gen(page, -1);
+	if (!reclaiming && lru_gen_is_active(zone, gen))
+		SetPageActive(page);
+	lru_gen_update_size(zone, page_is_file_cache(page), gen,
+			    -hpage_nr_pages(page));
+	list_del(&page->lru);
+	return true;
+}
+
+#else /* CONFIG_LRU_GEN */
+
+static inline bool lru_gen_enabled(void)
+{
+	return false;
+}
+
+static inline bool lru_gen_add_page(struct zone *zone, struct page *page,
+				    bool reclaiming)
+{
+	return false;
+}
+
+static inline bool lru_gen_del_page(struct zone *zone, struct page *page,
+				    bool reclaiming)
+{
+	return false;
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 static inline void
 __add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l,
 		       struct list_head *head)
@@ -33,12 +177,31 @@ __add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l,
 static inline void
 add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
+	if (lru_gen_add_page(zone, page, false))
+		return;
 	__add_page_to_lru_list(zone, page, l, &zone->lru[l].list);
 }
 
+/*
+ * Move an inactive page to where reclaim will look at it first, as a page
+ * that finished writeback or that was deactivated on request.
+ */
+static inline void
+move_page_to_lru_tail(struct zone *zone, struct page *page, enum lru_list l)
+{
+	if (lru_gen_del_page(zone, page, false)) {
+		lru_gen_add_page(zone, page, true);
+		return;
+	}
+	list_move_tail(&page->lru, &zone->lru[l].list);
+	mem_cgroup_rotate_reclaimable_page(page);
+}
+
 static inline void
 del_page_from_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
+	if (lru_gen_del_page(zone, page, false))
+		return;
 	list_del(&page->lru);
 	__mod_zone_page_state(zone, NR_LRU_BASE + l, -hpage_nr_pages(page));
 	mem_cgroup_del_lru_list(page, l);
@@ -64,6 +227,8 @@ del_page_from_lru(struct zone *zone, struct page *page)
 {
 	enum lru_list l;
 
+	if (lru_gen_del_page(zone, page, true))
+		return;
 	list_del(&page->lru);
 	if (PageUnevictable(page)) {
 		__ClearPageUnevictable(page);
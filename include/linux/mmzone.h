@@ -114,6 +114,9 @@ enum zone_stat_item {
 	NUMA_LOCAL,		/* allocation from local node */
 	NUMA_OTHER,		/* allocation from other node */
 #endif
+	WORKINGSET_REFAULT,	/* evicted file pages faulted back in */
+	WORKINGSET_ACTIVATE,	/* ... and activated at once */
+	WORKINGSET_NODERECLAIM,	/* shadow entry nodes freed */
 	NR_ANON_TRANSPARENT_HUGEPAGES,
 	NR_VM_ZONE_STAT_ITEMS };
 
@@ -158,6 +161,32 @@ static inline int is_unevictable_lru(enum lru_list l)
 	return (l == LRU_UNEVICTABLE);
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-gen LRU keeps the evictable pages of a zone in generations
+ * instead of on the active and inactive lists.  A generation is named by
+ * a sequence number: the aging opens a new youngest one, max_seq, and the
+ * eviction retires the oldest one of each type, min_seq, once it is empty.
+ * A page on the lists stores its generation, seq % MAX_NR_GENS, plus one
+ * in LRU_GEN_WIDTH bits of page->flags, see mm/vmscan.c.
+ */
+#define MIN_NR_GENS		2
+#define MAX_NR_GENS		4
+#define LRU_GEN_WIDTH		3
+
+struct lru_gen {
+	/* the youngest generation, shared by anon and file pages */
+	unsigned long		max_seq;
+	/* the oldest generation of anon [0] and file [1] pages */
+	unsigned long		min_seq[2];
+	/* pages and page counts per generation and type */
+	struct list_head	lists[MAX_NR_GENS][2];
+	long			nr_pages[MAX_NR_GENS][2];
+};
+#else
+#define LRU_GEN_WIDTH		0
+#endif
+
 enum zone_watermarks {
 	WMARK_MIN,
 	WMARK_LOW,
@@ -343,9 +372,16 @@ struct zone {
 	struct zone_lru {
 		struct list_head list;
 	} lru[NR_LRU_LISTS];
+#ifdef CONFIG_LRU_GEN
+	/* Replaces the evictable lists when the multi-gen LRU is enabled */
+	struct lru_gen		lru_gen;
+#endif
 
 	struct zone_reclaim_stat reclaim_stat;
 
+	/* Evictions and activations of file pages, see mm/workingset.c */
+	atomic_long_t		inactive_age;
+
 	unsigned long		pages_scanned;	   /* since last reclaim */
 	unsigned long		flags;		   /* zone flags, see below */
 
@@ -636,6 +672,12 @@ typedef struct pglist_data {
 	struct task_struct *kswapd;
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;
+	int kcompactd_max_order;
+	enum zone_type kcompactd_classzone_idx;
+#endif
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
@@ -36,9 +36,12 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		KSWAPD_LOW_WMARK_HIT_QUICKLY, KSWAPD_HIGH_WMARK_HIT_QUICKLY,
 		KSWAPD_SKIP_CONGESTION_WAIT,
 		PAGEOUTRUN, ALLOCSTALL, PGROTATED,
+		RECLAIM_CPU_DIRECT, RECLAIM_CPU_KSWAPD,	/* microseconds */
 #ifdef CONFIG_COMPACTION
 		COMPACTBLOCKS, COMPACTPAGES, COMPACTPAGEFAILED,
 		COMPACTSTALL, COMPACTFAIL, COMPACTSUCCESS,
+		COMPACTDAEMON_WAKE, COMPACTDAEMON_PROACTIVE,
+		COMPACTDAEMON_SUCCESS, COMPACTDAEMON_FAIL,
 #endif
 #ifdef CONFIG_HUGETLB_PAGE
 		HTLB_BUDDY_PGALLOC, HTLB_BUDDY_PGALLOC_FAIL,
@@ -57,6 +60,25 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		THP_COLLAPSE_ALLOC,
 		THP_COLLAPSE_ALLOC_FAILED,
 		THP_SPLIT,
+#endif
+#ifdef CONFIG_SWAP
+		SWAP_RA, SWAP_RA_HIT,
+		SWAP_VMA_RA, SWAP_VMA_RA_HIT,
+#endif
+#ifdef CONFIG_PROCESS_RECLAIM
+		PGSCAN_PROCESS, PGSTEAL_PROCESS,
+#endif
+#ifdef CONFIG_LRU_GEN
+		LRU_GEN_AGING,		/* new generations */
+		LRU_GEN_YOUNG,		/* accessed ptes found by the aging */
+#endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+		SPF_SUCCESS,		/* faults handled without mmap_sem */
+		SPF_ABORT,		/* retried with mmap_sem */
+#endif
+#ifdef CONFIG_READAHEAD_REPLAY
+		RA_REPLAY,		/* files whose record was replayed */
+		RA_REPLAY_PAGES,	/* pages read by the replay */
 #endif
 		NR_VM_EVENT_ITEMS
 };
@@ -179,6 +179,55 @@ DEFINE_EVENT(mm_vmscan_direct_reclaim_end_template, mm_vmscan_memcg_softlimit_re
 	TP_ARGS(nr_reclaimed)
 );
 
+TRACE_EVENT(mm_vmscan_process_reclaim_begin,
+
+	TP_PROTO(pid_t pid, int type),
+
+	TP_ARGS(pid, type),
+
+	TP_STRUCT__entry(
+		__field(	pid_t,	pid	)
+		__field(	int,	type	)
+	),
+
+	TP_fast_assign(
+		__entry->pid	= pid;
+		__entry->type	= type;
+	),
+
+	TP_printk("pid=%d type=%s",
+		__entry->pid,
+		__print_symbolic(__entry->type,
+			{ 1, "file" },
+			{ 2, "anon" },
+			{ 3, "all" }))
+);
+
+TRACE_EVENT(mm_vmscan_process_reclaim_end,
+
+	TP_PROTO(pid_t pid, unsigned long nr_scanned,
+		unsigned long nr_reclaimed),
+
+	TP_ARGS(pid, nr_scanned, nr_reclaimed),
+
+	TP_STRUCT__entry(
+		__field(	pid_t,		pid		)
+		__field(	unsigned long,	nr_scanned	)
+		__field(	unsigned long,	nr_reclaimed	)
+	),
+
+	TP_fast_assign(
+		__entry->pid		= pid;
+		__entry->nr_scanned	= nr_scanned;
+		__entry->nr_reclaimed	= nr_reclaimed;
+	),
+
+	TP_printk("pid=%d nr_scanned=%lu nr_reclaimed=%lu",
+		__entry->pid,
+		__entry->nr_scanned,
+		__entry->nr_reclaimed)
+);
+
 
 DECLARE_EVENT_CLASS(mm_vmscan_lru_isolate_template,
 
@@ -133,6 +133,7 @@ static unsigned long dirty_bytes_min = 2 * PAGE_SIZE;
 static int maxolduid = 65535;
 static int minolduid;
 static int min_percpu_pagelist_fract = 8;
+static int max_lru_batch = LRU_BATCH_MAX;
 
 static int ngroups_max = NGROUPS_MAX;
 
@@ -270,6 +271,9 @@ static int max_sched_tunable_scaling = SCHED_TUNABLESCALING_END-1;
 #ifdef CONFIG_COMPACTION
 static int min_extfrag_threshold;
 static int max_extfrag_threshold = 1000;
+static int max_compaction_order = MAX_ORDER - 1;
+static int min_compaction_interval = 10;
+static int max_compaction_interval = 60000;
 #endif
 
 static struct ctl_table kern_table[] = {
@@ -1036,6 +1040,17 @@ static struct ctl_table vm_table[] = {
 		.proc_handler	= proc_dointvec_minmax,
 		.extra1		= &zero,
 	},
+#ifdef CONFIG_SWAP
+	{
+		.procname	= "swap_vma_readahead",
+		.data		= &sysctl_swap_vma_readahead,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &one,
+	},
+#endif
 	{
 		.procname	= "dirty_background_ratio",
 		.data		= &dirty_background_ratio,
@@ -1179,6 +1194,24 @@ static struct ctl_table vm_table[] = {
 		.extra1		= &min_extfrag_threshold,
 		.extra2		= &max_extfrag_threshold,
 	},
+	{
+		.procname	= "compaction_proactive_order",
+		.data		= &sysctl_compaction_proactive_order,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= sysctl_compaction_proactive_handler,
+		.extra1		= &zero,
+		.extra2		= &max_compaction_order,
+	},
+	{
+		.procname	= "compaction_proactive_interval",
+		.data		= &sysctl_compaction_proactive_interval,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= sysctl_compaction_proactive_handler,
+		.extra1		= &min_compaction_interval,
+		.extra2		= &max_compaction_interval,
+	},
 
 #endif /* CONFIG_COMPACTION */
 	{
@@ -1204,6 +1237,15 @@ static struct ctl_table vm_table[] = {
 		.proc_handler	= percpu_pagelist_fraction_sysctl_handler,
 		.extra1		= &min_percpu_pagelist_fract,
 	},
+	{
+		.procname	= "lru_batch",
+		.data		= &sysctl_lru_batch,
+		.maxlen		= sizeof(sysctl_lru_batch),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &one,
+		.extra2		= &max_lru_batch,
+	},
 #ifdef CONFIG_MMU
 	{
 		.procname	= "max_map_count",
@@ -0,0 +1,113 @@
+/*
+ * LZ4 Compressor for the LZ4 block format designed by Yann Collet
+ *
+ * This is the fast variant: one hash table slot per 4 byte sequence and
+ * a search step that grows while no match is found, so incompressible
+ * data is skipped over quickly.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+#define HASH_LOG	12
+#define HASH_SIZE	(1U << HASH_LOG)
+#define SKIP_STRENGTH	6
+
+static inline u32 lz4_hash(const u8 *p)
+{
+	return (LZ4_READ32(p) * 2654435761U) >> (32 - HASH_LOG);
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		 unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	u32 *table = wrkmem;
+	const u8 *ip = src;
+	const u8 *anchor = src;
+	const u8 * const iend = src + src_len;
+	const u8 * const mflimit = iend - MFLIMIT;
+	const u8 * const matchlimit = iend - LASTLITERALS;
+	u8 *op = dst;
+	u8 * const oend = dst + *dst_len;
+	const u8 *ref;
+	u32 h;
+
+	BUILD_BUG_ON(HASH_SIZE * sizeof(u32) > LZ4_MEM_COMPRESS);
+
+	if (src_len > LZ4_MAX_INPUT_SIZE)
+		return -E2BIG;
+	if (src_len < MINLENGTH)
+		goto last_literals;
+
+	memset(table, 0, HASH_SIZE * sizeof(u32));
+	ip++;
+
+	for (;;) {
+		unsigned int attempts = (1U << SKIP_STRENGTH) + 3;
+		const u8 *fwd = ip;
+		size_t len;
+
+		/* find a match, taking bigger steps the longer it takes */
+		do {
+			ip = fwd;
+			fwd += attempts++ >> SKIP_STRENGTH;
+			if (unlikely(fwd > mflimit))
+				goto last_literals;
+			h = lz4_hash(ip);
+			ref = src + table[h];
+			table[h] = ip - src;
+		} while (ref + MAX_DISTANCE < ip ||
+			 LZ4_READ32(ref) != LZ4_READ32(ip));
+
+		/* extend it backwards over the pending literals */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		for (;;) {
+			len = MINMATCH + lz4_count(ip + MINMATCH,
+						   ref + MINMATCH, matchlimit);
+			op = lz4_put_sequence(op, oend, anchor, ip,
+					      ip - ref, len);
+			if (!op)
+				return -E2BIG;
+			ip += len;
+			anchor = ip;
+			if (ip > mflimit)
+				goto last_literals;
+
+			table[lz4_hash(ip - 2)] = ip - 2 - src;
+
+			/* a match right away needs no literals at all */
+			h = lz4_hash(ip);
+			ref = src + table[h];
+			table[h] = ip - src;
+			if (ref + MAX_DISTANCE < ip ||
+			    LZ4_READ32(ref) != LZ4_READ32(ip))
+				break;
+		}
+		ip++;
+	}
+
+last_literals:
+	op = lz4_put_last_literals(op, oend, anchor, iend);
+	if (!op)
+		return -E2BIG;
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 compressor");
@@ -0,0 +1,162 @@
+/*
+ * LZ4 Decompressor for the LZ4 block format designed by Yann Collet
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS)
+/* smallest multiple of the match offset that is at least 8 */
+static const u8 lz4_period8[8] = { 0, 8, 8, 9, 8, 10, 12, 14 };
+#endif
+
+/*
+ * Add up length bytes following a token, rejecting input that ends or
+ * asks for more than avail bytes before the length is complete.
+ */
+static inline int lz4_get_length(const u8 **ipp, const u8 *iend,
+				 size_t *len, size_t avail)
+{
+	const u8 *ip = *ipp;
+	unsigned int s;
+
+	do {
+		if (unlikely(ip >= iend))
+			return -EINVAL;
+		s = *ip++;
+		*len += s;
+		if (unlikely(*len > avail))
+			return -E2BIG;
+	} while (s == 255);
+	*ipp = ip;
+	return 0;
+}
+
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len)
+{
+	const u8 *ip = src;
+	const u8 * const iend = src + src_len;
+	u8 *op = dst;
+	u8 * const oend = dst + *dst_len;
+	int ret = -EINVAL;
+
+	if (unlikely(!src_len))
+		goto out;
+
+	for (;;) {
+		unsigned int token = *ip++;
+		size_t len = token >> ML_BITS;
+		size_t offset;
+		const u8 *ref;
+
+		/* literals */
+		if (len == RUN_MASK) {
+			ret = lz4_get_length(&ip, iend, &len, oend - op);
+			if (ret)
+				goto out;
+		}
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS)
+		if (len <= 16 && iend - ip >= 16 + 2 && oend - op >= 16) {
+			LZ4_COPY8(op, ip);
+			LZ4_COPY8(op + 8, ip + 8);
+		} else
+#endif
+		{
+			ret = -E2BIG;
+			if (unlikely(len > (size_t)(oend - op)))
+				goto out;
+			ret = -EINVAL;
+			if (unlikely(len > (size_t)(iend - ip)))
+				goto out;
+			memcpy(op, ip, len);
+		}
+		ip += len;
+		op += len;
+
+		/* the last sequence of a block has no match */
+		if (ip == iend)
+			break;
+
+		ret = -EINVAL;
+		if (unlikely(iend - ip < 2))
+			goto out;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(!offset || offset > (size_t)(op - dst)))
+			goto out;
+		ref = op - offset;
+
+		/* match */
+		len = token & ML_MASK;
+		if (len == ML_MASK) {
+			ret = lz4_get_length(&ip, iend, &len, oend - op);
+			if (ret)
+				goto out;
+		}
+		len += MINMATCH;
+		ret = -E2BIG;
+		if (unlikely(len > (size_t)(oend - op)))
+			goto out;
+		/* a match never ends the block */
+		ret = -EINVAL;
+		if (unlikely(ip >= iend))
+			goto out;
+
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS)
+		if (likely(oend - op >= 8)) {
+			u8 *end = op + len;
+
+			if (offset < 8) {
+				/*
+				 * Write the first 8 bytes one at a time, the
+				 * rest repeats them from a multiple of offset
+				 * at least 8 bytes back.
+				 */
+				op[0] = ref[0];
+				op[1] = ref[1];
+				op[2] = ref[2];
+				op[3] = ref[3];
+				op[4] = ref[4];
+				op[5] = ref[5];
+				op[6] = ref[6];
+				op[7] = ref[7];
+				op += 8;
+				ref = op - lz4_period8[offset];
+			}
+			while (op < end && oend - op >= 8) {
+				LZ4_COPY8(op, ref);
+				op += 8;
+				ref += 8;
+			}
+			if (op >= end) {
+				op = end;
+				continue;
+			}
+			/* the tail right at the end of the buffer */
+			len = end - op;
+		}
+#endif
+		do {
+			*op++ = *ref++;
+		} while (--len);
+	}
+	ret = 0;
+
+out:
+	*dst_len = op - dst;
+	return ret;
+}
+EXPORT_SYMBOL_GPL(lz4_decompress_safe);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 decompressor");
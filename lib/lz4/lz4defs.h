@@ -0,0 +1,144 @@
+/*
+ * lz4defs.h -- format constants and helpers shared by the LZ4 code
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * A sequence is a token byte (literal length in the high nibble, match
+ * length - MINMATCH in the low one), optional literal length bytes, the
+ * literals, a little endian 16-bit match offset and optional match
+ * length bytes.  Length bytes are added up until one is below 255.  The
+ * last sequence of a block only has literals.
+ */
+#define MINMATCH	4
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+#define MAX_DISTANCE	65535
+
+/*
+ * The format requires the last 5 bytes of a block to be literals and
+ * the last match to start at least 12 bytes before the end, which lets
+ * decoders copy in 8 byte steps.
+ */
+#define LASTLITERALS	5
+#define MFLIMIT		(8 + MINMATCH)
+#define MINLENGTH	(MFLIMIT + 1)
+
+#define LZ4_MAX_INPUT_SIZE	0x7E000000
+
+#define LZ4_READ32(p)	get_unaligned((const u32 *)(p))
+
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS)
+#define LZ4_COPY8(dst, src)	\
+		put_unaligned(get_unaligned((const u64 *)(src)), (u64 *)(dst))
+#endif
+
+/*
+ * Number of bytes at ip that match those at ref, not looking at limit
+ * and beyond.
+ */
+static inline size_t lz4_count(const u8 *ip, const u8 *ref, const u8 *limit)
+{
+	const u8 *start = ip;
+
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS)
+	while (ip + sizeof(unsigned long) <= limit) {
+		unsigned long diff = get_unaligned((const unsigned long *)ref) ^
+				     get_unaligned((const unsigned long *)ip);
+
+		if (!diff) {
+			ip += sizeof(unsigned long);
+			ref += sizeof(unsigned long);
+			continue;
+		}
+#ifdef __LITTLE_ENDIAN
+		ip += __ffs(diff) >> 3;
+#else
+		ip += (BITS_PER_LONG - 1 - __fls(diff)) >> 3;
+#endif
+		return ip - start;
+	}
+#endif
+	while (ip < limit && *ip == *ref) {
+		ip++;
+		ref++;
+	}
+	return ip - start;
+}
+
+/*
+ * Emit a run length: the remainder of what did not fit into the token
+ * nibble, as 255s followed by the final byte.
+ */
+static inline u8 *lz4_put_length(u8 *op, size_t len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = len;
+	return op;
+}
+
+/*
+ * Emit one sequence: literals from anchor up to ip followed by a match
+ * of match_len bytes at offset.  Returns the new output position, or
+ * NULL if it (plus the final literals) would not fit before oend.
+ */
+static inline u8 *lz4_put_sequence(u8 *op, u8 *oend, const u8 *anchor,
+				   const u8 *ip, size_t offset,
+				   size_t match_len)
+{
+	size_t lit_len = ip - anchor;
+	size_t ml = match_len - MINMATCH;
+	u8 *token = op++;
+
+	if (unlikely(op + lit_len + lit_len / 255 + 2 + 1 +
+		     ml / 255 + 1 + LASTLITERALS > oend))
+		return NULL;
+
+	if (lit_len >= RUN_MASK) {
+		*token = RUN_MASK << ML_BITS;
+		op = lz4_put_length(op, lit_len - RUN_MASK);
+	} else
+		*token = lit_len << ML_BITS;
+	memcpy(op, anchor, lit_len);
+	op += lit_len;
+
+	put_unaligned_le16(offset, op);
+	op += 2;
+
+	if (ml >= ML_MASK) {
+		*token |= ML_MASK;
+		op = lz4_put_length(op, ml - ML_MASK);
+	} else
+		*token |= ml;
+	return op;
+}
+
+/*
+ * Emit the final literal-only sequence.  Returns the new output
+ * position or NULL if it does not fit.
+ */
+static inline u8 *lz4_put_last_literals(u8 *op, u8 *oend, const u8 *anchor,
+					const u8 *iend)
+{
+	size_t lit_len = iend - anchor;
+
+	if (unlikely(op + 1 + lit_len + (lit_len + 255 - RUN_MASK) / 255 >
+		     oend))
+		return NULL;
+
+	if (lit_len >= RUN_MASK) {
+		*op++ = RUN_MASK << ML_BITS;
+		op = lz4_put_length(op, lit_len - RUN_MASK);
+	} else
+		*op++ = lit_len << ML_BITS;
+	memcpy(op, anchor, lit_len);
+	return op + lit_len;
+}
@@ -0,0 +1,179 @@
+/*
+ * LZ4 HC Compressor for the LZ4 block format designed by Yann Collet
+ *
+ * The high compression variant keeps every position of the last 64KB on
+ * hash chains and picks the longest match found on them.  A match is
+ * only emitted once the next position has been checked for a longer one
+ * (lazy matching).  The output is plain LZ4 and decompresses as fast as
+ * that of lz4_compress().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+#define HASH_LOG	15
+#define HASH_SIZE	(1U << HASH_LOG)
+#define CHAIN_SIZE	(MAX_DISTANCE + 1)
+#define MAX_ATTEMPTS	256
+
+/*
+ * Positions are offsets from the start of the input.  chain[] holds, for
+ * each position in the window, the distance back to the previous
+ * position with the same hash, 0 ending the chain.
+ */
+struct lz4hc_data {
+	u32 table[HASH_SIZE];
+	u16 chain[CHAIN_SIZE];
+};
+
+struct lz4hc_state {
+	struct lz4hc_data *data;
+	const u8 *src;
+	const u8 *matchlimit;
+	u32 next;		/* first position not yet inserted */
+};
+
+struct lz4hc_match {
+	size_t pos;
+	size_t len;
+	size_t off;
+};
+
+static inline u32 lz4hc_hash(const u8 *p)
+{
+	return (LZ4_READ32(p) * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static void lz4hc_insert(struct lz4hc_state *hc, size_t pos)
+{
+	struct lz4hc_data *d = hc->data;
+
+	while (hc->next < pos) {
+		u32 p = hc->next++;
+		u32 h = lz4hc_hash(hc->src + p);
+		u32 delta = p - d->table[h];
+
+		if (delta > MAX_DISTANCE)
+			delta = 0;
+		d->chain[p & MAX_DISTANCE] = delta;
+		d->table[h] = p;
+	}
+}
+
+/*
+ * Longest match for position pos, at least min_len + 1 bytes long.
+ * Returns its length, or 0 if none was found.
+ */
+static size_t lz4hc_find(struct lz4hc_state *hc, size_t pos, size_t min_len,
+			 size_t *off)
+{
+	struct lz4hc_data *d = hc->data;
+	const u8 *ip = hc->src + pos;
+	size_t best = min_len;
+	unsigned int attempts = MAX_ATTEMPTS;
+	u32 ref;
+
+	lz4hc_insert(hc, pos);
+
+	ref = d->table[lz4hc_hash(ip)];
+	while (ref < pos && pos - ref <= MAX_DISTANCE && attempts--) {
+		const u8 *r = hc->src + ref;
+
+		if (ip + best < hc->matchlimit && r[best] == ip[best] &&
+		    LZ4_READ32(r) == LZ4_READ32(ip)) {
+			size_t len = MINMATCH + lz4_count(ip + MINMATCH,
+							  r + MINMATCH,
+							  hc->matchlimit);
+
+			if (len > best) {
+				best = len;
+				*off = pos - ref;
+			}
+		}
+		if (!d->chain[ref & MAX_DISTANCE])
+			break;
+		ref -= d->chain[ref & MAX_DISTANCE];
+	}
+	return best > min_len ? best : 0;
+}
+
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		   unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	struct lz4hc_state hc;
+	const u8 *ip = src;
+	const u8 *anchor = src;
+	const u8 * const iend = src + src_len;
+	const u8 * const mflimit = iend - MFLIMIT;
+	const u8 * const matchlimit = iend - LASTLITERALS;
+	u8 *op = dst;
+	u8 * const oend = dst + *dst_len;
+	struct lz4hc_match cur, next;
+
+	BUILD_BUG_ON(sizeof(struct lz4hc_data) > LZ4HC_MEM_COMPRESS);
+
+	if (src_len > LZ4_MAX_INPUT_SIZE)
+		return -E2BIG;
+	if (src_len < MINLENGTH)
+		goto last_literals;
+
+	hc.data = wrkmem;
+	hc.src = src;
+	hc.matchlimit = matchlimit;
+	hc.next = 0;
+	memset(hc.data->table, 0, sizeof(hc.data->table));
+
+	while (ip <= mflimit) {
+		cur.pos = ip - src;
+		cur.len = lz4hc_find(&hc, cur.pos, MINMATCH - 1, &cur.off);
+		if (!cur.len) {
+			ip++;
+			continue;
+		}
+
+		/* try to find something better one byte later */
+		while (ip + 1 <= mflimit) {
+			next.pos = cur.pos + 1;
+			next.len = lz4hc_find(&hc, next.pos, cur.len,
+					      &next.off);
+			if (!next.len)
+				break;
+			cur = next;
+			ip++;
+		}
+
+		/* extend it backwards over the pending literals */
+		while (ip > anchor && cur.off < (size_t)(ip - src) &&
+		       ip[-1] == ip[-1 - (ssize_t)cur.off]) {
+			ip--;
+			cur.len++;
+		}
+
+		op = lz4_put_sequence(op, oend, anchor, ip, cur.off, cur.len);
+		if (!op)
+			return -E2BIG;
+		ip += cur.len;
+		anchor = ip;
+	}
+
+last_literals:
+	op = lz4_put_last_literals(op, oend, anchor, iend);
+	if (!op)
+		return -E2BIG;
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lz4hc_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 HC compressor");
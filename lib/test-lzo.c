@@ -0,0 +1,176 @@
+/*
+ * Runtime test and benchmark for the LZO1X compressor and decompressor.
+ *
+ * Every page of the corpus (the kernel's own text and rodata plus a few
+ * synthetic pages: zeroes, a repeated pattern and random data) is
+ * compressed, decompressed again and compared with the original.  The
+ * decompressor is also fed truncated streams, which it has to reject.
+ * Afterwards the whole corpus is timed and the throughput and ratio are
+ * printed, so the numbers can be compared between kernels or CPUs.
+ */
+#include <linux/init.h>
+#include <linux/kallsyms.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/lzo.h>
+#include <linux/mm.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/hrtimer.h>
+#include <linux/sched.h>
+#include <asm/sections.h>
+
+static unsigned int rounds = 8;
+module_param(rounds, uint, 0444);
+MODULE_PARM_DESC(rounds, "Number of passes over the corpus for timing");
+
+static unsigned char *wrkmem, *cbuf, *dbuf;
+static unsigned char *synth;
+
+enum { SYNTH_ZERO, SYNTH_PATTERN, SYNTH_RANDOM, SYNTH_NR };
+
+struct lzo_corpus {
+	const char *name;
+	const unsigned char *start;
+	size_t len;
+};
+
+static int __init test_lzo_page(const unsigned char *src, size_t len,
+				size_t *clen)
+{
+	size_t out_len, dlen;
+	int ret;
+
+	ret = lzo1x_1_compress(src, len, cbuf, &out_len, wrkmem);
+	if (ret != LZO_E_OK) {
+		WARN(1, "lzo1x_1_compress: %d\n", ret);
+		return -EINVAL;
+	}
+	if (out_len > lzo1x_worst_compress(len)) {
+		WARN(1, "lzo1x_1_compress: %zu bytes exceeds worst case\n",
+		     out_len);
+		return -EINVAL;
+	}
+
+	dlen = len;
+	ret = lzo1x_decompress_safe(cbuf, out_len, dbuf, &dlen);
+	if (ret != LZO_E_OK || dlen != len || memcmp(src, dbuf, len)) {
+		WARN(1, "lzo1x_decompress_safe: %d, %zu of %zu bytes\n",
+		     ret, dlen, len);
+		return -EINVAL;
+	}
+
+	/* a truncated stream or a short output buffer must not succeed */
+	dlen = len;
+	if (lzo1x_decompress_safe(cbuf, out_len - 1, dbuf, &dlen) == LZO_E_OK) {
+		WARN(1, "lzo1x_decompress_safe: accepted truncated input\n");
+		return -EINVAL;
+	}
+	dlen = len - 1;
+	if (lzo1x_decompress_safe(cbuf, out_len, dbuf, &dlen) == LZO_E_OK) {
+		WARN(1, "lzo1x_decompress_safe: overran output buffer\n");
+		return -EINVAL;
+	}
+
+	*clen = out_len;
+	return 0;
+}
+
+static void __init test_lzo_corpus(const struct lzo_corpus *c)
+{
+	size_t off, len, clen, total = 0;
+	u64 cns, dns;
+	ktime_t t0;
+	unsigned int r;
+
+	for (off = 0; off < c->len; off += PAGE_SIZE) {
+		len = min_t(size_t, PAGE_SIZE, c->len - off);
+		if (test_lzo_page(c->start + off, len, &clen))
+			return;
+		total += clen;
+	}
+
+	t0 = ktime_get();
+	for (r = 0; r < rounds; r++) {
+		for (off = 0; off < c->len; off += PAGE_SIZE) {
+			len = min_t(size_t, PAGE_SIZE, c->len - off);
+			lzo1x_1_compress(c->start + off, len, cbuf, &clen,
+					 wrkmem);
+		}
+		cond_resched();
+	}
+	cns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+	/* decompression is timed on the last page only, it is in cbuf */
+	t0 = ktime_get();
+	for (r = 0; r < rounds * DIV_ROUND_UP(c->len, PAGE_SIZE); r++) {
+		size_t dlen = len;
+
+		lzo1x_decompress_safe(cbuf, clen, dbuf, &dlen);
+	}
+	dns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+	pr_info("test-lzo: %-8s %8zu -> %8zu bytes (%3zu%%), "
+		"compress %llu KB/s, decompress %llu KB/s\n",
+		c->name, c->len, total, total * 100 / c->len,
+		cns ? div64_u64((u64)c->len * rounds * NSEC_PER_SEC,
+				cns * 1024) : 0,
+		dns ? div64_u64((u64)DIV_ROUND_UP(c->len, PAGE_SIZE) * len *
+				rounds * NSEC_PER_SEC, dns * 1024) : 0);
+}
+
+/*
+ * The section symbols are not exported, a modular build has to look them
+ * up (and skips the kernel image without CONFIG_KALLSYMS).
+ */
+#ifdef MODULE
+#define SECTION_START(sym)	((const unsigned char *)kallsyms_lookup_name(#sym))
+#else
+#define SECTION_START(sym)	((const unsigned char *)(sym))
+#endif
+#define SECTION_LEN(start, end)	\
+	((size_t)(SECTION_START(end) - SECTION_START(start)))
+
+static int __init test_lzo_init(void)
+{
+	unsigned char *pattern;
+	struct lzo_corpus corpus[] = {
+		{ "text",    SECTION_START(_stext), SECTION_LEN(_stext, _etext) },
+		{ "rodata",  SECTION_START(__start_rodata),
+			     SECTION_LEN(__start_rodata, __end_rodata) },
+		{ "zero",    NULL, PAGE_SIZE },
+		{ "pattern", NULL, PAGE_SIZE },
+		{ "random",  NULL, PAGE_SIZE },
+	};
+	unsigned int i;
+
+	wrkmem = vmalloc(LZO1X_1_MEM_COMPRESS);
+	cbuf = vmalloc(lzo1x_worst_compress(PAGE_SIZE));
+	dbuf = vmalloc(PAGE_SIZE);
+	synth = vmalloc(SYNTH_NR * PAGE_SIZE);
+	if (!wrkmem || !cbuf || !dbuf || !synth)
+		goto out;
+
+	memset(synth + SYNTH_ZERO * PAGE_SIZE, 0, PAGE_SIZE);
+	pattern = synth + SYNTH_PATTERN * PAGE_SIZE;
+	for (i = 0; i < PAGE_SIZE; i++)
+		pattern[i] = "lzo1x pattern "[i % 14] + (i / 512);
+	get_random_bytes(synth + SYNTH_RANDOM * PAGE_SIZE, PAGE_SIZE);
+	for (i = 0; i < SYNTH_NR; i++)
+		corpus[2 + i].start = synth + i * PAGE_SIZE;
+
+	for (i = 0; i < ARRAY_SIZE(corpus); i++)
+		if (corpus[i].start && corpus[i].len)
+			test_lzo_corpus(&corpus[i]);
+out:
+	vfree(synth);
+	vfree(dbuf);
+	vfree(cbuf);
+	vfree(wrkmem);
+	return -EINVAL;
+}
+module_init(test_lzo_init);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZO1X runtime test and benchmark");
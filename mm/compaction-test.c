@@ -0,0 +1,146 @@
+/*
+ * Fragmentation stress test for memory compaction.
+ *
+ * Fills a shmem file with fill_pct percent of the free memory, then punches
+ * out all but the first page of every 1 << order pages of it.  That leaves
+ * the freed memory in holes too small for an allocation of that order, each
+ * pinned by a movable page cache page which compaction can move out of the
+ * way.  After delay_ms milliseconds (to let kcompactd do its work) count
+ * pages of that order are allocated with GFP_KERNEL, and the allocation
+ * latency, the number of failures and the number of direct compaction
+ * stalls and background compaction passes are printed.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/gfp.h>
+#include <linux/shmem_fs.h>
+#include <linux/slab.h>
+#include <linux/swap.h>
+#include <linux/vmalloc.h>
+#include <linux/vmstat.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+
+static unsigned int order = PAGE_ALLOC_COSTLY_ORDER;
+module_param(order, uint, 0444);
+MODULE_PARM_DESC(order, "Order of the test allocations");
+
+static unsigned int count = 256;
+module_param(count, uint, 0444);
+MODULE_PARM_DESC(count, "Number of test allocations");
+
+static unsigned int fill_pct = 50;
+module_param(fill_pct, uint, 0444);
+MODULE_PARM_DESC(fill_pct, "Percentage of free memory to fragment");
+
+static unsigned int delay_ms;
+module_param(delay_ms, uint, 0444);
+MODULE_PARM_DESC(delay_ms, "Delay between fragmenting and allocating");
+
+static int __init fragment_memory(struct file *file, unsigned long nr_pages)
+{
+	struct address_space *mapping = file->f_mapping;
+	unsigned long i, step = 1UL << order;
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = shmem_read_mapping_page(mapping, i);
+
+		if (IS_ERR(page))
+			return PTR_ERR(page);
+		page_cache_release(page);
+		cond_resched();
+	}
+
+	for (i = 0; i + step <= nr_pages; i += step) {
+		shmem_truncate_range(mapping->host,
+				     (loff_t)(i + 1) << PAGE_SHIFT,
+				     ((loff_t)(i + step) << PAGE_SHIFT) - 1);
+		cond_resched();
+	}
+	return 0;
+}
+
+static void __init test_allocations(void)
+{
+	struct page **pages;
+	unsigned long *before, *after;
+	u64 total_ns = 0, max_ns = 0;
+	unsigned int i, ok = 0;
+
+	pages = vzalloc(count * sizeof(*pages));
+	before = kzalloc(2 * NR_VM_EVENT_ITEMS * sizeof(*before), GFP_KERNEL);
+	if (!pages || !before)
+		goto out;
+	after = before + NR_VM_EVENT_ITEMS;
+
+	all_vm_events(before);
+	for (i = 0; i < count; i++) {
+		ktime_t start = ktime_get();
+		u64 ns;
+
+		pages[i] = alloc_pages(GFP_KERNEL | __GFP_NOWARN, order);
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		total_ns += ns;
+		if (ns > max_ns)
+			max_ns = ns;
+		if (pages[i])
+			ok++;
+	}
+	all_vm_events(after);
+
+	do_div(total_ns, count);
+	do_div(max_ns, NSEC_PER_USEC);
+	printk(KERN_INFO "compaction-test: order-%u: %u/%u allocated, "
+	       "avg %llu ns, max %llu us, %lu compact stalls, "
+	       "%lu background passes\n", order, ok, count,
+	       (unsigned long long)total_ns, (unsigned long long)max_ns,
+	       after[COMPACTSTALL] - before[COMPACTSTALL],
+	       after[COMPACTDAEMON_WAKE] - before[COMPACTDAEMON_WAKE]);
+
+	for (i = 0; i < count; i++)
+		if (pages[i])
+			__free_pages(pages[i], order);
+out:
+	kfree(before);
+	vfree(pages);
+}
+
+static int __init test_compaction_init(void)
+{
+	unsigned long nr_pages;
+	struct file *file;
+	int ret;
+
+	if (!order || order >= MAX_ORDER || !count || fill_pct > 90)
+		return -EINVAL;
+
+	nr_pages = nr_free_pages() / 100 * fill_pct;
+	file = shmem_file_setup("compaction-test",
+				(loff_t)nr_pages << PAGE_SHIFT, VM_NORESERVE);
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+
+	ret = fragment_memory(file, nr_pages);
+	if (ret) {
+		printk(KERN_ERR "compaction-test: fragmenting failed (%d)\n",
+		       ret);
+		goto out;
+	}
+	printk(KERN_INFO "compaction-test: fragmented %lu pages in "
+	       "order-%u blocks\n", nr_pages, order);
+
+	if (delay_ms)
+		msleep(delay_ms);
+
+	test_allocations();
+out:
+	fput(file);
+	return -EINVAL;
+}
+module_init(test_compaction_init);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Memory compaction fragmentation stress test");
@@ -14,6 +14,8 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -653,6 +655,239 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 	return rc;
 }
 
+/*
+ * Background compaction.
+ *
+ * One kcompactd thread runs per node.  kswapd wakes it when it goes to sleep
+ * after reclaiming for a high-order allocation, so that the memory it freed
+ * is compacted into a page of that order before the next such allocation
+ * has to stall in direct compaction.  If compaction_proactive_order is set,
+ * kcompactd also wakes up every compaction_proactive_interval milliseconds
+ * and compacts the zones in which an allocation of that order would fail
+ * due to external fragmentation, as judged by compaction_suitable().
+ * The interval is timed with a deferrable timer, so an idle CPU is not
+ * woken up just for this.
+ *
+ * Background compaction is asynchronous and rate limited: every wakeup that
+ * does not leave a page of the wanted order free, whether the pass failed
+ * or there was nothing it could compact, doubles the proactive interval,
+ * up to 1 << COMPACT_MAX_DEFER_SHIFT times.  Only a successful pass resets
+ * it.  Proactive compaction is off by default.
+ */
+int sysctl_compaction_proactive_order;
+int sysctl_compaction_proactive_interval = 500;
+
+/* Bumped when the sysctls above change, so that kcompactd rereads them */
+static unsigned int kcompactd_proactive_seq;
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat, int order,
+				    int classzone_idx)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_suitable(zone, order) == COMPACT_CONTINUE)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Compact the zones of @pgdat up to @classzone_idx that need it for an
+ * allocation of @order.  Returns false if any of them still has no free
+ * page of that order afterwards.
+ */
+static bool kcompactd_do_work(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	int zoneid;
+	bool success = true;
+
+	count_vm_event(COMPACTDAEMON_WAKE);
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (kthread_should_stop() || freezing(current))
+			return false;
+
+		if (compaction_suitable(zone, order) != COMPACT_CONTINUE)
+			continue;
+
+		compact_zone_order(zone, order, GFP_KERNEL, false);
+
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone),
+				      0, 0)) {
+			count_vm_event(COMPACTDAEMON_SUCCESS);
+		} else {
+			count_vm_event(COMPACTDAEMON_FAIL);
+			success = false;
+		}
+	}
+
+	return success;
+}
+
+static bool kcompactd_work_requested(pg_data_t *pgdat, unsigned int seq)
+{
+	return pgdat->kcompactd_max_order > 0 || kthread_should_stop() ||
+		seq != ACCESS_ONCE(kcompactd_proactive_seq);
+}
+
+static void kcompactd_timer_fn(unsigned long data)
+{
+	pg_data_t *pgdat = (pg_data_t *)data;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * The background compaction daemon, started as a kernel thread
+ * from the init process.
+ */
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	unsigned int defer_shift = 0;
+	struct timer_list timer;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+	set_freezable();
+	setup_deferrable_timer_on_stack(&timer, kcompactd_timer_fn,
+					(unsigned long)pgdat);
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+
+	while (!kthread_should_stop()) {
+		unsigned int seq = ACCESS_ONCE(kcompactd_proactive_seq);
+		bool timed = sysctl_compaction_proactive_order > 0;
+		int order, classzone_idx;
+
+		if (timed)
+			mod_timer(&timer, jiffies + (msecs_to_jiffies(
+				sysctl_compaction_proactive_interval) <<
+				defer_shift));
+
+		wait_event_freezable(pgdat->kcompactd_wait,
+				kcompactd_work_requested(pgdat, seq) ||
+				(timed && !timer_pending(&timer)));
+		del_timer_sync(&timer);
+		if (kthread_should_stop())
+			break;
+
+		/* Start over at the configured interval after a change */
+		if (seq != ACCESS_ONCE(kcompactd_proactive_seq))
+			defer_shift = 0;
+
+		order = pgdat->kcompactd_max_order;
+		classzone_idx = pgdat->kcompactd_classzone_idx;
+		pgdat->kcompactd_max_order = 0;
+		pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+
+		if (!order) {
+			/* Timed out or reconfigured: check fragmentation */
+			order = sysctl_compaction_proactive_order;
+			if (order <= 0)
+				continue;
+			if (!kcompactd_node_suitable(pgdat, order,
+						     classzone_idx)) {
+				/* Nothing to compact, check less often */
+				if (defer_shift < COMPACT_MAX_DEFER_SHIFT)
+					defer_shift++;
+				continue;
+			}
+			count_vm_event(COMPACTDAEMON_PROACTIVE);
+		}
+
+		if (kcompactd_do_work(pgdat, order, classzone_idx))
+			defer_shift = 0;
+		else if (defer_shift < COMPACT_MAX_DEFER_SHIFT)
+			defer_shift++;
+	}
+
+	del_timer_sync(&timer);
+	destroy_timer_on_stack(&timer);
+
+	return 0;
+}
+
+/*
+ * kswapd has finished reclaiming for an allocation of @order, wake the
+ * node's kcompactd to compact the free memory into pages of that order.
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	if (!order)
+		return;
+
+	if (!kcompactd_node_suitable(pgdat, order, classzone_idx))
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+	if (pgdat->kcompactd_classzone_idx > classzone_idx)
+		pgdat->kcompactd_classzone_idx = classzone_idx;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		ret = PTR_ERR(pgdat->kcompactd);
+		pgdat->kcompactd = NULL;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+module_init(kcompactd_init)
+
 
 /* Compact all zones within a node */
 static int compact_node(int nid)
@@ -724,6 +959,22 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+int sysctl_compaction_proactive_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret, nid;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	kcompactd_proactive_seq++;
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		wake_up_interruptible(&NODE_DATA(nid)->kcompactd_wait);
+
+	return 0;
+}
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct sys_device *dev,
 			struct sysdev_attribute *attr,
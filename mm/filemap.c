@@ -110,12 +110,44 @@
  *    ->i_mmap_mutex
  */
 
+static void page_cache_tree_delete(struct address_space *mapping,
+				   struct page *page, void *shadow)
+{
+	struct radix_tree_node *node;
+	void **slot;
+	bool track;
+
+	__radix_tree_lookup(&mapping->page_tree, page->index, &node, &slot);
+
+	/*
+	 * The shadow entry takes the page's slot.  The root cannot hold
+	 * one, it has no node to account it to.
+	 */
+	if (shadow && node) {
+		radix_tree_replace_slot(slot, shadow);
+		node->exceptional++;
+		mapping->nrshadows++;
+		workingset_update_node(mapping, node, page->index);
+		return;
+	}
+
+	/*
+	 * A node that is left with shadow entries goes on the shadow node
+	 * list, unless the delete frees it: see mm/workingset.c.
+	 */
+	track = node && node->exceptional && node->count > 1;
+	radix_tree_delete(&mapping->page_tree, page->index);
+	if (track && mapping->page_tree.height)
+		workingset_update_node(mapping, node, page->index);
+}
+
 /*
  * Delete a page from the page cache and free it. Caller has to make
  * sure the page is locked and that nobody else uses it - or that usage
- * is safe.  The caller must hold the mapping's tree_lock.
+ * is safe.  The caller must hold the mapping's tree_lock.  If @shadow is
+ * not NULL, it is left in the page's place, see mm/workingset.c.
  */
-void __delete_from_page_cache(struct page *page)
+void __delete_from_page_cache(struct page *page, void *shadow)
 {
 	struct address_space *mapping = page->mapping;
 
@@ -129,7 +161,7 @@ void __delete_from_page_cache(struct page *page)
 	else
 		cleancache_flush_page(mapping, page);
 
-	radix_tree_delete(&mapping->page_tree, page->index);
+	page_cache_tree_delete(mapping, page, shadow);
 	page->mapping = NULL;
 	mapping->nrpages--;
 	__dec_zone_page_state(page, NR_FILE_PAGES);
@@ -167,7 +199,7 @@ void delete_from_page_cache(struct page *page)
 
 	freepage = mapping->a_ops->freepage;
 	spin_lock_irq(&mapping->tree_lock);
-	__delete_from_page_cache(page);
+	__delete_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
@@ -378,6 +410,43 @@ int filemap_write_and_wait_range(struct address_space *mapping,
 }
 EXPORT_SYMBOL(filemap_write_and_wait_range);
 
+/*
+ * Insert a page into the page cache tree.  If the slot holds the shadow
+ * entry of the page evicted from there, the page takes its place and the
+ * entry is returned in *@shadowp.
+ */
+static int page_cache_tree_insert(struct address_space *mapping,
+				  struct page *page, void **shadowp)
+{
+	struct radix_tree_node *node;
+	void **slot;
+	void *p;
+	int error;
+
+	p = __radix_tree_lookup(&mapping->page_tree, page->index,
+				&node, &slot);
+	if (p) {
+		if (!radix_tree_exceptional_entry(p))
+			return -EEXIST;
+		radix_tree_replace_slot(slot, page);
+		node->exceptional--;
+		mapping->nrshadows--;
+		workingset_update_node(mapping, node, page->index);
+		if (shadowp)
+			*shadowp = p;
+		return 0;
+	}
+
+	error = radix_tree_insert(&mapping->page_tree, page->index, page);
+	if (error || !mapping->nrshadows)
+		return error;
+
+	/* The node may have held nothing but shadow entries */
+	__radix_tree_lookup(&mapping->page_tree, page->index, &node, &slot);
+	workingset_update_node(mapping, node, page->index);
+	return 0;
+}
+
 /**
  * replace_page_cache_page - replace a pagecache page with a new one
  * @old:	page to be replaced
@@ -427,8 +496,8 @@ int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask)
 		new->index = offset;
 
 		spin_lock_irq(&mapping->tree_lock);
-		__delete_from_page_cache(old);
-		error = radix_tree_insert(&mapping->page_tree, offset, new);
+		__delete_from_page_cache(old, NULL);
+		error = page_cache_tree_insert(mapping, new, NULL);
 		BUG_ON(error);
 		mapping->nrpages++;
 		__inc_zone_page_state(new, NR_FILE_PAGES);
@@ -448,18 +517,9 @@ int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask)
 }
 EXPORT_SYMBOL_GPL(replace_page_cache_page);
 
-/**
- * add_to_page_cache_locked - add a locked page to the pagecache
- * @page:	page to add
- * @mapping:	the page's address_space
- * @offset:	page index
- * @gfp_mask:	page allocation mode
- *
- * This function is used to add a page to the pagecache. It must be locked.
- * This function does not add the page to the LRU.  The caller must do that.
- */
-int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
-		pgoff_t offset, gfp_t gfp_mask)
+static int __add_to_page_cache_locked(struct page *page,
+		struct address_space *mapping, pgoff_t offset,
+		gfp_t gfp_mask, void **shadowp)
 {
 	int error;
 
@@ -477,7 +537,7 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 		page->index = offset;
 
 		spin_lock_irq(&mapping->tree_lock);
-		error = radix_tree_insert(&mapping->page_tree, offset, page);
+		error = page_cache_tree_insert(mapping, page, shadowp);
 		if (likely(!error)) {
 			mapping->nrpages++;
 			__inc_zone_page_state(page, NR_FILE_PAGES);
@@ -496,11 +556,29 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 out:
 	return error;
 }
+
+/**
+ * add_to_page_cache_locked - add a locked page to the pagecache
+ * @page:	page to add
+ * @mapping:	the page's address_space
+ * @offset:	page index
+ * @gfp_mask:	page allocation mode
+ *
+ * This function is used to add a page to the pagecache. It must be locked.
+ * This function does not add the page to the LRU.  The caller must do that.
+ */
+int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
+		pgoff_t offset, gfp_t gfp_mask)
+{
+	return __add_to_page_cache_locked(page, mapping, offset,
+					  gfp_mask, NULL);
+}
 EXPORT_SYMBOL(add_to_page_cache_locked);
 
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t offset, gfp_t gfp_mask)
 {
+	void *shadow = NULL;
 	int ret;
 
 	/*
@@ -512,14 +590,28 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 	if (mapping_cap_swap_backed(mapping))
 		SetPageSwapBacked(page);
 
-	ret = add_to_page_cache(page, mapping, offset, gfp_mask);
-	if (ret == 0) {
-		if (page_is_file_cache(page))
-			lru_cache_add_file(page);
-		else
-			lru_cache_add_anon(page);
+	__set_page_locked(page);
+	ret = __add_to_page_cache_locked(page, mapping, offset,
+					 gfp_mask, &shadow);
+	if (unlikely(ret)) {
+		__clear_page_locked(page);
+		return ret;
 	}
-	return ret;
+
+	if (page_is_file_cache(page)) {
+		/*
+		 * The page was evicted recently enough that it would still
+		 * be in memory if the active list had been given to it: it
+		 * belongs to the working set, so put it on the active list.
+		 */
+		if (shadow && workingset_refault(shadow)) {
+			workingset_activation(page);
+			lru_cache_add_lru(page, LRU_ACTIVE_FILE);
+		} else
+			lru_cache_add_file(page);
+	} else
+		lru_cache_add_anon(page);
+	return 0;
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
@@ -694,6 +786,64 @@ int __lock_page_or_retry(struct page *page, struct mm_struct *mm,
 	}
 }
 
+/**
+ * page_cache_next_hole - find the next hole (not-present entry)
+ * @mapping: mapping
+ * @index: index
+ * @max_scan: maximum range to search
+ *
+ * Like radix_tree_next_hole() on @mapping->page_tree, except that the
+ * shadow entries of evicted pages count as holes.
+ */
+pgoff_t page_cache_next_hole(struct address_space *mapping,
+			     pgoff_t index, unsigned long max_scan)
+{
+	unsigned long i;
+
+	for (i = 0; i < max_scan; i++) {
+		struct page *page;
+
+		page = radix_tree_lookup(&mapping->page_tree, index);
+		if (!page || radix_tree_exceptional_entry(page))
+			break;
+		index++;
+		if (index == 0)
+			break;
+	}
+
+	return index;
+}
+EXPORT_SYMBOL(page_cache_next_hole);
+
+/**
+ * page_cache_prev_hole - find the prev hole (not-present entry)
+ * @mapping: mapping
+ * @index: index
+ * @max_scan: maximum range to search
+ *
+ * Like radix_tree_prev_hole() on @mapping->page_tree, except that the
+ * shadow entries of evicted pages count as holes.
+ */
+pgoff_t page_cache_prev_hole(struct address_space *mapping,
+			     pgoff_t index, unsigned long max_scan)
+{
+	unsigned long i;
+
+	for (i = 0; i < max_scan; i++) {
+		struct page *page;
+
+		page = radix_tree_lookup(&mapping->page_tree, index);
+		if (!page || radix_tree_exceptional_entry(page))
+			break;
+		index--;
+		if (index == ULONG_MAX)
+			break;
+	}
+
+	return index;
+}
+EXPORT_SYMBOL(page_cache_prev_hole);
+
 /**
  * find_get_page - find and get a page reference
  * @mapping: the address_space to search
@@ -717,6 +867,11 @@ repeat:
 			goto out;
 		if (radix_tree_deref_retry(page))
 			goto repeat;
+		/* The shadow entry of an evicted page, see mm/workingset.c */
+		if (radix_tree_exceptional_entry(page)) {
+			page = NULL;
+			goto out;
+		}
 
 		if (!page_cache_get_speculative(page))
 			goto repeat;
@@ -815,6 +970,32 @@ repeat:
 }
 EXPORT_SYMBOL(find_or_create_page);
 
+/*
+ * Move *@index past the shadow entries at and after it, to the next slot
+ * that holds something else.  Returns false if there is none.  Called
+ * under rcu_read_lock.
+ */
+static bool page_cache_skip_shadows(struct address_space *mapping,
+				    pgoff_t *index)
+{
+	unsigned long next;
+	void **slot;
+
+	while (radix_tree_gang_lookup_slot(&mapping->page_tree, &slot, &next,
+					   *index, 1)) {
+		void *entry = radix_tree_deref_slot(slot);
+
+		if (!radix_tree_exceptional_entry(entry)) {
+			*index = next;
+			return true;
+		}
+		*index = next + 1;
+		if (!*index)
+			break;
+	}
+	return false;
+}
+
 /**
  * find_get_pages - gang pagecache lookup
  * @mapping:	The address_space to search
@@ -836,13 +1017,14 @@ unsigned find_get_pages(struct address_space *mapping, pgoff_t start,
 {
 	unsigned int i;
 	unsigned int ret;
-	unsigned int nr_found;
+	unsigned int nr_found, nr_shadows;
 
 	rcu_read_lock();
 restart:
 	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, start, nr_pages);
+				(void ***)pages, NULL, start, nr_pages);
 	ret = 0;
+	nr_shadows = 0;
 	for (i = 0; i < nr_found; i++) {
 		struct page *page;
 repeat:
@@ -859,6 +1041,12 @@ repeat:
 			goto restart;
 		}
 
+		/* Skip the shadow entries of evicted pages */
+		if (radix_tree_exceptional_entry(page)) {
+			nr_shadows++;
+			continue;
+		}
+
 		if (!page_cache_get_speculative(page))
 			goto repeat;
 
@@ -875,9 +1063,14 @@ repeat:
 	/*
 	 * If all entries were removed before we could secure them,
 	 * try again, because callers stop trying once 0 is returned.
+	 * For the same reason, look past the shadow entries if there was
+	 * nothing else.
 	 */
-	if (unlikely(!ret && nr_found))
-		goto restart;
+	if (unlikely(!ret && nr_found)) {
+		if (nr_shadows < nr_found ||
+		    page_cache_skip_shadows(mapping, &start))
+			goto restart;
+	}
 	rcu_read_unlock();
 	return ret;
 }
@@ -904,7 +1097,7 @@ unsigned find_get_pages_contig(struct address_space *mapping, pgoff_t index,
 	rcu_read_lock();
 restart:
 	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, index, nr_pages);
+				(void ***)pages, NULL, index, nr_pages);
 	ret = 0;
 	for (i = 0; i < nr_found; i++) {
 		struct page *page;
@@ -920,6 +1113,10 @@ repeat:
 		if (radix_tree_deref_retry(page))
 			goto restart;
 
+		/* A shadow entry: the page was evicted, the run ends here */
+		if (radix_tree_exceptional_entry(page))
+			break;
+
 		if (!page_cache_get_speculative(page))
 			goto repeat;
 
@@ -985,6 +1182,14 @@ repeat:
 		if (radix_tree_deref_retry(page))
 			goto restart;
 
+		/*
+		 * Shadow entries are never tagged, but the tags are looked
+		 * up locklessly, and the page seen tagged may have been
+		 * evicted since.
+		 */
+		if (radix_tree_exceptional_entry(page))
+			continue;
+
 		if (!page_cache_get_speculative(page))
 			goto repeat;
 
@@ -2872,6 +2872,7 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	struct mem_cgroup *ptr;
 	int exclusive = 0;
 	int ret = 0;
+	bool vma_readahead;
 
 	if (!pte_unmap_same(mm, pmd, page_table, orig_pte))
 		goto out;
@@ -2889,10 +2890,15 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		goto out;
 	}
 	delayacct_set_flag(DELAYACCT_PF_SWAPIN);
-	page = lookup_swap_cache(entry);
+	vma_readahead = swap_use_vma_readahead();
+	page = lookup_swap_cache(entry, vma_readahead ? vma : NULL);
 	if (!page) {
 		grab_swap_token(mm); /* Contend for token _before_ read-in */
-		page = swapin_readahead(entry,
+		if (vma_readahead)
+			page = swap_vma_readahead(entry,
+					GFP_HIGHUSER_MOVABLE, vma, address);
+		else
+			page = swapin_readahead(entry,
 					GFP_HIGHUSER_MOVABLE, vma, address);
 		if (!page) {
 			/*
@@ -3072,14 +3078,84 @@ static inline int check_stack_guard_page(struct vm_area_struct *vma, unsigned lo
 	return 0;
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Check the vma fields a speculative fault depends on.  They are read
+ * without mmap_sem, so they only count if vm_sequence is unchanged when
+ * checked after them.
+ */
+static bool spf_vma_valid(struct vm_area_struct *vma, unsigned long address,
+		unsigned int flags)
+{
+	unsigned long vm_flags = ACCESS_ONCE(vma->vm_flags);
+
+	if (address < ACCESS_ONCE(vma->vm_start) ||
+	    address >= ACCESS_ONCE(vma->vm_end))
+		return false;
+	if (vm_flags & (VM_GROWSDOWN | VM_GROWSUP | VM_NONLINEAR |
+			VM_HUGETLB | VM_PFNMAP | VM_MIXEDMAP | VM_IO))
+		return false;
+	/* A private write needs the anon_vma, only mmap_sem may set it up */
+	if ((flags & FAULT_FLAG_WRITE) && !ACCESS_ONCE(vma->anon_vma))
+		return false;
+	return true;
+}
+
+/*
+ * Map and lock the pte for a fault that has allocated its page.  A
+ * speculative fault holds no mmap_sem, so it checks under the pte lock
+ * that its vma did not change since handle_speculative_fault() looked
+ * at it: then unmap_region() and the other writers wait for the lock
+ * before they change the page table.  It fails, for the fault to be
+ * retried with mmap_sem, if the vma changed.
+ */
+static bool pte_map_lock(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long address, pmd_t *pmd, unsigned int flags,
+		unsigned int seq, pte_t **page_table, spinlock_t **ptlp)
+{
+	spinlock_t *ptl;
+
+	if (!(flags & FAULT_FLAG_SPECULATIVE)) {
+		*page_table = pte_offset_map_lock(mm, pmd, address, ptlp);
+		return true;
+	}
+
+	spin_lock(&mm->page_table_lock);
+	if (read_seqcount_retry(&vma->vm_sequence, seq) ||
+	    !spf_vma_valid(vma, address, flags) ||
+	    pmd_none(*pmd) || unlikely(pmd_bad(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		return false;
+	}
+	ptl = pte_lockptr(mm, pmd);
+	if (ptl != &mm->page_table_lock) {
+		spin_lock(ptl);
+		spin_unlock(&mm->page_table_lock);
+	}
+	*page_table = pte_offset_map(pmd, address);
+	*ptlp = ptl;
+	return true;
+}
+#else
+static inline bool pte_map_lock(struct mm_struct *mm,
+		struct vm_area_struct *vma, unsigned long address, pmd_t *pmd,
+		unsigned int flags, unsigned int seq, pte_t **page_table,
+		spinlock_t **ptlp)
+{
+	*page_table = pte_offset_map_lock(mm, pmd, address, ptlp);
+	return true;
+}
+#endif
+
 /*
  * We enter with non-exclusive mmap_sem (to exclude vma changes,
  * but allow concurrent faults), and pte mapped but not yet locked.
  * We return with mmap_sem still held, but pte unmapped and unlocked.
+ * A speculative fault enters without mmap_sem, see pte_map_lock().
  */
 static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
-		unsigned int flags)
+		unsigned int flags, unsigned int seq)
 {
 	struct page *page;
 	spinlock_t *ptl;
@@ -3095,7 +3171,9 @@ static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (!(flags & FAULT_FLAG_WRITE)) {
 		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
 						vma->vm_page_prot));
-		page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+		if (!pte_map_lock(mm, vma, address, pmd, flags, seq,
+				  &page_table, &ptl))
+			return VM_FAULT_RETRY;
 		if (!pte_none(*page_table))
 			goto unlock;
 		goto setpte;
@@ -3116,7 +3194,12 @@ static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (vma->vm_flags & VM_WRITE)
 		entry = pte_mkwrite(pte_mkdirty(entry));
 
-	page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+	if (!pte_map_lock(mm, vma, address, pmd, flags, seq,
+			  &page_table, &ptl)) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+		return VM_FAULT_RETRY;
+	}
 	if (!pte_none(*page_table))
 		goto release;
 
@@ -3154,8 +3237,8 @@ oom:
  * We return with mmap_sem still held, but pte unmapped and unlocked.
  */
 static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
-		unsigned long address, pmd_t *pmd,
-		pgoff_t pgoff, unsigned int flags, pte_t orig_pte)
+		unsigned long address, pmd_t *pmd, pgoff_t pgoff,
+		unsigned int flags, pte_t orig_pte, unsigned int seq)
 {
 	pte_t *page_table;
 	spinlock_t *ptl;
@@ -3167,6 +3250,7 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	struct vm_fault vmf;
 	int ret;
 	int page_mkwrite = 0;
+	bool locked;
 
 	vmf.virtual_address = (void __user *)(address & PAGE_MASK);
 	vmf.pgoff = pgoff;
@@ -3250,7 +3334,8 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	}
 
-	page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+	locked = pte_map_lock(mm, vma, address, pmd, flags, seq,
+			      &page_table, &ptl);
 
 	/*
 	 * This silly early PAGE_DIRTY setting removes a race
@@ -3263,7 +3348,7 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	 * handle that later.
 	 */
 	/* Only go through if we didn't race with anybody else... */
-	if (likely(pte_same(*page_table, orig_pte))) {
+	if (likely(locked && pte_same(*page_table, orig_pte))) {
 		flush_icache_page(vma, page);
 		entry = mk_pte(page, vma->vm_page_prot);
 		if (flags & FAULT_FLAG_WRITE)
@@ -3292,7 +3377,10 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 			anon = 1; /* no anon but release faulted_page */
 	}
 
-	pte_unmap_unlock(page_table, ptl);
+	if (likely(locked))
+		pte_unmap_unlock(page_table, ptl);
+	else
+		ret = VM_FAULT_RETRY;
 
 out:
 	if (dirty_page) {
@@ -3328,13 +3416,13 @@ unwritable_page:
 
 static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
-		unsigned int flags, pte_t orig_pte)
+		unsigned int flags, pte_t orig_pte, unsigned int seq)
 {
 	pgoff_t pgoff = (((address & PAGE_MASK)
 			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
 
 	pte_unmap(page_table);
-	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
+	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte, seq);
 }
 
 /*
@@ -3366,7 +3454,7 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	}
 
 	pgoff = pte_to_pgoff(orig_pte);
-	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
+	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte, 0);
 }
 
 /*
@@ -3395,10 +3483,10 @@ int handle_pte_fault(struct mm_struct *mm,
 			if (vma->vm_ops) {
 				if (likely(vma->vm_ops->fault))
 					return do_linear_fault(mm, vma, address,
-						pte, pmd, flags, entry);
+						pte, pmd, flags, entry, 0);
 			}
 			return do_anonymous_page(mm, vma, address,
-						 pte, pmd, flags);
+						 pte, pmd, flags, 0);
 		}
 		if (pte_file(entry))
 			return do_nonlinear_fault(mm, vma, address,
@@ -3502,6 +3590,113 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Handle a fault without mmap_sem, if it is a fault on a pte that is not
+ * populated yet, in an anonymous or a regular file vma whose page tables
+ * are in place.  The vma is not locked: handle_speculative_fault() and
+ * pte_map_lock() check that it was not changed through its vm_sequence.
+ *
+ * vm_flags are those of which the vma must have one to allow the access.
+ * Returns VM_FAULT_RETRY if the fault was not handled, for the caller to
+ * handle it with mmap_sem.  Errors are retried likewise.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+		unsigned int flags, unsigned long vm_flags)
+{
+	struct vm_area_struct *vma;
+	unsigned int seq;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte;
+	pte_t entry;
+	int ret = VM_FAULT_RETRY;
+
+	vma = get_vma(mm, address);
+	if (!vma)
+		goto out;
+
+	seq = ACCESS_ONCE(vma->vm_sequence.sequence);
+	smp_rmb();
+	if (seq & 1)
+		goto out_put;
+
+	/*
+	 * get_vma() looked the vma up before seq was read, so it may have
+	 * been shrunk or split since: check the address again.  Leave the
+	 * stack, which may need expanding, special mappings and the shared
+	 * writes that must notify the filesystem to mmap_sem.
+	 */
+	if (!spf_vma_valid(vma, address, flags))
+		goto out_put;
+	if (!(ACCESS_ONCE(vma->vm_flags) & vm_flags))
+		goto out_put;
+	if (vma->vm_ops) {
+		if (vma->vm_ops->fault != filemap_fault)
+			goto out_put;
+		if ((flags & FAULT_FLAG_WRITE) &&
+		    (ACCESS_ONCE(vma->vm_flags) & VM_SHARED))
+			goto out_put;
+	}
+
+	/*
+	 * Look up the pte under page_table_lock, which keeps unmap_region()
+	 * from freeing the page table once the vma is seen unchanged.  The
+	 * page tables are not allocated here.
+	 */
+	spin_lock(&mm->page_table_lock);
+	if (read_seqcount_retry(&vma->vm_sequence, seq) ||
+	    !spf_vma_valid(vma, address, flags))
+		goto out_unlock;
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto out_unlock;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto out_unlock;
+	pmd = pmd_offset(pud, address);
+	if (pmd_none(*pmd) || pmd_trans_huge(*pmd) || unlikely(pmd_bad(*pmd)))
+		goto out_unlock;
+	pte = pte_offset_map(pmd, address);
+	entry = *pte;
+	spin_unlock(&mm->page_table_lock);
+
+	if (!pte_none(entry)) {
+		pte_unmap(pte);
+		goto out_put;
+	}
+
+	__set_current_state(TASK_RUNNING);
+	check_sync_rss_stat(current);
+
+	flags |= FAULT_FLAG_SPECULATIVE;
+	if (vma->vm_ops)
+		ret = do_linear_fault(mm, vma, address, pte, pmd, flags,
+				      entry, seq);
+	else
+		ret = do_anonymous_page(mm, vma, address, pte, pmd, flags,
+					seq);
+	if (ret & VM_FAULT_ERROR)
+		ret = VM_FAULT_RETRY;
+	goto out_put;
+
+out_unlock:
+	spin_unlock(&mm->page_table_lock);
+out_put:
+	put_vma(vma);
+out:
+	if (ret & VM_FAULT_RETRY) {
+		count_vm_event(SPF_ABORT);
+	} else {
+		count_vm_event(PGFAULT);
+		mem_cgroup_count_vm_event(mm, PGFAULT);
+		count_vm_event(SPF_SUCCESS);
+	}
+	return ret;
+}
+#endif
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -228,6 +228,116 @@ void unlink_file_vma(struct vm_area_struct *vma)
 	}
 }
 
+static void __free_vma(struct vm_area_struct *vma)
+{
+	if (vma->vm_file)
+		fput(vma->vm_file);
+	mpol_put(vma_policy(vma));
+	kmem_cache_free(vm_area_cachep, vma);
+}
+
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+static inline void mm_rb_write_lock(struct mm_struct *mm)
+{
+	write_lock(&mm->mm_rb_lock);
+}
+
+static inline void mm_rb_write_unlock(struct mm_struct *mm)
+{
+	write_unlock(&mm->mm_rb_lock);
+}
+
+/*
+ * A vma is given to speculative faults once it is linked into mm_rb:
+ * the mm holds one reference, and each speculative fault that found
+ * the vma holds another, so that a vma unmapped under the fault is only
+ * freed, with its file, when the fault is done with it.
+ */
+static inline void vma_init_speculative(struct vm_area_struct *vma)
+{
+	seqcount_init(&vma->vm_sequence);
+	atomic_set(&vma->vm_ref_count, 1);
+}
+
+/*
+ * A vma that is taken out of mm_rb is left with an odd vm_sequence for
+ * good, so that no speculative fault can complete on it any more.
+ */
+static inline void vma_mark_detached(struct vm_area_struct *vma)
+{
+	vm_write_begin(vma);
+}
+
+struct vm_area_struct *get_vma(struct mm_struct *mm, unsigned long addr)
+{
+	struct vm_area_struct *vma = NULL;
+	struct rb_node *rb_node;
+
+	read_lock(&mm->mm_rb_lock);
+	rb_node = mm->mm_rb.rb_node;
+	while (rb_node) {
+		struct vm_area_struct *vma_tmp;
+
+		vma_tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (vma_tmp->vm_end > addr) {
+			if (vma_tmp->vm_start <= addr) {
+				vma = vma_tmp;
+				atomic_inc(&vma->vm_ref_count);
+				break;
+			}
+			rb_node = rb_node->rb_left;
+		} else
+			rb_node = rb_node->rb_right;
+	}
+	read_unlock(&mm->mm_rb_lock);
+	return vma;
+}
+
+void put_vma(struct vm_area_struct *vma)
+{
+	if (atomic_dec_and_test(&vma->vm_ref_count))
+		__free_vma(vma);
+}
+
+/*
+ * A speculative fault checks that its vma is still attached with the
+ * page_table_lock held, before it looks up the page table.  Taking the
+ * lock once after detaching the vmas waits for those that got past the
+ * check, so that they hold the pte lock before the page tables are
+ * unmapped and freed.
+ */
+static inline void speculative_fault_barrier(struct mm_struct *mm)
+{
+	spin_lock(&mm->page_table_lock);
+	spin_unlock(&mm->page_table_lock);
+}
+#else
+static inline void mm_rb_write_lock(struct mm_struct *mm)
+{
+}
+
+static inline void mm_rb_write_unlock(struct mm_struct *mm)
+{
+}
+
+static inline void vma_init_speculative(struct vm_area_struct *vma)
+{
+}
+
+static inline void vma_mark_detached(struct vm_area_struct *vma)
+{
+}
+
+static inline void put_vma(struct vm_area_struct *vma)
+{
+	__free_vma(vma);
+}
+
+static inline void speculative_fault_barrier(struct mm_struct *mm)
+{
+}
+#endif
+
 /*
  * Close a vm structure and free it, returning the next.
  */
@@ -238,13 +348,9 @@ static struct vm_area_struct *remove_vma(struct vm_area_struct *vma)
 	might_sleep();
 	if (vma->vm_ops && vma->vm_ops->close)
 		vma->vm_ops->close(vma);
-	if (vma->vm_file) {
-		fput(vma->vm_file);
-		if (vma->vm_flags & VM_EXECUTABLE)
-			removed_exe_file_vma(vma->vm_mm);
-	}
-	mpol_put(vma_policy(vma));
-	kmem_cache_free(vm_area_cachep, vma);
+	if (vma->vm_file && (vma->vm_flags & VM_EXECUTABLE))
+		removed_exe_file_vma(vma->vm_mm);
+	put_vma(vma);
 	return next;
 }
 
@@ -401,8 +507,11 @@ find_vma_prepare(struct mm_struct *mm, unsigned long addr,
 void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 		struct rb_node **rb_link, struct rb_node *rb_parent)
 {
+	vma_init_speculative(vma);
+	mm_rb_write_lock(mm);
 	rb_link_node(&vma->vm_rb, rb_parent, rb_link);
 	rb_insert_color(&vma->vm_rb, &mm->mm_rb);
+	mm_rb_write_unlock(mm);
 }
 
 static void __vma_link_file(struct vm_area_struct *vma)
@@ -483,7 +592,10 @@ __vma_unlink(struct mm_struct *mm, struct vm_area_struct *vma,
 	prev->vm_next = next;
 	if (next)
 		next->vm_prev = prev;
+	mm_rb_write_lock(mm);
 	rb_erase(&vma->vm_rb, &mm->mm_rb);
+	mm_rb_write_unlock(mm);
+	vma_mark_detached(vma);
 	if (mm->mmap_cache == vma)
 		mm->mmap_cache = prev;
 }
@@ -587,12 +699,16 @@ again:			remove_next = 1 + (end > next->vm_end);
 			vma_prio_tree_remove(next, root);
 	}
 
+	vm_write_begin(vma);
 	vma->vm_start = start;
 	vma->vm_end = end;
 	vma->vm_pgoff = pgoff;
+	vm_write_end(vma);
 	if (adjust_next) {
+		vm_write_begin(next);
 		next->vm_start += adjust_next << PAGE_SHIFT;
 		next->vm_pgoff += adjust_next;
+		vm_write_end(next);
 	}
 
 	if (root) {
@@ -625,16 +741,12 @@ again:			remove_next = 1 + (end > next->vm_end);
 		mutex_unlock(&mapping->i_mmap_mutex);
 
 	if (remove_next) {
-		if (file) {
-			fput(file);
-			if (next->vm_flags & VM_EXECUTABLE)
-				removed_exe_file_vma(mm);
-		}
+		if (file && (next->vm_flags & VM_EXECUTABLE))
+			removed_exe_file_vma(mm);
 		if (next->anon_vma)
 			anon_vma_merge(vma, next);
 		mm->map_count--;
-		mpol_put(vma_policy(next));
-		kmem_cache_free(vm_area_cachep, next);
+		put_vma(next);
 		/*
 		 * In mprotect's case 6 (see comments on vma_merge),
 		 * we must remove another next too. It would clutter
@@ -1889,6 +2001,7 @@ static void unmap_region(struct mm_struct *mm,
 	unsigned long nr_accounted = 0;
 
 	lru_add_drain();
+	speculative_fault_barrier(mm);
 	tlb_gather_mmu(&tlb, mm, 0);
 	update_hiwater_rss(mm);
 	unmap_vmas(&tlb, vma, start, end, &nr_accounted, NULL);
@@ -1912,12 +2025,15 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
+	mm_rb_write_lock(mm);
 	do {
 		rb_erase(&vma->vm_rb, &mm->mm_rb);
+		vma_mark_detached(vma);
 		mm->map_count--;
 		tail_vma = vma;
 		vma = vma->vm_next;
 	} while (vma && vma->vm_start < end);
+	mm_rb_write_unlock(mm);
 	*insertion_point = vma;
 	if (vma)
 		vma->vm_prev = prev;
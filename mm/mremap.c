@@ -200,6 +200,13 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 	if (!new_vma)
 		return -ENOMEM;
 
+	/*
+	 * Keep speculative faults from instantiating ptes on either side
+	 * while they are being moved.
+	 */
+	vm_write_begin(vma);
+	if (new_vma != vma)
+		vm_write_begin(new_vma);
 	moved_len = move_page_tables(vma, old_addr, new_vma, new_addr, old_len);
 	if (moved_len < old_len) {
 		/*
@@ -208,6 +215,11 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 		 * and then proceed to unmap new area instead of old.
 		 */
 		move_page_tables(new_vma, new_addr, vma, old_addr, moved_len);
+	}
+	if (new_vma != vma)
+		vm_write_end(new_vma);
+	vm_write_end(vma);
+	if (moved_len < old_len) {
 		vma = new_vma;
 		old_len = new_len;
 		old_addr = new_addr;
@@ -0,0 +1,368 @@
+/*
+ * mm/readahead_replay.c - record and replay file readahead
+ *
+ * While recording, the page ranges that readahead reads from regular
+ * files are kept per file, merged into a few extents.  With replay
+ * enabled, opening a file that has a record reads its extents in the
+ * background, in large requests, before the reader gets to them with
+ * small synchronous reads.  This is meant for app launch and boot,
+ * which read the same parts of the same files every time.
+ *
+ * Records are looked up by device, inode number and generation, so they
+ * outlive the inode and its page cache, but not a reboot.
+ *
+ * See Documentation/vm/readahead-replay.txt.
+ */
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/hash.h>
+#include <linux/init.h>
+#include <linux/kobject.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/sysfs.h>
+#include <linux/vmstat.h>
+#include <linux/workqueue.h>
+#include <linux/backing-dev.h>
+
+#define RA_REPLAY_EXTENTS	32
+/* Holes of up to this many pages are read along, to make larger reads */
+#define RA_REPLAY_GAP		16
+#define RA_REPLAY_MAX_FILES	4096
+#define RA_REPLAY_HASH_BITS	10
+
+struct ra_extent {
+	pgoff_t start;
+	pgoff_t end;		/* exclusive */
+};
+
+struct ra_record {
+	struct hlist_node hash;
+	dev_t dev;
+	unsigned long ino;
+	u32 generation;
+	unsigned int nr_extents;
+	struct ra_extent extents[RA_REPLAY_EXTENTS];	/* sorted */
+};
+
+struct ra_replay_work {
+	struct work_struct work;
+	struct file *file;
+	unsigned int nr_extents;
+	struct ra_extent extents[RA_REPLAY_EXTENTS];
+};
+
+static int ra_replay_recording __read_mostly;
+static int ra_replay_enabled __read_mostly;
+
+/* Protects the hash table and the records */
+static DEFINE_SPINLOCK(ra_replay_lock);
+static struct hlist_head ra_replay_hash[1 << RA_REPLAY_HASH_BITS];
+static unsigned int ra_replay_nr_files;
+
+static struct hlist_head *ra_record_bucket(dev_t dev, unsigned long ino)
+{
+	return &ra_replay_hash[hash_long(ino ^ dev, RA_REPLAY_HASH_BITS)];
+}
+
+static struct ra_record *ra_record_lookup(struct inode *inode)
+{
+	dev_t dev = inode->i_sb->s_dev;
+	struct hlist_node *node;
+	struct ra_record *rec;
+
+	hlist_for_each_entry(rec, node, ra_record_bucket(dev, inode->i_ino),
+			     hash) {
+		if (rec->ino == inode->i_ino && rec->dev == dev &&
+		    rec->generation == inode->i_generation)
+			return rec;
+	}
+	return NULL;
+}
+
+/*
+ * Merge [start, end) into the extents of a record.  Extents that overlap
+ * it or are less than RA_REPLAY_GAP pages away are merged with it.  When
+ * the record has no room left, the new range is merged with the closer of
+ * its neighbours.
+ */
+static void ra_record_add(struct ra_record *rec, pgoff_t start, pgoff_t end)
+{
+	struct ra_extent *ext = rec->extents;
+	unsigned int i, j;
+
+	for (i = 0; i < rec->nr_extents; i++)
+		if (ext[i].end + RA_REPLAY_GAP >= start)
+			break;
+
+	for (j = i; j < rec->nr_extents; j++) {
+		if (ext[j].start > end + RA_REPLAY_GAP)
+			break;
+		start = min(start, ext[j].start);
+		end = max(end, ext[j].end);
+	}
+
+	if (j > i) {
+		ext[i].start = start;
+		ext[i].end = end;
+		memmove(&ext[i + 1], &ext[j],
+			(rec->nr_extents - j) * sizeof(*ext));
+		rec->nr_extents -= j - i - 1;
+		return;
+	}
+
+	if (rec->nr_extents == RA_REPLAY_EXTENTS) {
+		if (i == rec->nr_extents ||
+		    (i && start - ext[i - 1].end < ext[i].start - end))
+			i--;
+		ext[i].start = min(start, ext[i].start);
+		ext[i].end = max(end, ext[i].end);
+		return;
+	}
+
+	memmove(&ext[i + 1], &ext[i], (rec->nr_extents - i) * sizeof(*ext));
+	ext[i].start = start;
+	ext[i].end = end;
+	rec->nr_extents++;
+}
+
+/*
+ * Called by readahead for the pages [start, end) it is about to read.
+ */
+void readahead_replay_record(struct address_space *mapping, pgoff_t start,
+			     pgoff_t end)
+{
+	struct inode *inode = mapping->host;
+	struct ra_record *rec, *new;
+
+	if (!ra_replay_recording || !S_ISREG(inode->i_mode) || start >= end)
+		return;
+
+	spin_lock(&ra_replay_lock);
+	rec = ra_record_lookup(inode);
+	if (rec)
+		ra_record_add(rec, start, end);
+	spin_unlock(&ra_replay_lock);
+	if (rec || ra_replay_nr_files >= RA_REPLAY_MAX_FILES)
+		return;
+
+	new = kzalloc(sizeof(*new), GFP_NOFS | __GFP_NOWARN);
+	if (!new)
+		return;
+	new->dev = inode->i_sb->s_dev;
+	new->ino = inode->i_ino;
+	new->generation = inode->i_generation;
+
+	spin_lock(&ra_replay_lock);
+	rec = ra_record_lookup(inode);
+	if (!rec && ra_replay_nr_files < RA_REPLAY_MAX_FILES) {
+		hlist_add_head(&new->hash,
+			       ra_record_bucket(new->dev, new->ino));
+		ra_replay_nr_files++;
+		rec = new;
+		new = NULL;
+	}
+	if (rec)
+		ra_record_add(rec, start, end);
+	spin_unlock(&ra_replay_lock);
+	kfree(new);
+}
+
+static void ra_replay_workfn(struct work_struct *work)
+{
+	struct ra_replay_work *w = container_of(work, struct ra_replay_work,
+						work);
+	struct file *file = w->file;
+	unsigned int i;
+
+	for (i = 0; i < w->nr_extents; i++) {
+		struct ra_extent *ext = &w->extents[i];
+		int ret;
+
+		ret = force_page_cache_readahead(file->f_mapping, file,
+				ext->start, ext->end - ext->start);
+		if (ret < 0)
+			break;
+		count_vm_events(RA_REPLAY_PAGES, ret);
+	}
+	count_vm_event(RA_REPLAY);
+
+	fput(file);
+	kfree(w);
+}
+
+/*
+ * Called when a file has been opened.  If it has a record, and the
+ * recorded pages are not in the page cache already, read them in the
+ * background.
+ */
+void readahead_replay_open(struct file *file)
+{
+	struct address_space *mapping = file->f_mapping;
+	struct ra_replay_work *w;
+	struct ra_record *rec;
+	unsigned long pages = 0;
+	unsigned int i;
+
+	if (!ra_replay_enabled || !(file->f_mode & FMODE_READ) ||
+	    (file->f_flags & O_DIRECT) || !S_ISREG(mapping->host->i_mode) ||
+	    !mapping->backing_dev_info->ra_pages)
+		return;
+
+	w = kmalloc(sizeof(*w), GFP_KERNEL);
+	if (!w)
+		return;
+
+	spin_lock(&ra_replay_lock);
+	rec = ra_record_lookup(mapping->host);
+	w->nr_extents = rec ? rec->nr_extents : 0;
+	if (rec)
+		memcpy(w->extents, rec->extents,
+		       rec->nr_extents * sizeof(*w->extents));
+	spin_unlock(&ra_replay_lock);
+
+	for (i = 0; i < w->nr_extents; i++)
+		pages += w->extents[i].end - w->extents[i].start;
+	if (!pages || mapping->nrpages >= pages) {
+		kfree(w);
+		return;
+	}
+
+	INIT_WORK(&w->work, ra_replay_workfn);
+	get_file(file);
+	w->file = file;
+	queue_work(system_unbound_wq, &w->work);
+}
+
+static void ra_replay_clear(void)
+{
+	struct hlist_node *node, *tmp;
+	struct ra_record *rec;
+	HLIST_HEAD(free);
+	int i;
+
+	spin_lock(&ra_replay_lock);
+	for (i = 0; i < ARRAY_SIZE(ra_replay_hash); i++) {
+		hlist_for_each_entry_safe(rec, node, tmp, &ra_replay_hash[i],
+					  hash) {
+			hlist_del(&rec->hash);
+			hlist_add_head(&rec->hash, &free);
+		}
+	}
+	ra_replay_nr_files = 0;
+	spin_unlock(&ra_replay_lock);
+
+	hlist_for_each_entry_safe(rec, node, tmp, &free, hash)
+		kfree(rec);
+}
+
+#define RA_REPLAY_ATTR_RO(_name) \
+	static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+#define RA_REPLAY_ATTR(_name) \
+	static struct kobj_attribute _name##_attr = \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+
+static ssize_t ra_replay_store_bool(const char *buf, size_t count, int *val)
+{
+	unsigned long v;
+	int err;
+
+	err = strict_strtoul(buf, 10, &v);
+	if (err || v > 1)
+		return -EINVAL;
+	*val = v;
+	return count;
+}
+
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", ra_replay_enabled);
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	return ra_replay_store_bool(buf, count, &ra_replay_enabled);
+}
+RA_REPLAY_ATTR(enabled);
+
+static ssize_t record_show(struct kobject *kobj,
+			   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", ra_replay_recording);
+}
+
+static ssize_t record_store(struct kobject *kobj,
+			    struct kobj_attribute *attr,
+			    const char *buf, size_t count)
+{
+	return ra_replay_store_bool(buf, count, &ra_replay_recording);
+}
+RA_REPLAY_ATTR(record);
+
+static ssize_t files_show(struct kobject *kobj,
+			  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ra_replay_nr_files);
+}
+RA_REPLAY_ATTR_RO(files);
+
+static ssize_t pages_show(struct kobject *kobj,
+			  struct kobj_attribute *attr, char *buf)
+{
+	struct hlist_node *node;
+	struct ra_record *rec;
+	unsigned long pages = 0;
+	unsigned int i, j;
+
+	spin_lock(&ra_replay_lock);
+	for (i = 0; i < ARRAY_SIZE(ra_replay_hash); i++)
+		hlist_for_each_entry(rec, node, &ra_replay_hash[i], hash)
+			for (j = 0; j < rec->nr_extents; j++)
+				pages += rec->extents[j].end -
+					 rec->extents[j].start;
+	spin_unlock(&ra_replay_lock);
+
+	return sprintf(buf, "%lu\n", pages);
+}
+RA_REPLAY_ATTR_RO(pages);
+
+static ssize_t clear_store(struct kobject *kobj,
+			   struct kobj_attribute *attr,
+			   const char *buf, size_t count)
+{
+	if (buf[0] != '1')
+		return -EINVAL;
+	ra_replay_clear();
+	return count;
+}
+static struct kobj_attribute clear_attr = __ATTR(clear, 0200, NULL,
+						 clear_store);
+
+static struct attribute *ra_replay_attrs[] = {
+	&enabled_attr.attr,
+	&record_attr.attr,
+	&files_attr.attr,
+	&pages_attr.attr,
+	&clear_attr.attr,
+	NULL,
+};
+
+static struct attribute_group ra_replay_attr_group = {
+	.attrs = ra_replay_attrs,
+	.name = "readahead_replay",
+};
+
+static int __init readahead_replay_init(void)
+{
+	int err;
+
+	err = sysfs_create_group(mm_kobj, &ra_replay_attr_group);
+	if (err)
+		printk(KERN_ERR "readahead_replay: register sysfs failed\n");
+	return err;
+}
+module_init(readahead_replay_init)
@@ -1303,7 +1303,7 @@ repeat:
 
 	if (swap.val) {
 		/* Look it up and read it in.. */
-		swappage = lookup_swap_cache(swap);
+		swappage = lookup_swap_cache(swap, NULL);
 		if (!swappage) {
 			shmem_swp_unmap(entry);
 			spin_unlock(&info->lock);
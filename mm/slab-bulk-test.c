@@ -0,0 +1,123 @@
+/*
+ * Microbenchmark for single and bulk slab allocations.
+ *
+ * Creates a cache of objects of size bytes and, for each bulk size, takes
+ * that many objects and gives them back again, loops times in total: once
+ * with kmem_cache_alloc() and kmem_cache_free() one object at a time, and
+ * once with kmem_cache_alloc_bulk() and kmem_cache_free_bulk().  The time
+ * for an allocation and a free is printed per object, in cycles and in ns.
+ * Architectures without a cycle counter print 0 cycles.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/hrtimer.h>
+#include <linux/timex.h>
+
+#define MAX_BULK	128
+
+static unsigned int loops = 100000;
+module_param(loops, uint, 0444);
+MODULE_PARM_DESC(loops, "Number of objects allocated and freed per test");
+
+static unsigned int size = 256;
+module_param(size, uint, 0444);
+MODULE_PARM_DESC(size, "Object size of the test cache");
+
+static const unsigned int bulk_sizes[] __initconst = {
+	1, 2, 4, 8, 16, 32, 64, 128,
+};
+
+static void *objects[MAX_BULK] __initdata;
+
+static void __init report(const char *name, unsigned int bulk,
+			  unsigned long nr, cycles_t start_cycles,
+			  ktime_t start)
+{
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	u64 cycles = get_cycles() - start_cycles;
+
+	do_div(ns, nr);
+	do_div(cycles, nr);
+	printk(KERN_INFO "slab-bulk-test: %s %3u: %llu cycles %llu ns "
+	       "per alloc+free\n", name, bulk, (unsigned long long)cycles,
+	       (unsigned long long)ns);
+}
+
+static int __init test_single(struct kmem_cache *s, unsigned int bulk)
+{
+	unsigned int rounds = max(loops / bulk, 1U);
+	unsigned int round, i;
+	cycles_t start_cycles;
+	ktime_t start;
+
+	start = ktime_get();
+	start_cycles = get_cycles();
+	for (round = 0; round < rounds; round++) {
+		for (i = 0; i < bulk; i++) {
+			objects[i] = kmem_cache_alloc(s, GFP_KERNEL);
+			if (!objects[i])
+				goto fail;
+		}
+		for (i = 0; i < bulk; i++)
+			kmem_cache_free(s, objects[i]);
+	}
+	report("single", bulk, (unsigned long)rounds * bulk, start_cycles,
+	       start);
+	return 0;
+
+fail:
+	while (i--)
+		kmem_cache_free(s, objects[i]);
+	return -ENOMEM;
+}
+
+static int __init test_bulk(struct kmem_cache *s, unsigned int bulk)
+{
+	unsigned int rounds = max(loops / bulk, 1U);
+	unsigned int round;
+	cycles_t start_cycles;
+	ktime_t start;
+
+	start = ktime_get();
+	start_cycles = get_cycles();
+	for (round = 0; round < rounds; round++) {
+		if (!kmem_cache_alloc_bulk(s, GFP_KERNEL, bulk, objects))
+			return -ENOMEM;
+		kmem_cache_free_bulk(s, bulk, objects);
+	}
+	report("bulk  ", bulk, (unsigned long)rounds * bulk, start_cycles,
+	       start);
+	return 0;
+}
+
+static int __init test_slab_bulk_init(void)
+{
+	struct kmem_cache *s;
+	unsigned int i;
+	int ret = 0;
+
+	if (!loops || !size || size > PAGE_SIZE)
+		return -EINVAL;
+
+	s = kmem_cache_create("slab_bulk_test", size, 0, 0, NULL);
+	if (!s)
+		return -ENOMEM;
+
+	printk(KERN_INFO "slab-bulk-test: %u objects of %u bytes\n",
+	       loops, size);
+	for (i = 0; i < ARRAY_SIZE(bulk_sizes) && !ret; i++) {
+		ret = test_single(s, bulk_sizes[i]);
+		if (!ret)
+			ret = test_bulk(s, bulk_sizes[i]);
+	}
+	if (ret)
+		printk(KERN_ERR "slab-bulk-test: allocation failed\n");
+
+	kmem_cache_destroy(s);
+	return -EINVAL;
+}
+module_init(test_slab_bulk_init);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Single and bulk slab allocation microbenchmark");
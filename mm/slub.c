@@ -1420,12 +1420,27 @@ static inline int lock_and_freeze_slab(struct kmem_cache_node *n,
 	return 0;
 }
 
+/*
+ * Debug caches have to see every slab going through the lists, so
+ * they do not keep partial slabs per cpu.
+ */
+static inline int kmem_cache_has_cpu_partial(struct kmem_cache *s)
+{
+	return s->cpu_partial && !kmem_cache_debug(s);
+}
+
 /*
  * Try to allocate a partial slab from a specific node.
+ *
+ * While we hold the list_lock anyway, also move some more partial slabs
+ * to the partial list of this cpu, so that the next few slabs do not
+ * need the list_lock.
  */
-static struct page *get_partial_node(struct kmem_cache_node *n)
+static struct page *get_partial_node(struct kmem_cache *s,
+		struct kmem_cache_node *n, struct kmem_cache_cpu *c)
 {
-	struct page *page;
+	struct page *page, *page2;
+	struct page *found = NULL;
 
 	/*
 	 * Racy check. If we mistakenly see no partial slabs then we
@@ -1437,19 +1452,36 @@ static struct page *get_partial_node(struct kmem_cache_node *n)
 		return NULL;
 
 	spin_lock(&n->list_lock);
-	list_for_each_entry(page, &n->partial, lru)
-		if (lock_and_freeze_slab(n, page))
-			goto out;
-	page = NULL;
-out:
+	list_for_each_entry_safe(page, page2, &n->partial, lru) {
+		if (!found) {
+			if (lock_and_freeze_slab(n, page))
+				found = page;
+			continue;
+		}
+
+		if (!kmem_cache_has_cpu_partial(s) ||
+				c->nr_partial >= s->cpu_partial / 2)
+			break;
+
+		if (!slab_trylock(page))
+			continue;
+		__remove_partial(n, page);
+		__SetPageSlubFrozen(page);
+		slab_unlock(page);
+
+		list_add_tail(&page->lru, &c->partial);
+		c->nr_partial++;
+		stat(s, CPU_PARTIAL_NODE);
+	}
 	spin_unlock(&n->list_lock);
-	return page;
+	return found;
 }
 
 /*
  * Get a page from somewhere. Search in increasing NUMA distances.
  */
-static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
+static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags,
+		struct kmem_cache_cpu *c)
 {
 #ifdef CONFIG_NUMA
 	struct zonelist *zonelist;
@@ -1489,7 +1521,7 @@ static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
 
 		if (n && cpuset_zone_allowed_hardwall(zone, flags) &&
 				n->nr_partial > s->min_partial) {
-			page = get_partial_node(n);
+			page = get_partial_node(s, n, c);
 			if (page) {
 				put_mems_allowed();
 				return page;
@@ -1504,16 +1536,17 @@ static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
 /*
  * Get a partial page, lock it and return it.
  */
-static struct page *get_partial(struct kmem_cache *s, gfp_t flags, int node)
+static struct page *get_partial(struct kmem_cache *s, gfp_t flags, int node,
+		struct kmem_cache_cpu *c)
 {
 	struct page *page;
 	int searchnode = (node == NUMA_NO_NODE) ? numa_node_id() : node;
 
-	page = get_partial_node(get_node(s, searchnode));
+	page = get_partial_node(s, get_node(s, searchnode), c);
 	if (page || node != NUMA_NO_NODE)
 		return page;
 
-	return get_any_partial(s, flags);
+	return get_any_partial(s, flags, c);
 }
 
 /*
@@ -1626,8 +1659,13 @@ void init_kmem_cache_cpus(struct kmem_cache *s)
 {
 	int cpu;
 
-	for_each_possible_cpu(cpu)
-		per_cpu_ptr(s->cpu_slab, cpu)->tid = init_tid(cpu);
+	for_each_possible_cpu(cpu) {
+		struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
+
+		c->tid = init_tid(cpu);
+		INIT_LIST_HEAD(&c->partial);
+		c->nr_partial = 0;
+	}
 }
 /*
  * Remove the cpu slab
@@ -1664,6 +1702,67 @@ static void deactivate_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 	unfreeze_slab(s, page, tail);
 }
 
+/*
+ * Move the partial slabs of a cpu back to the node partial lists.
+ *
+ * Interrupts must be disabled, or the cpu must be offline.
+ */
+static void unfreeze_partials(struct kmem_cache *s, struct kmem_cache_cpu *c)
+{
+	struct page *page;
+
+	while (!list_empty(&c->partial)) {
+		page = list_first_entry(&c->partial, struct page, lru);
+		list_del(&page->lru);
+		c->nr_partial--;
+
+		slab_lock(page);
+		unfreeze_slab(s, page, 1);
+	}
+}
+
+/*
+ * Put a frozen slab that just got its first free object onto the partial
+ * list of this cpu instead of the node partial list. If the cpu already
+ * keeps as many slabs as it may, they all go back to the node first.
+ *
+ * Interrupts must be disabled.
+ */
+static void put_cpu_partial(struct kmem_cache *s, struct page *page)
+{
+	struct kmem_cache_cpu *c = __this_cpu_ptr(s->cpu_slab);
+
+	if (c->nr_partial >= s->cpu_partial) {
+		unfreeze_partials(s, c);
+		stat(s, CPU_PARTIAL_DRAIN);
+	}
+	list_add(&page->lru, &c->partial);
+	c->nr_partial++;
+}
+
+/*
+ * Take a slab off the partial list of this cpu, preferring the one that
+ * got a free object last. The slab stays frozen and gets locked.
+ */
+static struct page *get_cpu_partial(struct kmem_cache *s,
+		struct kmem_cache_cpu *c, int node)
+{
+	struct page *page;
+
+	if (list_empty(&c->partial))
+		return NULL;
+
+	page = list_first_entry(&c->partial, struct page, lru);
+#ifdef CONFIG_NUMA
+	if (node != NUMA_NO_NODE && page_to_nid(page) != node)
+		return NULL;
+#endif
+	list_del(&page->lru);
+	c->nr_partial--;
+	slab_lock(page);
+	return page;
+}
+
 static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 {
 	stat(s, CPUSLAB_FLUSH);
@@ -1680,8 +1779,11 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
-	if (likely(c && c->page))
-		flush_slab(s, c);
+	if (likely(c)) {
+		if (c->page)
+			flush_slab(s, c);
+		unfreeze_partials(s, c);
+	}
 }
 
 static void flush_cpu_slab(void *d)
@@ -1841,7 +1943,15 @@ another_slab:
 	deactivate_slab(s, c);
 
 new_slab:
-	page = get_partial(s, gfpflags, node);
+	page = get_cpu_partial(s, c, node);
+	if (page) {
+		stat(s, CPU_PARTIAL_ALLOC);
+		c->node = page_to_nid(page);
+		c->page = page;
+		goto load_freelist;
+	}
+
+	page = get_partial(s, gfpflags, node, c);
 	if (page) {
 		stat(s, ALLOC_FROM_PARTIAL);
 		c->node = page_to_nid(page);
@@ -2055,9 +2165,17 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 
 	/*
 	 * Objects left in the slab. If it was not on the partial list before
-	 * then add it.
+	 * then add it, to the partial list of this cpu if it keeps one.
 	 */
 	if (unlikely(!prior)) {
+		if (kmem_cache_has_cpu_partial(s)) {
+			__SetPageSlubFrozen(page);
+			slab_unlock(page);
+			put_cpu_partial(s, page);
+			local_irq_restore(flags);
+			stat(s, CPU_PARTIAL_FREE);
+			return;
+		}
 		add_partial(get_node(s, page_to_nid(page)), page, 1);
 		stat(s, FREE_ADD_PARTIAL);
 	}
@@ -2143,6 +2261,94 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/*
+ * Free several objects with interrupts disabled once. Objects of the cpu
+ * slab go straight onto the cpu freelist, the others take the slow path.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	size_t i;
+
+	local_irq_save(flags);
+	c = __this_cpu_ptr(s->cpu_slab);
+	for (i = 0; i < size; i++) {
+		void *object = p[i];
+		struct page *page = virt_to_head_page(object);
+
+		slab_free_hook(s, object);
+		if (likely(page == c->page)) {
+			set_freepointer(s, object, c->freelist);
+			c->freelist = object;
+			stat(s, FREE_FASTPATH);
+		} else
+			__slab_free(s, page, object, _RET_IP_);
+	}
+	/* Fail the cmpxchg of anyone who read the cpu freelist before */
+	c->tid = next_tid(c->tid);
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+/*
+ * Allocate several objects with interrupts disabled once, taking them
+ * off the cpu freelist for as long as it has any.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long irqflags;
+	size_t i;
+
+	if (slab_pre_alloc_hook(s, flags))
+		return 0;
+
+	local_irq_save(irqflags);
+	c = __this_cpu_ptr(s->cpu_slab);
+	for (i = 0; i < size; i++) {
+		void *object = c->freelist;
+
+		if (unlikely(!object)) {
+			/*
+			 * __slab_alloc() may enable interrupts to get a new
+			 * slab, after which we may run on another cpu.
+			 */
+			c->tid = next_tid(c->tid);
+			p[i] = __slab_alloc(s, flags, NUMA_NO_NODE,
+					    _RET_IP_, c);
+			if (unlikely(!p[i]))
+				goto error;
+			c = __this_cpu_ptr(s->cpu_slab);
+			continue;
+		}
+		c->freelist = get_freepointer(s, object);
+		p[i] = object;
+		stat(s, ALLOC_FASTPATH);
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_restore(irqflags);
+
+	for (i = 0; i < size; i++) {
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[i], 0, s->objsize);
+		slab_post_alloc_hook(s, flags, p[i]);
+	}
+	return size;
+
+error:
+	c = __this_cpu_ptr(s->cpu_slab);
+	c->tid = next_tid(c->tid);
+	local_irq_restore(irqflags);
+	size = i;
+	for (i = 0; i < size; i++)
+		slab_post_alloc_hook(s, flags, p[i]);
+	kmem_cache_free_bulk(s, size, p);
+	return 0;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 /*
  * Object placement in a slab is made very easy because we always start at
  * offset 0. If we tune the size of the object to the alignment then we can
@@ -2594,6 +2800,22 @@ static int kmem_cache_open(struct kmem_cache *s,
 	 * list to avoid pounding the page allocator excessively.
 	 */
 	set_min_partial(s, ilog2(s->size));
+
+	/*
+	 * Each cpu keeps a few partial slabs of its own, fewer the larger
+	 * the slabs are.
+	 */
+	if (kmem_cache_debug(s))
+		s->cpu_partial = 0;
+	else if (s->size >= PAGE_SIZE)
+		s->cpu_partial = 2;
+	else if (s->size >= 1024)
+		s->cpu_partial = 4;
+	else if (s->size >= 256)
+		s->cpu_partial = 6;
+	else
+		s->cpu_partial = 8;
+
 	s->refcount = 1;
 #ifdef CONFIG_NUMA
 	s->remote_node_defrag_ratio = 1000;
@@ -4140,6 +4362,29 @@ static ssize_t min_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(min_partial);
 
+static ssize_t cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%d\n", s->cpu_partial);
+}
+
+static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
+				 size_t length)
+{
+	unsigned long slabs;
+	int err;
+
+	err = strict_strtoul(buf, 10, &slabs);
+	if (err)
+		return err;
+	if (slabs > INT_MAX || (slabs && kmem_cache_debug(s)))
+		return -EINVAL;
+
+	s->cpu_partial = slabs;
+	flush_all(s);
+	return length;
+}
+SLAB_ATTR(cpu_partial);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -4166,6 +4411,29 @@ static ssize_t cpu_slabs_show(struct kmem_cache *s, char *buf)
 }
 SLAB_ATTR_RO(cpu_slabs);
 
+static ssize_t slabs_cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	int slabs = 0;
+	int cpu;
+	int len;
+
+	for_each_online_cpu(cpu)
+		slabs += per_cpu_ptr(s->cpu_slab, cpu)->nr_partial;
+
+	len = sprintf(buf, "%d", slabs);
+
+#ifdef CONFIG_SMP
+	for_each_online_cpu(cpu) {
+		int nr = per_cpu_ptr(s->cpu_slab, cpu)->nr_partial;
+
+		if (nr && len < PAGE_SIZE - 20)
+			len += sprintf(buf + len, " C%d=%d", cpu, nr);
+	}
+#endif
+	return len + sprintf(buf + len, "\n");
+}
+SLAB_ATTR_RO(slabs_cpu_partial);
+
 static ssize_t objects_show(struct kmem_cache *s, char *buf)
 {
 	return show_slab_objects(s, buf, SO_ALL|SO_OBJECTS);
@@ -4486,6 +4754,10 @@ STAT_ATTR(DEACTIVATE_TO_HEAD, deactivate_to_head);
 STAT_ATTR(DEACTIVATE_TO_TAIL, deactivate_to_tail);
 STAT_ATTR(DEACTIVATE_REMOTE_FREES, deactivate_remote_frees);
 STAT_ATTR(ORDER_FALLBACK, order_fallback);
+STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
+STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
+STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
+STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -4494,10 +4766,12 @@ static struct attribute *slab_attrs[] = {
 	&objs_per_slab_attr.attr,
 	&order_attr.attr,
 	&min_partial_attr.attr,
+	&cpu_partial_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
 	&cpu_slabs_attr.attr,
+	&slabs_cpu_partial_attr.attr,
 	&ctor_attr.attr,
 	&aliases_attr.attr,
 	&align_attr.attr,
@@ -4543,6 +4817,10 @@ static struct attribute *slab_attrs[] = {
 	&deactivate_to_tail_attr.attr,
 	&deactivate_remote_frees_attr.attr,
 	&order_fallback_attr.attr,
+	&cpu_partial_alloc_attr.attr,
+	&cpu_partial_free_attr.attr,
+	&cpu_partial_node_attr.attr,
+	&cpu_partial_drain_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
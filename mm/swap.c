@@ -37,9 +37,26 @@
 /* How many pages do we try to swap or page in/out together? */
 int page_cluster;
 
-static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
-static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
-static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
+/*
+ * Pages are added to, rotated on and moved between the LRU lists in per-cpu
+ * batches, to take zone->lru_lock once per batch instead of once per page.
+ * These batches can hold more pages than a pagevec on the stack.  They are
+ * drained when sysctl_lru_batch pages have been queued, or PAGEVEC_SIZE
+ * pages while the zone of the page being queued is short of free memory,
+ * so that reclaim does not miss too many pages sitting in them.
+ */
+struct lru_batch {
+	unsigned int nr;
+	struct page *pages[LRU_BATCH_MAX];
+};
+
+int sysctl_lru_batch = 2 * PAGEVEC_SIZE;
+
+static DEFINE_PER_CPU(struct lru_batch[NR_LRU_LISTS], lru_add_batches);
+static DEFINE_PER_CPU(struct lru_batch, lru_rotate_batches);
+static DEFINE_PER_CPU(struct lru_batch, lru_deactivate_batches);
+
+static void lru_batch_add_drain(struct lru_batch *batch, enum lru_list lru);
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -202,16 +219,16 @@ void put_pages_list(struct list_head *pages)
 }
 EXPORT_SYMBOL(put_pages_list);
 
-static void pagevec_lru_move_fn(struct pagevec *pvec,
-				void (*move_fn)(struct page *page, void *arg),
-				void *arg)
+static void lru_move_fn(struct page **pages, int nr, int cold,
+			void (*move_fn)(struct page *page, void *arg),
+			void *arg)
 {
 	int i;
 	struct zone *zone = NULL;
 	unsigned long flags = 0;
 
-	for (i = 0; i < pagevec_count(pvec); i++) {
-		struct page *page = pvec->pages[i];
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
 		struct zone *pagezone = page_zone(page);
 
 		if (pagezone != zone) {
@@ -225,10 +242,45 @@ static void pagevec_lru_move_fn(struct pagevec *pvec,
 	}
 	if (zone)
 		spin_unlock_irqrestore(&zone->lru_lock, flags);
-	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	release_pages(pages, nr, cold);
+}
+
+static void pagevec_lru_move_fn(struct pagevec *pvec,
+				void (*move_fn)(struct page *page, void *arg),
+				void *arg)
+{
+	lru_move_fn(pvec->pages, pagevec_count(pvec), pvec->cold,
+		    move_fn, arg);
 	pagevec_reinit(pvec);
 }
 
+static void lru_batch_move_fn(struct lru_batch *batch,
+				void (*move_fn)(struct page *page, void *arg),
+				void *arg)
+{
+	lru_move_fn(batch->pages, batch->nr, 0, move_fn, arg);
+	batch->nr = 0;
+}
+
+/*
+ * Queue a page in a per-cpu batch.  Returns true if the batch should be
+ * drained now.
+ */
+static bool lru_batch_add(struct lru_batch *batch, struct page *page)
+{
+	unsigned int limit = ACCESS_ONCE(sysctl_lru_batch);
+	struct zone *zone;
+
+	batch->pages[batch->nr++] = page;
+	if (batch->nr >= limit)
+		return true;
+	if (batch->nr < PAGEVEC_SIZE)
+		return false;
+
+	zone = page_zone(page);
+	return zone_page_state(zone, NR_FREE_PAGES) < low_wmark_pages(zone);
+}
+
 static void pagevec_move_tail_fn(struct page *page, void *arg)
 {
 	int *pgmoved = arg;
@@ -236,21 +288,20 @@ static void pagevec_move_tail_fn(struct page *page, void *arg)
 
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
 		enum lru_list lru = page_lru_base_type(page);
-		list_move_tail(&page->lru, &zone->lru[lru].list);
-		mem_cgroup_rotate_reclaimable_page(page);
+		move_page_to_lru_tail(zone, page, lru);
 		(*pgmoved)++;
 	}
 }
 
 /*
- * pagevec_move_tail() must be called with IRQ disabled.
+ * lru_batch_move_tail() must be called with IRQ disabled.
  * Otherwise this may cause nasty races.
  */
-static void pagevec_move_tail(struct pagevec *pvec)
+static void lru_batch_move_tail(struct lru_batch *batch)
 {
 	int pgmoved = 0;
 
-	pagevec_lru_move_fn(pvec, pagevec_move_tail_fn, &pgmoved);
+	lru_batch_move_fn(batch, pagevec_move_tail_fn, &pgmoved);
 	__count_vm_events(PGROTATED, pgmoved);
 }
 
@@ -263,14 +314,14 @@ void rotate_reclaimable_page(struct page *page)
 {
 	if (!PageLocked(page) && !PageDirty(page) && !PageActive(page) &&
 	    !PageUnevictable(page) && PageLRU(page)) {
-		struct pagevec *pvec;
+		struct lru_batch *batch;
 		unsigned long flags;
 
 		page_cache_get(page);
 		local_irq_save(flags);
-		pvec = &__get_cpu_var(lru_rotate_pvecs);
-		if (!pagevec_add(pvec, page))
-			pagevec_move_tail(pvec);
+		batch = &__get_cpu_var(lru_rotate_batches);
+		if (lru_batch_add(batch, page))
+			lru_batch_move_tail(batch);
 		local_irq_restore(flags);
 	}
 }
@@ -314,25 +365,25 @@ static void __activate_page(struct page *page, void *arg)
 }
 
 #ifdef CONFIG_SMP
-static DEFINE_PER_CPU(struct pagevec, activate_page_pvecs);
+static DEFINE_PER_CPU(struct lru_batch, activate_page_batches);
 
 static void activate_page_drain(int cpu)
 {
-	struct pagevec *pvec = &per_cpu(activate_page_pvecs, cpu);
+	struct lru_batch *batch = &per_cpu(activate_page_batches, cpu);
 
-	if (pagevec_count(pvec))
-		pagevec_lru_move_fn(pvec, __activate_page, NULL);
+	if (batch->nr)
+		lru_batch_move_fn(batch, __activate_page, NULL);
 }
 
 void activate_page(struct page *page)
 {
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
-		struct pagevec *pvec = &get_cpu_var(activate_page_pvecs);
+		struct lru_batch *batch = &get_cpu_var(activate_page_batches);
 
 		page_cache_get(page);
-		if (!pagevec_add(pvec, page))
-			pagevec_lru_move_fn(pvec, __activate_page, NULL);
-		put_cpu_var(activate_page_pvecs);
+		if (lru_batch_add(batch, page))
+			lru_batch_move_fn(batch, __activate_page, NULL);
+		put_cpu_var(activate_page_batches);
 	}
 }
 
@@ -364,6 +415,8 @@ void mark_page_accessed(struct page *page)
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
 		ClearPageReferenced(page);
+		if (page_is_file_cache(page))
+			workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
@@ -373,12 +426,12 @@ EXPORT_SYMBOL(mark_page_accessed);
 
 void __lru_cache_add(struct page *page, enum lru_list lru)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_pvecs)[lru];
+	struct lru_batch *batch = &get_cpu_var(lru_add_batches)[lru];
 
 	page_cache_get(page);
-	if (!pagevec_add(pvec, page))
-		____pagevec_lru_add(pvec, lru);
-	put_cpu_var(lru_add_pvecs);
+	if (lru_batch_add(batch, page))
+		lru_batch_add_drain(batch, lru);
+	put_cpu_var(lru_add_batches);
 }
 EXPORT_SYMBOL(__lru_cache_add);
 
@@ -480,8 +533,7 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 		 * The page's writeback ends up during pagevec
 		 * We moves tha page into tail of inactive.
 		 */
-		list_move_tail(&page->lru, &zone->lru[lru].list);
-		mem_cgroup_rotate_reclaimable_page(page);
+		move_page_to_lru_tail(zone, page, lru);
 		__count_vm_event(PGROTATED);
 	}
 
@@ -491,35 +543,35 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 }
 
 /*
- * Drain pages out of the cpu's pagevecs.
+ * Drain pages out of the cpu's LRU batches.
  * Either "cpu" is the current CPU, and preemption has already been
  * disabled; or "cpu" is being hot-unplugged, and is already dead.
  */
 static void drain_cpu_pagevecs(int cpu)
 {
-	struct pagevec *pvecs = per_cpu(lru_add_pvecs, cpu);
-	struct pagevec *pvec;
+	struct lru_batch *batches = per_cpu(lru_add_batches, cpu);
+	struct lru_batch *batch;
 	int lru;
 
 	for_each_lru(lru) {
-		pvec = &pvecs[lru - LRU_BASE];
-		if (pagevec_count(pvec))
-			____pagevec_lru_add(pvec, lru);
+		batch = &batches[lru - LRU_BASE];
+		if (batch->nr)
+			lru_batch_add_drain(batch, lru);
 	}
 
-	pvec = &per_cpu(lru_rotate_pvecs, cpu);
-	if (pagevec_count(pvec)) {
+	batch = &per_cpu(lru_rotate_batches, cpu);
+	if (batch->nr) {
 		unsigned long flags;
 
 		/* No harm done if a racing interrupt already did this */
 		local_irq_save(flags);
-		pagevec_move_tail(pvec);
+		lru_batch_move_tail(batch);
 		local_irq_restore(flags);
 	}
 
-	pvec = &per_cpu(lru_deactivate_pvecs, cpu);
-	if (pagevec_count(pvec))
-		pagevec_lru_move_fn(pvec, lru_deactivate_fn, NULL);
+	batch = &per_cpu(lru_deactivate_batches, cpu);
+	if (batch->nr)
+		lru_batch_move_fn(batch, lru_deactivate_fn, NULL);
 
 	activate_page_drain(cpu);
 }
@@ -542,11 +594,11 @@ void deactivate_page(struct page *page)
 		return;
 
 	if (likely(get_page_unless_zero(page))) {
-		struct pagevec *pvec = &get_cpu_var(lru_deactivate_pvecs);
+		struct lru_batch *batch = &get_cpu_var(lru_deactivate_batches);
 
-		if (!pagevec_add(pvec, page))
-			pagevec_lru_move_fn(pvec, lru_deactivate_fn, NULL);
-		put_cpu_var(lru_deactivate_pvecs);
+		if (lru_batch_add(batch, page))
+			lru_batch_move_fn(batch, lru_deactivate_fn, NULL);
+		put_cpu_var(lru_deactivate_batches);
 	}
 }
 
@@ -681,8 +733,10 @@ void lru_add_page_tail(struct zone* zone,
 			lru = LRU_INACTIVE_ANON;
 		}
 		update_page_reclaim_stat(zone, page_tail, file, active);
-		if (likely(PageLRU(page)))
+		if (likely(PageLRU(page)) && !lru_gen_enabled())
 			head = page->lru.prev;
+		else if (lru_gen_add_page(zone, page_tail, false))
+			return;
 		else
 			head = &zone->lru[lru].list;
 		__add_page_to_lru_list(zone, page_tail, lru, head);
@@ -723,6 +777,13 @@ void ____pagevec_lru_add(struct pagevec *pvec, enum lru_list lru)
 
 EXPORT_SYMBOL(____pagevec_lru_add);
 
+static void lru_batch_add_drain(struct lru_batch *batch, enum lru_list lru)
+{
+	VM_BUG_ON(is_unevictable_lru(lru));
+
+	lru_batch_move_fn(batch, ____pagevec_lru_add_fn, (void *)lru);
+}
+
 /*
  * Try to drop buffers from the pages in a pagevec
  */
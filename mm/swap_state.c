@@ -19,6 +19,8 @@
 #include <linux/pagevec.h>
 #include <linux/migrate.h>
 #include <linux/page_cgroup.h>
+#include <linux/pfn.h>
+#include <linux/log2.h>
 
 #include <asm/pgtable.h>
 
@@ -54,6 +56,55 @@ static struct {
 	unsigned long find_total;
 } swap_cache_info;
 
+/* Use VMA based swap readahead where swap is not on rotating disks */
+int sysctl_swap_vma_readahead __read_mostly = 1;
+
+/*
+ * vma->swap_readahead_info holds the address of the last swapin fault in
+ * the VMA, the readahead window used for it and the number of pages read
+ * ahead which were used since, packed into the page offset bits.
+ */
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((unsigned long)(win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) | \
+	 ((unsigned long)(hits) & SWAP_RA_HITS_MASK))
+
+/* The ptes of the window are copied to the stack, keep it small */
+#ifdef CONFIG_64BIT
+#define SWAP_RA_ORDER_CEILING	5
+#else
+#define SWAP_RA_ORDER_CEILING	3
+#endif
+
+/*
+ * A page read ahead into the swap cache has been used: count it for
+ * VMA based readahead if @vma is given, else for swap slot readahead.
+ */
+static void swap_ra_hit(struct vm_area_struct *vma)
+{
+	unsigned long ra_val;
+
+	if (!vma) {
+		count_vm_event(SWAP_RA_HIT);
+		return;
+	}
+
+	count_vm_event(SWAP_VMA_RA_HIT);
+	ra_val = atomic_long_read(&vma->swap_readahead_info);
+	if (SWAP_RA_HITS(ra_val) < SWAP_RA_HITS_MAX)
+		atomic_long_cmpxchg(&vma->swap_readahead_info,
+				    ra_val, ra_val + 1);
+}
+
 void show_swap_cache_info(void)
 {
 	printk("%lu pages in swap cache\n", total_swapcache_pages);
@@ -259,15 +310,21 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
  * unlocked and with its refcount incremented - we rely on the kernel
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
+ *
+ * If the page was read ahead, the hit is accounted to @vma's readahead
+ * window when using VMA based readahead, so pass @vma only then.
  */
-struct page * lookup_swap_cache(swp_entry_t entry)
+struct page * lookup_swap_cache(swp_entry_t entry, struct vm_area_struct *vma)
 {
 	struct page *page;
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		if (TestClearPageReadahead(page))
+			swap_ra_hit(vma);
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
@@ -279,12 +336,14 @@ struct page * lookup_swap_cache(swp_entry_t entry)
  * A failure return means that either the page allocation failed or that
  * the swap entry is no longer in use.
  */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry,
+			gfp_t gfp_mask, struct vm_area_struct *vma,
+			unsigned long addr, bool *new_page_allocated)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
 
+	*new_page_allocated = false;
 	do {
 		/*
 		 * First check the swap cache.  Since this is normally
@@ -335,6 +394,7 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			 */
 			lru_cache_add_anon(new_page);
 			swap_readpage(new_page);
+			*new_page_allocated = true;
 			return new_page;
 		}
 		radix_tree_preload_end();
@@ -352,6 +412,36 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	bool page_allocated;
+
+	return __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &page_allocated);
+}
+
+/*
+ * Read ahead the swap page for @entry: like read_swap_cache_async(), but
+ * a page newly read is marked PageReadahead, so that lookup_swap_cache()
+ * can tell whether reading it was useful, and counted in @event.
+ */
+static struct page *swap_readahead_one(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			enum vm_event_item event)
+{
+	bool page_allocated;
+	struct page *page;
+
+	page = __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &page_allocated);
+	if (page && page_allocated) {
+		SetPageReadahead(page);
+		count_vm_event(event);
+	}
+	return page;
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -389,8 +479,13 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	nr_pages = valid_swaphandles(entry, &offset);
 	for (end_offset = offset + nr_pages; offset < end_offset; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
+		if (offset == swp_offset(entry))
+			page = read_swap_cache_async(entry, gfp_mask,
+						     vma, addr);
+		else
+			page = swap_readahead_one(swp_entry(swp_type(entry),
+							    offset),
+						  gfp_mask, vma, addr, SWAP_RA);
 		if (!page)
 			break;
 		page_cache_release(page);
@@ -398,3 +493,128 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
+
+/*
+ * Size the readahead window for a fault at page @pfn of the VMA: read
+ * ahead two more pages than were used since the last fault at @prev_pfn,
+ * rounded up to a power of 2, but not more than @max_win pages.  With no
+ * hits, only keep reading ahead if the faults move sequentially.  Halve
+ * the last window @prev_win at most, so that a burst of random faults
+ * does not collapse a window that worked well.
+ */
+static unsigned int swap_ra_window(unsigned long prev_pfn, unsigned long pfn,
+				   unsigned int hits, unsigned int max_win,
+				   unsigned int prev_win)
+{
+	unsigned int win;
+
+	win = hits + 2;
+	if (win == 2) {
+		if (pfn != prev_pfn + 1 && pfn != prev_pfn - 1)
+			win = 1;
+	} else {
+		win = roundup_pow_of_two(max(win, 4U));
+	}
+
+	win = max(win, prev_win / 2);
+	return min(win, max_win);
+}
+
+/**
+ * swap_vma_readahead - swap in pages mapped next to the faulting address
+ * @fentry: swap entry of this memory
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma this address belongs to
+ * @addr: faulting address
+ *
+ * Returns the struct page for @fentry and @addr, after queueing swapin.
+ *
+ * Pages next to each other in swap were swapped out at about the same
+ * time but are often unrelated, and with swap on zram or an SSD their
+ * order on swap saves nothing when reading.  Instead, this reads the swap
+ * entries of the pages mapped around @addr in @vma, which the task is far
+ * more likely to touch next.  The window is sized by swap_ra_window() from
+ * the hits since the last fault in the VMA, and is placed ahead of @addr
+ * in the direction the faults move, or around @addr otherwise.  It does
+ * not extend beyond the VMA or the page table of @addr.
+ *
+ * Caller must hold down_read on the vma->vm_mm.
+ */
+struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	pte_t ptes[1 << SWAP_RA_ORDER_CEILING];
+	unsigned long ra_val, pfn, prev_pfn, first, last, start, end, left;
+	unsigned int max_win, win, i;
+	struct page *page;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	max_win = 1 << min_t(int, page_cluster, SWAP_RA_ORDER_CEILING);
+	pfn = PFN_DOWN(addr);
+	ra_val = atomic_long_read(&vma->swap_readahead_info);
+	prev_pfn = PFN_DOWN(SWAP_RA_ADDR(ra_val));
+	win = swap_ra_window(prev_pfn, pfn, SWAP_RA_HITS(ra_val), max_win,
+			     SWAP_RA_WIN(ra_val));
+	atomic_long_set(&vma->swap_readahead_info, SWAP_RA_VAL(addr, win, 0));
+	if (win <= 1)
+		goto skip;
+
+	if (pfn == prev_pfn - 1)
+		left = win - 1;
+	else if (pfn == prev_pfn + 1)
+		left = 0;
+	else
+		left = (win - 1) / 2;
+
+	first = PFN_DOWN(max(vma->vm_start, addr & PMD_MASK));
+	last = PFN_DOWN(min(vma->vm_end, (addr & PMD_MASK) + PMD_SIZE));
+	start = pfn - min(left, pfn - first);
+	end = min(start + win, last);
+
+	pgd = pgd_offset(vma->vm_mm, addr);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto skip;
+	pud = pud_offset(pgd, addr);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto skip;
+	pmd = pmd_offset(pud, addr);
+	if (pmd_none(*pmd) || pmd_trans_huge(*pmd) || unlikely(pmd_bad(*pmd)))
+		goto skip;
+
+	/*
+	 * The ptes are read without the page table lock: an entry which has
+	 * changed since is either no longer a swap entry or fails to be read
+	 * into the swap cache, at worst a page is read in vain.
+	 */
+	pte = pte_offset_map(pmd, start << PAGE_SHIFT);
+	for (i = 0; i < end - start; i++)
+		ptes[i] = pte[i];
+	pte_unmap(pte);
+
+	for (i = 0; i < end - start; i++) {
+		unsigned long vaddr = (start + i) << PAGE_SHIFT;
+		swp_entry_t entry;
+
+		if (!is_swap_pte(ptes[i]))
+			continue;
+		entry = pte_to_swp_entry(ptes[i]);
+		if (unlikely(non_swap_entry(entry)))
+			continue;
+
+		if (vaddr == (addr & PAGE_MASK))
+			page = read_swap_cache_async(fentry, gfp_mask,
+						     vma, addr);
+		else
+			page = swap_readahead_one(entry, gfp_mask, vma, vaddr,
+						  SWAP_VMA_RA);
+		if (!page)
+			continue;
+		page_cache_release(page);
+	}
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+skip:
+	return read_swap_cache_async(fentry, gfp_mask, vma, addr);
+}
@@ -105,6 +105,12 @@ struct scan_control {
 	 */
 	reclaim_mode_t reclaim_mode;
 
+	/*
+	 * Reclaim the pages regardless of their references, because the
+	 * caller picked them on purpose. i.e, per-process reclaim.
+	 */
+	int force_reclaim;
+
 	/* Which cgroup do we reclaim from */
 	struct mem_cgroup *mem_cgroup;
 
@@ -527,10 +533,14 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
 
-		__delete_from_page_cache(page);
+		/* Remember the eviction in case the page is read back soon */
+		if (page_is_file_cache(page))
+			shadow = workingset_eviction(mapping, page);
+		__delete_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -696,6 +706,20 @@ static enum page_references page_check_references(struct page *page,
 	return PAGEREF_RECLAIM;
 }
 
+/*
+ * The multi-gen LRU found the accessed ptes of the page when it walked the
+ * page tables, and try_to_unmap() still keeps a page that was accessed
+ * after that, so only PG_referenced is left to check.
+ */
+static enum page_references lru_gen_page_references(struct page *page)
+{
+	/* Reclaim if clean, defer dirty pages to writeback */
+	if (TestClearPageReferenced(page) && !PageSwapBacked(page))
+		return PAGEREF_RECLAIM_CLEAN;
+
+	return PAGEREF_RECLAIM;
+}
+
 static noinline_for_stack void free_page_list(struct list_head *free_pages)
 {
 	struct pagevec freed_pvec;
@@ -745,7 +769,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			goto keep;
 
 		VM_BUG_ON(PageActive(page));
-		VM_BUG_ON(page_zone(page) != zone);
+		VM_BUG_ON(zone && page_zone(page) != zone);
 
 		sc->nr_scanned++;
 
@@ -780,7 +804,12 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		references = page_check_references(page, sc);
+		if (sc->force_reclaim)
+			references = PAGEREF_RECLAIM;
+		else if (lru_gen_enabled())
+			references = lru_gen_page_references(page);
+		else
+			references = page_check_references(page, sc);
 		switch (references) {
 		case PAGEREF_ACTIVATE:
 			goto activate_locked;
@@ -810,7 +839,12 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		 * processes. Try to unmap it here.
 		 */
 		if (page_mapped(page) && mapping) {
-			switch (try_to_unmap(page, TTU_UNMAP)) {
+			enum ttu_flags ttu_flags = TTU_UNMAP;
+
+			if (sc->force_reclaim)
+				ttu_flags |= TTU_IGNORE_ACCESS;
+
+			switch (try_to_unmap(page, ttu_flags)) {
 			case SWAP_FAIL:
 				goto activate_locked;
 			case SWAP_AGAIN:
@@ -952,7 +986,8 @@ keep_lumpy:
 	 * back off and wait for congestion to clear because further reclaim
 	 * will encounter the same problem
 	 */
-	if (nr_dirty && nr_dirty == nr_congested && scanning_global_lru(sc))
+	if (nr_dirty && nr_dirty == nr_congested && scanning_global_lru(sc) &&
+	    zone)
 		zone_set_flag(zone, ZONE_CONGESTED);
 
 	free_page_list(&free_pages);
@@ -962,6 +997,49 @@ keep_lumpy:
 	return nr_reclaimed;
 }
 
+#ifdef CONFIG_PROCESS_RECLAIM
+/**
+ * reclaim_pages_from_list - reclaim a list of isolated pages
+ * @page_list: pages taken off the LRU with isolate_lru_page()
+ *
+ * The pages may belong to any zone and are reclaimed whether or not they
+ * were referenced recently.  Those that cannot be reclaimed are put back
+ * on the LRU, and @page_list is empty on return.
+ *
+ * Returns the number of reclaimed pages.
+ */
+unsigned long reclaim_pages_from_list(struct list_head *page_list)
+{
+	struct scan_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.may_writepage = !laptop_mode,
+		.may_unmap = 1,
+		.may_swap = 1,
+		.force_reclaim = 1,
+	};
+	unsigned long nr_taken = 0;
+	unsigned long nr_reclaimed;
+	struct page *page;
+
+	list_for_each_entry(page, page_list, lru) {
+		ClearPageActive(page);
+		nr_taken++;
+	}
+
+	nr_reclaimed = shrink_page_list(page_list, NULL, &sc);
+
+	while (!list_empty(page_list)) {
+		page = lru_to_page(page_list);
+		list_del(&page->lru);
+		putback_lru_page(page);
+	}
+
+	count_vm_events(PGSCAN_PROCESS, nr_taken);
+	count_vm_events(PGSTEAL_PROCESS, nr_reclaimed);
+	return nr_reclaimed;
+}
+#endif /* CONFIG_PROCESS_RECLAIM */
+
 /*
  * Attempt to remove the specified page from its LRU.  Only take this page
  * if it is of the appropriate PageActive status.  Pages which are being
@@ -1318,19 +1396,27 @@ putback_lru_pages(struct zone *zone, struct scan_control *sc,
 	__mod_zone_page_state(zone, NR_ISOLATED_ANON, -nr_anon);
 	__mod_zone_page_state(zone, NR_ISOLATED_FILE, -nr_file);
 
+	reclaim_stat->recent_scanned[0] += nr_anon;
+	reclaim_stat->recent_scanned[1] += nr_file;
+
 	spin_unlock_irq(&zone->lru_lock);
 	pagevec_release(&pvec);
 }
 
+/*
+ * Count the isolated pages per LRU list and clear their active flags.
+ * Nobody else plays with the flags of pages off the LRU, so this only
+ * needs interrupts disabled for the zone counters, not zone->lru_lock.
+ * The reclaim_stat, which the lock does protect, is updated when the
+ * pages are put back.
+ */
 static noinline_for_stack void update_isolated_counts(struct zone *zone,
-					struct scan_control *sc,
 					unsigned long *nr_anon,
 					unsigned long *nr_file,
 					struct list_head *isolated_list)
 {
 	unsigned long nr_active;
 	unsigned int count[NR_LRU_LISTS] = { 0, };
-	struct zone_reclaim_stat *reclaim_stat = get_reclaim_stat(zone, sc);
 
 	nr_active = clear_active_flags(isolated_list, count);
 	__count_vm_events(PGDEACTIVATE, nr_active);
@@ -1348,9 +1434,6 @@ static noinline_for_stack void update_isolated_counts(struct zone *zone,
 	*nr_file = count[LRU_ACTIVE_FILE] + count[LRU_INACTIVE_FILE];
 	__mod_zone_page_state(zone, NR_ISOLATED_ANON, *nr_anon);
 	__mod_zone_page_state(zone, NR_ISOLATED_FILE, *nr_file);
-
-	reclaim_stat->recent_scanned[0] += *nr_anon;
-	reclaim_stat->recent_scanned[1] += *nr_file;
 }
 
 /*
@@ -1452,9 +1535,11 @@ shrink_inactive_list(unsigned long nr_to_scan, struct zone *zone,
 		return 0;
 	}
 
-	update_isolated_counts(zone, sc, &nr_anon, &nr_file, &page_list);
+	spin_unlock(&zone->lru_lock);
 
-	spin_unlock_irq(&zone->lru_lock);
+	update_isolated_counts(zone, &nr_anon, &nr_file, &page_list);
+
+	local_irq_enable();
 
 	nr_reclaimed = shrink_page_list(&page_list, zone, sc);
 
@@ -1651,9 +1736,9 @@ static int inactive_anon_is_low(struct zone *zone, struct scan_control *sc)
 
 	/*
 	 * If we don't have swap space, anonymous page deactivation
-	 * is pointless.
+	 * is pointless.  The multi-gen LRU does not deactivate pages.
 	 */
-	if (!total_swap_pages)
+	if (!total_swap_pages || lru_gen_enabled())
 		return 0;
 
 	if (scanning_global_lru(sc))
@@ -1928,6 +2013,526 @@ static inline bool should_continue_reclaim(struct zone *zone,
 	}
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-gen LRU
+ *
+ * Instead of the active and inactive lists, the evictable pages of a zone
+ * are kept in MIN_NR_GENS to MAX_NR_GENS generations per type, anon and
+ * file, see struct lru_gen.  The aging opens a new youngest generation,
+ * after walking the page tables of all processes and moving every page it
+ * finds accessed into the current youngest one.  The walk only updates the
+ * generation in page->flags; the page is moved to the matching list when
+ * the eviction comes across it.  The eviction takes pages from the oldest
+ * generation of a type, hands them to shrink_page_list() without another
+ * look at their references through rmap, and retires the generation once
+ * it is empty.  When a type is down to MIN_NR_GENS generations, the
+ * eviction runs the aging first.
+ *
+ * The page table walks harvest the accessed bits of a process a page table
+ * at a time, in address order, instead of walking the rmap of each page
+ * taken off the active list, and pages that were not accessed are not
+ * scanned again and again while they age.
+ *
+ * The mode is picked at boot, with lru_gen=, and cannot change once pages
+ * are on the lists.  Lumpy reclaim is not done; high-order allocations
+ * rely on compaction.
+ */
+#ifdef CONFIG_LRU_GEN_ENABLED
+bool __lru_gen_enabled __read_mostly = true;
+#else
+bool __lru_gen_enabled __read_mostly;
+#endif
+
+static int __init setup_lru_gen(char *str)
+{
+	int enabled;
+
+	if (!get_option(&str, &enabled))
+		return -EINVAL;
+	__lru_gen_enabled = enabled;
+	return 0;
+}
+early_param("lru_gen", setup_lru_gen);
+
+void __meminit lru_gen_init_zone(struct zone *zone)
+{
+	struct lru_gen *lrugen = &zone->lru_gen;
+	int gen, type;
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++) {
+		for (type = 0; type < 2; type++) {
+			INIT_LIST_HEAD(&lrugen->lists[gen][type]);
+			lrugen->nr_pages[gen][type] = 0;
+		}
+	}
+	lrugen->min_seq[0] = lrugen->min_seq[1] = 0;
+	lrugen->max_seq = MIN_NR_GENS - 1;
+}
+
+/*
+ * The mm_structs of all processes, for the aging to walk.  The walk takes
+ * them from the head and puts them back at the tail.
+ */
+static LIST_HEAD(lru_gen_mm_list);
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
+static unsigned long lru_gen_nr_mms;
+/* The mm whose page tables the aging walks right now */
+static struct mm_struct *lru_gen_walk_mm;
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	INIT_LIST_HEAD(&mm->lru_gen_list);
+	if (!lru_gen_enabled())
+		return;
+
+	spin_lock(&lru_gen_mm_lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+	lru_gen_nr_mms++;
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+/*
+ * Called by mmput() once the last user is gone, before the page tables
+ * are torn down.  If the aging is walking them, wait for it to finish;
+ * any later walk sees mm_users at zero and leaves the mm alone.
+ */
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	bool walking;
+
+	if (list_empty(&mm->lru_gen_list))
+		return;
+
+	spin_lock(&lru_gen_mm_lock);
+	list_del_init(&mm->lru_gen_list);
+	lru_gen_nr_mms--;
+	walking = lru_gen_walk_mm == mm;
+	spin_unlock(&lru_gen_mm_lock);
+
+	if (walking) {
+		down_write(&mm->mmap_sem);
+		up_write(&mm->mmap_sem);
+	}
+}
+
+/* State of the aging, serialized by lru_gen_aging_mutex */
+struct lru_gen_walk {
+	int nid;
+	struct vm_area_struct *vma;
+	unsigned long nr_young;
+	/* Size changes of the generations, applied after the walk */
+	long nr_pages[MAX_NR_ZONES][MAX_NR_GENS][2];
+};
+
+static DEFINE_MUTEX(lru_gen_aging_mutex);
+static struct lru_gen_walk lru_gen_walk;
+
+/*
+ * Move a page on the multi-gen LRU to generation @gen, without the list
+ * move, and return the old one, or -1 if it is not on the lists.
+ */
+static int page_update_lru_gen(struct page *page, int gen)
+{
+	unsigned long old, new;
+
+	do {
+		old = ACCESS_ONCE(page->flags);
+		if (!(old & LRU_GEN_MASK))
+			return -1;
+		new = (old & ~LRU_GEN_MASK) |
+		      ((unsigned long)(gen + 1) << LRU_GEN_PGOFF);
+	} while (cmpxchg(&page->flags, old, new) != old);
+
+	return (int)((old & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1;
+}
+
+static int lru_gen_walk_pmd_range(pmd_t *pmd, unsigned long addr,
+				  unsigned long end, struct mm_walk *mm_walk)
+{
+	struct lru_gen_walk *walk = mm_walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	unsigned long start = addr;
+	pte_t *pte, *orig_pte;
+	spinlock_t *ptl;
+	int young = 0;
+
+	if (pmd_trans_huge(*pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		struct page *page;
+		struct zone *zone;
+		int old_gen, new_gen, type, delta;
+
+		if (!pte_present(*pte) || !pte_young(*pte))
+			continue;
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page || page_to_nid(page) != walk->nid ||
+		    page_lru_gen(page) < 0)
+			continue;
+		if (!ptep_test_and_clear_young(vma, addr, pte))
+			continue;
+		young++;
+
+		zone = page_zone(page);
+		new_gen = lru_gen_from_seq(zone->lru_gen.max_seq);
+		old_gen = page_update_lru_gen(page, new_gen);
+		if (old_gen < 0 || old_gen == new_gen)
+			continue;
+
+		type = page_is_file_cache(page);
+		delta = hpage_nr_pages(page);
+		walk->nr_pages[zone_idx(zone)][old_gen][type] -= delta;
+		walk->nr_pages[zone_idx(zone)][new_gen][type] += delta;
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+
+	/* The next access has to set the accessed bits again */
+	if (young) {
+		flush_tlb_range(vma, start, end);
+		walk->nr_young += young;
+	}
+	cond_resched();
+	return 0;
+}
+
+/*
+ * Walk the page tables of every process.  mmap_sem is only tried, so an
+ * mm that is busy, or locked further up in this reclaim path, is skipped;
+ * try_to_unmap() still catches its accessed pages at eviction time.
+ */
+static void lru_gen_walk_mms(struct lru_gen_walk *walk)
+{
+	struct mm_walk mm_walk = {
+		.pmd_entry = lru_gen_walk_pmd_range,
+		.private = walk,
+	};
+	unsigned long nr;
+
+	spin_lock(&lru_gen_mm_lock);
+	for (nr = lru_gen_nr_mms; nr && !list_empty(&lru_gen_mm_list); nr--) {
+		struct vm_area_struct *vma;
+		struct mm_struct *mm;
+
+		mm = list_first_entry(&lru_gen_mm_list, struct mm_struct,
+				      lru_gen_list);
+		list_move_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+		if (!atomic_read(&mm->mm_users))
+			continue;
+		atomic_inc(&mm->mm_count);
+		lru_gen_walk_mm = mm;
+		spin_unlock(&lru_gen_mm_lock);
+
+		if (down_read_trylock(&mm->mmap_sem)) {
+			/* Exiting, see lru_gen_del_mm() */
+			if (!atomic_read(&mm->mm_users))
+				vma = NULL;
+			else
+				vma = mm->mmap;
+			mm_walk.mm = mm;
+			for (; vma; vma = vma->vm_next) {
+				if (vma->vm_flags & (VM_LOCKED | VM_IO |
+						     VM_PFNMAP | VM_HUGETLB))
+					continue;
+				walk->vma = vma;
+				walk_page_range(vma->vm_start, vma->vm_end,
+						&mm_walk);
+			}
+			up_read(&mm->mmap_sem);
+		}
+
+		spin_lock(&lru_gen_mm_lock);
+		lru_gen_walk_mm = NULL;
+		spin_unlock(&lru_gen_mm_lock);
+		mmdrop(mm);
+		spin_lock(&lru_gen_mm_lock);
+	}
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+/*
+ * Open a new youngest generation.  The one that was second youngest now
+ * counts as inactive.  A type that has run out of generations, because
+ * reclaim could not evict from it, as anon pages without swap, gives up
+ * its oldest one, and the pages left there count as the youngest.
+ */
+static void lru_gen_inc_max_seq(struct zone *zone)
+{
+	struct lru_gen *lrugen = &zone->lru_gen;
+	int prev, next, type;
+
+	for (type = 0; type < 2; type++) {
+		if (lrugen->max_seq - lrugen->min_seq[type] + 1 == MAX_NR_GENS)
+			lrugen->min_seq[type]++;
+	}
+
+	prev = lru_gen_from_seq(lrugen->max_seq - 1);
+	next = lru_gen_from_seq(lrugen->max_seq + 1);
+	for (type = 0; type < 2; type++) {
+		enum lru_list l = type * LRU_FILE;
+		long delta = lrugen->nr_pages[prev][type] -
+			     lrugen->nr_pages[next][type];
+
+		__mod_zone_page_state(zone, NR_LRU_BASE + l + LRU_ACTIVE,
+				      -delta);
+		__mod_zone_page_state(zone, NR_LRU_BASE + l, delta);
+	}
+	lrugen->max_seq++;
+}
+
+/*
+ * Age the zones on the node of @zone by one generation, unless another
+ * reclaimer did so while this one waited for its turn.
+ */
+static void lru_gen_age(struct zone *zone)
+{
+	struct pglist_data *pgdat = zone->zone_pgdat;
+	struct lru_gen_walk *walk = &lru_gen_walk;
+	unsigned long max_seq = zone->lru_gen.max_seq;
+	int i, gen, type;
+
+	mutex_lock(&lru_gen_aging_mutex);
+	if (zone->lru_gen.max_seq != max_seq)
+		goto out;
+
+	memset(walk, 0, sizeof(*walk));
+	walk->nid = pgdat->node_id;
+	lru_gen_walk_mms(walk);
+
+	for (i = 0; i < pgdat->nr_zones; i++) {
+		struct zone *z = pgdat->node_zones + i;
+
+		if (!populated_zone(z))
+			continue;
+
+		spin_lock_irq(&z->lru_lock);
+		for (gen = 0; gen < MAX_NR_GENS; gen++) {
+			for (type = 0; type < 2; type++) {
+				long delta = walk->nr_pages[i][gen][type];
+
+				if (delta)
+					lru_gen_update_size(z, type, gen,
+							    delta);
+			}
+		}
+		lru_gen_inc_max_seq(z);
+		spin_unlock_irq(&z->lru_lock);
+	}
+
+	count_vm_event(LRU_GEN_AGING);
+	count_vm_events(LRU_GEN_YOUNG, walk->nr_young);
+out:
+	mutex_unlock(&lru_gen_aging_mutex);
+}
+
+/* Retire the oldest generations of a type that are empty */
+static void lru_gen_inc_min_seq(struct zone *zone, int type)
+{
+	struct lru_gen *lrugen = &zone->lru_gen;
+
+	while (lrugen->min_seq[type] + MIN_NR_GENS <= lrugen->max_seq) {
+		int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+
+		if (!list_empty(&lrugen->lists[gen][type]))
+			break;
+		lrugen->min_seq[type]++;
+	}
+}
+
+/* Only the generations older than the two youngest are evicted */
+static bool lru_gen_needs_aging(struct zone *zone, int type)
+{
+	struct lru_gen *lrugen = &zone->lru_gen;
+
+	return lrugen->min_seq[type] + MIN_NR_GENS > lrugen->max_seq;
+}
+
+/*
+ * Evict the type with the older pages.  Without swap, that is always the
+ * file pages; on a tie, vm.swappiness decides.
+ */
+static int lru_gen_type_to_evict(struct zone *zone, struct scan_control *sc)
+{
+	struct lru_gen *lrugen = &zone->lru_gen;
+
+	if (!sc->may_swap || nr_swap_pages <= 0)
+		return 1;
+	if (lrugen->min_seq[0] != lrugen->min_seq[1])
+		return lrugen->min_seq[0] > lrugen->min_seq[1];
+	return sc->swappiness <= 100;
+}
+
+/*
+ * Isolate up to @nr_to_scan pages from the tail of the oldest generation
+ * of @type.  Pages that the aging found accessed are sorted into their
+ * generation on the way.  Called with zone->lru_lock held.
+ */
+static unsigned long lru_gen_isolate(struct zone *zone, int type,
+				     unsigned long nr_to_scan,
+				     struct list_head *dst,
+				     unsigned long *nr_scanned)
+{
+	struct lru_gen *lrugen = &zone->lru_gen;
+	int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	struct list_head *src = &lrugen->lists[gen][type];
+	unsigned long nr_taken = 0;
+	unsigned long scan = 0;
+
+	while (scan < nr_to_scan && !list_empty(src)) {
+		struct page *page = lru_to_page(src);
+		int new_gen = page_lru_gen(page);
+
+		prefetchw_prev_lru_page(page, src, flags);
+		scan++;
+
+		if (new_gen != gen) {
+			list_move(&page->lru, &lrugen->lists[new_gen][type]);
+			continue;
+		}
+
+		switch (__isolate_lru_page(page, ISOLATE_INACTIVE, type)) {
+		case 0:
+			lru_gen_del_page(zone, page, true);
+			list_add(&page->lru, dst);
+			nr_taken += hpage_nr_pages(page);
+			break;
+
+		case -EBUSY:
+			/* else it is being freed elsewhere */
+			list_move(&page->lru, src);
+			break;
+
+		default:
+			BUG();
+		}
+	}
+
+	lru_gen_inc_min_seq(zone, type);
+	*nr_scanned = scan;
+	return nr_taken;
+}
+
+static unsigned long lru_gen_evict(struct zone *zone, int type,
+				   unsigned long nr_to_scan,
+				   struct scan_control *sc, int priority)
+{
+	LIST_HEAD(page_list);
+	unsigned long nr_scanned;
+	unsigned long nr_reclaimed;
+	unsigned long nr_taken;
+
+	while (unlikely(too_many_isolated(zone, type, sc))) {
+		congestion_wait(BLK_RW_ASYNC, HZ/10);
+
+		/* We are about to die and free our memory. Return now. */
+		if (fatal_signal_pending(current))
+			return SWAP_CLUSTER_MAX;
+	}
+
+	set_reclaim_mode(priority, sc, false);
+	lru_add_drain();
+	spin_lock_irq(&zone->lru_lock);
+
+	nr_taken = lru_gen_isolate(zone, type, nr_to_scan, &page_list,
+				   &nr_scanned);
+	zone->pages_scanned += nr_scanned;
+	if (current_is_kswapd())
+		__count_zone_vm_events(PGSCAN_KSWAPD, zone, nr_scanned);
+	else
+		__count_zone_vm_events(PGSCAN_DIRECT, zone, nr_scanned);
+
+	if (nr_taken == 0) {
+		spin_unlock_irq(&zone->lru_lock);
+		return 0;
+	}
+
+	__mod_zone_page_state(zone, NR_ISOLATED_ANON + type, nr_taken);
+	spin_unlock_irq(&zone->lru_lock);
+
+	nr_reclaimed = shrink_page_list(&page_list, zone, sc);
+
+	local_irq_disable();
+	if (current_is_kswapd())
+		__count_vm_events(KSWAPD_STEAL, nr_reclaimed);
+	__count_zone_vm_events(PGSTEAL, zone, nr_reclaimed);
+
+	putback_lru_pages(zone, sc, type ? 0 : nr_taken, type ? nr_taken : 0,
+			  &page_list);
+
+	trace_mm_vmscan_lru_shrink_inactive(zone->zone_pgdat->node_id,
+		zone_idx(zone),
+		nr_scanned, nr_reclaimed,
+		priority,
+		trace_shrink_flags(type, sc->reclaim_mode));
+	return nr_reclaimed;
+}
+
+/*
+ * shrink_zone() for the multi-gen LRU: evict the oldest pages, and age
+ * the zone at most once per call when it runs out of old generations.
+ */
+static void lru_gen_shrink_zone(int priority, struct zone *zone,
+				struct scan_control *sc)
+{
+	unsigned long nr_to_scan, nr_reclaimed, nr_scanned;
+	struct blk_plug plug;
+	bool aged = false;
+
+restart:
+	nr_reclaimed = 0;
+	nr_scanned = sc->nr_scanned;
+
+	nr_to_scan = zone_page_state(zone, NR_ACTIVE_FILE) +
+		     zone_page_state(zone, NR_INACTIVE_FILE);
+	if (sc->may_swap && nr_swap_pages > 0)
+		nr_to_scan += zone_page_state(zone, NR_ACTIVE_ANON) +
+			      zone_page_state(zone, NR_INACTIVE_ANON);
+	nr_to_scan >>= priority;
+	/* kswapd does zone balancing and needs to scan this zone */
+	if (!nr_to_scan && current_is_kswapd())
+		nr_to_scan = SWAP_CLUSTER_MAX;
+
+	blk_start_plug(&plug);
+	while (nr_to_scan) {
+		int type = lru_gen_type_to_evict(zone, sc);
+		unsigned long nr;
+
+		if (lru_gen_needs_aging(zone, type)) {
+			if (aged)
+				break;
+			lru_gen_age(zone);
+			aged = true;
+			continue;
+		}
+
+		nr = min_t(unsigned long, nr_to_scan, SWAP_CLUSTER_MAX);
+		nr_to_scan -= nr;
+		nr_reclaimed += lru_gen_evict(zone, type, nr, sc, priority);
+
+		/* See shrink_zone() */
+		if (nr_reclaimed >= sc->nr_to_reclaim &&
+		    priority < DEF_PRIORITY)
+			break;
+	}
+	blk_finish_plug(&plug);
+	sc->nr_reclaimed += nr_reclaimed;
+
+	/* reclaim/compaction might need reclaim to continue */
+	if (should_continue_reclaim(zone, nr_reclaimed,
+					sc->nr_scanned - nr_scanned, sc))
+		goto restart;
+
+	throttle_vm_writeout(sc->gfp_mask);
+}
+#else
+static inline void lru_gen_shrink_zone(int priority, struct zone *zone,
+				       struct scan_control *sc)
+{
+}
+#endif /* CONFIG_LRU_GEN */
+
 /*
  * This is a basic per-zone page freer.  Used by both kswapd and direct reclaim.
  */
@@ -1941,6 +2546,11 @@ static void shrink_zone(int priority, struct zone *zone,
 	unsigned long nr_to_reclaim = sc->nr_to_reclaim;
 	struct blk_plug plug;
 
+	if (lru_gen_enabled()) {
+		lru_gen_shrink_zone(priority, zone, sc);
+		return;
+	}
+
 restart:
 	nr_reclaimed = 0;
 	nr_scanned = sc->nr_scanned;
@@ -2178,10 +2788,23 @@ out:
 	return 0;
 }
 
+/*
+ * Account the CPU time spent in reclaim since @start, in microseconds, to
+ * compare the costs of the LRU aging modes.
+ */
+static void count_reclaim_cpu(enum vm_event_item item, u64 start)
+{
+	u64 delta = task_sched_runtime(current) - start;
+
+	do_div(delta, NSEC_PER_USEC);
+	count_vm_events(item, delta);
+}
+
 unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 				gfp_t gfp_mask, nodemask_t *nodemask)
 {
 	unsigned long nr_reclaimed;
+	u64 start;
 	struct scan_control sc = {
 		.gfp_mask = gfp_mask,
 		.may_writepage = !laptop_mode,
@@ -2201,7 +2824,9 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 				sc.may_writepage,
 				gfp_mask);
 
+	start = task_sched_runtime(current);
 	nr_reclaimed = do_try_to_free_pages(zonelist, &sc, &shrink);
+	count_reclaim_cpu(RECLAIM_CPU_DIRECT, start);
 
 	trace_mm_vmscan_direct_reclaim_end(nr_reclaimed);
 
@@ -2698,6 +3323,13 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
 		 * them before going back to sleep.
 		 */
 		set_pgdat_percpu_threshold(pgdat, calculate_normal_threshold);
+
+		/*
+		 * kswapd has freed enough memory for an allocation of this
+		 * order, let kcompactd turn it into contiguous pages while
+		 * we sleep.
+		 */
+		wakeup_kcompactd(pgdat, order, classzone_idx);
 		schedule();
 		set_pgdat_percpu_threshold(pgdat, calculate_pressure_threshold);
 	} else {
@@ -2796,8 +3428,11 @@ static int kswapd(void *p)
 		 * after returning from the refrigerator
 		 */
 		if (!ret) {
+			u64 start = task_sched_runtime(current);
+
 			trace_mm_vmscan_kswapd_wake(pgdat->node_id, order);
 			order = balance_pgdat(pgdat, order, &classzone_idx);
+			count_reclaim_cpu(RECLAIM_CPU_KSWAPD, start);
 		}
 	}
 	return 0;
@@ -3240,9 +3875,14 @@ retry:
 		enum lru_list l = page_lru_base_type(page);
 
 		__dec_zone_state(zone, NR_UNEVICTABLE);
-		list_move(&page->lru, &zone->lru[l].list);
-		mem_cgroup_move_lists(page, LRU_UNEVICTABLE, l);
-		__inc_zone_state(zone, NR_INACTIVE_ANON + l);
+		if (lru_gen_enabled()) {
+			list_del(&page->lru);
+			lru_gen_add_page(zone, page, false);
+		} else {
+			list_move(&page->lru, &zone->lru[l].list);
+			mem_cgroup_move_lists(page, LRU_UNEVICTABLE, l);
+			__inc_zone_state(zone, NR_INACTIVE_ANON + l);
+		}
 		__count_vm_event(UNEVICTABLE_PGRESCUED);
 	} else {
 		/*
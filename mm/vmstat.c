@@ -717,6 +717,9 @@ const char * const vmstat_text[] = {
 	"numa_local",
 	"numa_other",
 #endif
+	"workingset_refault",
+	"workingset_activate",
+	"workingset_nodereclaim",
 	"nr_anon_transparent_hugepages",
 	"nr_dirty_threshold",
 	"nr_dirty_background_threshold",
@@ -755,6 +758,8 @@ const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"reclaim_cpu_direct_us",
+	"reclaim_cpu_kswapd_us",
 
 #ifdef CONFIG_COMPACTION
 	"compact_blocks_moved",
@@ -763,6 +768,10 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_daemon_wake",
+	"compact_daemon_proactive",
+	"compact_daemon_success",
+	"compact_daemon_fail",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -785,6 +794,28 @@ const char * const vmstat_text[] = {
 	"thp_collapse_alloc_failed",
 	"thp_split",
 #endif
+#ifdef CONFIG_SWAP
+	"swap_ra",
+	"swap_ra_hit",
+	"swap_vma_ra",
+	"swap_vma_ra_hit",
+#endif
+#ifdef CONFIG_PROCESS_RECLAIM
+	"pgscan_process",
+	"pgsteal_process",
+#endif
+#ifdef CONFIG_LRU_GEN
+	"lru_gen_aging",
+	"lru_gen_young",
+#endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	"spf_success",
+	"spf_abort",
+#endif
+#ifdef CONFIG_READAHEAD_REPLAY
+	"ra_replay",
+	"ra_replay_pages",
+#endif
 
 #endif /* CONFIG_VM_EVENTS_COUNTERS */
 };
@@ -0,0 +1,332 @@
+/*
+ * Workingset detection
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/module.h>
+#include <linux/pagemap.h>
+#include <linux/pagevec.h>
+#include <linux/swap.h>
+#include <linux/vmstat.h>
+#include <linux/radix-tree.h>
+
+/*
+ * File pages start out on the inactive list and are only promoted to the
+ * active list when they are referenced a second time while still on it.
+ * When the inactive list is too small to hold the pages of a working set
+ * between two accesses, those pages are evicted before their second access
+ * and never make it onto the active list, even though they are used over
+ * and over: every access is a refault that has to read from the disk.
+ *
+ * To detect this, every zone counts the evictions and activations of its
+ * file pages in zone->inactive_age, which is a clock of how far pages move
+ * through the inactive list.  When a page cache page is evicted, the
+ * current time of that clock is recorded in a shadow entry that takes the
+ * page's place in the mapping's page_tree.  When the page is read
+ * back in, the difference between the clock and the shadow entry is the
+ * refault distance: the number of slots in the inactive list the page
+ * would have needed beyond those it had to stay in memory until now.
+ *
+ * If the refault distance is not larger than the active list, the page
+ * would have stayed in memory had the active list been given to it, so it
+ * competes with the active pages for memory: it is put straight on the
+ * active list instead of the inactive one.  Active pages that are not part
+ * of the working set anymore are then demoted by the usual inactive list
+ * balancing in vmscan, while pages accessed only once still pass through
+ * the inactive list without disturbing the active one.
+ *
+ * Shadow entries take the slots of the pages they replace, so recording an
+ * eviction allocates nothing.  But the radix tree nodes that are left
+ * holding only shadow entries are memory that page reclaim does not get
+ * back.  Entries older than the file LRU lists are big can never lead to
+ * an activation, so a shrinker keeps the number of these nodes in
+ * proportion to the file LRU, and frees the ones that have held only
+ * shadow entries longest first.
+ */
+
+/*
+ * A shadow entry is the zone's inactive_age at eviction time, the node and
+ * zone index, stored as an exceptional radix tree entry.
+ */
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + ZONES_SHIFT + \
+			 NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+/* Bottom level page_tree nodes that hold nothing but shadow entries */
+static LIST_HEAD(shadow_nodes);
+static DEFINE_SPINLOCK(shadow_nodes_lock);
+static unsigned long nr_shadow_nodes;
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *eviction)
+{
+	unsigned long entry = (unsigned long)shadow;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+	*eviction = entry;
+}
+
+static void shadow_node_unlist(struct radix_tree_node *node)
+{
+	if (list_empty(&node->private_list))
+		return;
+	spin_lock(&shadow_nodes_lock);
+	list_del_init(&node->private_list);
+	nr_shadow_nodes--;
+	spin_unlock(&shadow_nodes_lock);
+}
+
+/**
+ * workingset_update_node - track page_tree nodes holding only shadow entries
+ * @mapping: address space @node belongs to
+ * @node: bottom level node of @mapping->page_tree, or NULL
+ * @index: index of an entry in @node
+ *
+ * Must be called under mapping->tree_lock after entries of @node were
+ * added, replaced or deleted, unless that freed @node.  Nodes that are
+ * left with nothing but shadow entries are put on the list the shrinker
+ * frees them from, and taken off again when they get a page.
+ */
+void workingset_update_node(struct address_space *mapping,
+			    struct radix_tree_node *node, pgoff_t index)
+{
+	if (!node)
+		return;
+
+	if (node->count != node->exceptional) {
+		shadow_node_unlist(node);
+		return;
+	}
+	if (!list_empty(&node->private_list))
+		return;
+
+	node->private_data = mapping;
+	node->index = index & ~RADIX_TREE_MAP_MASK;
+	spin_lock(&shadow_nodes_lock);
+	list_add_tail(&node->private_list, &shadow_nodes);
+	nr_shadow_nodes++;
+	spin_unlock(&shadow_nodes_lock);
+}
+
+/*
+ * Delete the shadow entry at @index from @node, which must not be on the
+ * shadow node list.  Returns false if that freed @node: when it took the
+ * last entry, or when the tree shrank and moved the remaining page into
+ * the root.  Called under mapping->tree_lock.
+ */
+static bool shadow_delete(struct address_space *mapping,
+			  struct radix_tree_node *node, pgoff_t index)
+{
+	bool last = node->count == 1;
+
+	node->exceptional--;
+	mapping->nrshadows--;
+	radix_tree_delete(&mapping->page_tree, index);
+
+	return !last && mapping->page_tree.height;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from the page cache
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place of
+ * the evicted page, for workingset_refault() to evaluate when the page is
+ * read back in.  Called under mapping->tree_lock.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_clear_shadows - drop the shadow entries of a range of a mapping
+ * @mapping: address space being truncated
+ * @start: first index to drop
+ * @end: last index to drop, inclusive
+ *
+ * The data of truncated pages is gone, and with it the reason to remember
+ * when they were evicted.  This must be called before the mapping is freed,
+ * for the radix tree nodes that hold shadow entries.
+ */
+void workingset_clear_shadows(struct address_space *mapping,
+			      pgoff_t start, pgoff_t end)
+{
+	void **slots[PAGEVEC_SIZE];
+	pgoff_t indices[PAGEVEC_SIZE];
+	unsigned int nr, i;
+
+	while (mapping->nrshadows && start <= end) {
+		spin_lock_irq(&mapping->tree_lock);
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, start, PAGEVEC_SIZE);
+		for (i = 0; i < nr && indices[i] <= end; i++) {
+			struct radix_tree_node *node;
+			void **slot;
+			void *entry;
+
+			entry = radix_tree_deref_slot_protected(slots[i],
+							&mapping->tree_lock);
+			if (!radix_tree_exceptional_entry(entry))
+				continue;
+
+			__radix_tree_lookup(&mapping->page_tree, indices[i],
+					    &node, &slot);
+			shadow_node_unlist(node);
+			if (shadow_delete(mapping, node, indices[i]))
+				workingset_update_node(mapping, node,
+						       indices[i]);
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+
+		if (i < PAGEVEC_SIZE)
+			break;
+		start = indices[i - 1] + 1;
+		if (!start)
+			break;
+		cond_resched();
+	}
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously evicted
+ * page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	unsigned long eviction;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &eviction);
+
+	refault_distance = (atomic_long_read(&zone->inactive_age) - eviction) &
+			   EVICTION_MASK;
+
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/*
+ * A shadow entry older than the file LRU lists are big never activates a
+ * page.  Allow as many shadow nodes as it takes to hold one entry for every
+ * file LRU page when the nodes are only an eighth full.
+ */
+static unsigned long max_shadow_nodes(void)
+{
+	unsigned long pages;
+
+	pages = global_page_state(NR_ACTIVE_FILE) +
+		global_page_state(NR_INACTIVE_FILE);
+
+	return pages >> (RADIX_TREE_MAP_SHIFT - 3);
+}
+
+/*
+ * Free up to @nr_to_scan shadow nodes by deleting their entries, oldest
+ * first.  Nodes whose mapping's tree_lock is contended are skipped: the
+ * lock order is tree_lock -> shadow_nodes_lock.
+ */
+static void prune_shadow_nodes(unsigned long nr_to_scan)
+{
+	spin_lock_irq(&shadow_nodes_lock);
+	while (nr_to_scan-- && !list_empty(&shadow_nodes)) {
+		struct address_space *mapping;
+		struct radix_tree_node *node;
+		struct zone *zone;
+		unsigned int i;
+
+		node = list_first_entry(&shadow_nodes, struct radix_tree_node,
+					private_list);
+		mapping = node->private_data;
+		list_move_tail(&node->private_list, &shadow_nodes);
+		if (!spin_trylock(&mapping->tree_lock))
+			continue;
+
+		list_del_init(&node->private_list);
+		nr_shadow_nodes--;
+
+		/* Skip nodes that got a page from outside mm/filemap.c */
+		if (node->count == node->exceptional) {
+			zone = page_zone(virt_to_page(node));
+			__inc_zone_state(zone, WORKINGSET_NODERECLAIM);
+			for (i = 0; i < RADIX_TREE_MAP_SIZE; i++) {
+				if (!node->slots[i])
+					continue;
+				if (!shadow_delete(mapping, node,
+						   node->index + i))
+					break;
+			}
+		}
+		spin_unlock(&mapping->tree_lock);
+	}
+	spin_unlock_irq(&shadow_nodes_lock);
+}
+
+static int shrink_shadow_nodes(struct shrinker *shrink,
+			       struct shrink_control *sc)
+{
+	long excess;
+
+	excess = ACCESS_ONCE(nr_shadow_nodes) - max_shadow_nodes();
+	if (sc->nr_to_scan && excess > 0) {
+		prune_shadow_nodes(min_t(unsigned long, sc->nr_to_scan,
+					 excess));
+		excess = ACCESS_ONCE(nr_shadow_nodes) - max_shadow_nodes();
+	}
+
+	return excess > 0 ? min_t(long, excess, INT_MAX) : 0;
+}
+
+static struct shrinker workingset_shadow_shrinker = {
+	.shrink = shrink_shadow_nodes,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init workingset_init(void)
+{
+	register_shrinker(&workingset_shadow_shrinker);
+	return 0;
+}
+module_init(workingset_init);
@@ -0,0 +1,184 @@
+/*
+ * flash-iosched-latency.c - read latency of a block device under write load
+ *
+ * Starts W writer threads doing small random O_DIRECT writes to DEV, and
+ * one reader doing 4KB random O_DIRECT reads, one at a time, for T seconds.
+ * Prints the number of reads, their average, 99th percentile and maximum
+ * latency, and the write throughput, e.g. to compare IO schedulers:
+ *
+ *	gcc -O2 -o flash-iosched-latency flash-iosched-latency.c -lpthread
+ *	echo flash > /sys/block/sdX/queue/scheduler
+ *	./flash-iosched-latency -w 4 -t 10 /dev/sdX
+ *
+ * THE WRITERS OVERWRITE THE DEVICE.  Only run it on a scratch device, such
+ * as one provided by scsi_debug.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <linux/fs.h>
+
+#define BLOCK		4096
+#define MAX_WRITE	(64 * 1024)
+#define MAX_SAMPLES	(1 << 20)
+
+static const char *dev;
+static unsigned long long dev_blocks;
+static volatile int stop;
+static unsigned long long written;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+static int open_dev(void)
+{
+	int fd = open(dev, O_RDWR | O_DIRECT);
+
+	if (fd < 0) {
+		perror(dev);
+		exit(1);
+	}
+	return fd;
+}
+
+static void *writer(void *arg)
+{
+	unsigned int seed = (unsigned long)arg;
+	unsigned long long bytes = 0;
+	int fd = open_dev();
+	void *buf;
+
+	if (posix_memalign(&buf, BLOCK, MAX_WRITE))
+		exit(1);
+	memset(buf, 0x5a, MAX_WRITE);
+
+	while (!stop) {
+		size_t len = BLOCK * (1 + rand_r(&seed) % (MAX_WRITE / BLOCK));
+		off_t off = (off_t)(rand_r(&seed) %
+				    (dev_blocks - MAX_WRITE / BLOCK)) * BLOCK;
+
+		if (pwrite(fd, buf, len, off) != (ssize_t)len) {
+			perror("pwrite");
+			exit(1);
+		}
+		bytes += len;
+	}
+
+	pthread_mutex_lock(&lock);
+	written += bytes;
+	pthread_mutex_unlock(&lock);
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-w writers] [-t seconds] DEV\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int n_writers = 4, secs = 10, opt, fd, i;
+	unsigned int seed = 1;
+	unsigned long long size;
+	double *lat, start, end, sum = 0;
+	pthread_t *threads;
+	size_t n = 0;
+	void *buf;
+
+	while ((opt = getopt(argc, argv, "w:t:")) != -1) {
+		switch (opt) {
+		case 'w':
+			n_writers = atoi(optarg);
+			break;
+		case 't':
+			secs = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || n_writers < 0 || secs < 1)
+		usage(argv[0]);
+	dev = argv[optind];
+
+	fd = open_dev();
+	if (ioctl(fd, BLKGETSIZE64, &size)) {
+		struct stat st;
+
+		/* a regular file works too, for trying the program out */
+		if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+			perror("BLKGETSIZE64");
+			return 1;
+		}
+		size = st.st_size;
+	}
+	dev_blocks = size / BLOCK;
+	if (dev_blocks <= 2 * MAX_WRITE / BLOCK) {
+		fprintf(stderr, "%s is too small\n", dev);
+		return 1;
+	}
+
+	lat = malloc(MAX_SAMPLES * sizeof(*lat));
+	threads = calloc(n_writers + 1, sizeof(*threads));
+	if (!lat || !threads || posix_memalign(&buf, BLOCK, BLOCK))
+		return 1;
+
+	for (i = 0; i < n_writers; i++)
+		pthread_create(&threads[i], NULL, writer,
+			       (void *)(unsigned long)(i + 2));
+
+	start = now_us();
+	end = start + secs * 1e6;
+	while (n < MAX_SAMPLES) {
+		off_t off = (off_t)(rand_r(&seed) % dev_blocks) * BLOCK;
+		double t = now_us();
+
+		if (t >= end)
+			break;
+		if (pread(fd, buf, BLOCK, off) != BLOCK) {
+			perror("pread");
+			return 1;
+		}
+		lat[n] = now_us() - t;
+		sum += lat[n++];
+	}
+	stop = 1;
+	for (i = 0; i < n_writers; i++)
+		pthread_join(threads[i], NULL);
+	end = now_us();
+
+	if (!n) {
+		fprintf(stderr, "no reads completed\n");
+		return 1;
+	}
+	qsort(lat, n, sizeof(*lat), cmp_double);
+	printf("writers %d: %zu reads, avg %.0f us, p99 %.0f us, max %.0f us, "
+	       "writes %.1f MiB/s\n", n_writers, n, sum / n,
+	       lat[n * 99 / 100], lat[n - 1],
+	       written / ((end - start) / 1e6) / (1024 * 1024));
+	return 0;
+}
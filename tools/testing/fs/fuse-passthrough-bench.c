@@ -0,0 +1,351 @@
+/*
+ * fuse-passthrough-bench.c - compare FUSE passthrough with regular FUSE I/O
+ *
+ * A minimal FUSE filesystem speaking the raw kernel protocol.  It exposes
+ * a single file "data" that proxies LOWER, optionally handing the lower
+ * file descriptor to the kernel in the OPEN reply (-p), and then times a
+ * sequential write and a sequential read of that file through the mount.
+ *
+ * Run as root with and without -p and compare the numbers:
+ *
+ *	gcc -O2 -o fuse-passthrough-bench fuse-passthrough-bench.c
+ *	./fuse-passthrough-bench    -s 256 -b 65536 /data/lower /mnt/fuse
+ *	./fuse-passthrough-bench -p -s 256 -b 65536 /data/lower /mnt/fuse
+ *
+ * Drop the lower page cache between runs if cold read numbers are wanted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <linux/fuse.h>
+
+/* Passthrough extension of this tree's include/linux/fuse.h */
+#define BENCH_FUSE_PASSTHROUGH	(1u << 31)
+#define BENCH_FOPEN_PASSTHROUGH	(1u << 31)
+
+#define BENCH_MAX_WRITE		(128 * 1024)
+#define BENCH_BUFSIZE		(BENCH_MAX_WRITE + 4096)
+#define BENCH_DATA_ID		2
+
+/* Protocol 7.16 layouts, newer userspace headers may have grown them */
+struct bench_init_out {
+	uint32_t major;
+	uint32_t minor;
+	uint32_t max_readahead;
+	uint32_t flags;
+	uint16_t max_background;
+	uint16_t congestion_threshold;
+	uint32_t max_write;
+};
+
+struct bench_open_out {
+	uint64_t fh;
+	uint32_t open_flags;
+	uint32_t passthrough_fd;
+};
+
+static int lower_fd;
+static int passthrough;
+
+static void fill_attr(struct fuse_attr *attr, uint64_t nodeid)
+{
+	struct stat st;
+
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = nodeid;
+	if (nodeid == FUSE_ROOT_ID) {
+		attr->mode = S_IFDIR | 0755;
+		attr->nlink = 2;
+		return;
+	}
+	fstat(lower_fd, &st);
+	attr->mode = S_IFREG | 0666;
+	attr->nlink = 1;
+	attr->size = st.st_size;
+	attr->blocks = st.st_blocks;
+	attr->blksize = st.st_blksize;
+	attr->mtime = st.st_mtime;
+	attr->ctime = st.st_ctime;
+	attr->atime = st.st_atime;
+}
+
+static void reply(int fd, uint64_t unique, int error, const void *arg,
+		  size_t argsize)
+{
+	struct fuse_out_header oh;
+	struct iovec iov[2];
+
+	oh.unique = unique;
+	oh.error = error;
+	oh.len = sizeof(oh) + (error ? 0 : argsize);
+	iov[0].iov_base = &oh;
+	iov[0].iov_len = sizeof(oh);
+	iov[1].iov_base = (void *) arg;
+	iov[1].iov_len = error ? 0 : argsize;
+	if (writev(fd, iov, 2) < 0 && errno != ENOENT)
+		perror("fuse reply");
+}
+
+static void serve(int fd)
+{
+	static char buf[BENCH_BUFSIZE];
+	static char data[BENCH_MAX_WRITE];
+
+	for (;;) {
+		struct fuse_in_header *ih = (struct fuse_in_header *) buf;
+		void *arg = buf + sizeof(*ih);
+		ssize_t res;
+
+		res = read(fd, buf, sizeof(buf));
+		if (res < 0) {
+			if (errno == ENOENT || errno == EINTR)
+				continue;
+			if (errno != ENODEV)
+				perror("fuse read");
+			return;
+		}
+
+		switch (ih->opcode) {
+		case FUSE_INIT: {
+			struct fuse_init_in *in = arg;
+			struct bench_init_out out;
+
+			memset(&out, 0, sizeof(out));
+			out.major = FUSE_KERNEL_VERSION;
+			out.minor = 16;
+			out.max_readahead = in->max_readahead;
+			out.flags = in->flags & (FUSE_ASYNC_READ | FUSE_BIG_WRITES);
+			if (passthrough)
+				out.flags |= in->flags & BENCH_FUSE_PASSTHROUGH;
+			out.max_write = BENCH_MAX_WRITE;
+			if (passthrough && !(out.flags & BENCH_FUSE_PASSTHROUGH))
+				fprintf(stderr, "kernel does not offer passthrough\n");
+			reply(fd, ih->unique, 0, &out, sizeof(out));
+			break;
+		}
+		case FUSE_LOOKUP: {
+			struct fuse_entry_out out;
+
+			if (ih->nodeid != FUSE_ROOT_ID || strcmp(arg, "data")) {
+				reply(fd, ih->unique, -ENOENT, NULL, 0);
+				break;
+			}
+			memset(&out, 0, sizeof(out));
+			out.nodeid = BENCH_DATA_ID;
+			fill_attr(&out.attr, BENCH_DATA_ID);
+			reply(fd, ih->unique, 0, &out, sizeof(out));
+			break;
+		}
+		case FUSE_GETATTR:
+		case FUSE_SETATTR: {
+			struct fuse_attr_out out;
+
+			memset(&out, 0, sizeof(out));
+			fill_attr(&out.attr, ih->nodeid);
+			reply(fd, ih->unique, 0, &out, sizeof(out));
+			break;
+		}
+		case FUSE_OPEN: {
+			struct bench_open_out out;
+
+			memset(&out, 0, sizeof(out));
+			if (passthrough) {
+				out.open_flags = BENCH_FOPEN_PASSTHROUGH;
+				out.passthrough_fd = lower_fd;
+			}
+			reply(fd, ih->unique, 0, &out, sizeof(out));
+			break;
+		}
+		case FUSE_READ: {
+			struct fuse_read_in *in = arg;
+			size_t size = in->size < sizeof(data) ? in->size :
+								sizeof(data);
+
+			res = pread(lower_fd, data, size, in->offset);
+			if (res < 0)
+				reply(fd, ih->unique, -errno, NULL, 0);
+			else
+				reply(fd, ih->unique, 0, data, res);
+			break;
+		}
+		case FUSE_WRITE: {
+			struct fuse_write_in *in = arg;
+			struct fuse_write_out out;
+
+			res = pwrite(lower_fd, in + 1, in->size, in->offset);
+			if (res < 0) {
+				reply(fd, ih->unique, -errno, NULL, 0);
+				break;
+			}
+			memset(&out, 0, sizeof(out));
+			out.size = res;
+			reply(fd, ih->unique, 0, &out, sizeof(out));
+			break;
+		}
+		case FUSE_OPENDIR:
+		case FUSE_RELEASEDIR:
+		case FUSE_RELEASE:
+		case FUSE_FLUSH:
+		case FUSE_FSYNC:
+		case FUSE_DESTROY: {
+			struct fuse_open_out out;
+
+			memset(&out, 0, sizeof(out));
+			reply(fd, ih->unique, 0, &out,
+			      ih->opcode == FUSE_OPENDIR ? sizeof(out) : 0);
+			break;
+		}
+		case FUSE_FORGET:
+		case FUSE_BATCH_FORGET:
+		case FUSE_INTERRUPT:
+			break;
+		default:
+			reply(fd, ih->unique, -ENOSYS, NULL, 0);
+			break;
+		}
+	}
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void report(const char *what, size_t bytes, double secs)
+{
+	printf("%-5s %-11s %8.1f MiB/s  (%zu MiB in %.3f s)\n", what,
+	       passthrough ? "passthrough" : "fuse",
+	       bytes / secs / (1024 * 1024), bytes >> 20, secs);
+}
+
+static int bench(const char *mnt, size_t size, size_t bs)
+{
+	char path[4096];
+	size_t done;
+	char *buf;
+	double t;
+	int fd;
+
+	buf = malloc(bs);
+	if (!buf)
+		return -1;
+	memset(buf, 0xa5, bs);
+
+	snprintf(path, sizeof(path), "%s/data", mnt);
+	fd = open(path, O_RDWR);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	t = now();
+	for (done = 0; done < size; done += bs) {
+		if (pwrite(fd, buf, bs, done) != (ssize_t) bs) {
+			perror("write");
+			return -1;
+		}
+	}
+	fsync(fd);
+	report("write", size, now() - t);
+
+	t = now();
+	for (done = 0; done < size; done += bs) {
+		if (pread(fd, buf, bs, done) != (ssize_t) bs) {
+			perror("read");
+			return -1;
+		}
+	}
+	report("read", size, now() - t);
+
+	close(fd);
+	free(buf);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-p] [-s MiB] [-b blocksize] LOWER MOUNTPOINT\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t size = 64 << 20, bs = 64 << 10;
+	char opts[128];
+	int fuse_fd, ret, opt;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "ps:b:")) != -1) {
+		switch (opt) {
+		case 'p':
+			passthrough = 1;
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'b':
+			bs = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2 || !bs || size % bs)
+		usage(argv[0]);
+
+	lower_fd = open(argv[optind], O_RDWR | O_CREAT, 0644);
+	if (lower_fd < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	fuse_fd = open("/dev/fuse", O_RDWR);
+	if (fuse_fd < 0) {
+		perror("/dev/fuse");
+		return 1;
+	}
+
+	snprintf(opts, sizeof(opts),
+		 "fd=%d,rootmode=40000,user_id=0,group_id=0,allow_other",
+		 fuse_fd);
+	if (mount("passthrough-bench", argv[optind + 1], "fuse",
+		  MS_NOSUID | MS_NODEV, opts)) {
+		perror("mount");
+		return 1;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		umount2(argv[optind + 1], MNT_DETACH);
+		return 1;
+	}
+	if (pid == 0) {
+		serve(fuse_fd);
+		_exit(0);
+	}
+
+	ret = bench(argv[optind + 1], size, bs);
+
+	umount2(argv[optind + 1], MNT_DETACH);
+	close(fuse_fd);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+
+	return ret ? 1 : 0;
+}
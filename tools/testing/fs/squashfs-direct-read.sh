@@ -0,0 +1,71 @@
+#!/bin/sh
+#
+# squashfs-direct-read.sh - file read throughput and memory traffic
+#
+# Builds lzo and xz squashfs images of SRCDIR, and for each one drops
+# the page cache and reads every file once, printing the throughput and,
+# if perf is installed, the last level cache misses (a stand-in for DRAM
+# traffic, 64 bytes per miss) of the whole system during the read.
+#
+# Run it on a kernel built with CONFIG_SQUASHFS_FILE_CACHE and on one
+# built with CONFIG_SQUASHFS_FILE_DIRECT, and compare.  Files smaller
+# than the block size are read through the fragment cache either way, so
+# use a SRCDIR with mostly large files (e.g. /usr/lib) to see the
+# difference.
+#
+# Usage: squashfs-direct-read.sh SRCDIR [MOUNTPOINT]
+#
+# Needs root, mksquashfs with lzo and xz support, and loop devices.
+
+src=$1
+mnt=${2:-/mnt/squashfs-bench}
+img=/tmp/squashfs-bench.$$
+
+if [ ! -d "$src" ]; then
+	echo "usage: $0 SRCDIR [MOUNTPOINT]" >&2
+	exit 1
+fi
+
+mkdir -p "$mnt"
+mode=unknown
+if [ -r /proc/config.gz ]; then
+	zcat /proc/config.gz | grep -q '^CONFIG_SQUASHFS_FILE_DIRECT=y' &&
+		mode=direct || mode=cache
+fi
+echo "squashfs file reads, $mode decompression"
+
+for comp in lzo xz; do
+	mksquashfs "$src" $img -comp $comp -noappend >/dev/null || exit 1
+	mount -t squashfs -o loop,ro $img "$mnt" || exit 1
+
+	# Drop the file pages, but have the image itself cached so that
+	# decompression rather than the disk is measured
+	sync
+	echo 1 >/proc/sys/vm/drop_caches
+	cat $img >/dev/null
+
+	bytes=$(find "$mnt" -type f -printf '%s\n' | awk '{ s += $1 } END { print s }')
+	perf_out=/tmp/squashfs-bench-perf.$$
+	start=$(date +%s.%N)
+	if command -v perf >/dev/null; then
+		perf stat -a -x, -o $perf_out -e LLC-load-misses,LLC-store-misses \
+			sh -c "find '$mnt' -type f -exec cat {} + >/dev/null"
+	else
+		find "$mnt" -type f -exec cat {} + >/dev/null
+	fi
+	end=$(date +%s.%N)
+
+	printf "%-4s %8.1f MiB/s" $comp \
+		$(echo "$bytes / 1048576 / ($end - $start)" | bc -l)
+	if [ -r $perf_out ]; then
+		misses=$(awk -F, '/LLC/ { s += $1 } END { print s }' $perf_out)
+		printf ", %8.1f MiB LLC miss traffic, %.2f bytes per byte read" \
+			$(echo "$misses * 64 / 1048576" | bc -l) \
+			$(echo "$misses * 64 / $bytes" | bc -l)
+		rm -f $perf_out
+	fi
+	echo
+
+	umount "$mnt"
+	rm -f $img
+done
@@ -0,0 +1,152 @@
+/*
+ * squashfs-parallel-read.c - read a squashfs tree with N parallel readers
+ *
+ * Collects the regular files below DIR, drops the page cache (so every
+ * datablock has to be decompressed again) and then lets N threads read
+ * whole files, each taking the next unread file from a shared list, the
+ * way many processes starting up at once load their binaries and
+ * libraries.  Prints the aggregate throughput of uncompressed data.
+ *
+ *	gcc -O2 -o squashfs-parallel-read squashfs-parallel-read.c -lpthread
+ *	mksquashfs /usr/lib system.sqsh -comp xz
+ *	mount -o loop system.sqsh /mnt/system
+ *	for n in 1 2 4 8; do ./squashfs-parallel-read -t $n /mnt/system; done
+ *
+ * With CONFIG_SQUASHFS_DECOMP_SINGLE the numbers stay flat as readers are
+ * added, with CONFIG_SQUASHFS_DECOMP_MULTI they should scale up to the
+ * number of CPUs for CPU bound (e.g. xz) images.  Must be run as root.
+ */
+
+#define _XOPEN_SOURCE 500
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define BUFSIZE		(128 * 1024)
+
+static char **files;
+static int n_files, max_files;
+static int next_file;
+static unsigned long long total_bytes;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int add_file(const char *path, const struct stat *st, int type,
+		    struct FTW *ftw)
+{
+	if (type != FTW_F || !S_ISREG(st->st_mode))
+		return 0;
+
+	if (n_files == max_files) {
+		max_files = max_files ? max_files * 2 : 1024;
+		files = realloc(files, max_files * sizeof(*files));
+		if (!files) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	files[n_files++] = strdup(path);
+	return 0;
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0 || write(fd, "3", 1) != 1) {
+		perror("/proc/sys/vm/drop_caches");
+		exit(1);
+	}
+	close(fd);
+}
+
+static void *reader(void *arg)
+{
+	unsigned long long bytes = 0;
+	char *buf = malloc(BUFSIZE);
+	ssize_t res;
+	int i, fd;
+
+	for (;;) {
+		pthread_mutex_lock(&lock);
+		i = next_file++;
+		pthread_mutex_unlock(&lock);
+		if (i >= n_files)
+			break;
+
+		fd = open(files[i], O_RDONLY);
+		if (fd < 0) {
+			perror(files[i]);
+			continue;
+		}
+		while ((res = read(fd, buf, BUFSIZE)) > 0)
+			bytes += res;
+		if (res < 0)
+			perror(files[i]);
+		close(fd);
+	}
+
+	pthread_mutex_lock(&lock);
+	total_bytes += bytes;
+	pthread_mutex_unlock(&lock);
+	free(buf);
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t threads] DIR\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct timeval start, end;
+	int n_threads = 1, opt, i;
+	pthread_t *threads;
+	double secs;
+
+	while ((opt = getopt(argc, argv, "t:")) != -1) {
+		switch (opt) {
+		case 't':
+			n_threads = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || n_threads < 1)
+		usage(argv[0]);
+
+	if (nftw(argv[optind], add_file, 64, FTW_PHYS | FTW_MOUNT)) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (!n_files) {
+		fprintf(stderr, "no regular files below %s\n", argv[optind]);
+		return 1;
+	}
+
+	drop_caches();
+
+	threads = calloc(n_threads, sizeof(*threads));
+	gettimeofday(&start, NULL);
+	for (i = 0; i < n_threads; i++)
+		pthread_create(&threads[i], NULL, reader, NULL);
+	for (i = 0; i < n_threads; i++)
+		pthread_join(threads[i], NULL);
+	gettimeofday(&end, NULL);
+
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+	printf("readers %2d: %d files, %llu MiB in %.3f s, %8.1f MiB/s\n",
+	       n_threads, n_files, total_bytes >> 20, secs,
+	       total_bytes / secs / (1024 * 1024));
+	return 0;
+}
@@ -0,0 +1,78 @@
+#!/bin/sh
+#
+# yaffs2-mount-bench.sh - time yaffs2 mounts on a nandsim device
+#
+# Creates a nandsim device of the given size (256 or 1024 MiB, 2KiB pages,
+# 128KiB blocks), fills it to about 75% with files, and times:
+#
+#   - a mount from the checkpoint written at unmount,
+#   - a mount that ignores the checkpoint and scans the whole device, as
+#     after an unclean shutdown (mount option no-checkpoint-read),
+#
+# and then checks that after a write followed by yaffs_bg_checkpoint
+# seconds of idleness the background thread has written a checkpoint,
+# so that a crash at that point would still get the first kind of mount.
+# Background checkpoints are off by default, the script sets
+# yaffs_bg_checkpoint to 10 seconds for this.
+#
+# Usage: yaffs2-mount-bench.sh [256|1024] [MOUNTPOINT]
+#
+# Needs root, and nandsim, mtdblock and yaffs built as modules.
+
+size=${1:-256}
+mnt=${2:-/mnt/yaffs-bench}
+
+case $size in
+256)	ids="first_id_byte=0xec second_id_byte=0xda third_id_byte=0x10 fourth_id_byte=0x95" ;;
+1024)	ids="first_id_byte=0xec second_id_byte=0xd3 third_id_byte=0x51 fourth_id_byte=0x95" ;;
+*)	echo "size must be 256 or 1024" >&2; exit 1 ;;
+esac
+
+mtd_num() {
+	# The nandsim device is the last one registered
+	echo $(($(grep -c '^mtd' /proc/mtd) - 1))
+}
+
+timed_mount() {
+	start=$(date +%s.%N)
+	mount -t yaffs2 $1 "$dev" "$mnt" || exit 1
+	end=$(date +%s.%N)
+	printf "%-28s %6.2f s\n" "$2" $(echo "$end - $start" | bc)
+}
+
+modprobe nandsim $ids || exit 1
+modprobe mtdblock
+modprobe yaffs
+dev=/dev/mtdblock$(mtd_num)
+mkdir -p "$mnt"
+
+echo "yaffs2 mount times, ${size} MiB nandsim"
+
+mount -t yaffs2 "$dev" "$mnt" || exit 1
+fill=$((size * 3 / 4))
+i=0
+while [ $i -lt $fill ]; do
+	mkdir -p "$mnt/d$((i / 64))"
+	dd if=/dev/urandom of="$mnt/d$((i / 64))/f$i" bs=64k count=16 2>/dev/null
+	i=$((i + 1))
+done
+umount "$mnt"
+
+timed_mount "" "checkpoint"
+umount "$mnt"
+
+timed_mount "-o no-checkpoint-read" "full scan"
+umount "$mnt"
+
+idle=10
+echo $idle > /sys/module/yaffs/parameters/yaffs_bg_checkpoint
+mount -t yaffs2 "$dev" "$mnt" || exit 1
+# No sync here, yaffs_sync_fs() would checkpoint by itself
+dd if=/dev/urandom of="$mnt/dirty" bs=64k count=16 2>/dev/null
+sleep $((idle + 3))
+grep -E 'n_bg_checkpoints|blocks_in_checkpt' /proc/yaffs
+umount "$mnt"
+
+rmmod yaffs
+rmmod mtdblock
+rmmod nandsim
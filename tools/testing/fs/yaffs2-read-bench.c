@@ -0,0 +1,152 @@
+/*
+ * yaffs2-read-bench.c - sequential and random read benchmark for yaffs2
+ *
+ * Writes a test file on a mounted yaffs2 filesystem, drops the page cache
+ * and then times a sequential read of the whole file followed by random
+ * reads of single blocks.  The yaffs read cache counters for the device
+ * are printed from /proc/yaffs after each phase.
+ *
+ * Setting up a 128MiB nandsim device with 2KiB pages:
+ *
+ *	modprobe nandsim first_id_byte=0x20 second_id_byte=0xa1 \
+ *		third_id_byte=0x00 fourth_id_byte=0x15
+ *	mount -t yaffs2 /dev/mtdblock0 /mnt/yaffs
+ *	gcc -O2 -o yaffs2-read-bench yaffs2-read-bench.c
+ *	./yaffs2-read-bench -s 32 /mnt/yaffs
+ *
+ * Compare with read-ahead off, either by remounting with -o no-read-ahead
+ * or by loading yaffs with yaffs_read_ahead=1.  nandsim can emulate NAND
+ * timings with its access_delay, programm_delay and output_cycle
+ * parameters, which makes the numbers closer to real hardware.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void drop_caches(void)
+{
+	int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+
+	sync();
+	if (fd < 0 || write(fd, "3", 1) != 1)
+		perror("drop_caches");
+	if (fd >= 0)
+		close(fd);
+}
+
+static void show_stats(void)
+{
+	char line[256];
+	FILE *f = fopen("/proc/yaffs", "r");
+
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, "rd_cache", 8) ||
+		    !strncmp(line, "n_rd_ahead", 10) ||
+		    !strncmp(line, "n_page_reads", 12))
+			printf("\t%s", line);
+	fclose(f);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-s MiB] [-b blocksize] [-n random_reads] DIR\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t size = 16 << 20, bs = 4096, done;
+	long n_random = 2000, i;
+	char path[4096];
+	char *buf;
+	double t;
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "s:b:n:")) != -1) {
+		switch (opt) {
+		case 's':
+			size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'b':
+			bs = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			n_random = strtol(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || !bs || size < bs || size % bs)
+		usage(argv[0]);
+
+	buf = malloc(bs);
+	if (!buf)
+		return 1;
+	memset(buf, 0x5a, bs);
+
+	snprintf(path, sizeof(path), "%s/read-bench.dat", argv[optind]);
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		return 1;
+	}
+	for (done = 0; done < size; done += bs) {
+		if (write(fd, buf, bs) != (ssize_t) bs) {
+			perror("write");
+			return 1;
+		}
+	}
+	fsync(fd);
+
+	drop_caches();
+	t = now();
+	for (done = 0; done < size; done += bs) {
+		if (pread(fd, buf, bs, done) != (ssize_t) bs) {
+			perror("read");
+			return 1;
+		}
+	}
+	t = now() - t;
+	printf("sequential: %8.2f MiB/s (%zu MiB, bs %zu)\n",
+	       size / t / (1 << 20), size >> 20, bs);
+	show_stats();
+
+	drop_caches();
+	srandom(1);
+	t = now();
+	for (i = 0; i < n_random; i++) {
+		off_t off = (random() % (size / bs)) * bs;
+
+		if (pread(fd, buf, bs, off) != (ssize_t) bs) {
+			perror("read");
+			return 1;
+		}
+	}
+	t = now() - t;
+	printf("random:     %8.0f reads/s (%ld reads, bs %zu)\n",
+	       n_random / t, n_random, bs);
+	show_stats();
+
+	close(fd);
+	unlink(path);
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ * yaffs2-rw-latency.c - read and stat latency under a concurrent writer
+ *
+ * One thread keeps rewriting a large file while reader threads time
+ * single block reads of a second file (with its page cache dropped
+ * before each read, so every read goes to yaffs) and stat() calls.
+ * Latency percentiles are printed for both, with and without the writer.
+ *
+ *	gcc -O2 -o yaffs2-rw-latency yaffs2-rw-latency.c -lpthread
+ *	modprobe nandsim first_id_byte=0xec second_id_byte=0xda \
+ *		third_id_byte=0x10 fourth_id_byte=0x95
+ *	mount -t yaffs2 /dev/mtdblock0 /mnt/yaffs
+ *	./yaffs2-rw-latency -r 2 -d 10 /mnt/yaffs
+ *
+ * nandsim's access_delay and programm_delay parameters make the NAND
+ * timings, and so the numbers, closer to real hardware.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define READ_FILE_SIZE	(4 << 20)
+#define BLOCK		4096
+#define MAX_SAMPLES	(1 << 20)
+
+struct samples {
+	double *v;
+	int n;
+};
+
+static const char *dir;
+static int n_readers = 1;
+static int duration = 10;
+static size_t write_size = 16 << 20;
+static volatile int stop;
+static struct samples read_lat, stat_lat;
+static pthread_mutex_t sample_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void add_sample(struct samples *s, double v)
+{
+	pthread_mutex_lock(&sample_lock);
+	if (s->n < MAX_SAMPLES)
+		s->v[s->n++] = v;
+	pthread_mutex_unlock(&sample_lock);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char *what, struct samples *s)
+{
+	static const double pct[] = { 50, 90, 99, 99.9 };
+	unsigned i;
+
+	if (!s->n) {
+		printf("%-6s no samples\n", what);
+		return;
+	}
+	qsort(s->v, s->n, sizeof(double), cmp_double);
+	printf("%-6s n %7d", what, s->n);
+	for (i = 0; i < sizeof(pct) / sizeof(pct[0]); i++)
+		printf("  p%-4g %8.3f ms", pct[i],
+		       s->v[(int) (s->n * pct[i] / 100)] * 1e3);
+	printf("  max %8.3f ms\n", s->v[s->n - 1] * 1e3);
+	s->n = 0;
+}
+
+static void *writer(void *arg)
+{
+	char path[4096];
+	char *buf = malloc(64 << 10);
+	size_t done;
+	int fd;
+
+	memset(buf, 0xa5, 64 << 10);
+	snprintf(path, sizeof(path), "%s/latency-write.dat", dir);
+	while (!stop) {
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			perror(path);
+			break;
+		}
+		for (done = 0; !stop && done < write_size; done += 64 << 10)
+			if (write(fd, buf, 64 << 10) < 0)
+				break;
+		fsync(fd);
+		close(fd);
+	}
+	free(buf);
+	return NULL;
+}
+
+static void *reader(void *arg)
+{
+	char path[4096];
+	char buf[BLOCK];
+	struct stat st;
+	unsigned seed = (unsigned long) arg;
+	double t;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/latency-read.dat", dir);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return NULL;
+	}
+	while (!stop) {
+		off_t off = (rand_r(&seed) % (READ_FILE_SIZE / BLOCK)) * BLOCK;
+
+		posix_fadvise(fd, off, BLOCK, POSIX_FADV_DONTNEED);
+		t = now();
+		pread(fd, buf, BLOCK, off);
+		add_sample(&read_lat, now() - t);
+
+		t = now();
+		stat(path, &st);
+		add_sample(&stat_lat, now() - t);
+
+		usleep(1000);
+	}
+	close(fd);
+	return NULL;
+}
+
+static void run(int with_writer)
+{
+	pthread_t w, r[64];
+	int i;
+
+	stop = 0;
+	if (with_writer)
+		pthread_create(&w, NULL, writer, NULL);
+	for (i = 0; i < n_readers; i++)
+		pthread_create(&r[i], NULL, reader, (void *) (long) (i + 1));
+	sleep(duration);
+	stop = 1;
+	for (i = 0; i < n_readers; i++)
+		pthread_join(r[i], NULL);
+	if (with_writer)
+		pthread_join(w, NULL);
+
+	printf("%s writer:\n", with_writer ? "with" : "without");
+	report("read", &read_lat);
+	report("stat", &stat_lat);
+}
+
+int main(int argc, char *argv[])
+{
+	char path[4096], buf[BLOCK];
+	int fd, opt, i;
+
+	while ((opt = getopt(argc, argv, "r:d:s:")) != -1) {
+		switch (opt) {
+		case 'r':
+			n_readers = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 's':
+			write_size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (argc - optind != 1 || n_readers < 1 || n_readers > 64)
+		goto usage;
+	dir = argv[optind];
+
+	read_lat.v = malloc(MAX_SAMPLES * sizeof(double));
+	stat_lat.v = malloc(MAX_SAMPLES * sizeof(double));
+
+	snprintf(path, sizeof(path), "%s/latency-read.dat", dir);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		return 1;
+	}
+	memset(buf, 0x5a, sizeof(buf));
+	for (i = 0; i < READ_FILE_SIZE / BLOCK; i++)
+		write(fd, buf, sizeof(buf));
+	fsync(fd);
+	close(fd);
+
+	run(0);
+	run(1);
+
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/latency-write.dat", dir);
+	unlink(path);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-r readers] [-d seconds] [-s write_MiB] DIR\n",
+		argv[0]);
+	return 1;
+}
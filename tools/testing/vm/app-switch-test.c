@@ -0,0 +1,254 @@
+/*
+ * app-switch-test.c - switch between apps that do not all fit in memory
+ *
+ * Forks NAPPS processes that each hold ANON MiB of anonymous memory and map
+ * a FILE MiB file in DIR.  Then it brings them to the foreground one after
+ * another, for ROUNDS rounds: the app in the foreground touches every page
+ * of its memory and its file, the way an app that is switched to redraws
+ * and runs its code.  With enough apps, reclaim has to evict the memory of
+ * the apps in the background to make room.  For every round it prints the
+ * total and the slowest switch time, and the change of the refault, scan
+ * and reclaim CPU time counters in /proc/vmstat.
+ *
+ *	gcc -O2 -o app-switch-test app-switch-test.c
+ *	./app-switch-test -n 12 -a 48 -f 32 -r 5 /data/local/tmp
+ *
+ * Run it once booted with lru_gen=0 and once with lru_gen=1 to compare the
+ * active/inactive lists with the multi-generational LRU.  The anon memory
+ * of the apps can only be reclaimed with swap.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define CHUNK	(1 << 20)
+
+/* Counted by prefix, so that the per-zone counters add up */
+static const char *counters[] = {
+	"pgmajfault", "workingset_refault", "workingset_activate",
+	"pgscan_kswapd", "pgscan_direct", "reclaim_cpu_kswapd_us",
+	"reclaim_cpu_direct_us", "lru_gen_aging",
+};
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+struct app {
+	pid_t pid;
+	int cmd;	/* parent writes, app reads */
+	int done;	/* app writes, parent reads */
+};
+
+static void read_vmstat(unsigned long long *val)
+{
+	char name[64];
+	unsigned long long v;
+	unsigned int i;
+	FILE *f = fopen("/proc/vmstat", "r");
+
+	memset(val, 0, NR_COUNTERS * sizeof(*val));
+	if (!f)
+		return;
+	while (fscanf(f, "%63s %llu", name, &v) == 2)
+		for (i = 0; i < NR_COUNTERS; i++)
+			if (!strncmp(name, counters[i], strlen(counters[i])))
+				val[i] += v;
+	fclose(f);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static char *map_file(const char *dir, int id, size_t size)
+{
+	char path[4096], *buf, *map;
+	size_t done;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/app-switch-test-%d", dir, id);
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	unlink(path);
+	buf = malloc(CHUNK);
+	if (!buf)
+		exit(1);
+	for (done = 0; done < size; done += CHUNK) {
+		memset(buf, id + done / CHUNK, CHUNK);
+		if (write(fd, buf, CHUNK) != CHUNK) {
+			perror("write");
+			exit(1);
+		}
+	}
+	free(buf);
+	fsync(fd);
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	return map;
+}
+
+static void run_app(int id, struct app *app, size_t anon, size_t file,
+		    const char *dir)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	volatile unsigned long sum = 0;
+	char *heap = NULL, *map = NULL;
+	size_t off;
+	char c;
+
+	if (anon) {
+		heap = mmap(NULL, anon, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (heap == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+	}
+	if (file)
+		map = map_file(dir, id, file);
+
+	while (read(app->cmd, &c, 1) == 1) {
+		for (off = 0; off < anon; off += page_size)
+			heap[off]++;
+		for (off = 0; off < file; off += page_size)
+			sum += map[off];
+		if (write(app->done, &c, 1) != 1)
+			break;
+	}
+	exit(0);
+}
+
+static void start_app(struct app *apps, int id, size_t anon, size_t file,
+		      const char *dir)
+{
+	struct app *app = &apps[id];
+	int cmd[2], done[2], i;
+
+	if (pipe(cmd) || pipe(done)) {
+		perror("pipe");
+		exit(1);
+	}
+	app->pid = fork();
+	if (app->pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (!app->pid) {
+		/* Only the parent may keep the other apps running */
+		for (i = 0; i < id; i++) {
+			close(apps[i].cmd);
+			close(apps[i].done);
+		}
+		close(cmd[1]);
+		close(done[0]);
+		app->cmd = cmd[0];
+		app->done = done[1];
+		run_app(id, app, anon, file, dir);
+	}
+	close(cmd[0]);
+	close(done[1]);
+	app->cmd = cmd[1];
+	app->done = done[0];
+}
+
+/* Bring an app to the foreground and wait until it is done */
+static double switch_to(struct app *app)
+{
+	double start = now();
+	char c = 'r';
+
+	if (write(app->cmd, &c, 1) != 1 || read(app->done, &c, 1) != 1) {
+		fprintf(stderr, "app %d died\n", (int)app->pid);
+		exit(1);
+	}
+	return now() - start;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n apps] [-a MiB] [-f MiB] [-r rounds] DIR\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long long before[NR_COUNTERS], after[NR_COUNTERS];
+	unsigned int napps = 8, rounds = 5, round, i, k;
+	size_t anon = 64UL << 20, file = 32UL << 20;
+	struct app *apps;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:a:f:r:")) != -1) {
+		switch (opt) {
+		case 'n':
+			napps = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			anon = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'f':
+			file = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || !napps || (!anon && !file))
+		usage(argv[0]);
+
+	apps = calloc(napps, sizeof(*apps));
+	if (!apps)
+		return 1;
+	for (i = 0; i < napps; i++)
+		start_app(apps, i, anon, file, argv[optind]);
+
+	/* The first round starts the apps, it is not a switch */
+	for (i = 0; i < napps; i++)
+		switch_to(&apps[i]);
+
+	for (round = 0; round < rounds; round++) {
+		double total = 0, slowest = 0;
+
+		read_vmstat(before);
+		for (i = 0; i < napps; i++) {
+			double t = switch_to(&apps[i]);
+
+			total += t;
+			if (t > slowest)
+				slowest = t;
+		}
+		read_vmstat(after);
+		printf("round %u: %u switches in %.3f s, slowest %.3f s",
+		       round, napps, total, slowest);
+		for (k = 0; k < NR_COUNTERS; k++)
+			printf(" %s %llu", counters[k], after[k] - before[k]);
+		printf("\n");
+	}
+
+	for (i = 0; i < napps; i++) {
+		close(apps[i].cmd);
+		waitpid(apps[i].pid, NULL, 0);
+	}
+	return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * lru-fault-test.c - fault in memory from many processes at once
+ *
+ * Forks NPROCS processes that each map SIZE MiB, touch every page of it
+ * and unmap it again, LOOPS times.  Every new page goes through the per-cpu
+ * LRU batches, so with enough processes zone->lru_lock becomes the point
+ * of contention.  The test prints the page faults per second, and, on a
+ * kernel with CONFIG_LOCK_STAT, the lock_stat lines of the LRU lock,
+ * which are cleared before the run.
+ *
+ *	gcc -O2 -o lru-fault-test lru-fault-test.c
+ *	echo 14 > /proc/sys/vm/lru_batch; ./lru-fault-test -n 16 -s 256
+ *	echo 64 > /proc/sys/vm/lru_batch; ./lru-fault-test -n 16 -s 256
+ *
+ * With -f DIR the processes map a file in DIR instead of anonymous
+ * memory and read from it, so the page cache faults are measured.  The
+ * files are written before the timed run, and their page cache dropped
+ * with POSIX_FADV_DONTNEED before each loop; use a disk backed filesystem.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void print_file(const char *path, const char *prefix)
+{
+	char line[256];
+	FILE *f = fopen(path, "r");
+
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f))
+		printf("%s%s", prefix, line);
+	fclose(f);
+}
+
+static void clear_lock_stat(void)
+{
+	int fd = open("/proc/lock_stat", O_WRONLY);
+
+	if (fd < 0)
+		return;
+	if (write(fd, "0", 1) != 1)
+		perror("/proc/lock_stat");
+	close(fd);
+}
+
+static void print_lock_stat(void)
+{
+	char line[512];
+	int header = 0;
+	FILE *f = fopen("/proc/lock_stat", "r");
+
+	if (!f) {
+		printf("no /proc/lock_stat, lock statistics not available\n");
+		return;
+	}
+	/* Print the column names and the statistics of the LRU lock */
+	while (fgets(line, sizeof(line), f)) {
+		if (strstr(line, "class name") && !header++)
+			printf("%s", line);
+		else if (strstr(line, "lru_lock"))
+			printf("%s", line);
+	}
+	fclose(f);
+}
+
+static void fault_in(size_t size, int fd, int loops)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	volatile unsigned long sum = 0;
+	size_t off;
+	int loop;
+
+	for (loop = 0; loop < loops; loop++) {
+		char *map;
+
+		if (fd >= 0) {
+			posix_fadvise(fd, 0, size, POSIX_FADV_DONTNEED);
+			map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		} else {
+			map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		}
+		if (map == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		for (off = 0; off < size; off += page_size) {
+			if (fd >= 0)
+				sum += map[off];
+			else
+				map[off] = 1;
+		}
+		munmap(map, size);
+	}
+}
+
+static int create_file(const char *dir, int nr, size_t size)
+{
+	char path[4096], buf[4096];
+	size_t done;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/lru-fault-test-%d", dir, nr);
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	unlink(path);
+	memset(buf, nr, sizeof(buf));
+	for (done = 0; done < size; done += sizeof(buf))
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			perror("write");
+			exit(1);
+		}
+	fsync(fd);
+	return fd;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n procs] [-s MiB] [-l loops] [-f DIR]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t size = 256UL << 20;
+	const char *dir = NULL;
+	int *fds = NULL;
+	double start, elapsed;
+	unsigned long faults;
+	int opt, loops = 5, i, status, failed = 0;
+
+	while ((opt = getopt(argc, argv, "n:s:l:f:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nprocs = strtol(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'l':
+			loops = strtol(optarg, NULL, 0);
+			break;
+		case 'f':
+			dir = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || nprocs < 1 || !size || loops < 1)
+		usage(argv[0]);
+
+	if (dir) {
+		fds = calloc(nprocs, sizeof(*fds));
+		if (!fds)
+			return 1;
+		for (i = 0; i < nprocs; i++)
+			fds[i] = create_file(dir, i, size);
+	}
+
+	print_file("/proc/sys/vm/lru_batch", "lru_batch ");
+	clear_lock_stat();
+
+	start = now();
+	for (i = 0; i < nprocs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (!pid) {
+			fault_in(size, fds ? fds[i] : -1, loops);
+			exit(0);
+		}
+	}
+	while (wait(&status) > 0)
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed = 1;
+	elapsed = now() - start;
+
+	faults = nprocs * loops * (size / sysconf(_SC_PAGESIZE));
+	printf("%ld processes, %lu faults in %.3f s, %.0f faults/s\n",
+	       nprocs, faults, elapsed, faults / elapsed);
+	print_lock_stat();
+	return failed;
+}
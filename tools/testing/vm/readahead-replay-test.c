@@ -0,0 +1,225 @@
+/*
+ * readahead-replay-test.c - count the reads of a cold start, with and
+ * without readahead replay
+ *
+ * "Launches" the regular files in DIR: maps each of them and touches every
+ * STRIDE-th page, the way an app launch faults in parts of its APK, code
+ * and libraries.  Every launch starts with a cold page cache, after writing
+ * /proc/sys/vm/drop_caches.  The first launch runs without readahead
+ * replay, the second one records, and the ROUNDS launches after that
+ * replay the record.  For every launch it prints the time taken, the reads
+ * and sectors read from the block device DEV (from /sys/block/DEV/stat),
+ * and the change of the major fault and replay counters in /proc/vmstat.
+ *
+ *	gcc -O2 -o readahead-replay-test readahead-replay-test.c
+ *	./readahead-replay-test -b mmcblk0 -s 4 -r 3 /system/app
+ *
+ * It needs CONFIG_READAHEAD_REPLAY and root, and it drops the records
+ * that were there before.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define REPLAY	"/sys/kernel/mm/readahead_replay/"
+
+static const char *counters[] = {
+	"pgmajfault", "ra_replay", "ra_replay_pages",
+};
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+static long page_size;
+static size_t stride = 4;
+
+static void read_vmstat(unsigned long long *val)
+{
+	char name[64];
+	unsigned long long v;
+	unsigned int i;
+	FILE *f = fopen("/proc/vmstat", "r");
+
+	memset(val, 0, NR_COUNTERS * sizeof(*val));
+	if (!f)
+		return;
+	while (fscanf(f, "%63s %llu", name, &v) == 2)
+		for (i = 0; i < NR_COUNTERS; i++)
+			if (!strcmp(name, counters[i]))
+				val[i] = v;
+	fclose(f);
+}
+
+/* Reads completed and sectors read, the first and third field */
+static void read_blockstat(const char *dev, unsigned long long *reads,
+			   unsigned long long *sectors)
+{
+	char path[256];
+	unsigned long long merged;
+	FILE *f;
+
+	*reads = *sectors = 0;
+	snprintf(path, sizeof(path), "/sys/block/%s/stat", dev);
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	if (fscanf(f, "%llu %llu %llu", reads, &merged, sectors) != 3)
+		*reads = *sectors = 0;
+	fclose(f);
+}
+
+static void write_file(const char *path, const char *val)
+{
+	int fd = open(path, O_WRONLY);
+
+	if (fd < 0 || write(fd, val, strlen(val)) != (ssize_t)strlen(val)) {
+		perror(path);
+		exit(1);
+	}
+	close(fd);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static unsigned long touch_file(const char *path)
+{
+	volatile unsigned long sum = 0;
+	unsigned long pages = 0;
+	struct stat st;
+	size_t off;
+	char *map;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || !st.st_size) {
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		close(fd);
+		return 0;
+	}
+	for (off = 0; off < (size_t)st.st_size; off += stride * page_size) {
+		sum += map[off];
+		pages++;
+	}
+	munmap(map, st.st_size);
+	close(fd);
+	return pages;
+}
+
+static unsigned long launch(const char *dir)
+{
+	char path[4096];
+	struct dirent *de;
+	unsigned long pages = 0;
+	DIR *d = opendir(dir);
+
+	if (!d) {
+		perror(dir);
+		exit(1);
+	}
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		pages += touch_file(path);
+	}
+	closedir(d);
+	return pages;
+}
+
+static void cold_launch(const char *name, const char *dev, const char *dir)
+{
+	unsigned long long before[NR_COUNTERS], after[NR_COUNTERS];
+	unsigned long long reads, sectors, reads2, sectors2;
+	unsigned long pages;
+	double start, elapsed;
+	unsigned int k;
+
+	sync();
+	write_file("/proc/sys/vm/drop_caches", "3");
+
+	read_vmstat(before);
+	read_blockstat(dev, &reads, &sectors);
+	start = now();
+	pages = launch(dir);
+	elapsed = now() - start;
+	/* Let the replay of the files opened last finish */
+	sleep(1);
+	read_blockstat(dev, &reads2, &sectors2);
+	read_vmstat(after);
+
+	printf("%-8s %lu pages in %.3f s, %llu reads, %llu sectors", name,
+	       pages, elapsed, reads2 - reads, sectors2 - sectors);
+	for (k = 0; k < NR_COUNTERS; k++)
+		printf(" %s %llu", counters[k], after[k] - before[k]);
+	printf("\n");
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s -b DEV [-s stride] [-r rounds] DIR\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int rounds = 3, round;
+	const char *dev = NULL;
+	char name[32];
+	int opt;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	while ((opt = getopt(argc, argv, "b:s:r:")) != -1) {
+		switch (opt) {
+		case 'b':
+			dev = optarg;
+			break;
+		case 's':
+			stride = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || !dev || !stride)
+		usage(argv[0]);
+
+	write_file(REPLAY "enabled", "0");
+	write_file(REPLAY "record", "0");
+	write_file(REPLAY "clear", "1");
+	cold_launch("cold", dev, argv[optind]);
+
+	write_file(REPLAY "record", "1");
+	cold_launch("record", dev, argv[optind]);
+	write_file(REPLAY "record", "0");
+
+	write_file(REPLAY "enabled", "1");
+	for (round = 0; round < rounds; round++) {
+		snprintf(name, sizeof(name), "replay%u", round);
+		cold_launch(name, dev, argv[optind]);
+	}
+	write_file(REPLAY "enabled", "0");
+	return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * spf-test.c - fault in memory from threads while others mmap and munmap
+ *
+ * Starts NTHREADS threads that each map SIZE MiB and touch every page of
+ * it, then drop the pages again with MADV_DONTNEED and start over, and
+ * NMAPPERS threads that keep mapping, touching and unmapping a small
+ * area, the way a garbage collector or a binder buffer would.  The mapping
+ * threads take mmap_sem for writing, so without speculative page faults
+ * the faulting threads wait for them.  After SECONDS seconds it prints the
+ * pages per second touched by the faulting threads, each touch a page
+ * fault, the mmap/munmap rounds of the mapping threads, and the change of
+ * the page fault counters in /proc/vmstat.
+ *
+ *	gcc -O2 -o spf-test spf-test.c -lpthread
+ *	./spf-test -t 4 -m 2 -s 64 -d 10
+ *
+ * With -f DIR the faulting threads map a file in DIR privately instead of
+ * anonymous memory and read from it, so the page cache faults are measured.
+ * Run it with -m 0 for the faults without contention.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+static const char *counters[] = {
+	"pgfault", "spf_success", "spf_abort",
+};
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+static volatile int stop;
+static size_t size = 64UL << 20;
+static long page_size;
+static int fd = -1;
+
+struct worker {
+	pthread_t thread;
+	unsigned long count;
+};
+
+static void read_vmstat(unsigned long long *val)
+{
+	char name[64];
+	unsigned long long v;
+	unsigned int i;
+	FILE *f = fopen("/proc/vmstat", "r");
+
+	memset(val, 0, NR_COUNTERS * sizeof(*val));
+	if (!f)
+		return;
+	while (fscanf(f, "%63s %llu", name, &v) == 2)
+		for (i = 0; i < NR_COUNTERS; i++)
+			if (!strcmp(name, counters[i]))
+				val[i] = v;
+	fclose(f);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void *fault_thread(void *arg)
+{
+	struct worker *w = arg;
+	volatile unsigned long sum = 0;
+	size_t off;
+	char *map;
+
+	if (fd >= 0)
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+			   fd, 0);
+	else
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	while (!stop) {
+		for (off = 0; off < size && !stop; off += page_size) {
+			if (fd >= 0)
+				sum += map[off];
+			else
+				map[off] = 1;
+			w->count++;
+		}
+		madvise(map, size, MADV_DONTNEED);
+	}
+	munmap(map, size);
+	return NULL;
+}
+
+static void *map_thread(void *arg)
+{
+	struct worker *w = arg;
+	size_t len = 16 * page_size, off;
+	char *map;
+
+	while (!stop) {
+		map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (map == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		for (off = 0; off < len; off += page_size)
+			map[off] = 1;
+		munmap(map, len);
+		w->count++;
+	}
+	return NULL;
+}
+
+static int create_file(const char *dir)
+{
+	char path[4096], buf[4096];
+	size_t done;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/spf-test", dir);
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	unlink(path);
+	memset(buf, 1, sizeof(buf));
+	for (done = 0; done < size; done += sizeof(buf))
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			perror("write");
+			exit(1);
+		}
+	return fd;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-t threads] [-m mappers] [-s MiB] [-d seconds] [-f DIR]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long long before[NR_COUNTERS], after[NR_COUNTERS];
+	int nthreads = 4, nmappers = 2, seconds = 10, opt, i;
+	unsigned long faults = 0, maps = 0;
+	struct worker *workers;
+	double start, elapsed;
+	unsigned int k;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	while ((opt = getopt(argc, argv, "t:m:s:d:f:")) != -1) {
+		switch (opt) {
+		case 't':
+			nthreads = strtol(optarg, NULL, 0);
+			break;
+		case 'm':
+			nmappers = strtol(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'd':
+			seconds = strtol(optarg, NULL, 0);
+			break;
+		case 'f':
+			fd = create_file(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || nthreads < 1 || nmappers < 0 || !size ||
+	    seconds < 1)
+		usage(argv[0]);
+
+	workers = calloc(nthreads + nmappers, sizeof(*workers));
+	if (!workers)
+		return 1;
+
+	read_vmstat(before);
+	start = now();
+	for (i = 0; i < nthreads + nmappers; i++) {
+		if (pthread_create(&workers[i].thread, NULL,
+				   i < nthreads ? fault_thread : map_thread,
+				   &workers[i])) {
+			fprintf(stderr, "pthread_create failed\n");
+			return 1;
+		}
+	}
+	sleep(seconds);
+	stop = 1;
+	for (i = 0; i < nthreads + nmappers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (i < nthreads)
+			faults += workers[i].count;
+		else
+			maps += workers[i].count;
+	}
+	elapsed = now() - start;
+	read_vmstat(after);
+
+	printf("%d threads, %lu pages touched in %.3f s, %.0f pages/s\n",
+	       nthreads, faults, elapsed, faults / elapsed);
+	printf("%d mappers, %lu mmap/munmap rounds, %.0f rounds/s\n",
+	       nmappers, maps, maps / elapsed);
+	for (k = 0; k < NR_COUNTERS; k++)
+		printf("%s %llu\n", counters[k], after[k] - before[k]);
+	return 0;
+}
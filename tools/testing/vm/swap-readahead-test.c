@@ -0,0 +1,141 @@
+/*
+ * swap-readahead-test.c - time re-touching a heap that has been swapped out
+ *
+ * Fills a heap of SIZE MiB, then reads it back PASSES times, either in
+ * address order or in randomly placed runs of -r pages, and prints the
+ * time per pass along with the swap-in and swap readahead counters from
+ * /proc/vmstat.  To push the heap out to swap it is run in a memory cgroup
+ * smaller than the heap, e.g. to compare the readahead modes on zram:
+ *
+ *	gcc -O2 -o swap-readahead-test swap-readahead-test.c
+ *	modprobe zram num_devices=1
+ *	echo $((2 << 30)) > /sys/block/zram0/disksize
+ *	mkswap /dev/zram0 && swapon /dev/zram0
+ *	mount -t cgroup -o memory none /cgroup && mkdir /cgroup/test
+ *	echo 256M > /cgroup/test/memory.limit_in_bytes
+ *	echo $$ > /cgroup/test/tasks
+ *	for m in 0 1; do
+ *		echo $m > /proc/sys/vm/swap_vma_readahead
+ *		./swap-readahead-test -s 1024 -r 16 -p 3
+ *	done
+ *
+ * The pages are filled so that they compress about as well as typical
+ * anonymous memory, rather than being all zero.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+static const char *counters[] = {
+	"pswpin", "pgmajfault",
+	"swap_ra", "swap_ra_hit", "swap_vma_ra", "swap_vma_ra_hit",
+};
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+static void read_vmstat(unsigned long long *val)
+{
+	char name[64];
+	unsigned long long v;
+	unsigned int i;
+	FILE *f = fopen("/proc/vmstat", "r");
+
+	memset(val, 0, NR_COUNTERS * sizeof(*val));
+	if (!f)
+		return;
+	while (fscanf(f, "%63s %llu", name, &v) == 2)
+		for (i = 0; i < NR_COUNTERS; i++)
+			if (!strcmp(name, counters[i]))
+				val[i] = v;
+	fclose(f);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-s MiB] [-p passes] [-r run_pages]\n"
+		"  -r 0 reads the heap in address order (default)\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long size_mb = 1024, run = 0, nr_pages, page_size, i, j;
+	unsigned long long before[NR_COUNTERS], after[NR_COUNTERS];
+	unsigned int passes = 3, pass, k, seed = 1;
+	volatile unsigned long sum = 0;
+	unsigned char *heap;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:p:r:")) != -1) {
+		switch (opt) {
+		case 's':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			passes = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			run = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || !size_mb)
+		usage(argv[0]);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	nr_pages = (size_mb << 20) / page_size;
+	if (run > nr_pages)
+		run = nr_pages;
+	heap = mmap(NULL, nr_pages * page_size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (heap == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	/* A counter in each word of the first half, the rest stays zero */
+	for (i = 0; i < nr_pages; i++) {
+		unsigned long *p = (unsigned long *)(heap + i * page_size);
+
+		for (j = 0; j < page_size / sizeof(*p) / 2; j++)
+			p[j] = i + j;
+	}
+
+	for (pass = 0; pass < passes; pass++) {
+		double start;
+
+		read_vmstat(before);
+		start = now();
+		if (!run) {
+			for (i = 0; i < nr_pages; i++)
+				sum += heap[i * page_size];
+		} else {
+			for (i = 0; i < nr_pages; i += run) {
+				unsigned long first = rand_r(&seed) %
+						      (nr_pages - run + 1);
+
+				for (j = first; j < first + run; j++)
+					sum += heap[j * page_size];
+			}
+		}
+		printf("pass %u: %.3f s", pass, now() - start);
+		read_vmstat(after);
+		for (k = 0; k < NR_COUNTERS; k++)
+			printf(" %s %llu", counters[k], after[k] - before[k]);
+		printf("\n");
+	}
+	return 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * workingset-test.c - alternate between two file working sets
+ *
+ * Creates two files of SIZE MiB each in DIR and reads them back in
+ * phases: the first file PASSES times, then the second file PASSES times,
+ * and so on for ROUNDS rounds.  Each file should fit in memory on its own,
+ * but not both together.  For every pass it prints the time taken and the
+ * change of the page cache counters in /proc/vmstat.  Once the working set
+ * changes, the first passes over the new file read it from disk; with
+ * refault detection its pages are activated and later passes hit the page
+ * cache, while without it they can keep missing it for as long as the old
+ * working set holds on to the active list.
+ *
+ *	gcc -O2 -o workingset-test workingset-test.c
+ *	./workingset-test -s 600 -p 4 -r 2 /mnt/scratch
+ *
+ * With -m the files are mapped and touched page by page instead of read,
+ * which exercises the page fault path the way executing code would.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#define CHUNK	(1 << 20)
+
+static const char *counters[] = {
+	"pgpgin", "pgmajfault", "workingset_refault", "workingset_activate",
+};
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+static void read_vmstat(unsigned long long *val)
+{
+	char name[64];
+	unsigned long long v;
+	unsigned int i;
+	FILE *f = fopen("/proc/vmstat", "r");
+
+	memset(val, 0, NR_COUNTERS * sizeof(*val));
+	if (!f)
+		return;
+	while (fscanf(f, "%63s %llu", name, &v) == 2)
+		for (i = 0; i < NR_COUNTERS; i++)
+			if (!strcmp(name, counters[i]))
+				val[i] = v;
+	fclose(f);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void create_file(const char *path, size_t size, char *buf)
+{
+	size_t done;
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	for (done = 0; done < size; done += CHUNK) {
+		memset(buf, done / CHUNK, CHUNK);
+		if (write(fd, buf, CHUNK) != CHUNK) {
+			perror("write");
+			exit(1);
+		}
+	}
+	fsync(fd);
+	close(fd);
+}
+
+static void touch_file(const char *path, size_t size, char *buf, int use_mmap)
+{
+	volatile unsigned long sum = 0;
+	size_t off;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	if (use_mmap) {
+		long page_size = sysconf(_SC_PAGESIZE);
+		char *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+
+		if (map == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		for (off = 0; off < size; off += page_size)
+			sum += map[off];
+		munmap(map, size);
+	} else {
+		for (off = 0; off < size; off += CHUNK)
+			if (read(fd, buf, CHUNK) != CHUNK) {
+				perror("read");
+				exit(1);
+			}
+	}
+	close(fd);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-s MiB] [-p passes] [-r rounds] [-m] DIR\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long long before[NR_COUNTERS], after[NR_COUNTERS];
+	unsigned int passes = 4, rounds = 2, round, pass, set, k;
+	size_t size = 600UL << 20;
+	char path[2][4096], *buf;
+	int opt, use_mmap = 0;
+
+	while ((opt = getopt(argc, argv, "s:p:r:m")) != -1) {
+		switch (opt) {
+		case 's':
+			size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'p':
+			passes = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			use_mmap = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || !size)
+		usage(argv[0]);
+
+	buf = malloc(CHUNK);
+	if (!buf)
+		return 1;
+	for (set = 0; set < 2; set++) {
+		snprintf(path[set], sizeof(path[set]), "%s/workingset-%c",
+			 argv[optind], 'a' + set);
+		create_file(path[set], size, buf);
+	}
+
+	for (round = 0; round < rounds; round++) {
+		for (set = 0; set < 2; set++) {
+			for (pass = 0; pass < passes; pass++) {
+				double start;
+
+				read_vmstat(before);
+				start = now();
+				touch_file(path[set], size, buf, use_mmap);
+				printf("round %u set %c pass %u: %.3f s", round,
+				       'a' + set, pass, now() - start);
+				read_vmstat(after);
+				for (k = 0; k < NR_COUNTERS; k++)
+					printf(" %s %llu", counters[k],
+					       after[k] - before[k]);
+				printf("\n");
+			}
+		}
+	}
+
+	unlink(path[0]);
+	unlink(path[1]);
+	return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * zcache-launch-test.c - time reloading evicted files, as an app launch does
+ *
+ * Maps every regular file in DIR and touches each of its pages, the way
+ * launching an app faults in its code and libraries.  Then it allocates
+ * and touches PRESSURE MiB of anonymous memory, which should push the
+ * files out of the page cache, frees it again and "launches" once more,
+ * for ROUNDS rounds.  For every launch it prints the time taken and the
+ * change of the page fault and page-in counters in /proc/vmstat and of
+ * the cleancache counters in /sys/kernel/mm/cleancache.  With zcache the
+ * evicted pages are put into the compressed cache, and the launches after
+ * the first should find them there instead of reading them from storage.
+ *
+ *	gcc -O2 -o zcache-launch-test zcache-launch-test.c
+ *	./zcache-launch-test -p 768 -r 3 /system/app
+ *
+ * With -d, /proc/sys/vm/drop_caches is written instead of applying memory
+ * pressure, which also evicts the clean page cache into cleancache.  The
+ * zcache statistics are printed after the last round.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define CLEANCACHE	"/sys/kernel/mm/cleancache/"
+#define ZCACHE		"/sys/kernel/mm/zcache/"
+
+static const char *counters[] = {
+	"pgmajfault", "pgpgin",
+};
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+static const char *cc_counters[] = {
+	"succ_gets", "failed_gets", "puts",
+};
+#define NR_CC_COUNTERS	(sizeof(cc_counters) / sizeof(cc_counters[0]))
+
+static const char *zcache_stats[] = {
+	"eph_zpages", "eph_zbytes", "eph_pool_bytes", "eph_cumul_zpages",
+	"evicted_eph_zpages", "eph_pool_limit_hit", "compress_poor",
+};
+#define NR_ZCACHE_STATS	(sizeof(zcache_stats) / sizeof(zcache_stats[0]))
+
+static void read_vmstat(unsigned long long *val)
+{
+	char name[64];
+	unsigned long long v;
+	unsigned int i;
+	FILE *f = fopen("/proc/vmstat", "r");
+
+	memset(val, 0, NR_COUNTERS * sizeof(*val));
+	if (!f)
+		return;
+	while (fscanf(f, "%63s %llu", name, &v) == 2)
+		for (i = 0; i < NR_COUNTERS; i++)
+			if (!strcmp(name, counters[i]))
+				val[i] = v;
+	fclose(f);
+}
+
+static unsigned long long read_sysfs(const char *dir, const char *name)
+{
+	char path[256];
+	unsigned long long v = 0;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s%s", dir, name);
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+	if (fscanf(f, "%llu", &v) != 1)
+		v = 0;
+	fclose(f);
+	return v;
+}
+
+static void read_cleancache(unsigned long long *val)
+{
+	unsigned int i;
+
+	for (i = 0; i < NR_CC_COUNTERS; i++)
+		val[i] = read_sysfs(CLEANCACHE, cc_counters[i]);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static unsigned long touch_file(const char *path)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	volatile unsigned long sum = 0;
+	struct stat st;
+	size_t off;
+	char *map;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || !st.st_size) {
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+	for (off = 0; off < (size_t)st.st_size; off += page_size)
+		sum += map[off];
+	munmap(map, st.st_size);
+	return (st.st_size + page_size - 1) / page_size;
+}
+
+static unsigned long launch(const char *dir)
+{
+	char path[4096];
+	struct dirent *de;
+	unsigned long pages = 0;
+	DIR *d = opendir(dir);
+
+	if (!d) {
+		perror(dir);
+		exit(1);
+	}
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		pages += touch_file(path);
+	}
+	closedir(d);
+	return pages;
+}
+
+static void evict(size_t pressure, int drop)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	size_t off;
+	char *map;
+	int fd;
+
+	if (drop) {
+		sync();
+		fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+		if (fd < 0 || write(fd, "1", 1) != 1) {
+			perror("/proc/sys/vm/drop_caches");
+			exit(1);
+		}
+		close(fd);
+		return;
+	}
+	map = mmap(NULL, pressure, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	for (off = 0; off < pressure; off += page_size)
+		map[off] = 1;
+	munmap(map, pressure);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-p MiB] [-r rounds] [-d] DIR\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long long before[NR_COUNTERS], after[NR_COUNTERS];
+	unsigned long long cc_before[NR_CC_COUNTERS], cc_after[NR_CC_COUNTERS];
+	unsigned int rounds = 3, round, k;
+	size_t pressure = 512UL << 20;
+	unsigned long pages;
+	int opt, drop = 0;
+
+	while ((opt = getopt(argc, argv, "p:r:d")) != -1) {
+		switch (opt) {
+		case 'p':
+			pressure = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			drop = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || (!drop && !pressure))
+		usage(argv[0]);
+
+	for (round = 0; round <= rounds; round++) {
+		double start;
+
+		if (round)
+			evict(pressure, drop);
+		read_vmstat(before);
+		read_cleancache(cc_before);
+		start = now();
+		pages = launch(argv[optind]);
+		printf("launch %u: %lu pages in %.3f s", round, pages,
+		       now() - start);
+		read_vmstat(after);
+		read_cleancache(cc_after);
+		for (k = 0; k < NR_COUNTERS; k++)
+			printf(" %s %llu", counters[k], after[k] - before[k]);
+		for (k = 0; k < NR_CC_COUNTERS; k++)
+			printf(" %s %llu", cc_counters[k],
+			       cc_after[k] - cc_before[k]);
+		printf("\n");
+	}
+
+	if (access(ZCACHE, F_OK)) {
+		printf("no %s, zcache statistics not available\n", ZCACHE);
+		return 0;
+	}
+	for (k = 0; k < NR_ZCACHE_STATS; k++)
+		printf("zcache %s %llu\n", zcache_stats[k],
+		       read_sysfs(ZCACHE, zcache_stats[k]));
+	return 0;
+}